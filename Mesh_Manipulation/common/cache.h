@@ -0,0 +1,107 @@
+#ifndef CACHE_H
+#define CACHE_H
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+#include <glm/glm.hpp>
+#include "util.h"
+
+/**
+* Version of the loaders' output and of the cache layout. Bump it whenever a
+* loader, indexVBO() or optimizeMesh() produces different arrays, or the way
+* they are stored changes, so caches written by older builds are ignored.
+*/
+const uint32_t MESH_CACHE_VERSION = 4;
+
+/**
+* The arrays of an indexed mesh to store with MeshCache::save(); uvs and
+* normals are null if the mesh has none.
+*/
+struct MeshView {
+    const glm::vec3* vertices;
+    const glm::vec2* uvs;
+    const glm::vec3* normals;
+    const unsigned int* indices;
+    uint32_t vertexCount;
+    uint32_t indexCount;
+    int material;    // index in the cached materials, -1 for none
+};
+
+/**
+* An indexed mesh read back from a cache, stored the way it is drawn so it
+* can be handed to glBufferData() straight from the mapped file: vertexData
+* interleaves the position, normal and uv floats of each vertex, leaving out
+* the attributes the mesh has not, as uploadVertexArrays() does with
+* PositionAttribute, NormalAttribute and UVAttribute; indexData holds the
+* indices in the narrowest type narrowIndexType() picks, 1, 2 or 4 bytes.
+*/
+struct CachedMesh {
+    const void* vertexData;
+    const void* indexData;
+    uint32_t vertexCount;
+    uint32_t indexCount;
+    uint32_t vertexStride;   // bytes per vertex
+    uint32_t indexSize;      // bytes per index
+    bool hasUVs;
+    bool hasNormals;
+    int material;            // index in the cached materials, -1 for none
+
+    /* Copy the mesh into separate arrays, e.g. to simplify it */
+    void unpack(std::vector<glm::vec3>& vertices, std::vector<glm::vec2>& uvs,
+                std::vector<glm::vec3>& normals, std::vector<unsigned int>& indices) const;
+};
+
+/**
+* The .mtl fields used by ogl::Model, textures are kept by name.
+*/
+struct CachedMaterial {
+    float ambient[3];
+    float diffuse[3];
+    float specular[3];
+    float shininess;
+    std::string ambientTexture;
+    std::string diffuseTexture;
+    std::string specularTexture;
+    std::string highlightTexture;
+};
+
+/**
+* Persistent binary cache of the indexed meshes loaded from a source file.
+* The cache lives next to the source as <source>.<kind>.meshcache and is
+* keyed by the hash of the source contents, of the .mtl files an .obj source
+* names in mtllib, of the MeshOptimizer settings and of MESH_CACHE_VERSION;
+* `kind` keeps apart loaders that split the same file differently. A valid cache is
+* memory mapped and its meshes can be uploaded without parsing, indexing or
+* interleaving.
+*/
+class MeshCache {
+public:
+    MeshCache(const std::string& source, const std::string& kind);
+    MeshCache(const MeshCache&) = delete;
+    MeshCache& operator=(const MeshCache&) = delete;
+
+    /* True if the cache matches the current source and loader version */
+    bool valid() const { return file != nullptr; }
+    const std::vector<CachedMesh>& meshes() const { return cachedMeshes; }
+    const std::vector<CachedMaterial>& materials() const { return cachedMaterials; }
+
+    /* (Re)write the cache file. Failures are only logged */
+    void save(const std::vector<MeshView>& meshes,
+              const std::vector<CachedMaterial>& materials = {});
+
+    /* Set to false to neither read nor write caches */
+    static bool enabled;
+
+private:
+    std::string path;
+    uint64_t hash;
+    std::unique_ptr<MappedFile> file;
+    std::vector<CachedMesh> cachedMeshes;
+    std::vector<CachedMaterial> cachedMaterials;
+
+    bool read();
+};
+
+#endif
@@ -5,47 +5,81 @@
 #include <vector>
 #include <string>
 #include <map>
+#include <memory>
 #include <glm/glm.hpp>
+#include "vertex.h"
+#include "simplify.h"
+#include "meshlet.h"
+
+struct CachedMesh;
+class MeshCache;
+class AssetLoader;
+class GeometryRegistry;
+class TextureStreamer;
+struct SharedGeometry;
+struct ArenaBlock;
+
+/**
+* Arrays of a loaded mesh, returned by value by the loaders and moved into
+* Drawable or ogl::Mesh. Without indices they are a triangle soup of three
+* vertices per triangle, with indices they are already indexed. uvs and
+* normals are empty if the file has none. joints and weights are the skin of
+* indexed vertices, only read from .glb files.
+*/
+struct MeshData {
+    std::vector<glm::vec3> vertices;
+    std::vector<glm::vec2> uvs;
+    std::vector<glm::vec3> normals;
+    std::vector<unsigned int> indices;
+    std::vector<glm::u16vec4> joints;
+    std::vector<glm::vec4> weights;
+};
 
-static std::vector<unsigned int> VEC_UINT_DEFAUTL_VALUE{};
-static std::vector<glm::vec3> VEC_VEC3_DEFAUTL_VALUE{};
-static std::vector<glm::vec2> VEC_VEC2_DEFAUTL_VALUE{};
-static std::map<std::string, GLuint> MAP_STRING_GLUINT_DEFAULT_VALUE{};
 /**
 * A very simple .obj loader. Use only for teaching purposes. Use loadOBJWithTiny()
 * instead.
 */
-void loadOBJ(
-    const std::string& path,
-    std::vector<glm::vec3>& vertices,
-    std::vector<glm::vec2>& uvs,
-    std::vector<glm::vec3>& normals,
-    std::vector<unsigned int>& indices = VEC_UINT_DEFAUTL_VALUE
-);
+MeshData loadOBJ(const std::string& path);
 
 /**
-* A .vtp loader.
+* A .vtp loader. The file is memory mapped and streamed once: only the
+* normals, points, connectivity and offsets DataArrays are parsed, straight
+* into their arrays, and polygons are triangulated as fans.
 */
-void loadVTP(
-    const std::string& path,
-    std::vector<glm::vec3>& vertices,
-    std::vector<glm::vec2>& uvs,
-    std::vector<glm::vec3>& normals,
-    std::vector<unsigned int>& indices = VEC_UINT_DEFAUTL_VALUE
-);
+MeshData loadVTP(const std::string& path);
 
 /**
 * An .obj loader that uses tinyobjloader library. Any mesh (quad) is triangulated.
 *
 * https://github.com/syoyo/tinyobjloader
 */
-void loadOBJWithTiny(
-    const std::string& path,
-    std::vector<glm::vec3>& verticies,
-    std::vector<glm::vec2>& uvs,
-    std::vector<glm::vec3>& normals,
-    std::vector<unsigned int>& indices = VEC_UINT_DEFAUTL_VALUE
-);
+MeshData loadOBJWithTiny(const std::string& path);
+
+/**
+* A fast .obj loader. The file is memory mapped and its numbers are parsed in
+* place. Faces may use v, v/vt, v//vn and v/vt/vn corners with absolute or
+* negative (relative) indices; polygons are triangulated as fans. The output
+* matches loadOBJWithTiny().
+*/
+MeshData loadOBJMapped(const std::string& path);
+
+/**
+* Multi-threaded variant of loadOBJMapped(). The file is split at line
+* boundaries and the chunks are parsed on up to `threads` threads (0 uses
+* every hardware thread); small files are parsed on the calling thread.
+*/
+MeshData loadOBJParallel(const std::string& path, unsigned int threads = 0);
+
+/**
+* Index-preserving variants of loadOBJParallel() and loadVTP(). The indexed
+* arrays are built straight from the file instead of expanding every
+* triangle corner: OBJ vertices are the distinct (v, vt, vn) tuples in order
+* of first use, VTP vertices are the points of the file and the indices are
+* their point ids.
+*/
+MeshData loadOBJIndexed(const std::string& path, unsigned int threads = 0);
+
+MeshData loadVTPIndexed(const std::string& path);
 
 /**
 * Create VBO indexing.
@@ -61,31 +95,191 @@ void indexVBO(
     std::vector<glm::vec3> & out_normals
 );
 
+/**
+* Options of weldVertices(). An attribute whose epsilon is 0 must match
+* exactly, otherwise it is snapped to a grid of that spacing and vertices in
+* the same cell are merged (near vertices across a cell border are not).
+*/
+struct WeldOptions {
+    float positionEpsilon;
+    float uvEpsilon;
+    float normalEpsilon;
+    unsigned int threads;    // 0 uses every hardware thread
+};
+
+struct WeldStats {
+    size_t inputVertices;
+    size_t outputVertices;
+    /* Fraction of the input vertices that were merged away */
+    float reduction() const {
+        return inputVertices ? 1.0f - float(outputVertices) / inputVertices : 0.0f;
+    }
+};
+
+/**
+* Sort based alternative to indexVBO() for very large triangle soups: every
+* vertex is hashed to a 64-bit key, the (key, index) pairs are radix sorted
+* on several threads and vertices are welded from the runs of equal keys. Each
+* merged vertex keeps the values of its first occurrence. With all epsilons
+* at 0 the output is the same as indexVBO().
+*/
+WeldStats weldVertices(
+    const std::vector<glm::vec3>& in_vertices,
+    const std::vector<glm::vec2>& in_uvs,
+    const std::vector<glm::vec3>& in_normals,
+    std::vector<unsigned int>& out_indices,
+    std::vector<glm::vec3>& out_vertices,
+    std::vector<glm::vec2>& out_uvs,
+    std::vector<glm::vec3>& out_normals,
+    const WeldOptions& options = WeldOptions{0.0f, 0.0f, 0.0f, 0}
+);
+
 class Drawable {
 public:
+    /* Loads the file with loadOBJIndexed() or loadVTPIndexed(), reorders it
+    with optimizeMesh() and caches it with MeshCache. A .glb is loaded with
+    loadGLB() and used as it is, without reordering or caching. Only the
+    indexed arrays are filled, vertices, uvs and normals stay empty. A valid
+    cache is uploaded straight from the mapped file and the indexed arrays
+    stay empty too until fillCPU() */
     Drawable(std::string path);
 
-    Drawable(
-        const std::vector<glm::vec3>& vertices,
-        const std::vector<glm::vec2>& uvs = VEC_VEC2_DEFAUTL_VALUE,
-        const std::vector<glm::vec3>& normals = VEC_VEC3_DEFAUTL_VALUE);
+    /* Takes over the arrays of mesh. A triangle soup is indexed with
+    indexVBO() and reordered with optimizeMesh(), indexed arrays are used
+    as they are */
+    Drawable(MeshData&& mesh);
 
     ~Drawable();
 
     void bind();
 
-    /* Bind VAO before calling draw */
-    void draw(int mode = GL_TRIANGLES);
+    /* Bind VAO before calling draw. lod indexes lods, 0 is the full mesh */
+    void draw(int mode = GL_TRIANGLES, unsigned int lod = 0);
+
+    /* Simplify the mesh into LODs with the given fractions of its triangles,
+    see buildLODChain(). They share the vertex buffer and are stored after
+    the full mesh in elementVBO */
+    void generateLODs(const std::vector<float>& ratios = {0.5f, 0.25f, 0.1f});
+
+    /* The LOD to draw with these matrices, see selectLOD(). modelView must
+    not include dequantization */
+    unsigned int selectLOD(const glm::mat4& modelView, const glm::mat4& projection) const;
+
+    /* Split the mesh into meshlets with buildMeshlets(), which reorders its
+    triangles. Call it before generateLODs(), only the full mesh is split */
+    void buildMeshlets(unsigned int maxVertices = 64, unsigned int maxTriangles = 124);
+
+    /* Free the CPU copies of the mesh once it is uploaded and no longer
+    changed. It can still be drawn, also at its LODs and by meshlets */
+    void releaseCPU();
+
+    /* Fill the indexed arrays of a drawable uploaded from its cache and
+    unmap the cache. generateLODs(), buildMeshlets(), quantize() and
+    GeometryRegistry call it, anything else reading the arrays must */
+    void fillCPU();
+
+    /* Copy the buffers into the GeometryArena and delete them. VAO becomes
+    the arena's for the vertex format, shared with the other drawables in
+    it. Call it once the buffers are final: geometry in the arena can not be
+    changed. Does nothing if the drawable is already there */
+    void moveToArena();
+
+    /* Bind VAO before calling. Draws the meshlets left by cullMeshlets()
+    with one glMultiDrawElements(), or everything if there are none.
+    modelView must not include dequantization */
+    MeshletStats drawMeshlets(const glm::mat4& modelView, const glm::mat4& projection,
+                              bool backfaces = true, int mode = GL_TRIANGLES);
+
+    /* Replace the vertex buffer with one in another VertexFormat, e.g. to add
+    attributes. The arrays follow the attributes of the format */
+    template<typename Format, typename... Arrays>
+    void setVertexFormat(const Arrays&... arrays) {
+        bindVertexBuffer();
+        Format::upload(arrays...);
+        vertexStride = Format::stride;
+        vertexSetup = &Format::setup;
+    }
+
+    /* Replace the vertex buffer with the compact encoding of vertex.h:
+    quantized positions, GL_INT_2_10_10_10_REV normals and half float uvs,
+    followed by the Extra attributes given as arrays. The model matrix must
+    be multiplied by dequantization. Logs the bytes saved */
+    template<typename... Extra>
+    void quantize(const std::vector<typename Extra::type>&... extra) {
+        fillCPU();
+        size_t stride = floatStride() + VertexFormat<Extra...>::stride;
+        bindVertexBuffer();
+        vertexStride = uploadVertexArrays<QuantizedPositionAttribute, PackedNormalAttribute,
+                                          HalfUVAttribute, Extra...>(
+            quantizePositions(indexedVertices, dequantization),
+            packNormals(indexedNormals), packUVs(indexedUVS), extra...);
+        vertexSetup = vertexArraysSetup<QuantizedPositionAttribute, PackedNormalAttribute,
+                                        HalfUVAttribute, Extra...>(
+            !indexedNormals.empty(), !indexedUVS.empty());
+        logQuantization(stride);
+    }
 
 public:
     std::vector<glm::vec3> vertices, normals, indexedVertices, indexedNormals;
     std::vector<glm::vec2> uvs, indexedUVS;
     std::vector<unsigned int> indices;
+    /* Skin of the indexed vertices, empty unless loaded from a .glb. They are
+    uploaded as JointAttribute and WeightAttribute, quantize() leaves them
+    out unless given as extra attributes */
+    std::vector<glm::u16vec4> joints;
+    std::vector<glm::vec4> weights;
 
-    GLuint VAO, verticesVBO, uvsVBO, normalsVBO, elementVBO;
+    /* The indexed arrays are interleaved in vertexVBO, in the format that
+    vertexSetup points VAO at */
+    GLuint VAO, vertexVBO, elementVBO;
+    GLenum indexType;
+    size_t vertexStride;
+    VertexSetupFunction vertexSetup;
+    /* Identity unless quantize() was called */
+    glm::mat4 dequantization;
+    /* Filled by generateLODs(), with the bounding sphere used to select them */
+    std::vector<MeshLOD> lods;
+    glm::vec4 bounds;
+    /* Filled by buildMeshlets(), with the ranges of the last drawMeshlets() */
+    std::vector<Meshlet> meshlets;
+    MeshletDrawList meshletDraws;
+    /* File the drawable was loaded from, if any */
+    std::string path;
+    /* Set while the drawable was uploaded from the mapped cache and the
+    indexed arrays are not filled */
+    std::shared_ptr<const MeshCache> cache;
+    const CachedMesh* cached;
+    /* Set once registered with GeometryRegistry, which then owns VAO and the
+    buffers. Shared geometry can not be changed */
+    std::shared_ptr<SharedGeometry> geometry;
+    /* Set by moveToArena(), the buffers are then 0 and the vertices and
+    indices are drawn from these blocks */
+    ArenaBlock* vertexBlock;
+    ArenaBlock* indexBlock;
 
 private:
-    void createContext();
+    friend class AssetLoader;
+    friend class GeometryRegistry;
+    /* Empty drawable, filled later by AssetLoader */
+    Drawable();
+
+    /* The CPU side of Drawable(path): maps the cache or fills the indexed
+    arrays from the file, without any GL calls */
+    void loadFile();
+    void generateBuffers();
+    void createBuffers();
+    /* Upload the indexed arrays and the skin, or the cached vertices, into the
+    bound GL_ARRAY_BUFFER */
+    void uploadIndexedArrays();
+    /* Upload the indices, or the cached ones, into the bound
+    GL_ELEMENT_ARRAY_BUFFER and set indexType */
+    void uploadIndexArray();
+    void bindVertexBuffer();
+    /* Throws if the geometry is shared or in the arena */
+    void checkChangeable() const;
+    /* Stride of the indexed arrays as floats, without extra attributes */
+    size_t floatStride() const;
+    void logQuantization(size_t floatStride);
 };
 
 /*****************************************************************************/
@@ -104,38 +298,153 @@ namespace ogl {
 
     class Mesh {
     public:
-        Mesh(const std::vector<glm::vec3>& vertices,
-             const std::vector<glm::vec2>& uvs,
-             const std::vector<glm::vec3>& normals,
-             const Material& mtl);
+        /* See Drawable(MeshData&&). Without buffers VAO and the buffers stay
+        0 and only the arrays are filled, e.g. for Model to pack */
+        Mesh(MeshData&& mesh, const Material& mtl, bool buffers = true);
+        /* Mesh from an entry of cache. With buffers it is uploaded straight
+        from the mapped file, which the mesh keeps until fillCPU(), without
+        only the arrays are filled */
+        Mesh(std::shared_ptr<const MeshCache> cache, const CachedMesh& mesh,
+             const Material& mtl, bool buffers = true);
         Mesh(const Mesh&) = delete;
         Mesh(Mesh&& other);
         ~Mesh();
         void bind();
-        void draw(int mode = GL_TRIANGLES);
+        void draw(int mode = GL_TRIANGLES, unsigned int lod = 0);
+        /* See Drawable::generateLODs() and Drawable::selectLOD() */
+        void generateLODs(const std::vector<float>& ratios = {0.5f, 0.25f, 0.1f});
+        unsigned int selectLOD(const glm::mat4& modelView, const glm::mat4& projection) const;
+        /* See Drawable::buildMeshlets() and Drawable::drawMeshlets() */
+        void buildMeshlets(unsigned int maxVertices = 64, unsigned int maxTriangles = 124);
+        MeshletStats drawMeshlets(const glm::mat4& modelView, const glm::mat4& projection,
+                                  bool backfaces = true, int mode = GL_TRIANGLES);
+        /* See Drawable::moveToArena(). LODs and meshlets must be built first */
+        void moveToArena();
+        /* See Drawable::fillCPU() */
+        void fillCPU();
     public:
         std::vector<glm::vec3> vertices, normals, indexedVertices, indexedNormals;
         std::vector<glm::vec2> uvs, indexedUVS;
         std::vector<unsigned int> indices;
+        /* See Drawable::joints */
+        std::vector<glm::u16vec4> joints;
+        std::vector<glm::vec4> weights;
         Material mtl;
-        GLuint VAO, verticesVBO, uvsVBO, normalsVBO, elementVBO;
+        GLuint VAO, vertexVBO, elementVBO;
+        GLenum indexType;
+        size_t vertexStride;
+        VertexSetupFunction vertexSetup;
+        /* See Drawable::vertexBlock */
+        ArenaBlock* vertexBlock;
+        ArenaBlock* indexBlock;
+        std::vector<MeshLOD> lods;
+        glm::vec4 bounds;
+        std::vector<Meshlet> meshlets;
+        MeshletDrawList meshletDraws;
+        /* See Drawable::cache */
+        std::shared_ptr<const MeshCache> cache;
+        const CachedMesh* cached;
     private:
-        void createContext();
+        void createBuffers();
+    };
+
+    /**
+    * Work of one Model::draw(). State changes are the VAO binds and the
+    * material uploads.
+    */
+    struct ModelDrawStats {
+        size_t drawCalls;
+        size_t vertexArrayBinds;
+        size_t materialUploads;
     };
 
+    /**
+    * Meshes of a Model with the same material and textures, drawn with one
+    * glMultiDrawElementsBaseVertex().
+    */
+    struct MeshBatch {
+        Material mtl;
+        std::vector<size_t> meshes;
+        /* The VAO the meshes are drawn with and the type of their indices */
+        GLuint VAO;
+        GLenum indexType;
+        /* Arguments of the draw, filled with the LODs being drawn */
+        std::vector<GLsizei> counts;
+        std::vector<const void*> offsets;
+        std::vector<GLint> baseVertices;
+    };
+
+    /**
+    * A multi-material model. Its meshes are packed into one block of
+    * vertices and one of indices in the GeometryArena, drawn with the VAO of
+    * their format, and grouped into batches by material when loaded, so
+    * drawing it takes one VAO bind and one draw and material upload per
+    * batch. An indexed .glb is not packed: its buffer views are uploaded as
+    * they are and drawn with a VAO per layout of their attributes.
+    */
     class Model {
     public:
         using MTLUploadFunction = void(const Material&);
-        Model(std::string path, MTLUploadFunction* uploader = nullptr);
+        /* threads != 1 parses the .obj with loadOBJParallel() instead of
+        tinyobjloader. Loaded models are cached by MeshCache. A .glb gets a
+        mesh per primitive, with its material converted from the metallic
+        roughness factors and its embedded base color texture, and is not
+        cached; its arrays are only read for generateLODs() */
+        Model(std::string path, MTLUploadFunction* uploader = nullptr,
+              unsigned int threads = 1);
         ~Model();
-        void draw();
-    private:
+        ModelDrawStats draw();
+        /* Draw every mesh at the LOD selected for these matrices */
+        ModelDrawStats draw(const glm::mat4& modelView, const glm::mat4& projection);
+        /* See Drawable::generateLODs() */
+        void generateLODs(const std::vector<float>& ratios = {0.5f, 0.25f, 0.1f});
+        /* When set, the texture files of models loaded from then on are
+        added to this streamer instead of loaded whole, and drawing with
+        matrices requests the levels their meshes need. Images embedded in
+        a .glb are not streamed */
+        static TextureStreamer* textureStreamer;
+    public:
+        /* Only the arrays, LODs and materials, they have no buffers. The
+        meshes of a .glb drawn from its buffer views only have materials */
         std::vector<Mesh> meshes;
+        std::vector<MeshBatch> batches;
+        GLuint VAO;
+        ArenaBlock* vertexBlock;
+        ArenaBlock* indexBlock;
+        GLenum indexType;
+    private:
         std::map<std::string, GLuint> textures;
         MTLUploadFunction* uploadFunction;
+        TextureStreamer* streamer;
+        /* Texture coordinates per unit of every mesh, see uvDensity() */
+        std::vector<float> meshUVDensity;
+        /* First vertex of every mesh in vertexBlock, and its first index in
+        indexBlock, followed by its LODs */
+        std::vector<GLint> meshBaseVertex;
+        std::vector<size_t> meshFirst;
+        /* Set while a .glb is drawn from its buffer views, see loadGLB(): the
+        buffer holding them, a VAO per layout of their attributes, and the
+        file to read the arrays from when they are needed */
+        GLuint glbBuffer;
+        std::vector<GLuint> glbVertexArrays;
+        std::string glbPath;
     private:
-        void loadOBJWithTiny(const std::string& filename);
-        void loadTexture(const std::string& filename);
+        void pack();
+        void packIndices(const std::vector<const std::vector<unsigned int>*>& chains);
+        void selectLOD(MeshBatch& batch, size_t i, unsigned int lod);
+        ModelDrawStats drawBatches();
+        void requestTextures(const glm::mat4& modelView, const glm::mat4& projection);
+        void loadCache(const std::shared_ptr<const MeshCache>& cache);
+        void loadOBJWithTiny(const std::string& filename, MeshCache& cache);
+        void loadOBJParallel(const std::string& filename, unsigned int threads,
+                             MeshCache& cache);
+        void loadGLB(const std::string& filename);
+        /* Read the arrays of a .glb drawn from its buffer views into its
+        meshes and pack them like those of an .obj */
+        void unpackGLB();
+        /* Load the textures not loaded yet on every hardware thread with
+        loadCompressedTextures() */
+        void loadTextures(const std::vector<std::string>& filenames);
     };
 }
 
@@ -42,8 +42,7 @@ Camera* camera;
 GLuint shaderProgram;
 GLuint MVPLocation, MLocation, planeLocation, detachmentCoeffLocation;
 GLuint modelVAO, modelVerticiesVBO, planeVAO, planeVerticiesVBO;
-std::vector<vec3> modelVertices, modelNormals;
-std::vector<vec2> modelUVs;
+MeshData model;
 
 float planeY = 0.0f;
 float planeAngle = 0.0f;
@@ -61,13 +60,13 @@ void createContext() {
     detachmentCoeffLocation = glGetUniformLocation(shaderProgram, "detachmentDisplacement");
 
     // Load heart model
-    loadOBJWithTiny("heart.obj", modelVertices, modelUVs, modelNormals);
+    model = loadOBJWithTiny("heart.obj");
     glGenVertexArrays(1, &modelVAO);
     glBindVertexArray(modelVAO);
     glGenBuffers(1, &modelVerticiesVBO);
     glBindBuffer(GL_ARRAY_BUFFER, modelVerticiesVBO);
-    glBufferData(GL_ARRAY_BUFFER, modelVertices.size() * sizeof(glm::vec3),
-                 &modelVertices[0], GL_STATIC_DRAW);
+    glBufferData(GL_ARRAY_BUFFER, model.vertices.size() * sizeof(glm::vec3),
+                 &model.vertices[0], GL_STATIC_DRAW);
     glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, NULL);
     glEnableVertexAttribArray(0);
 
@@ -138,7 +137,7 @@ void mainLoop() {
         mat4 modelMVP = projectionMatrix * viewMatrix * modelModelMatrix;
         glUniformMatrix4fv(MVPLocation, 1, GL_FALSE, &modelMVP[0][0]);
         glUniformMatrix4fv(MLocation, 1, GL_FALSE, &modelModelMatrix[0][0]);
-        glDrawArrays(GL_TRIANGLES, 0, modelVertices.size());
+        glDrawArrays(GL_TRIANGLES, 0, model.vertices.size());
 
         glfwSwapBuffers(window);
         glfwPollEvents();
@@ -0,0 +1,121 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <GL/glew.h>
+#include <map>
+#include <set>
+#include <vector>
+#include "vertex.h"
+
+class BufferArena;
+
+/**
+* A range of a BufferArena, owned by the arena. Its offset changes when the
+* arena is defragmented or grows, so keep the pointer and read the offset
+* when drawing.
+*/
+struct ArenaBlock {
+    BufferArena* arena;
+    size_t offset;
+    size_t size;
+    size_t alignment;
+
+    /* For vertices allocated with their stride as alignment, the base vertex
+    to draw them with */
+    GLint baseVertex() const { return static_cast<GLint>(offset / alignment); }
+};
+
+struct ArenaStats {
+    size_t capacity;        // bytes of the GL buffer
+    size_t used;            // bytes of the live blocks
+    size_t blocks;
+    size_t freeRanges;      // holes between the blocks, and the space after them
+    size_t largestFree;
+    size_t relocations;     // defragmentations and growths so far
+};
+
+/**
+* First-fit sub-allocator over one GL buffer with immutable storage, or a
+* fixed-size glBufferData() without GL_ARB_buffer_storage. Free ranges are
+* kept sorted by offset and merged with their neighbours. When a block does
+* not fit, or holes take more than defragmentThreshold of the buffer after a
+* free(), the live blocks are copied packed into a new buffer, twice as
+* large if needed, so buffer changes then.
+*/
+class BufferArena {
+public:
+    BufferArena(size_t capacity);
+    ~BufferArena();
+    BufferArena(const BufferArena&) = delete;
+
+    ArenaBlock* allocate(size_t size, size_t alignment);
+    void free(ArenaBlock* block);
+    /* Fill a block from memory or from the start of another buffer */
+    void upload(const ArenaBlock* block, const void* data);
+    void copy(GLuint source, const ArenaBlock* block);
+    /* Pack the live blocks at the start of a new buffer of the same size */
+    void defragment();
+    ArenaStats stats() const;
+
+    static float defragmentThreshold;
+
+public:
+    GLuint buffer;
+
+private:
+    size_t capacity;
+    size_t relocations;
+    std::set<ArenaBlock*> blocks;
+    /* Offset to size */
+    std::map<size_t, size_t> freeRanges;
+
+    ArenaBlock* place(size_t size, size_t alignment);
+    void relocate(size_t minimumFree);
+};
+
+/**
+* Size in bytes of a GL buffer.
+*/
+size_t bufferSize(GLuint buffer);
+
+/**
+* The arenas drawables and meshes are moved into: one for vertices, one for
+* indices, and one VAO per vertex format that reads both, so everything with
+* the same format is drawn with the same VAO, at its block's base vertex and
+* index offset. The VAOs are kept pointing at the arenas when they move. Only
+* use it on the thread that draws.
+*/
+class GeometryArena {
+public:
+    /* Vertices of stride bytes, aligned so that baseVertex() indexes them */
+    static ArenaBlock* allocateVertices(size_t size, size_t stride);
+    /* Indices of indexSize bytes */
+    static ArenaBlock* allocateIndices(size_t size, size_t indexSize);
+    static void free(ArenaBlock* block);
+    /* VAO of a vertex format, see vertexArraysSetup() */
+    static GLuint vertexArray(VertexSetupFunction format);
+    static void defragment();
+
+    static ArenaStats vertexStats();
+    static ArenaStats indexStats();
+    /* Logs the stats of both arenas */
+    static void report();
+    /* Delete the buffers and VAOs, e.g. before the context is destroyed.
+    Blocks still in use are lost */
+    static void destroy();
+
+    /* Bytes of each arena when first used */
+    static size_t initialCapacity;
+
+private:
+    static BufferArena* vertices;
+    static BufferArena* indices;
+    static std::map<VertexSetupFunction, GLuint> vertexArrays;
+    /* The buffers the VAOs point at */
+    static GLuint vertexBuffer, indexBuffer;
+
+    static BufferArena& arena(BufferArena*& arena);
+    static void bindBuffers();
+};
+
+#endif
@@ -0,0 +1,82 @@
+#ifndef OPTIMIZE_H
+#define OPTIMIZE_H
+
+#include <string>
+#include <vector>
+#include <glm/glm.hpp>
+
+/**
+* Post-transform vertex cache efficiency of an indexed triangle list, as
+* measured by simulating a FIFO cache: ACMR is the number of transformed
+* vertices per triangle (0.5 at best, 3 at worst) and ATVR the number of
+* transformed vertices per vertex (1 at best).
+*/
+struct VertexCacheStats {
+    float acmr;
+    float atvr;
+};
+
+VertexCacheStats analyzeVertexCache(
+    const std::vector<unsigned int>& indices, size_t vertexCount,
+    unsigned int cacheSize = 16);
+
+/**
+* Reorder the triangles for a FIFO vertex cache of cacheSize entries using
+* Tipsify (Sander et al. 2007), keeping the winding of every triangle. If
+* clusters is given, it receives the index of the first triangle of every
+* run that starts after a cache flush, for optimizeOverdraw().
+*/
+void optimizeVertexCache(
+    std::vector<unsigned int>& indices, size_t vertexCount,
+    unsigned int cacheSize = 16, std::vector<unsigned int>* clusters = nullptr);
+
+/**
+* Reorder the clusters of optimizeVertexCache() so that the ones facing
+* outwards are drawn first, which lets early depth testing reject more of
+* the fragments behind them. The order within each cluster is kept.
+*/
+void optimizeOverdraw(
+    std::vector<unsigned int>& indices, const std::vector<glm::vec3>& positions,
+    const std::vector<unsigned int>& clusters);
+
+/**
+* Renumber the vertices in the order the indices first use them, so vertex
+* fetches walk the buffer forwards. Unused vertices are moved to the end.
+* Returns the new index of every old vertex, to apply with remapVertices().
+*/
+std::vector<unsigned int> optimizeVertexFetch(
+    std::vector<unsigned int>& indices, size_t vertexCount);
+
+template<typename T>
+void remapVertices(std::vector<T>& vertices, const std::vector<unsigned int>& remap) {
+    if (vertices.empty()) return;
+    std::vector<T> remapped(vertices.size());
+    for (size_t i = 0; i < vertices.size(); i++) {
+        remapped[remap[i]] = vertices[i];
+    }
+    vertices.swap(remapped);
+}
+
+/**
+* Run the enabled passes of MeshOptimizer on an indexed mesh: vertex cache,
+* then overdraw, then vertex fetch order. uvs and normals may be empty.
+* `name` identifies the mesh in the report.
+*/
+void optimizeMesh(
+    std::vector<unsigned int>& indices, std::vector<glm::vec3>& positions,
+    std::vector<glm::vec2>& uvs, std::vector<glm::vec3>& normals,
+    const std::string& name = "");
+
+/**
+* Settings of optimizeMesh(), shared by every loader.
+*/
+struct MeshOptimizer {
+    /* Set to false to upload meshes in file order */
+    static bool enabled;
+    /* Also sort the triangle clusters for overdraw, at some cache cost */
+    static bool overdraw;
+    /* Log the ACMR and ATVR before and after every mesh */
+    static bool report;
+};
+
+#endif
@@ -0,0 +1,353 @@
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <queue>
+#include "simplify.h"
+#include "optimize.h"
+
+using namespace glm;
+using namespace std;
+
+// Weight of the squared normal and uv differences against the squared
+// distances of the position quadrics, which are divided by the squared
+// size of the mesh so the weight does not depend on its units
+static const double ATTRIBUTE_WEIGHT = 0.01;
+
+float LODSelection::maxScreenError = 0.001f;
+bool LODSelection::enabled = true;
+
+// Sum of squared distances to a set of planes, the symmetric 4x4 matrix
+// stored as its upper triangle
+struct Quadric {
+    double a[10];
+
+    void addPlane(const dvec3& n, double d) {
+        a[0] += n.x * n.x; a[1] += n.x * n.y; a[2] += n.x * n.z; a[3] += n.x * d;
+        a[4] += n.y * n.y; a[5] += n.y * n.z; a[6] += n.y * d;
+        a[7] += n.z * n.z; a[8] += n.z * d;
+        a[9] += d * d;
+    }
+
+    void add(const Quadric& q) {
+        for (int i = 0; i < 10; i++) a[i] += q.a[i];
+    }
+
+    double evaluate(const dvec3& p) const {
+        double e = a[0] * p.x * p.x + 2 * a[1] * p.x * p.y + 2 * a[2] * p.x * p.z + 2 * a[3] * p.x +
+            a[4] * p.y * p.y + 2 * a[5] * p.y * p.z + 2 * a[6] * p.y +
+            a[7] * p.z * p.z + 2 * a[8] * p.z + a[9];
+        return std::max(e, 0.0);
+    }
+};
+
+struct Collapse {
+    double cost;
+    unsigned int from, to;
+    unsigned int fromVersion, toVersion;
+
+    bool operator<(const Collapse& other) const {
+        return cost > other.cost;    // lowest cost first in priority_queue
+    }
+};
+
+// Vertices with equal positions get the same id, so collapses see through
+// the splits at normal and uv seams
+static vector<unsigned int> positionIds(const vector<vec3>& positions, unsigned int& count) {
+    vector<unsigned int> order(positions.size());
+    for (size_t i = 0; i < order.size(); i++) order[i] = static_cast<unsigned int>(i);
+    auto less = [&](unsigned int a, unsigned int b) {
+        return memcmp(&positions[a], &positions[b], sizeof(vec3)) < 0;
+    };
+    sort(order.begin(), order.end(), less);
+    vector<unsigned int> ids(positions.size());
+    count = 0;
+    for (size_t i = 0; i < order.size(); i++) {
+        if (i > 0 && less(order[i - 1], order[i])) count++;
+        ids[order[i]] = count;
+    }
+    if (!order.empty()) count++;
+    return ids;
+}
+
+vector<unsigned int> simplifyMesh(
+    const vector<unsigned int>& indices, const vector<vec3>& positions,
+    const vector<vec3>& normals, const vector<vec2>& uvs,
+    size_t targetIndexCount, float* error) {
+    if (error) *error = 0.0f;
+    vector<unsigned int> corners(indices.begin(), indices.begin() + indices.size() / 3 * 3);
+    size_t triangleCount = corners.size() / 3;
+    if (corners.size() <= targetIndexCount) return corners;
+
+    unsigned int idCount;
+    vector<unsigned int> id = positionIds(positions, idCount);
+    vec3 extent = positions.empty() ? vec3(0.0f) : positions[0];
+    {
+        vec3 lo = extent, hi = extent;
+        for (const auto& p : positions) {
+            lo = min(lo, p);
+            hi = max(hi, p);
+        }
+        extent = hi - lo;
+    }
+    double scale = std::max(double(length(extent)), 1e-12);
+    double positionWeight = 1.0 / (scale * scale);
+
+    // triangles around every position and the quadric of their planes
+    vector<vector<unsigned int>> around(idCount);
+    {
+        vector<unsigned int> count(idCount, 0);
+        for (unsigned int v : corners) count[id[v]]++;
+        for (unsigned int p = 0; p < idCount; p++) around[p].reserve(count[p]);
+    }
+    vector<Quadric> quadrics(idCount, Quadric{});
+    for (size_t t = 0; t < triangleCount; t++) {
+        dvec3 a(positions[corners[3 * t]]), b(positions[corners[3 * t + 1]]), c(positions[corners[3 * t + 2]]);
+        dvec3 n = cross(b - a, c - a);
+        double area = length(n);
+        if (area > 0.0) n /= area;
+        for (int k = 0; k < 3; k++) {
+            unsigned int p = id[corners[3 * t + k]];
+            around[p].push_back(static_cast<unsigned int>(t));
+            quadrics[p].addPlane(n, -dot(n, a));
+        }
+    }
+
+    // border and non-manifold edges are used by other than two triangles,
+    // their ends are locked like seams, where a position has several vertices
+    vector<bool> locked(idCount, false);
+    {
+        vector<unsigned int> wedge(idCount, ~0u);
+        for (unsigned int v : corners) {
+            if (wedge[id[v]] == ~0u) wedge[id[v]] = v;
+            else if (wedge[id[v]] != v) locked[id[v]] = true;
+        }
+        vector<pair<unsigned int, unsigned int>> edges;
+        edges.reserve(corners.size());
+        for (size_t t = 0; t < triangleCount; t++) {
+            for (int k = 0; k < 3; k++) {
+                unsigned int a = id[corners[3 * t + k]], b = id[corners[3 * t + (k + 1) % 3]];
+                edges.push_back(make_pair(std::min(a, b), std::max(a, b)));
+            }
+        }
+        sort(edges.begin(), edges.end());
+        for (size_t i = 0; i < edges.size();) {
+            size_t j = i;
+            while (j < edges.size() && edges[j] == edges[i]) j++;
+            if (j - i != 2) locked[edges[i].first] = locked[edges[i].second] = true;
+            i = j;
+        }
+    }
+
+    vector<bool> dead(triangleCount, false);
+    vector<bool> removed(idCount, false);
+    vector<unsigned int> version(idCount, 0);
+
+    auto cost = [&](unsigned int from, unsigned int to) {
+        Quadric q = quadrics[id[from]];
+        q.add(quadrics[id[to]]);
+        double c = q.evaluate(dvec3(positions[to])) * positionWeight;
+        if (!normals.empty()) {
+            vec3 d = normals[from] - normals[to];
+            c += ATTRIBUTE_WEIGHT * dot(d, d);
+        }
+        if (!uvs.empty()) {
+            vec2 d = uvs[from] - uvs[to];
+            c += ATTRIBUTE_WEIGHT * dot(d, d);
+        }
+        return c;
+    };
+
+    priority_queue<Collapse> queue;
+    auto push = [&](unsigned int from, unsigned int to) {
+        if (locked[id[from]] || id[from] == id[to]) return;
+        queue.push(Collapse{cost(from, to), from, to, version[id[from]], version[id[to]]});
+    };
+    // every edge of a closed mesh is in two triangles, push it from one
+    for (size_t t = 0; t < triangleCount; t++) {
+        for (int k = 0; k < 3; k++) {
+            unsigned int a = corners[3 * t + k], b = corners[3 * t + (k + 1) % 3];
+            if (a < b || locked[id[a]] || locked[id[b]]) {
+                push(a, b);
+                push(b, a);
+            }
+        }
+    }
+
+    // positions of the live triangles around p, other than p
+    vector<unsigned int> fromRing, toRing, shared, neighbours;
+    auto ring = [&](unsigned int p, vector<unsigned int>& out) {
+        out.clear();
+        for (unsigned int t : around[p]) {
+            if (dead[t]) continue;
+            for (int k = 0; k < 3; k++) {
+                unsigned int q = id[corners[3 * t + k]];
+                if (q != p) out.push_back(q);
+            }
+        }
+        sort(out.begin(), out.end());
+        out.erase(unique(out.begin(), out.end()), out.end());
+    };
+
+    double maxError = 0.0;
+    size_t liveTriangles = triangleCount;
+    while (liveTriangles * 3 > targetIndexCount && !queue.empty()) {
+        Collapse collapse = queue.top();
+        queue.pop();
+        unsigned int from = id[collapse.from], to = id[collapse.to];
+        if (removed[from] || removed[to]) continue;
+        if (collapse.fromVersion != version[from] || collapse.toVersion != version[to]) {
+            push(collapse.from, collapse.to);
+            continue;
+        }
+
+        // the collapse must keep the surface a manifold: the only positions
+        // next to both ends are the third corners of the triangles on the edge
+        size_t edgeTriangles = 0;
+        bool valid = true;
+        for (unsigned int t : around[from]) {
+            if (dead[t]) continue;
+            bool hasTo = false;
+            for (int k = 0; k < 3; k++) {
+                unsigned int v = corners[3 * t + k];
+                if (id[v] == to) {
+                    hasTo = true;
+                    // the triangles that stay must be able to use this vertex
+                    if (v != collapse.to) valid = false;
+                }
+            }
+            if (hasTo) {
+                edgeTriangles++;
+                continue;
+            }
+            // and must not flip
+            vec3 p[3], q[3];
+            for (int k = 0; k < 3; k++) {
+                unsigned int v = corners[3 * t + k];
+                p[k] = positions[v];
+                q[k] = id[v] == from ? positions[collapse.to] : p[k];
+            }
+            vec3 before = cross(p[1] - p[0], p[2] - p[0]);
+            vec3 after = cross(q[1] - q[0], q[2] - q[0]);
+            if (dot(before, after) <= 0.0f) valid = false;
+        }
+        if (!valid || edgeTriangles == 0) continue;
+        ring(from, fromRing);
+        ring(to, toRing);
+        shared.clear();
+        set_intersection(fromRing.begin(), fromRing.end(), toRing.begin(), toRing.end(),
+                         back_inserter(shared));
+        if (shared.size() != edgeTriangles) continue;
+
+        // move the triangles of from over to the vertex of to
+        for (unsigned int t : around[from]) {
+            if (dead[t]) continue;
+            bool degenerate = false;
+            for (int k = 0; k < 3; k++) {
+                unsigned int& v = corners[3 * t + k];
+                if (id[v] == from) v = collapse.to;
+                else if (id[v] == to) degenerate = true;
+            }
+            if (degenerate) {
+                dead[t] = true;
+                liveTriangles--;
+            } else {
+                around[to].push_back(t);
+            }
+        }
+        around[to].erase(remove_if(around[to].begin(), around[to].end(),
+                                   [&](unsigned int t) { return dead[t]; }), around[to].end());
+        vector<unsigned int>().swap(around[from]);
+        removed[from] = true;
+        quadrics[to].add(quadrics[from]);
+        version[to]++;
+        maxError = std::max(maxError, quadrics[to].evaluate(dvec3(positions[collapse.to])));
+
+        // the collapses into and out of to changed cost
+        neighbours.clear();
+        for (unsigned int t : around[to]) {
+            for (int k = 0; k < 3; k++) {
+                unsigned int v = corners[3 * t + k];
+                if (id[v] != to) neighbours.push_back(v);
+            }
+        }
+        sort(neighbours.begin(), neighbours.end());
+        neighbours.erase(unique(neighbours.begin(), neighbours.end()), neighbours.end());
+        for (unsigned int v : neighbours) {
+            push(v, collapse.to);
+            push(collapse.to, v);
+        }
+    }
+
+    vector<unsigned int> result;
+    result.reserve(liveTriangles * 3);
+    for (size_t t = 0; t < triangleCount; t++) {
+        if (!dead[t]) result.insert(result.end(), &corners[3 * t], &corners[3 * t] + 3);
+    }
+    if (error) *error = static_cast<float>(sqrt(maxError));
+    return result;
+}
+
+vector<MeshLOD> buildLODChain(
+    const vector<unsigned int>& indices, const vector<vec3>& positions,
+    const vector<vec3>& normals, const vector<vec2>& uvs,
+    const vector<float>& ratios, vector<unsigned int>& chain) {
+    chain.assign(indices.begin(), indices.end());
+    vector<MeshLOD> lods{MeshLOD{0, static_cast<unsigned int>(indices.size()), 0.0f}};
+
+    vector<unsigned int> previous = indices;
+    float previousError = 0.0f;
+    for (float ratio : ratios) {
+        size_t target = static_cast<size_t>(indices.size() / 3 * ratio) * 3;
+        float error;
+        vector<unsigned int> lod = simplifyMesh(previous, positions, normals, uvs, target, &error);
+        // locked borders and seams can stop the simplifier early
+        if (lod.empty() || lod.size() > previous.size() * 9 / 10) break;
+        optimizeVertexCache(lod, positions.size());
+
+        previousError += error;
+        lods.push_back(MeshLOD{static_cast<unsigned int>(chain.size()),
+                               static_cast<unsigned int>(lod.size()), previousError});
+        chain.insert(chain.end(), lod.begin(), lod.end());
+        previous.swap(lod);
+    }
+    return lods;
+}
+
+vec4 boundingSphere(const vector<vec3>& positions) {
+    if (positions.empty()) return vec4(0.0f);
+    vec3 lo = positions[0], hi = positions[0];
+    for (const auto& p : positions) {
+        lo = min(lo, p);
+        hi = max(hi, p);
+    }
+    vec3 center = (lo + hi) * 0.5f;
+    float radius = 0.0f;
+    for (const auto& p : positions) {
+        radius = std::max(radius, length(p - center));
+    }
+    return vec4(center, radius);
+}
+
+unsigned int selectLOD(
+    const vector<MeshLOD>& lods, const vec4& sphere,
+    const mat4& modelView, const mat4& projection) {
+    if (!LODSelection::enabled || lods.size() < 2) return 0;
+
+    // errors scale with the largest axis of the model view matrix
+    float scale = std::max(length(vec3(modelView[0])),
+                           std::max(length(vec3(modelView[1])), length(vec3(modelView[2]))));
+    // fraction of the viewport height one unit of model space covers,
+    // projection[1][1] maps view space to the [-1, 1] height
+    float screenPerUnit = 0.5f * projection[1][1] * scale;
+    if (projection[2][3] != 0.0f) {
+        float depth = -(modelView * vec4(vec3(sphere), 1.0f)).z - sphere.w * scale;
+        if (depth <= 0.0f) return 0;
+        screenPerUnit /= depth;
+    }
+
+    unsigned int lod = 0;
+    for (unsigned int i = 1; i < lods.size(); i++) {
+        if (lods[i].error * screenPerUnit <= LODSelection::maxScreenError) lod = i;
+    }
+    return lod;
+}
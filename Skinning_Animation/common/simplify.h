@@ -0,0 +1,65 @@
+#ifndef SIMPLIFY_H
+#define SIMPLIFY_H
+
+#include <vector>
+#include <glm/glm.hpp>
+
+/**
+* Simplify an indexed triangle mesh with the quadric error metric (Garland
+* and Heckbert 1997) until at most targetIndexCount indices are left.
+* Vertices are only collapsed onto neighbours, so the result indexes the
+* same vertex buffer. Differences of normals and uvs add to the cost of a
+* collapse; vertices on open borders and on attribute seams are never
+* removed, so the result may stay above the target. error receives the
+* largest distance, in model units, a collapse moved the surface.
+*/
+std::vector<unsigned int> simplifyMesh(
+    const std::vector<unsigned int>& indices, const std::vector<glm::vec3>& positions,
+    const std::vector<glm::vec3>& normals, const std::vector<glm::vec2>& uvs,
+    size_t targetIndexCount, float* error = nullptr);
+
+/**
+* A level of detail in an index buffer that holds a whole LOD chain.
+*/
+struct MeshLOD {
+    unsigned int first;    // first index
+    unsigned int count;    // number of indices
+    float error;           // simplification error in model units
+};
+
+/**
+* Build a chain of LODs with the given fractions of the triangles of the
+* input, each simplified from the previous one and ordered for the vertex
+* cache. chain receives the indices of all LODs, the input first. Levels
+* that the simplifier can not make noticeably smaller are left out.
+*/
+std::vector<MeshLOD> buildLODChain(
+    const std::vector<unsigned int>& indices, const std::vector<glm::vec3>& positions,
+    const std::vector<glm::vec3>& normals, const std::vector<glm::vec2>& uvs,
+    const std::vector<float>& ratios, std::vector<unsigned int>& chain);
+
+/**
+* Bounding sphere of the positions, center in xyz and radius in w.
+*/
+glm::vec4 boundingSphere(const std::vector<glm::vec3>& positions);
+
+/**
+* The coarsest LOD whose error, projected with modelView and projection at
+* the point of the bounding sphere nearest to the camera, stays below
+* LODSelection::maxScreenError.
+*/
+unsigned int selectLOD(
+    const std::vector<MeshLOD>& lods, const glm::vec4& sphere,
+    const glm::mat4& modelView, const glm::mat4& projection);
+
+/**
+* Settings of selectLOD().
+*/
+struct LODSelection {
+    /* Largest projected error, as a fraction of the viewport height */
+    static float maxScreenError;
+    /* Set to false to always draw the full detail */
+    static bool enabled;
+};
+
+#endif
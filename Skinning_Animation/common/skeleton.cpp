@@ -24,16 +24,30 @@ void Body::draw(
     const GLuint& projectionMatrixLocation,
     const glm::mat4 & viewMatrix, const glm::mat4 & projectionMatrix) {
     joint->updateWorldTransformation();
-    glUniformMatrix4fv(modelMatrixLocation, 1, GL_FALSE,
-                       &joint->jointWorldTransformation[0][0]);
     glUniformMatrix4fv(viewMatrixLocation, 1, GL_FALSE, &viewMatrix[0][0]);
     glUniformMatrix4fv(projectionMatrixLocation, 1, GL_FALSE,
                        &projectionMatrix[0][0]);
 
+    // drawables in the geometry arena with the same format share their VAO
+    GLuint bound = 0;
     for (Drawable* d : drawables) {
-        d->bind();
-        d->draw();
+        // not streamed in yet
+        if (d->VAO == 0) continue;
+
+        // quantized drawables are dequantized by the model matrix
+        glm::mat4 modelMatrix = joint->jointWorldTransformation * d->dequantization;
+        glUniformMatrix4fv(modelMatrixLocation, 1, GL_FALSE, &modelMatrix[0][0]);
+        // mirror images share the buffers of the other side, so their
+        // winding is reversed
+        glFrontFace(glm::determinant(d->dequantization) < 0.0f ? GL_CW : GL_CCW);
+        if (d->VAO != bound) {
+            d->bind();
+            bound = d->VAO;
+        }
+        d->draw(GL_TRIANGLES, d->selectLOD(
+            viewMatrix * joint->jointWorldTransformation, projectionMatrix));
     }
+    glFrontFace(GL_CCW);
 }
 
 Skeleton::Skeleton(
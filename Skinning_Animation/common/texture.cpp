@@ -1,9 +1,15 @@
 #include <GL/glew.h>
 #include <glfw3.h>
 #include <SOIL.h>
+#include <stb_image_aug.h>
 #include <string.h>
+#include <math.h>
 #include <iostream>
+#include <memory>
+#include <mutex>
 #include "texture.h"
+#include "util.h"
+#include "dds.h"
 using namespace std;
 
 GLuint loadBMP(const char* imagePath) {
@@ -61,8 +67,11 @@ GLuint loadBMP(const char* imagePath) {
         dataPos = 54; // The BMP header is done that way
     }
 
-    // Create a buffer
-    data = new unsigned char[imageSize];
+    // Rows are padded to a multiple of 4 bytes
+    unsigned int stride = (width * 3 + 3) & ~3u;
+
+    // Create a buffer, large enough for every row even if imageSize is short
+    data = new unsigned char[std::max(imageSize, stride * height)]();
 
     // Read the actual data from the file into the buffer
     fread(data, 1, imageSize, file);
@@ -80,9 +89,27 @@ GLuint loadBMP(const char* imagePath) {
     // Give the image to OpenGL
     glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_BGR, GL_UNSIGNED_BYTE, data);
 
+    // Build the mipmaps in linear space from the packed rows; glGenerateMipmap()
+    // would average the sRGB values as they are and darken every level
+    vector<unsigned char> pixels(size_t(width) * height * 3);
+    for (unsigned int y = 0; y < height; y++) {
+        memcpy(&pixels[size_t(y) * width * 3], data + size_t(y) * stride, width * 3);
+    }
+
     // OpenGL has now copied the data. Free our own version
     delete[] data;
 
+    vector<vector<unsigned char>> mips = generateMipmaps(pixels.data(), width, height, 3);
+    GLint alignment;
+    glGetIntegerv(GL_UNPACK_ALIGNMENT, &alignment);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    for (size_t level = 1; level <= mips.size(); level++) {
+        glTexImage2D(GL_TEXTURE_2D, static_cast<GLint>(level), GL_RGB,
+                     std::max(1u, width >> level), std::max(1u, height >> level), 0,
+                     GL_BGR, GL_UNSIGNED_BYTE, mips[level - 1].data());
+    }
+    glPixelStorei(GL_UNPACK_ALIGNMENT, alignment);
+
     // Poor filtering, or ...
     //glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
     //glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
@@ -92,8 +119,7 @@ GLuint loadBMP(const char* imagePath) {
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-    // ... which requires mipmaps. Generate them automatically.
-    glGenerateMipmap(GL_TEXTURE_2D);
+    // ... which requires the mipmaps uploaded above.
 
     // Return the ID of the texture we just created
     return textureID;
@@ -124,113 +150,485 @@ GLuint loadBMP(const char* imagePath) {
 //	return textureID;
 //}
 
-#define FOURCC_DXT1 0x31545844 // Equivalent to "DXT1" in ASCII
-#define FOURCC_DXT3 0x33545844 // Equivalent to "DXT3" in ASCII
-#define FOURCC_DXT5 0x35545844 // Equivalent to "DXT5" in ASCII
+GLuint loadDDS(const char* imagePath, GLenum* target) {
+    // every mipmap is uploaded straight from the mapping
+    MappedFile file(imagePath);
+    return uploadDDS(reinterpret_cast<const unsigned char*>(file.begin()), file.size(), target);
+}
 
-GLuint loadDDS(const char* imagePath) {
-    unsigned char header[124];
+GLuint uploadDDS(const unsigned char* data, size_t size, GLenum* target) {
+    DDSImage image = parseDDS(data, size);
+    if (target) *target = image.target;
+    return uploadDDS(image);
+}
+
+// SSE2 holds the four channels of a pixel in one register; without it the
+// same filters run on plain floats
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+typedef __m128 Pixel4;
+static inline Pixel4 loadPixel(const float* p) { return _mm_loadu_ps(p); }
+static inline void storePixel(float* p, Pixel4 v) { _mm_storeu_ps(p, v); }
+static inline Pixel4 zeroPixel() { return _mm_setzero_ps(); }
+static inline Pixel4 addWeighted(Pixel4 sum, float weight, Pixel4 v) {
+    return _mm_add_ps(sum, _mm_mul_ps(_mm_set1_ps(weight), v));
+}
+// Clamp to [0, 1], scale and round to integers
+static inline void quantizePixel(Pixel4 v, const float* scale, int* out) {
+    v = _mm_min_ps(_mm_max_ps(v, _mm_setzero_ps()), _mm_set1_ps(1.0f));
+    v = _mm_add_ps(_mm_mul_ps(v, _mm_loadu_ps(scale)), _mm_set1_ps(0.5f));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(out), _mm_cvttps_epi32(v));
+}
+#else
+struct Pixel4 { float v[4]; };
+static inline Pixel4 loadPixel(const float* p) { return Pixel4{{p[0], p[1], p[2], p[3]}}; }
+static inline void storePixel(float* p, Pixel4 v) { memcpy(p, v.v, sizeof v.v); }
+static inline Pixel4 zeroPixel() { return Pixel4{{0, 0, 0, 0}}; }
+static inline Pixel4 addWeighted(Pixel4 sum, float weight, Pixel4 v) {
+    for (int c = 0; c < 4; c++) sum.v[c] += weight * v.v[c];
+    return sum;
+}
+static inline void quantizePixel(Pixel4 v, const float* scale, int* out) {
+    for (int c = 0; c < 4; c++) {
+        float x = v.v[c] < 0.0f ? 0.0f : (v.v[c] > 1.0f ? 1.0f : v.v[c]);
+        out[c] = static_cast<int>(x * scale[c] + 0.5f);
+    }
+}
+#endif
+
+// sRGB transfer functions as tables: 8-bit to linear, and linear quantized
+// to 16 bits back to 8-bit, fine enough to round like the exact curve
+struct SRGBTables {
+    float toLinear[256];
+    float unorm[256];
+    unsigned char fromLinear[65536];
+
+    SRGBTables() {
+        for (int i = 0; i < 256; i++) {
+            double c = i / 255.0;
+            toLinear[i] = static_cast<float>(c <= 0.04045 ? c / 12.92 : pow((c + 0.055) / 1.055, 2.4));
+            unorm[i] = static_cast<float>(c);
+        }
+        for (int i = 0; i < 65536; i++) {
+            double l = i / 65535.0;
+            double c = l <= 0.0031308 ? l * 12.92 : 1.055 * pow(l, 1 / 2.4) - 0.055;
+            fromLinear[i] = static_cast<unsigned char>(c * 255.0 + 0.5);
+        }
+    }
+};
 
-    FILE *fp;
+static const SRGBTables& srgbTables() {
+    static const SRGBTables tables;
+    return tables;
+}
 
-    /* try to open the file */
-    fp = fopen(imagePath, "rb");
-    if (fp == NULL) {
-        throw runtime_error(string("Image could not be opened: ") + imagePath);
+// Converts rows of 8-bit pixels to and from 4 linear floats per pixel
+struct ByteMipCodec {
+    int channels;
+    bool srgb[4];
+    float decode[4][256];
+    float scale[4];
+
+    ByteMipCodec(int channels, bool srgbColor) : channels{channels} {
+        const SRGBTables& tables = srgbTables();
+        // alpha, the last channel of 2 and 4 channel images, is linear
+        for (int c = 0; c < 4; c++) {
+            bool alpha = (channels == 2 || channels == 4) && c == channels - 1;
+            srgb[c] = srgbColor && !alpha;
+            memcpy(decode[c], srgb[c] ? tables.toLinear : tables.unorm, sizeof decode[c]);
+            scale[c] = srgb[c] ? 65535.0f : 255.0f;
+        }
     }
 
-    /* verify the type of file */
-    char filecode[4];
-    fread(filecode, 1, 4, fp);
-    if (strncmp(filecode, "DDS ", 4) != 0) {
-        fclose(fp);
-        throw runtime_error("DDS error");
-    }
-
-    /* get the surface desc */
-    fread(&header, 124, 1, fp);
-
-    unsigned int height = *(unsigned int*)&(header[8]);
-    unsigned int width = *(unsigned int*)&(header[12]);
-    unsigned int linearSize = *(unsigned int*)&(header[16]);
-    unsigned int mipMapCount = *(unsigned int*)&(header[24]);
-    unsigned int fourCC = *(unsigned int*)&(header[80]);
-
-    unsigned char * buffer;
-    unsigned int bufsize;
-    /* how big is it going to be including all mipmaps? */
-    bufsize = mipMapCount > 1 ? linearSize * 2 : linearSize;
-    buffer = (unsigned char*) malloc(bufsize * sizeof(unsigned char));
-    fread(buffer, 1, bufsize, fp);
-    /* close the file pointer */
-    fclose(fp);
-
-    unsigned int components = (fourCC == FOURCC_DXT1) ? 3 : 4;
-    unsigned int format;
-    switch (fourCC) {
-        case FOURCC_DXT1:
-            format = GL_COMPRESSED_RGBA_S3TC_DXT1_EXT;
-            break;
-        case FOURCC_DXT3:
-            format = GL_COMPRESSED_RGBA_S3TC_DXT3_EXT;
-            break;
-        case FOURCC_DXT5:
-            format = GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
-            break;
-        default:
-            free(buffer);
-            return 0;
+    template<int N>
+    void decodePixels(const unsigned char* row, int width, float* out) const {
+        for (int x = 0; x < width; x++, row += N, out += 4) {
+            for (int c = 0; c < 4; c++) out[c] = c < N ? decode[c][row[c]] : 0.0f;
+        }
     }
 
-    // Create one OpenGL texture
-    GLuint textureID;
-    glGenTextures(1, &textureID);
+    template<int N>
+    void encodePixels(const float* row, int width, unsigned char* out) const {
+        const unsigned char* fromLinear = srgbTables().fromLinear;
+        int q[4];
+        for (int x = 0; x < width; x++, row += 4, out += N) {
+            quantizePixel(loadPixel(row), scale, q);
+            for (int c = 0; c < N; c++) {
+                out[c] = srgb[c] ? fromLinear[q[c]] : static_cast<unsigned char>(q[c]);
+            }
+        }
+    }
 
-    // "Bind" the newly created texture : all future texture functions will modify this texture
-    glBindTexture(GL_TEXTURE_2D, textureID);
-    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    void decodeRow(const unsigned char* row, int width, float* out) const {
+        switch (channels) {
+            case 1: decodePixels<1>(row, width, out); break;
+            case 2: decodePixels<2>(row, width, out); break;
+            case 3: decodePixels<3>(row, width, out); break;
+            default: decodePixels<4>(row, width, out); break;
+        }
+    }
 
-    unsigned int blockSize = (format == GL_COMPRESSED_RGBA_S3TC_DXT1_EXT) ? 8 : 16;
-    unsigned int offset = 0;
+    void encodeRow(const float* row, int width, unsigned char* out) const {
+        switch (channels) {
+            case 1: encodePixels<1>(row, width, out); break;
+            case 2: encodePixels<2>(row, width, out); break;
+            case 3: encodePixels<3>(row, width, out); break;
+            default: encodePixels<4>(row, width, out); break;
+        }
+    }
+};
 
-    /* load the mipmaps */
-    for (unsigned int level = 0; level < mipMapCount && (width || height); ++level) {
-        unsigned int size = ((width + 3) / 4)*((height + 3) / 4)*blockSize;
-        glCompressedTexImage2D(GL_TEXTURE_2D, level, format, width, height,
-                               0, size, buffer + offset);
+// Float pixels are linear already
+struct FloatMipCodec {
+    int channels;
 
-        offset += size;
-        width /= 2;
-        height /= 2;
+    void decodeRow(const float* row, int width, float* out) const {
+        for (int x = 0; x < width; x++, row += channels, out += 4) {
+            for (int c = 0; c < 4; c++) out[c] = c < channels ? row[c] : 0.0f;
+        }
+    }
 
-        // Deal with Non-Power-Of-Two textures. This code is not included in the webpage to reduce clutter.
-        if (width < 1) width = 1;
-        if (height < 1) height = 1;
+    void encodeRow(const float* row, int width, float* out) const {
+        for (int x = 0; x < width; x++, row += 4, out += channels) {
+            for (int c = 0; c < channels; c++) out[c] = row[c];
+        }
+    }
+};
+
+// The weights of the `count` source pixels from first[i] on that make
+// destination pixel i along one axis, zero weights padding the shorter
+// ones. first[i] can be outside the image, where edge pixels repeat
+struct MipTaps {
+    int count;
+    vector<int> first;
+    vector<float> weight;
+};
+
+static double besselI0(double x) {
+    double sum = 1.0, term = 1.0;
+    for (int k = 1; term > 1e-12 * sum; k++) {
+        term *= (x / (2 * k)) * (x / (2 * k));
+        sum += term;
     }
+    return sum;
+}
 
-    free(buffer);
+// Kaiser windowed sinc, in destination pixels: 3 of them on each side
+static const double KAISER_RADIUS = 3.0;
+static const double KAISER_ALPHA = 4.0;
+static const double PI = 3.14159265358979323846;
 
-    return textureID;
+static double kaiser(double t) {
+    if (fabs(t) >= KAISER_RADIUS) return 0.0;
+    double sinc = t == 0.0 ? 1.0 : sin(PI * t) / (PI * t);
+    double window = t / KAISER_RADIUS;
+    return sinc * besselI0(KAISER_ALPHA * sqrt(1.0 - window * window)) / besselI0(KAISER_ALPHA);
 }
 
-GLuint loadSOIL(const char* imagePath) {
+static MipTaps mipTaps(int source, int destination, MipFilter filter) {
+    // destination pixel i covers [i * ratio, (i + 1) * ratio) of the source
+    double ratio = double(source) / destination;
+    double radius = filter == MIP_BOX ? ratio / 2 : KAISER_RADIUS * ratio;
+    int span = static_cast<int>(ceil(2 * radius)) + 1;
+    vector<int> first(destination);
+    vector<double> weights(size_t(destination) * span);
+    int lo = span, hi = 0;
+    for (int i = 0; i < destination; i++) {
+        double center = (i + 0.5) * ratio;
+        first[i] = static_cast<int>(floor(center - radius));
+        double total = 0.0;
+        for (int k = 0; k < span; k++) {
+            int s = first[i] + k;
+            double w;
+            if (filter == MIP_BOX) {
+                // the part of source pixel s inside the box
+                w = std::max(0.0, std::min(s + 1.0, center + radius) - std::max(double(s), center - radius));
+            } else {
+                w = kaiser((s + 0.5 - center) / ratio);
+            }
+            weights[size_t(i) * span + k] = w;
+            total += w;
+        }
+        for (int k = 0; k < span; k++) {
+            double& w = weights[size_t(i) * span + k];
+            w /= total;
+            // taps at the ends of the support are 0 for every pixel
+            if (fabs(w) > 1e-7) {
+                lo = std::min(lo, k);
+                hi = std::max(hi, k);
+            }
+        }
+    }
+
+    MipTaps taps;
+    taps.count = hi - lo + 1;
+    taps.first.resize(destination);
+    taps.weight.resize(size_t(destination) * taps.count);
+    for (int i = 0; i < destination; i++) {
+        taps.first[i] = first[i] + lo;
+        for (int k = 0; k < taps.count; k++) {
+            taps.weight[size_t(i) * taps.count + k] = static_cast<float>(weights[size_t(i) * span + lo + k]);
+        }
+    }
+    return taps;
+}
+
+// Destination rows filtered by one task
+static const int MIP_BAND_ROWS = 32;
+
+// Filter one level into the next, first along rows, then down columns. Each
+// band of destination rows filters the source rows it needs on its own
+template<typename Codec, typename T>
+static void filterMipLevel(const T* source, int width, int height, T* destination,
+                           int w, int h, MipFilter filter, const Codec& codec,
+                           unsigned int threads) {
+    size_t sourceRow = size_t(width) * codec.channels;
+    size_t destinationRow = size_t(w) * codec.channels;
+    size_t bands = (size_t(h) + MIP_BAND_ROWS - 1) / MIP_BAND_ROWS;
+
+    // the usual case, halving an even level, is the average of 2x2 pixels
+    if (filter == MIP_BOX && width == 2 * w && height == 2 * h) {
+        parallelFor(bands, threads, [&](size_t band) {
+            int y0 = static_cast<int>(band) * MIP_BAND_ROWS;
+            int y1 = std::min(h, y0 + MIP_BAND_ROWS);
+            unique_ptr<float[]> lines(new float[size_t(width) * 8]);
+            unique_ptr<float[]> filtered(new float[size_t(w) * 4]);
+            const float* top = lines.get();
+            const float* bottom = lines.get() + size_t(width) * 4;
+            for (int y = y0; y < y1; y++) {
+                codec.decodeRow(source + 2 * y * sourceRow, width, lines.get());
+                codec.decodeRow(source + (2 * y + 1) * sourceRow, width, lines.get() + size_t(width) * 4);
+                for (int x = 0; x < w; x++) {
+                    Pixel4 sum = addWeighted(zeroPixel(), 0.25f, loadPixel(top + 8 * x));
+                    sum = addWeighted(sum, 0.25f, loadPixel(top + 8 * x + 4));
+                    sum = addWeighted(sum, 0.25f, loadPixel(bottom + 8 * x));
+                    sum = addWeighted(sum, 0.25f, loadPixel(bottom + 8 * x + 4));
+                    storePixel(filtered.get() + size_t(x) * 4, sum);
+                }
+                codec.encodeRow(filtered.get(), w, destination + y * destinationRow);
+            }
+        });
+        return;
+    }
+
+    MipTaps across = mipTaps(width, w, filter);
+    MipTaps down = mipTaps(height, h, filter);
+    // source pixels the taps reach outside the image on the left and right
+    int left = std::max(0, -across.first.front());
+    int right = std::max(0, across.first.back() + across.count - width);
+
+    parallelFor(bands, threads, [&](size_t band) {
+        int y0 = static_cast<int>(band) * MIP_BAND_ROWS;
+        int y1 = std::min(h, y0 + MIP_BAND_ROWS);
+        int first = std::max(0, down.first[y0]);
+        int last = std::min(height - 1, down.first[y1 - 1] + down.count - 1);
+
+        // left uninitialized, every float is written before it is read
+        unique_ptr<float[]> line(new float[size_t(left + width + right) * 4]);
+        unique_ptr<float[]> rows(new float[size_t(last - first + 1) * w * 4]);
+        float* pixels = line.get() + size_t(left) * 4;
+        for (int y = first; y <= last; y++) {
+            // repeat the edge pixels so the taps of every pixel are contiguous
+            codec.decodeRow(source + y * sourceRow, width, pixels);
+            for (int x = -left; x < 0; x++) memcpy(pixels + x * 4, pixels, 4 * sizeof(float));
+            for (int x = width; x < width + right; x++) {
+                memcpy(pixels + x * 4, pixels + (width - 1) * 4, 4 * sizeof(float));
+            }
+
+            float* out = rows.get() + size_t(y - first) * w * 4;
+            const float* weight = across.weight.data();
+            for (int x = 0; x < w; x++, weight += across.count) {
+                const float* p = pixels + across.first[x] * 4;
+                Pixel4 sum = zeroPixel();
+                for (int k = 0; k < across.count; k++) sum = addWeighted(sum, weight[k], loadPixel(p + k * 4));
+                storePixel(out + size_t(x) * 4, sum);
+            }
+        }
+
+        // one source row at a time into the sums of a destination row
+        unique_ptr<float[]> filtered(new float[size_t(w) * 4]);
+        for (int y = y0; y < y1; y++) {
+            const float* weight = &down.weight[size_t(y) * down.count];
+            for (int k = 0; k < down.count; k++) {
+                int row = std::min(std::max(down.first[y] + k, 0), height - 1) - first;
+                const float* p = rows.get() + size_t(row) * w * 4;
+                float* sum = filtered.get();
+                for (int x = 0; x < w; x++, p += 4, sum += 4) {
+                    storePixel(sum, addWeighted(k == 0 ? zeroPixel() : loadPixel(sum), weight[k], loadPixel(p)));
+                }
+            }
+            codec.encodeRow(filtered.get(), w, destination + y * destinationRow);
+        }
+    });
+}
+
+template<typename Codec, typename T>
+static vector<vector<T>> filterMipChain(const T* pixels, int width, int height,
+                                        MipFilter filter, const Codec& codec,
+                                        unsigned int threads) {
+    if (codec.channels < 1 || codec.channels > 4) {
+        throw runtime_error("Mipmaps need 1 to 4 channels per pixel");
+    }
+    vector<vector<T>> levels;
+    const T* source = pixels;
+    while (width > 1 || height > 1) {
+        int w = std::max(1, width / 2), h = std::max(1, height / 2);
+        levels.emplace_back(size_t(w) * h * codec.channels);
+        filterMipLevel(source, width, height, levels.back().data(), w, h, filter, codec, threads);
+        source = levels.back().data();
+        width = w;
+        height = h;
+    }
+    return levels;
+}
+
+vector<vector<unsigned char>> generateMipmaps(const unsigned char* pixels, int width, int height,
+                                              int channels, MipFilter filter, bool srgb,
+                                              unsigned int threads) {
+    return filterMipChain(pixels, width, height, filter, ByteMipCodec(channels, srgb), threads);
+}
+
+vector<vector<float>> generateMipmaps(const float* pixels, int width, int height, int channels,
+                                      MipFilter filter, unsigned int threads) {
+    return filterMipChain(pixels, width, height, filter, FloatMipCodec{channels}, threads);
+}
+
+// A 1x1 PNG whose pixels are deflated with fixed Huffman codes, the only
+// kind of block that makes stb_image build the tables of init_defaults()
+static const unsigned char FIXED_HUFFMAN_PNG[] = {
+    0x89, 0x50, 0x4e, 0x47, 0x0d, 0x0a, 0x1a, 0x0a, 0x00, 0x00, 0x00, 0x0d, 0x49, 0x48,
+    0x44, 0x52, 0x00, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00, 0x01, 0x08, 0x02, 0x00, 0x00,
+    0x00, 0x90, 0x77, 0x53, 0xde, 0x00, 0x00, 0x00, 0x0c, 0x49, 0x44, 0x41, 0x54, 0x78,
+    0x01, 0x63, 0x68, 0x70, 0x50, 0x00, 0x00, 0x02, 0x24, 0x00, 0xe1, 0xb9, 0xda, 0xde,
+    0x74, 0x00, 0x00, 0x00, 0x00, 0x49, 0x45, 0x4e, 0x44, 0xae, 0x42, 0x60, 0x82
+};
+
+// stb_image keeps its error per thread, but builds the tables of the
+// fixed Huffman codes on first use; build them once, before any two decodes
+// can overlap
+static void prepareDecoder() {
+    static once_flag prepared;
+    call_once(prepared, [] {
+        int width, height, channels;
+        stbi_image_free(stbi_load_from_memory(FIXED_HUFFMAN_PNG, sizeof(FIXED_HUFFMAN_PNG),
+                                              &width, &height, &channels, 0));
+    });
+}
+
+unsigned char* decodeImage(const char* imagePath, int& width, int& height, int& channels,
+                           int forceChannels, string& error) {
+    prepareDecoder();
+    unsigned char* pixels = stbi_load(imagePath, &width, &height, &channels, forceChannels);
+    if (pixels == nullptr) error = stbi_failure_reason();
+    return pixels;
+}
+
+unsigned char* decodeImage(const unsigned char* buffer, size_t size, int& width, int& height,
+                           int& channels, int forceChannels, string& error) {
+    prepareDecoder();
+    unsigned char* pixels = stbi_load_from_memory(buffer, static_cast<int>(size), &width, &height,
+                                                  &channels, forceChannels);
+    if (pixels == nullptr) error = stbi_failure_reason();
+    return pixels;
+}
+
+SOILImage decodeSOIL(const char* imagePath) {
     cout << "Reading image: " << imagePath << endl;
 
-    GLuint texture = 0;
+    SOILImage image;
+    int channels;
+    string error;
+    image.data = decodeImage(imagePath, image.width, image.height, channels, SOIL_LOAD_RGB, error);
+
+    // error check
+    if (image.data == nullptr) {
+        cout << "SOIL loading error: " << error << endl;
+    }
 
-    //Load Image File Directly into an OpenGL Texture
-    texture = SOIL_load_OGL_texture
-    (
-        imagePath,
-        SOIL_LOAD_RGB,
-        SOIL_CREATE_NEW_ID,
-        SOIL_FLAG_TEXTURE_REPEATS
-    );
+    return image;
+}
+
+SOILImage decodeSOIL(const unsigned char* buffer, size_t size) {
+    SOILImage image;
+    int channels;
+    string error;
+    image.data = decodeImage(buffer, size, image.width, image.height, channels, SOIL_LOAD_RGB,
+                             error);
 
     // error check
-    if (texture == 0) {
-        cout << "SOIL loading error: " << SOIL_last_result() << endl;
+    if (image.data == nullptr) {
+        cout << "SOIL loading error: " << error << endl;
     }
 
+    return image;
+}
+
+void buildMipmaps(SOILImage& image, unsigned int threads) {
+    if (image.data == nullptr) return;
+    image.mips = generateMipmaps(image.data, image.width, image.height, 3, MIP_BOX, true, threads);
+}
+
+GLuint uploadSOIL(SOILImage& image) {
+    if (image.data == nullptr) return 0;
+
+    // GL 3.3 samples textures of any size, so unlike SOIL_create_OGL_texture()
+    // the image is not rescaled to a power of two on the CPU
+    GLsizei levels = static_cast<GLsizei>(1 + image.mips.size());
+    GLuint texture;
+    glGenTextures(1, &texture);
+    glBindTexture(GL_TEXTURE_2D, texture);
+    if (GLEW_ARB_texture_storage) {
+        glTexStorage2D(GL_TEXTURE_2D, levels, GL_RGB8, image.width, image.height);
+    } else {
+        for (GLint level = 0; level < levels; level++) {
+            glTexImage2D(GL_TEXTURE_2D, level, GL_RGB8, std::max(1, image.width >> level),
+                         std::max(1, image.height >> level), 0, GL_RGB, GL_UNSIGNED_BYTE, NULL);
+        }
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, levels - 1);
+    }
+
+    // rows of RGB pixels are not 4 byte aligned
+    GLint alignment;
+    glGetIntegerv(GL_UNPACK_ALIGNMENT, &alignment);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, image.width, image.height,
+                    GL_RGB, GL_UNSIGNED_BYTE, image.data);
+    for (GLint level = 1; level < levels; level++) {
+        glTexSubImage2D(GL_TEXTURE_2D, level, 0, 0, std::max(1, image.width >> level),
+                        std::max(1, image.height >> level), GL_RGB, GL_UNSIGNED_BYTE,
+                        image.mips[level - 1].data());
+    }
+    glPixelStorei(GL_UNPACK_ALIGNMENT, alignment);
+
+    // the sampling of SOIL_FLAG_TEXTURE_REPEATS, trilinear with mipmaps
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER,
+                    levels > 1 ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+
+    SOIL_free_image_data(image.data);
+    image.data = nullptr;
+    vector<vector<unsigned char>>().swap(image.mips);
+
     return texture;
-}
\ No newline at end of file
+}
+
+GLuint loadSOIL(const char* imagePath) {
+    SOILImage image = decodeSOIL(imagePath);
+    buildMipmaps(image);
+    return uploadSOIL(image);
+}
+
+vector<GLuint> loadSOILTextures(const vector<string>& imagePaths, unsigned int threads) {
+    vector<SOILImage> images(imagePaths.size());
+    parallelFor(imagePaths.size(), threads, [&](size_t i) {
+        images[i] = decodeSOIL(imagePaths[i].c_str());
+    });
+    // one image at a time, its rows filtered on every thread
+    for (auto& image : images) buildMipmaps(image, threads);
+
+    vector<GLuint> textures;
+    for (auto& image : images) textures.push_back(uploadSOIL(image));
+    return textures;
+}
@@ -1,6 +1,20 @@
 #include <GL/glew.h>
 #include <iostream>
+#include <stdexcept>
 #include <cmath>
+#include <cstring>
+#include <climits>
+#include <algorithm>
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
 using namespace std;
 #include "util.h"
 
@@ -71,4 +85,230 @@ bool fileExists(const std::string & abs_filename) {
     }
 
     return ret;
-}
\ No newline at end of file
+}
+
+#ifdef _WIN32
+MappedFile::MappedFile(const std::string& path)
+    : data{nullptr}, length{0}, file{INVALID_HANDLE_VALUE}, mapping{nullptr} {
+    file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL,
+                       OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if (file == INVALID_HANDLE_VALUE) {
+        throw runtime_error("Can't open the file: " + path);
+    }
+    LARGE_INTEGER fileSize;
+    GetFileSizeEx(file, &fileSize);
+    length = static_cast<size_t>(fileSize.QuadPart);
+    if (length == 0) return;
+
+    mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (mapping != NULL) {
+        data = static_cast<const char*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+    }
+    if (data == nullptr) {
+        if (mapping != NULL) CloseHandle(mapping);
+        CloseHandle(file);
+        throw runtime_error("Can't map the file: " + path);
+    }
+}
+
+MappedFile::~MappedFile() {
+    if (data) UnmapViewOfFile(data);
+    if (mapping) CloseHandle(mapping);
+    if (file != INVALID_HANDLE_VALUE) CloseHandle(file);
+}
+#else
+MappedFile::MappedFile(const std::string& path) : data{nullptr}, length{0} {
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw runtime_error("Can't open the file: " + path);
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        close(fd);
+        throw runtime_error("Can't stat the file: " + path);
+    }
+    length = static_cast<size_t>(st.st_size);
+    if (length != 0) {
+        void* addr = mmap(NULL, length, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (addr == MAP_FAILED) {
+            close(fd);
+            throw runtime_error("Can't map the file: " + path);
+        }
+        madvise(addr, length, MADV_SEQUENTIAL);
+        data = static_cast<const char*>(addr);
+    }
+    // the mapping stays valid after the descriptor is closed
+    close(fd);
+}
+
+MappedFile::~MappedFile() {
+    if (data) munmap(const_cast<char*>(data), length);
+}
+#endif
+
+static inline bool isDigit(char c) {
+    return static_cast<unsigned int>(c - '0') < 10u;
+}
+
+const char* parseFloat(const char* first, const char* last, float& value) {
+    static const double powLUT[] = {
+        1.0, 0.1, 0.01, 0.001, 0.0001, 0.00001, 0.000001, 0.0000001
+    };
+    const int lutEntries = sizeof powLUT / sizeof powLUT[0];
+
+    const char* p = first;
+    if (p == last) return first;
+
+    bool negative = false;
+    if (*p == '+' || *p == '-') {
+        negative = *p == '-';
+        p++;
+    }
+
+    // integer part, accumulated the same way tinyobjloader does, which also
+    // requires at least one digit: ".5" is not a number
+    double mantissa = 0.0;
+    if (p == last || !isDigit(*p)) return first;
+    while (p != last && isDigit(*p)) {
+        mantissa = mantissa * 10 + (*p - '0');
+        p++;
+    }
+
+    // fractional part
+    if (p != last && *p == '.') {
+        p++;
+        int read = 1;
+        while (p != last && isDigit(*p)) {
+            mantissa += (*p - '0') * (read < lutEntries ? powLUT[read] : pow(10.0, -read));
+            p++;
+            read++;
+        }
+    }
+
+    // exponent; like tinyobjloader, an 'e' without digits after it makes the
+    // whole number malformed rather than ending it: "1e" is not a number
+    int exponent = 0;
+    if (p != last && (*p == 'e' || *p == 'E')) {
+        p++;
+        bool negativeExp = false;
+        if (p != last && (*p == '+' || *p == '-')) {
+            negativeExp = *p == '-';
+            p++;
+        }
+        if (p == last || !isDigit(*p)) return first;
+        while (p != last && isDigit(*p)) {
+            exponent = exponent * 10 + (*p - '0');
+            p++;
+        }
+        if (negativeExp) exponent = -exponent;
+    }
+
+    double result = exponent ? ldexp(mantissa * pow(5.0, exponent), exponent) : mantissa;
+    value = static_cast<float>(negative ? -result : result);
+    return p;
+}
+
+const char* parseInt(const char* first, const char* last, int& value) {
+    const char* p = first;
+    if (p == last) return first;
+
+    bool negative = false;
+    if (*p == '+' || *p == '-') {
+        negative = *p == '-';
+        p++;
+    }
+    if (p == last || !isDigit(*p)) return first;
+
+    // accumulated wide and clamped to the range of int like strtol
+    const long long limit = negative ? -static_cast<long long>(INT_MIN) : INT_MAX;
+    long long result = 0;
+    while (p != last && isDigit(*p)) {
+        result = min(result * 10 + (*p - '0'), limit);
+        p++;
+    }
+    value = static_cast<int>(negative ? -result : result);
+    return p;
+}
+
+size_t decodeBase64(const char* first, const char* last,
+                    unsigned char* out, size_t skip, size_t count) {
+    // sextet of every character, -1 outside of the alphabet
+    static const struct Table {
+        signed char value[256];
+        Table() {
+            const char* alphabet =
+                "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+            for (int i = 0; i < 256; i++) value[i] = -1;
+            for (int i = 0; i < 64; i++) value[static_cast<unsigned char>(alphabet[i])] = i;
+        }
+    } table;
+
+    size_t written = 0, decoded = 0;
+    unsigned int group = 0;
+    int sextets = 0;
+    for (const char* p = first; p != last && written < count; p++) {
+        if (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r') continue;
+        int value = table.value[static_cast<unsigned char>(*p)];
+        if (value < 0) break;
+        group = (group << 6) | value;
+        if (++sextets == 4) {
+            unsigned char bytes[3] = {
+                static_cast<unsigned char>(group >> 16),
+                static_cast<unsigned char>(group >> 8),
+                static_cast<unsigned char>(group)
+            };
+            for (int i = 0; i < 3 && written < count; i++, decoded++) {
+                if (decoded >= skip) out[written++] = bytes[i];
+            }
+            group = 0;
+            sextets = 0;
+        }
+    }
+
+    // a trailing partial group, terminated by padding
+    if (sextets >= 2 && written < count) {
+        group <<= 6 * (4 - sextets);
+        unsigned char bytes[2] = {
+            static_cast<unsigned char>(group >> 16),
+            static_cast<unsigned char>(group >> 8)
+        };
+        for (int i = 0; i < sextets - 1 && written < count; i++, decoded++) {
+            if (decoded >= skip) out[written++] = bytes[i];
+        }
+    }
+    return written;
+}
+
+uint64_t hashBytes(const void* data, size_t size, uint64_t seed) {
+    const uint64_t m = 0xc6a4a7935bd1e995ULL;
+    const int r = 47;
+    const unsigned char* p = static_cast<const unsigned char*>(data);
+    uint64_t h = seed ^ (size * m);
+
+    for (size_t i = 0; i + 8 <= size; i += 8) {
+        uint64_t k;
+        memcpy(&k, p + i, 8);
+        k *= m;
+        k ^= k >> r;
+        k *= m;
+        h ^= k;
+        h *= m;
+    }
+
+    const unsigned char* tail = p + (size & ~size_t(7));
+    switch (size & 7) {
+    case 7: h ^= uint64_t(tail[6]) << 48; // fall through
+    case 6: h ^= uint64_t(tail[5]) << 40; // fall through
+    case 5: h ^= uint64_t(tail[4]) << 32; // fall through
+    case 4: h ^= uint64_t(tail[3]) << 24; // fall through
+    case 3: h ^= uint64_t(tail[2]) << 16; // fall through
+    case 2: h ^= uint64_t(tail[1]) << 8; // fall through
+    case 1: h ^= uint64_t(tail[0]);
+        h *= m;
+    }
+
+    h ^= h >> r;
+    h *= m;
+    h ^= h >> r;
+    return h;
+}
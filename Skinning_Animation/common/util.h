@@ -3,6 +3,13 @@
 
 #include <vector>
 #include <string>
+#include <cstddef>
+#include <cstdint>
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <mutex>
+#include <thread>
 
 /* We can use a function like this to print some GL capabilities of our adapter
 to the log file. handy if we want to debug problems on other people's computers
@@ -31,6 +38,42 @@ std::vector<T> slice(const std::vector<T>& v, int start = 0, int end = -1) {
     return nv;
 }
 
+/**
+* Run task(i) for every i in [0, count) on up to `threads` threads (0 uses
+* every hardware thread). The calling thread takes part in the work and the
+* first exception thrown by a task is rethrown once all threads are done.
+*/
+template<typename Task>
+void parallelFor(size_t count, unsigned int threads, Task task) {
+    if (threads == 0) threads = std::max(1u, std::thread::hardware_concurrency());
+    size_t workers = std::min<size_t>(threads, count);
+    if (workers <= 1) {
+        for (size_t i = 0; i < count; i++) task(i);
+        return;
+    }
+
+    std::atomic<size_t> next(0);
+    std::exception_ptr error;
+    std::mutex errorMutex;
+    auto work = [&]() {
+        for (size_t i = next++; i < count; i = next++) {
+            try {
+                task(i);
+            } catch (...) {
+                std::lock_guard<std::mutex> lock(errorMutex);
+                if (!error) error = std::current_exception();
+                next = count;
+            }
+        }
+    };
+
+    std::vector<std::thread> pool;
+    for (size_t i = 1; i < workers; i++) pool.emplace_back(work);
+    work();
+    for (auto& t : pool) t.join();
+    if (error) std::rethrow_exception(error);
+}
+
 /**
 * Get base directory from file path.
 */
@@ -41,4 +84,54 @@ std::string getBaseDir(const std::string& filepath);
 */
 bool fileExists(const std::string& abs_filename);
 
+/**
+* Read-only memory mapping of a whole file. The mapping is released when the
+* object goes out of scope.
+*/
+class MappedFile {
+public:
+    MappedFile(const std::string& path);
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+    ~MappedFile();
+
+    const char* begin() const { return data; }
+    const char* end() const { return data + length; }
+    size_t size() const { return length; }
+
+private:
+    const char* data;
+    size_t length;
+#ifdef _WIN32
+    void* file;
+    void* mapping;
+#endif
+};
+
+/**
+* Parse a number located at [first, last) in the spirit of std::from_chars.
+* Returns a pointer past the last parsed character, or first if no number
+* could be read. parseFloat() follows the grammar and rounding of
+* tinyobjloader, so both produce bit-identical values, and like it needs a
+* digit before the decimal point and fails on an exponent without digits.
+* parseInt() clamps to the range of int.
+*/
+const char* parseFloat(const char* first, const char* last, float& value);
+const char* parseInt(const char* first, const char* last, int& value);
+
+/**
+* Decode base64 text at [first, last), ignoring whitespace. The first `skip`
+* decoded bytes are discarded and at most `count` bytes are written to out.
+* Decoding stops at padding or at the first character that is not part of
+* the base64 alphabet. Returns the number of bytes written.
+*/
+size_t decodeBase64(const char* first, const char* last,
+                    unsigned char* out, size_t skip, size_t count);
+
+/**
+* 64-bit MurmurHash64A of a byte range. It is fast but not cryptographic:
+* use it to recognise contents, not to authenticate them.
+*/
+uint64_t hashBytes(const void* data, size_t size, uint64_t seed = 0);
+
 #endif
\ No newline at end of file
@@ -0,0 +1,133 @@
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <glm/gtc/matrix_transform.hpp>
+#include "vertex.h"
+
+using namespace glm;
+using namespace std;
+
+vector<u16vec4> quantizePositions(const vector<vec3>& positions, mat4& dequantization) {
+    vec3 minimum(0.0f), maximum(0.0f);
+    if (!positions.empty()) minimum = maximum = positions[0];
+    for (const auto& p : positions) {
+        minimum = min(minimum, p);
+        maximum = max(maximum, p);
+    }
+    vec3 extent = maximum - minimum;
+    float size = std::max(extent.x, std::max(extent.y, extent.z));
+    if (size <= 0.0f) size = 1.0f;
+    dequantization = scale(translate(mat4(1.0f), minimum), vec3(size));
+
+    vector<u16vec4> quantized(positions.size());
+    for (size_t i = 0; i < positions.size(); i++) {
+        vec3 q = clamp((positions[i] - minimum) / size, 0.0f, 1.0f) * 65535.0f + 0.5f;
+        quantized[i] = u16vec4(u16vec3(q), 0);
+    }
+    return quantized;
+}
+
+// A component in [-1, 1] as a 10-bit two's complement snorm
+static inline uint32_t packSnorm10(float value) {
+    float scaled = std::round(std::min(std::max(value, -1.0f), 1.0f) * 511.0f);
+    return static_cast<uint32_t>(static_cast<int32_t>(scaled)) & 0x3ff;
+}
+
+vector<uint32_t> packNormals(const vector<vec3>& normals) {
+    vector<uint32_t> packed(normals.size());
+    for (size_t i = 0; i < normals.size(); i++) {
+        const vec3& n = normals[i];
+        packed[i] = packSnorm10(n.x) | packSnorm10(n.y) << 10 | packSnorm10(n.z) << 20;
+    }
+    return packed;
+}
+
+// Rounds a float to the nearest half float, ties to even. The bits are
+// copied with memcpy rather than read through a union or a cast pointer.
+static inline uint32_t packHalf(float value) {
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof bits);
+    uint32_t sign = (bits >> 16) & 0x8000;
+    uint32_t magnitude = bits & 0x7fffffff;
+
+    if (magnitude >= 0x7f800000) {
+        // infinity, or a quiet NaN
+        return sign | 0x7c00 | (magnitude > 0x7f800000 ? 0x200 : 0);
+    }
+    if (magnitude >= 0x477ff000) {
+        // 65520 and above round to infinity
+        return sign | 0x7c00;
+    }
+    if (magnitude < 0x38800000) {
+        // below the smallest normal half, counted in steps of 2^-24
+        float absolute;
+        memcpy(&absolute, &magnitude, sizeof absolute);
+        return sign | static_cast<uint32_t>(std::nearbyint(absolute * 16777216.0f));
+    }
+    // rebias the exponent from 127 to 15 and round away 13 mantissa bits
+    return sign | ((magnitude - 0x38000000 + 0xfff + ((magnitude >> 13) & 1)) >> 13);
+}
+
+vector<uint32_t> packUVs(const vector<vec2>& uvs) {
+    vector<uint32_t> packed(uvs.size());
+    for (size_t i = 0; i < uvs.size(); i++) {
+        packed[i] = packHalf(uvs[i].x) | packHalf(uvs[i].y) << 16;
+    }
+    return packed;
+}
+
+template<typename T>
+static void uploadIndicesAs(const vector<unsigned int>& indices) {
+    vector<T> narrow(indices.begin(), indices.end());
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, narrow.size() * sizeof(T),
+                 narrow.data(), GL_STATIC_DRAW);
+}
+
+GLenum uploadIndices(const vector<unsigned int>& indices) {
+    GLenum type = narrowIndexType(indices);
+    if (type == GL_UNSIGNED_BYTE) {
+        uploadIndicesAs<uint8_t>(indices);
+    } else if (type == GL_UNSIGNED_SHORT) {
+        uploadIndicesAs<uint16_t>(indices);
+    } else {
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int),
+                     indices.data(), GL_STATIC_DRAW);
+    }
+    return type;
+}
+
+GLenum narrowIndexType(const vector<unsigned int>& indices) {
+    unsigned int maximum = 0;
+    for (unsigned int index : indices) maximum = std::max(maximum, index);
+    if (maximum <= 0xff) return GL_UNSIGNED_BYTE;
+    if (maximum <= 0xffff) return GL_UNSIGNED_SHORT;
+    return GL_UNSIGNED_INT;
+}
+
+template<typename T>
+static void narrowIndicesTo(const vector<unsigned int>& indices, unsigned char* data) {
+    for (size_t i = 0; i < indices.size(); i++) {
+        T index = static_cast<T>(indices[i]);
+        memcpy(data + i * sizeof(T), &index, sizeof(T));
+    }
+}
+
+vector<unsigned char> narrowIndices(const vector<unsigned int>& indices, GLenum type) {
+    vector<unsigned char> data(indices.size() * indexTypeSize(type));
+    if (type == GL_UNSIGNED_BYTE) {
+        narrowIndicesTo<uint8_t>(indices, data.data());
+    } else if (type == GL_UNSIGNED_SHORT) {
+        narrowIndicesTo<uint16_t>(indices, data.data());
+    } else {
+        narrowIndicesTo<uint32_t>(indices, data.data());
+    }
+    return data;
+}
+
+size_t indexTypeSize(GLenum type) {
+    switch (type) {
+    case GL_UNSIGNED_BYTE: return 1;
+    case GL_UNSIGNED_SHORT: return 2;
+    default: return 4;
+    }
+}
@@ -0,0 +1,235 @@
+#ifndef VERTEX_H
+#define VERTEX_H
+
+#include <GL/glew.h>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <vector>
+#include <glm/glm.hpp>
+#include <glm/gtc/type_precision.hpp>
+
+/**
+* Number of components and GL type of the C++ types used as vertex
+* attributes.
+*/
+template<typename T> struct VertexType;
+template<> struct VertexType<float> { static const GLint size = 1; static const GLenum type = GL_FLOAT; };
+template<> struct VertexType<glm::vec2> { static const GLint size = 2; static const GLenum type = GL_FLOAT; };
+template<> struct VertexType<glm::vec3> { static const GLint size = 3; static const GLenum type = GL_FLOAT; };
+template<> struct VertexType<glm::vec4> { static const GLint size = 4; static const GLenum type = GL_FLOAT; };
+
+/**
+* A vertex attribute: the shader location, the C++ type stored per vertex and
+* how GL reads it (by default deduced from the type).
+*/
+template<GLuint Location, typename T,
+         GLint Size = VertexType<T>::size,
+         GLenum Type = VertexType<T>::type,
+         GLboolean Normalized = GL_FALSE>
+struct VertexAttribute {
+    typedef T type;
+    static const GLuint location = Location;
+    static const GLint size = Size;
+    static const GLenum glType = Type;
+    static const GLboolean normalized = Normalized;
+};
+
+// The attributes the shaders of the labs share
+typedef VertexAttribute<0, glm::vec3> PositionAttribute;
+typedef VertexAttribute<1, glm::vec3> NormalAttribute;
+typedef VertexAttribute<2, glm::vec2> UVAttribute;
+// The skin of .glb meshes, four joints and their weights per vertex. They
+// skip location 3, which the labs use for their own attributes
+typedef VertexAttribute<4, glm::u16vec4, 4, GL_UNSIGNED_SHORT> JointAttribute;
+typedef VertexAttribute<5, glm::vec4> WeightAttribute;
+
+// Their compact encodings, see quantizePositions(), packNormals() and packUVs()
+typedef VertexAttribute<0, glm::u16vec4, 3, GL_UNSIGNED_SHORT, GL_TRUE> QuantizedPositionAttribute;
+typedef VertexAttribute<1, uint32_t, 4, GL_INT_2_10_10_10_REV, GL_TRUE> PackedNormalAttribute;
+typedef VertexAttribute<2, uint32_t, 2, GL_HALF_FLOAT> HalfUVAttribute;
+
+/**
+* Interleaved (array of structures) vertex layout, declared at compile time
+* as a list of VertexAttributes that are stored in order:
+*
+*   typedef VertexFormat<PositionAttribute, NormalAttribute> Format;
+*   glBindBuffer(GL_ARRAY_BUFFER, vbo);
+*   Format::upload(positions, normals);
+*
+* The arrays passed to pack() and upload() follow the attributes. An empty
+* array leaves its attribute zeroed, the others must be as long as the first.
+*/
+template<typename... Attributes> struct VertexFormat;
+
+template<>
+struct VertexFormat<> {
+    static const size_t stride = 0;
+
+    static void setupAttributes(GLsizei, size_t) {}
+    static void packAttributes(unsigned char*, size_t, size_t) {}
+};
+
+template<typename First, typename... Rest>
+struct VertexFormat<First, Rest...> {
+    typedef typename First::type type;
+    static const size_t stride = sizeof(type) + VertexFormat<Rest...>::stride;
+
+    /* Point the attributes at the bound GL_ARRAY_BUFFER and enable them */
+    static void setup() {
+        setupAttributes(static_cast<GLsizei>(stride), 0);
+    }
+
+    /* Interleave the arrays into a buffer of stride bytes per vertex */
+    static std::vector<unsigned char> pack(
+        const std::vector<type>& first,
+        const std::vector<typename Rest::type>&... rest) {
+        std::vector<unsigned char> data(first.size() * stride);
+        packAttributes(data.data(), stride, first.size(), first, rest...);
+        return data;
+    }
+
+    /* pack() the arrays into the bound GL_ARRAY_BUFFER and setup() */
+    static void upload(
+        const std::vector<type>& first,
+        const std::vector<typename Rest::type>&... rest) {
+        std::vector<unsigned char> data = pack(first, rest...);
+        glBufferData(GL_ARRAY_BUFFER, data.size(), data.data(), GL_STATIC_DRAW);
+        setup();
+    }
+
+    static void setupAttributes(GLsizei vertexStride, size_t offset) {
+        glVertexAttribPointer(First::location, First::size, First::glType, First::normalized,
+                              vertexStride, reinterpret_cast<const void*>(offset));
+        glEnableVertexAttribArray(First::location);
+        VertexFormat<Rest...>::setupAttributes(vertexStride, offset + sizeof(type));
+    }
+
+    static void packAttributes(
+        unsigned char* data, size_t vertexStride, size_t count,
+        const std::vector<type>& first,
+        const std::vector<typename Rest::type>&... rest) {
+        if (!first.empty()) {
+            if (first.size() != count) {
+                throw std::runtime_error("Vertex attribute arrays differ in size");
+            }
+            for (size_t i = 0; i < count; i++) {
+                memcpy(data + i * vertexStride, &first[i], sizeof(type));
+            }
+        }
+        VertexFormat<Rest...>::packAttributes(data + sizeof(type), vertexStride, count, rest...);
+    }
+};
+
+/**
+* VertexFormat::setup() of the format uploadVertexArrays() uses for arrays
+* with or without normals and uvs, to point another VAO at the same buffer,
+* e.g. one of another GL context.
+*/
+typedef void (*VertexSetupFunction)();
+
+template<typename Position, typename Normal, typename UV, typename... Extra>
+VertexSetupFunction vertexArraysSetup(bool normals, bool uvs) {
+    if (normals && uvs) return &VertexFormat<Position, Normal, UV, Extra...>::setup;
+    if (normals) return &VertexFormat<Position, Normal, Extra...>::setup;
+    if (uvs) return &VertexFormat<Position, UV, Extra...>::setup;
+    return &VertexFormat<Position, Extra...>::setup;
+}
+
+/**
+* Vertices interleaved by packVertexArrays(), with the stride and setup of
+* their format.
+*/
+struct PackedVertices {
+    std::vector<unsigned char> data;
+    size_t stride;
+    VertexSetupFunction setup;
+};
+
+/**
+* Interleave positions, normals and uvs with the given attributes, followed
+* by any extra attributes. Normals and uvs are left out of the format if
+* their arrays are empty.
+*/
+template<typename Position, typename Normal, typename UV, typename... Extra>
+PackedVertices packVertexArrays(
+    const std::vector<typename Position::type>& positions,
+    const std::vector<typename Normal::type>& normals,
+    const std::vector<typename UV::type>& uvs,
+    const std::vector<typename Extra::type>&... extra) {
+    if (!normals.empty() && !uvs.empty()) {
+        typedef VertexFormat<Position, Normal, UV, Extra...> Format;
+        return PackedVertices{Format::pack(positions, normals, uvs, extra...),
+                              Format::stride, &Format::setup};
+    } else if (!normals.empty()) {
+        typedef VertexFormat<Position, Normal, Extra...> Format;
+        return PackedVertices{Format::pack(positions, normals, extra...),
+                              Format::stride, &Format::setup};
+    } else if (!uvs.empty()) {
+        typedef VertexFormat<Position, UV, Extra...> Format;
+        return PackedVertices{Format::pack(positions, uvs, extra...),
+                              Format::stride, &Format::setup};
+    }
+    typedef VertexFormat<Position, Extra...> Format;
+    return PackedVertices{Format::pack(positions, extra...), Format::stride, &Format::setup};
+}
+
+/**
+* packVertexArrays() into the bound GL_ARRAY_BUFFER and point the bound VAO
+* at it. Returns the stride.
+*/
+template<typename Position, typename Normal, typename UV, typename... Extra>
+size_t uploadVertexArrays(
+    const std::vector<typename Position::type>& positions,
+    const std::vector<typename Normal::type>& normals,
+    const std::vector<typename UV::type>& uvs,
+    const std::vector<typename Extra::type>&... extra) {
+    PackedVertices packed = packVertexArrays<Position, Normal, UV, Extra...>(
+        positions, normals, uvs, extra...);
+    glBufferData(GL_ARRAY_BUFFER, packed.data.size(), packed.data.data(), GL_STATIC_DRAW);
+    packed.setup();
+    return packed.stride;
+}
+
+/**
+* Positions as 16-bit unsigned normalized values within the bounding box of
+* the mesh (the fourth component is padding). dequantization maps them back
+* and must be folded into the matrix applied to the positions, e.g. the
+* model matrix. It is a translation and a uniform scale, so normals
+* transformed by the same matrix only change length.
+*/
+std::vector<glm::u16vec4> quantizePositions(
+    const std::vector<glm::vec3>& positions, glm::mat4& dequantization);
+
+/**
+* Unit normals as signed normalized GL_INT_2_10_10_10_REV values.
+*/
+std::vector<uint32_t> packNormals(const std::vector<glm::vec3>& normals);
+
+/**
+* UVs as pairs of half floats.
+*/
+std::vector<uint32_t> packUVs(const std::vector<glm::vec2>& uvs);
+
+/**
+* Upload indices to the bound GL_ELEMENT_ARRAY_BUFFER using the narrowest of
+* GL_UNSIGNED_BYTE, GL_UNSIGNED_SHORT and GL_UNSIGNED_INT that holds them.
+* Returns the type to pass to glDrawElements.
+*/
+GLenum uploadIndices(const std::vector<unsigned int>& indices);
+
+/**
+* The index type uploadIndices() picks for indices, and the indices
+* converted to it, e.g. to upload them elsewhere.
+*/
+GLenum narrowIndexType(const std::vector<unsigned int>& indices);
+
+std::vector<unsigned char> narrowIndices(const std::vector<unsigned int>& indices, GLenum type);
+
+/**
+* Size in bytes of a glDrawElements index type.
+*/
+size_t indexTypeSize(GLenum type);
+
+#endif
@@ -0,0 +1,1283 @@
+// Benchmarks of the common sources, run from src/ like the lab. Without
+// arguments every section runs, otherwise only the ones named:
+//
+//   bench [obj] [threads] [indexvbo] [cache] [layout] [meshlets] [mips]
+//         [textures] [weld] [glb] [lods] [batching] [memory]...
+//
+// Timings are the best of a few runs, in milliseconds.
+
+// Include C++ headers
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <new>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Include GLEW
+#include <GL/glew.h>
+
+// Include GLFW
+#include <glfw3.h>
+
+// Include SOIL
+#include <SOIL.h>
+
+// Include GLM
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+// The XML DOM the .vtp loader used to read into
+#include <tinyxml2.h>
+
+// SOIL's resampler
+extern "C" {
+#include <image_helper.h>
+}
+
+// Mesh loading and textures
+#include <common/cache.h>
+#include <common/gltf.h>
+#include <common/meshlet.h>
+#include <common/model.h>
+#include <common/optimize.h>
+#include <common/simplify.h>
+#include <common/texcache.h>
+#include <common/texture.h>
+#include <common/vertex.h>
+
+using namespace std;
+using namespace glm;
+
+// Silences cout, which the loaders log to, while in scope
+struct QuietCout {
+    ostringstream sink;
+    streambuf* previous;
+    QuietCout() : previous(cout.rdbuf(sink.rdbuf())) {}
+    ~QuietCout() { cout.rdbuf(previous); }
+};
+
+// Calls of the global operator new, which every container allocation goes
+// through, and the bytes it has handed out: those still live and the most
+// that were live at once. Each block starts with its size
+static atomic<size_t> allocationCount(0), liveBytes(0), peakBytes(0);
+static const size_t ALLOCATION_HEADER = alignof(max_align_t);
+
+void* operator new(size_t size) {
+    allocationCount++;
+    char* block = static_cast<char*>(malloc(size + ALLOCATION_HEADER));
+    if (!block) throw bad_alloc();
+    *reinterpret_cast<size_t*>(block) = size;
+    size_t live = liveBytes += size;
+    size_t peak = peakBytes;
+    while (live > peak && !peakBytes.compare_exchange_weak(peak, live)) {}
+    return block + ALLOCATION_HEADER;
+}
+
+void operator delete(void* p) noexcept {
+    if (!p) return;
+    char* block = static_cast<char*>(p) - ALLOCATION_HEADER;
+    liveBytes -= *reinterpret_cast<size_t*>(block);
+    free(block);
+}
+
+// Number of allocations of one call of task
+template<typename Task>
+static size_t allocationsOf(Task task) {
+    QuietCout quiet;
+    size_t before = allocationCount;
+    task();
+    return allocationCount - before;
+}
+
+// Most bytes allocated at once during one call of load, which returns the
+// meshes it loaded, and the bytes of their arrays in outputBytes. Memory
+// mapped files are not allocated and not counted
+template<typename Load>
+static size_t peakBytesOf(Load load, size_t& outputBytes) {
+    QuietCout quiet;
+    size_t before = liveBytes;
+    peakBytes = before;
+    vector<MeshData> meshes = load();
+    outputBytes = 0;
+    for (const auto& mesh : meshes) {
+        outputBytes += mesh.vertices.size() * sizeof(vec3) + mesh.uvs.size() * sizeof(vec2) +
+            mesh.normals.size() * sizeof(vec3) + mesh.indices.size() * sizeof(unsigned int);
+    }
+    return peakBytes - before;
+}
+
+// Best wall time of runs calls of task, in milliseconds
+template<typename Task>
+static double bestOf(int runs, Task task) {
+    double best = 0.0;
+    for (int i = 0; i < runs; i++) {
+        auto start = chrono::steady_clock::now();
+        {
+            QuietCout quiet;
+            task();
+        }
+        double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+        if (i == 0 || ms < best) best = ms;
+    }
+    return best;
+}
+
+// A size x size grid of quads, split in two triangles each, with positions,
+// texture coordinates and normals, standing in for a large scan
+static void writeGridOBJ(const string& path, int size) {
+    ofstream out(path);
+    out << fixed << setprecision(6);
+    for (int y = 0; y <= size; y++) {
+        for (int x = 0; x <= size; x++) {
+            float u = float(x) / size, v = float(y) / size;
+            out << "v " << u << " " << 0.05f * (x % 7) / 7 << " " << v << "\n";
+            out << "vt " << u << " " << v << "\n";
+            out << "vn 0 1 0\n";
+        }
+    }
+    for (int y = 0; y < size; y++) {
+        for (int x = 0; x < size; x++) {
+            int a = y * (size + 1) + x + 1, b = a + 1, c = a + size + 1, d = c + 1;
+            out << "f " << a << "/" << a << "/" << a << " " << c << "/" << c << "/" << c
+                << " " << b << "/" << b << "/" << b << "\n";
+            out << "f " << b << "/" << b << "/" << b << " " << c << "/" << c << "/" << c
+                << " " << d << "/" << d << "/" << d << "\n";
+        }
+    }
+}
+
+// loadOBJ() and loadOBJWithTiny() against loadOBJMapped(), timed and by the
+// allocations of one load
+static void benchOBJ() {
+    const string grid = "bench_grid.obj";
+    writeGridOBJ(grid, 512);
+    struct Input {
+        string path;
+        int runs;
+    };
+    const vector<Input> inputs = {
+        {"../../Mesh_Manipulation/src/heart.obj", 5}, {"models/male.obj", 5},
+        {"../../Standard_Shading/src/suzanne.obj", 5}, {grid, 3}
+    };
+
+    for (const auto& input : inputs) {
+        size_t triangles = loadOBJMapped(input.path).vertices.size() / 3;
+        double tiny = bestOf(input.runs, [&]() { loadOBJWithTiny(input.path); });
+        double mapped = bestOf(input.runs, [&]() { loadOBJMapped(input.path); });
+
+        ostringstream line;
+        line << fixed << setprecision(2) << "obj " << input.path << " (" << triangles
+            << " triangles): loadOBJ ";
+        // loadOBJ() only reads faces of v/vt/vn corners
+        try {
+            line << bestOf(input.runs, [&]() { loadOBJ(input.path); }) << " ms";
+        } catch (const runtime_error&) {
+            line << "n/a";
+        }
+        line << ", loadOBJWithTiny " << tiny << " ms, loadOBJMapped " << mapped << " ms, "
+            << tiny / mapped << "x faster than tinyobjloader";
+        cout << line.str() << endl;
+
+        line.str("");
+        line << "obj " << input.path << " allocations: loadOBJ ";
+        try {
+            line << allocationsOf([&]() { loadOBJ(input.path); });
+        } catch (const runtime_error&) {
+            line << "n/a";
+        }
+        line << ", loadOBJWithTiny " << allocationsOf([&]() { loadOBJWithTiny(input.path); })
+            << ", loadOBJMapped " << allocationsOf([&]() { loadOBJMapped(input.path); })
+            << ", loadOBJIndexed " << allocationsOf([&]() { loadOBJIndexed(input.path); });
+        cout << line.str() << endl;
+    }
+    remove(grid.c_str());
+}
+
+// Scaling of loadOBJParallel() with its thread count
+static void benchThreads() {
+    const string grid = "bench_grid.obj";
+    writeGridOBJ(grid, 512);
+    const vector<string> inputs = {"../../Mesh_Manipulation/src/heart.obj", grid};
+
+    for (const auto& path : inputs) {
+        ostringstream line;
+        line << fixed << setprecision(2) << "threads " << path << ":";
+        double single = 0.0;
+        for (unsigned int threads : {1u, 2u, 4u, 8u}) {
+            double ms = bestOf(3, [&]() { loadOBJParallel(path, threads); });
+            if (threads == 1) single = ms;
+            line << (threads == 1 ? " " : ", ") << threads << " threads " << ms << " ms ("
+                << single / ms << "x)";
+        }
+        cout << line.str() << endl;
+    }
+    remove(grid.c_str());
+}
+
+// SOIL's mipmap_image() applied level after level, the way
+// SOIL_create_OGL_texture() builds its mip chains
+static vector<vector<unsigned char>> soilMipmaps(const unsigned char* pixels, int width,
+                                                 int height, int channels) {
+    vector<vector<unsigned char>> levels;
+    while (width > 1 || height > 1) {
+        int w = std::max(1, width / 2), h = std::max(1, height / 2);
+        levels.emplace_back(size_t(w) * h * channels);
+        mipmap_image(pixels, width, height, channels, levels.back().data(), 2, 2);
+        pixels = levels.back().data();
+        width = w;
+        height = h;
+    }
+    return levels;
+}
+
+// SOIL's mip chains against generateMipmaps() with its box and Kaiser
+// filters, on noisy synthetic images of 2K and 8K. The ratios are speedups
+// over SOIL, which filters in gamma space on one thread
+static void benchMips() {
+    struct Input {
+        int size, channels, runs;
+    };
+    const vector<Input> inputs = {{2048, 3, 5}, {2048, 4, 5}, {8192, 3, 2}};
+
+    for (const auto& input : inputs) {
+        vector<unsigned char> image(size_t(input.size) * input.size * input.channels);
+        unsigned int seed = 1;
+        for (size_t i = 0; i < image.size(); i++) {
+            seed = seed * 1103515245 + 12345;
+            size_t pixel = i / input.channels;
+            int x = static_cast<int>(pixel % input.size), y = static_cast<int>(pixel / input.size);
+            image[i] = static_cast<unsigned char>((x ^ y) + (seed >> 27));
+        }
+
+        double soil = bestOf(input.runs, [&]() {
+            soilMipmaps(image.data(), input.size, input.size, input.channels);
+        });
+        double box = bestOf(input.runs, [&]() {
+            generateMipmaps(image.data(), input.size, input.size, input.channels, MIP_BOX);
+        });
+        double kaiser = bestOf(input.runs, [&]() {
+            generateMipmaps(image.data(), input.size, input.size, input.channels, MIP_KAISER);
+        });
+
+        ostringstream line;
+        line << fixed << setprecision(1) << "mips " << input.size << "x" << input.size << " "
+            << input.channels << " channels: SOIL mipmap_image " << soil << " ms, box "
+            << box << " ms (" << setprecision(2) << soil / box << "x), kaiser "
+            << setprecision(1) << kaiser << " ms (" << setprecision(2) << soil / kaiser << "x)";
+        cout << line.str() << endl;
+    }
+}
+
+// The std::map based indexVBO() that the hash table replaced, as baseline
+struct PackedVertex {
+    vec3 position;
+    vec2 uv;
+    vec3 normal;
+    bool operator<(const PackedVertex& that) const {
+        return memcmp(this, &that, sizeof(PackedVertex)) > 0;
+    }
+};
+
+static void indexVBOWithMap(const vector<vec3>& vertices, const vector<vec2>& uvs,
+                            const vector<vec3>& normals, vector<unsigned int>& indices,
+                            vector<vec3>& outVertices, vector<vec2>& outUVs,
+                            vector<vec3>& outNormals) {
+    map<PackedVertex, unsigned int> vertexToIndex;
+    for (size_t i = 0; i < vertices.size(); i++) {
+        PackedVertex packed = {vertices[i], uvs[i], normals[i]};
+        auto it = vertexToIndex.find(packed);
+        if (it != vertexToIndex.end()) {
+            indices.push_back(it->second);
+            continue;
+        }
+        outVertices.push_back(vertices[i]);
+        outUVs.push_back(uvs[i]);
+        outNormals.push_back(normals[i]);
+        unsigned int index = static_cast<unsigned int>(outVertices.size() - 1);
+        indices.push_back(index);
+        vertexToIndex[packed] = index;
+    }
+}
+
+// The triangle soup of a size x size grid of quads, six corners per quad
+static void writeGridSoup(int size, vector<vec3>& vertices, vector<vec2>& uvs,
+                          vector<vec3>& normals) {
+    for (int y = 0; y < size; y++) {
+        for (int x = 0; x < size; x++) {
+            const int corners[6][2] = {{0, 0}, {1, 0}, {0, 1}, {1, 0}, {1, 1}, {0, 1}};
+            for (const auto& corner : corners) {
+                vec2 uv(float(x + corner[0]) / size, float(y + corner[1]) / size);
+                vertices.push_back(vec3(uv.x, 0.0f, uv.y));
+                uvs.push_back(uv);
+                normals.push_back(vec3(0.0f, 1.0f, 0.0f));
+            }
+        }
+    }
+}
+
+// indexVBO() against the std::map version on triangle soups of grids, six
+// corners per vertex, from 10k to 10M corners
+static void benchIndexVBO() {
+    for (int size : {41, 129, 408, 1291}) {
+        vector<vec3> vertices, normals;
+        vector<vec2> uvs;
+        writeGridSoup(size, vertices, uvs, normals);
+
+        int runs = vertices.size() > 1000000 ? 1 : 3;
+        vector<unsigned int> indices;
+        vector<vec3> outVertices, outNormals;
+        vector<vec2> outUVs;
+        auto clear = [&]() {
+            indices.clear();
+            outVertices.clear();
+            outUVs.clear();
+            outNormals.clear();
+        };
+        double hashed = bestOf(runs, [&]() {
+            clear();
+            indexVBO(vertices, uvs, normals, indices, outVertices, outUVs, outNormals);
+        });
+        vector<unsigned int> hashedIndices = indices;
+        double mapped = bestOf(runs, [&]() {
+            clear();
+            indexVBOWithMap(vertices, uvs, normals, indices, outVertices, outUVs, outNormals);
+        });
+
+        ostringstream line;
+        line << fixed << setprecision(2) << "indexvbo " << vertices.size() << " corners, "
+            << outVertices.size() << " vertices: map " << mapped << " ms, hash " << hashed
+            << " ms, " << mapped / hashed << "x faster"
+            << (indices == hashedIndices ? "" : ", DIFFERENT INDICES");
+        cout << line.str() << endl;
+    }
+}
+
+// weldVertices() against indexVBO() on the grid soups of benchIndexVBO(),
+// then on a copy whose positions are jittered by up to 1e-6, the noise of a
+// scan, welded exactly and on a 1e-4 grid
+static void benchWeld() {
+    unsigned int hardware = std::max(1u, thread::hardware_concurrency());
+    for (int size : {408, 1291}) {
+        vector<vec3> vertices, normals;
+        vector<vec2> uvs;
+        writeGridSoup(size, vertices, uvs, normals);
+
+        int runs = vertices.size() > 1000000 ? 1 : 3;
+        vector<unsigned int> indices;
+        vector<vec3> outVertices, outNormals;
+        vector<vec2> outUVs;
+        auto clear = [&]() {
+            indices.clear();
+            outVertices.clear();
+            outUVs.clear();
+            outNormals.clear();
+        };
+        double hashed = bestOf(runs, [&]() {
+            clear();
+            indexVBO(vertices, uvs, normals, indices, outVertices, outUVs, outNormals);
+        });
+        vector<unsigned int> hashedIndices = indices;
+        WeldStats stats{0, 0};
+        auto weld = [&](unsigned int threads) {
+            return bestOf(runs, [&]() {
+                clear();
+                stats = weldVertices(vertices, uvs, normals, indices, outVertices, outUVs,
+                                     outNormals, WeldOptions{0.0f, 0.0f, 0.0f, threads});
+            });
+        };
+        double welded[2] = {weld(1), weld(hardware)};
+
+        ostringstream line;
+        line << fixed << setprecision(2) << "weld grid " << stats.inputVertices << " corners: "
+            << stats.outputVertices << " vertices (" << 100.0f * stats.reduction()
+            << "% merged), indexVBO " << hashed << " ms, weldVertices " << welded[0]
+            << " ms on 1 thread, " << welded[1] << " ms on " << hardware << " threads"
+            << (indices == hashedIndices ? "" : ", DIFFERENT INDICES");
+        cout << line.str() << endl;
+
+        unsigned int seed = 1;
+        for (auto& v : vertices) {
+            for (int c = 0; c < 3; c++) {
+                seed = seed * 1103515245 + 12345;
+                v[c] += 1e-6f * ((seed >> 16) / 32768.0f - 1.0f);
+            }
+        }
+        WeldStats exact{0, 0}, snapped{0, 0};
+        double exactMs = bestOf(runs, [&]() {
+            clear();
+            exact = weldVertices(vertices, uvs, normals, indices, outVertices, outUVs,
+                                 outNormals);
+        });
+        double snappedMs = bestOf(runs, [&]() {
+            clear();
+            snapped = weldVertices(vertices, uvs, normals, indices, outVertices, outUVs,
+                                   outNormals, WeldOptions{1e-4f, 0.0f, 0.0f, 0});
+        });
+
+        line.str("");
+        line << fixed << setprecision(2) << "weld jittered grid " << exact.inputVertices
+            << " corners: exact " << exact.outputVertices << " vertices ("
+            << 100.0f * exact.reduction() << "% merged, " << exactMs << " ms), epsilon 1e-4 "
+            << snapped.outputVertices << " vertices (" << 100.0f * snapped.reduction()
+            << "% merged, " << snappedMs << " ms)";
+        cout << line.str() << endl;
+    }
+}
+
+// A hidden window whose GL 3.3 context is made current, for the sections
+// that upload
+static GLFWwindow* createHiddenContext() {
+    if (!glfwInit()) {
+        throw runtime_error("Failed to initialize GLFW\n");
+    }
+    glfwWindowHint(GLFW_VISIBLE, GL_FALSE);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+    glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
+    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+    GLFWwindow* window = glfwCreateWindow(64, 64, "bench", NULL, NULL);
+    if (window == NULL) {
+        glfwTerminate();
+        throw runtime_error("Failed to open GLFW window\n");
+    }
+    glfwMakeContextCurrent(window);
+    glewExperimental = GL_TRUE;
+    if (glewInit() != GLEW_OK) {
+        glfwTerminate();
+        throw runtime_error("Failed to initialize GLEW\n");
+    }
+    return window;
+}
+
+// The meshes of the Skinning_Animation scene, as createContext() loads them
+static const vector<string> SKINNING_SCENE = {
+    "models/sacrum.vtp", "models/pelvis.vtp", "models/l_pelvis.vtp", "models/femur.vtp",
+    "models/tibia.vtp", "models/fibula.vtp", "models/talus.vtp", "models/foot.vtp",
+    "models/bofoot.vtp", "models/hat_spine.vtp", "models/hat_jaw.vtp",
+    "models/hat_skull.vtp", "models/hat_ribs.vtp", "models/l_femur.vtp",
+    "models/l_tibia.vtp", "models/l_fibula.vtp", "models/l_talus.vtp", "models/l_foot.vtp",
+    "models/l_bofoot.vtp", "models/male.obj"
+};
+
+// loadVTP() as it was before it streamed the file: a tinyxml2 DOM of the
+// whole document, every DataArray read through a stringstream and a vector
+// per polygon, as baseline
+static MeshData loadVTPWithDOM(const string& path) {
+    tinyxml2::XMLDocument vtp;
+    if (vtp.LoadFile(path.c_str()) != tinyxml2::XML_SUCCESS) {
+        throw runtime_error("Failed to read " + path);
+    }
+    tinyxml2::XMLElement* piece =
+        vtp.FirstChildElement("VTKFile")->FirstChildElement("PolyData")->FirstChildElement("Piece");
+    auto dataArray = [&](const char* parent, bool last) {
+        tinyxml2::XMLElement* element = piece->FirstChildElement(parent);
+        element = last ? element->LastChildElement("DataArray")
+            : element->FirstChildElement("DataArray");
+        return stringstream(element->FirstChild()->Value());
+    };
+
+    vector<vec3> normals, coordinates;
+    vec3 v;
+    stringstream sNorm = dataArray("PointData", false);
+    while (sNorm >> v.x >> v.y >> v.z) normals.push_back(v);
+    stringstream sCoord = dataArray("Points", false);
+    while (sCoord >> v.x >> v.y >> v.z) coordinates.push_back(v);
+    vector<int> offsets, connectivity;
+    int value;
+    stringstream sOffsets = dataArray("Polys", true);
+    while (sOffsets >> value) offsets.push_back(value);
+    stringstream sConn = dataArray("Polys", false);
+    while (sConn >> value) connectivity.push_back(value);
+
+    MeshData mesh;
+    int start = 0;
+    for (int offset : offsets) {
+        vector<int> face(connectivity.begin() + start, connectivity.begin() + offset);
+        for (size_t i = 2; i < face.size(); i++) {
+            for (int corner : {face[0], face[i - 1], face[i]}) {
+                mesh.vertices.push_back(coordinates[corner]);
+                mesh.normals.push_back(normals[corner]);
+                mesh.indices.push_back(static_cast<unsigned int>(mesh.indices.size()));
+            }
+        }
+        start = offset;
+    }
+    return mesh;
+}
+
+// A triangle soup indexed with indexVBO(), the soup still allocated while
+// it runs, as Drawable did before the loaders kept the indices
+static MeshData indexSoup(MeshData soup) {
+    MeshData mesh;
+    indexVBO(soup.vertices, soup.uvs, soup.normals, mesh.indices, mesh.vertices, mesh.uvs,
+             mesh.normals);
+    return mesh;
+}
+
+// Peak heap memory of loading hat_spine.vtp, heart.obj and every bone of the
+// Skinning_Animation scene, against the bytes of the indexed meshes they
+// give: through the tinyxml2 DOM or tinyobjloader, through the streaming
+// loaders then indexVBO(), and through the loaders that keep the indices
+static void benchMemory() {
+    struct Loader {
+        const char* name;
+        MeshData (*load)(const string& path);
+    };
+    const Loader vtpLoaders[] = {
+        {"DOM + indexVBO", [](const string& path) { return indexSoup(loadVTPWithDOM(path)); }},
+        {"loadVTP + indexVBO", [](const string& path) { return indexSoup(loadVTP(path)); }},
+        {"loadVTPIndexed", [](const string& path) { return loadVTPIndexed(path); }}
+    };
+    const Loader objLoaders[] = {
+        {"loadOBJWithTiny + indexVBO",
+         [](const string& path) { return indexSoup(loadOBJWithTiny(path)); }},
+        {"loadOBJMapped + indexVBO",
+         [](const string& path) { return indexSoup(loadOBJMapped(path)); }},
+        {"loadOBJIndexed", [](const string& path) { return loadOBJIndexed(path, 1); }}
+    };
+
+    vector<string> bones;
+    for (const auto& path : SKINNING_SCENE) {
+        if (path.substr(path.size() - 4) == ".vtp") bones.push_back(path);
+    }
+    struct Input {
+        string name;
+        vector<string> paths;
+        const Loader* loaders;
+    };
+    const vector<Input> inputs = {
+        {"models/hat_spine.vtp", {"models/hat_spine.vtp"}, vtpLoaders},
+        {"../../Mesh_Manipulation/src/heart.obj", {"../../Mesh_Manipulation/src/heart.obj"},
+         objLoaders},
+        {to_string(bones.size()) + " bones", bones, vtpLoaders}
+    };
+
+    for (const auto& input : inputs) {
+        ostringstream line;
+        line << fixed << setprecision(1) << "memory " << input.name << ":";
+        for (int i = 0; i < 3; i++) {
+            const Loader& loader = input.loaders[i];
+            size_t output = 0;
+            size_t peak = peakBytesOf([&]() {
+                vector<MeshData> meshes;
+                for (const auto& path : input.paths) meshes.push_back(loader.load(path));
+                return meshes;
+            }, output);
+            if (i == 0) line << " indexed meshes " << output / 1024.0 << " KiB, peak";
+            line << (i == 0 ? " " : ", ") << loader.name << " " << peak / 1024.0 << " KiB ("
+                << setprecision(2) << double(peak) / output << "x)" << setprecision(1);
+        }
+        cout << line.str() << endl;
+    }
+}
+
+// Loading and uploading the drawables of the Skinning_Animation scene
+// without MeshCache, with a cold cache that is written, and with a warm one
+static void benchCache() {
+    auto removeCaches = []() {
+        for (const auto& path : SKINNING_SCENE) remove((path + ".drawable.meshcache").c_str());
+    };
+    auto loadScene = [&]() {
+        vector<unique_ptr<Drawable>> drawables;
+        for (const auto& path : SKINNING_SCENE) drawables.emplace_back(new Drawable(path));
+        glFinish();
+    };
+
+    removeCaches();
+    MeshCache::enabled = false;
+    double off = bestOf(5, loadScene);
+    MeshCache::enabled = true;
+    double cold = bestOf(5, [&]() {
+        removeCaches();
+        loadScene();
+    });
+    double warm = bestOf(5, loadScene);
+    removeCaches();
+
+    ostringstream line;
+    line << fixed << setprecision(2) << "cache Skinning_Animation scene ("
+        << SKINNING_SCENE.size() << " drawables): off " << off << " ms, cold " << cold
+        << " ms, warm " << warm << " ms, " << off / warm << "x faster warm";
+    cout << line.str() << endl;
+}
+
+// Triangles submitted without culling against the ones cullMeshlets() keeps,
+// along camera paths around heart.obj and male.obj: an orbit showing the
+// whole mesh, an orbit close enough to leave part of it off screen, and a
+// dolly from far away into the mesh
+static void benchMeshlets() {
+    const vector<string> inputs = {"../../Mesh_Manipulation/src/heart.obj", "models/male.obj"};
+    const int frames = 120;
+    const mat4 projection = perspective(radians(45.0f), 4.0f / 3.0f, 0.01f, 1000.0f);
+
+    for (const auto& path : inputs) {
+        // indexed and optimized the way Drawable loads it
+        MeshData mesh;
+        {
+            QuietCout quiet;
+            mesh = loadOBJIndexed(path);
+        }
+        optimizeMesh(mesh.indices, mesh.vertices, mesh.uvs, mesh.normals, path);
+        vector<Meshlet> meshlets = buildMeshlets(mesh.indices, mesh.vertices);
+
+        vec3 minimum = mesh.vertices[0], maximum = mesh.vertices[0];
+        for (const auto& v : mesh.vertices) {
+            minimum = min(minimum, v);
+            maximum = max(maximum, v);
+        }
+        vec3 center = (minimum + maximum) * 0.5f;
+        float radius = length(maximum - minimum) * 0.5f;
+
+        struct CameraPath {
+            const char* name;
+            vec3 (*eye)(float t, float radius);
+        };
+        const CameraPath paths[] = {
+            {"orbit", [](float t, float r) {
+                return vec3(sin(6.2831853f * t), 0.3f, cos(6.2831853f * t)) * 3.0f * r;
+            }},
+            {"close orbit", [](float t, float r) {
+                return vec3(sin(6.2831853f * t), 0.1f, cos(6.2831853f * t)) * 0.6f * r;
+            }},
+            {"dolly", [](float t, float r) {
+                return vec3(0.2f, 0.1f, 1.0f) * mix(6.0f, 0.3f, t) * r;
+            }}
+        };
+
+        for (const auto& cameraPath : paths) {
+            size_t submitted = 0, visible = 0, ranges = 0;
+            double cullMs = 0.0;
+            MeshletDrawList draws;
+            for (int frame = 0; frame < frames; frame++) {
+                float t = float(frame) / (frames - 1);
+                mat4 view = lookAt(center + cameraPath.eye(t, radius), center, vec3(0, 1, 0));
+                auto start = chrono::steady_clock::now();
+                MeshletStats stats = cullMeshlets(meshlets, view, projection,
+                                                  sizeof(unsigned int), true, draws);
+                cullMs += chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+                submitted += stats.triangles;
+                visible += stats.visibleTriangles;
+                ranges += stats.ranges;
+            }
+
+            ostringstream line;
+            line << fixed << setprecision(1) << "meshlets " << path << " " << cameraPath.name
+                << " (" << meshlets.size() << " meshlets, " << frames << " frames): "
+                << submitted / frames << " triangles submitted, " << visible / frames
+                << " visible (" << 100.0 * visible / submitted << "%), " << double(ranges) / frames
+                << " draws, cull " << setprecision(3) << cullMs / frames << " ms per frame";
+            cout << line.str() << endl;
+        }
+    }
+}
+
+// Compiles and links a program of a vertex and a fragment shader source
+static GLuint compileProgram(const char* vertexSource, const char* fragmentSource) {
+    GLuint program = glCreateProgram();
+    for (auto shader : {make_pair(GL_VERTEX_SHADER, vertexSource),
+                        make_pair(GL_FRAGMENT_SHADER, fragmentSource)}) {
+        GLuint id = glCreateShader(shader.first);
+        glShaderSource(id, 1, &shader.second, NULL);
+        glCompileShader(id);
+        GLint compiled;
+        glGetShaderiv(id, GL_COMPILE_STATUS, &compiled);
+        if (!compiled) throw runtime_error("Failed to compile a shader of the layout bench");
+        glAttachShader(program, id);
+        glDeleteShader(id);
+    }
+    glLinkProgram(program);
+    return program;
+}
+
+// A color and depth framebuffer of width x height with depth testing,
+// bound and set as viewport while in scope
+struct OffscreenTarget {
+    GLuint framebuffer, renderbuffers[2];
+
+    OffscreenTarget(int width, int height) {
+        glGenFramebuffers(1, &framebuffer);
+        glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+        glGenRenderbuffers(2, renderbuffers);
+        glBindRenderbuffer(GL_RENDERBUFFER, renderbuffers[0]);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, renderbuffers[0]);
+        glBindRenderbuffer(GL_RENDERBUFFER, renderbuffers[1]);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, renderbuffers[1]);
+        glViewport(0, 0, width, height);
+        glEnable(GL_DEPTH_TEST);
+    }
+
+    ~OffscreenTarget() {
+        glDisable(GL_DEPTH_TEST);
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        glDeleteFramebuffers(1, &framebuffer);
+        glDeleteRenderbuffers(2, renderbuffers);
+    }
+};
+
+// Vertex fetch bound draws, the wireframes of heart.obj and male.obj drawn
+// from one VBO per attribute against an interleaved VBO, into a small
+// offscreen target so rasterization costs little
+static void benchLayout() {
+    const char* vertexShader =
+        "#version 330 core\n"
+        "layout(location = 0) in vec3 position;\n"
+        "layout(location = 1) in vec3 normal;\n"
+        "layout(location = 2) in vec2 uv;\n"
+        "uniform mat4 MVP;\n"
+        "out vec3 color;\n"
+        "void main() {\n"
+        "    gl_Position = MVP * vec4(position, 1.0);\n"
+        "    color = abs(normal) * 0.5 + vec3(uv, 0.0) * 0.5;\n"
+        "}\n";
+    const char* fragmentShader =
+        "#version 330 core\n"
+        "in vec3 color;\n"
+        "out vec4 fragment;\n"
+        "void main() { fragment = vec4(color, 1.0); }\n";
+    GLuint program = compileProgram(vertexShader, fragmentShader);
+
+    const int width = 128, height = 96;
+    OffscreenTarget target(width, height);
+    glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
+    glUseProgram(program);
+
+    const vector<string> inputs = {"../../Mesh_Manipulation/src/heart.obj", "models/male.obj"};
+    for (const auto& path : inputs) {
+        MeshData mesh;
+        {
+            QuietCout quiet;
+            mesh = loadOBJIndexed(path);
+        }
+        optimizeMesh(mesh.indices, mesh.vertices, mesh.uvs, mesh.normals, path);
+        if (mesh.uvs.empty()) mesh.uvs.assign(mesh.vertices.size(), vec2(0.0f));
+
+        vec3 minimum = mesh.vertices[0], maximum = mesh.vertices[0];
+        for (const auto& v : mesh.vertices) {
+            minimum = min(minimum, v);
+            maximum = max(maximum, v);
+        }
+        float radius = length(maximum - minimum) * 0.5f;
+        vec3 center = (minimum + maximum) * 0.5f;
+        mat4 mvp = perspective(radians(45.0f), float(width) / height, 0.1f * radius, 10.0f * radius) *
+            lookAt(center + vec3(0.0f, 0.0f, 3.0f * radius), center, vec3(0.0f, 1.0f, 0.0f));
+        glUniformMatrix4fv(glGetUniformLocation(program, "MVP"), 1, GL_FALSE, &mvp[0][0]);
+
+        // the same indices drawn from both layouts
+        GLuint vaos[2], buffers[5];
+        glGenVertexArrays(2, vaos);
+        glGenBuffers(5, buffers);
+        glBindVertexArray(vaos[0]);
+        glBindBuffer(GL_ARRAY_BUFFER, buffers[0]);
+        VertexFormat<PositionAttribute>::upload(mesh.vertices);
+        glBindBuffer(GL_ARRAY_BUFFER, buffers[1]);
+        VertexFormat<NormalAttribute>::upload(mesh.normals);
+        glBindBuffer(GL_ARRAY_BUFFER, buffers[2]);
+        VertexFormat<UVAttribute>::upload(mesh.uvs);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, buffers[4]);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, mesh.indices.size() * sizeof(unsigned int),
+                     mesh.indices.data(), GL_STATIC_DRAW);
+        glBindVertexArray(vaos[1]);
+        glBindBuffer(GL_ARRAY_BUFFER, buffers[3]);
+        VertexFormat<PositionAttribute, NormalAttribute, UVAttribute>::upload(
+            mesh.vertices, mesh.normals, mesh.uvs);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, buffers[4]);
+
+        double times[2];
+        for (int layout = 0; layout < 2; layout++) {
+            glBindVertexArray(vaos[layout]);
+            times[layout] = bestOf(10, [&]() {
+                glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+                for (int i = 0; i < 20; i++) {
+                    glDrawElements(GL_TRIANGLES, static_cast<GLsizei>(mesh.indices.size()),
+                                   GL_UNSIGNED_INT, NULL);
+                }
+                glFinish();
+            });
+        }
+        glBindVertexArray(0);
+        glDeleteVertexArrays(2, vaos);
+        glDeleteBuffers(5, buffers);
+
+        ostringstream line;
+        line << fixed << setprecision(2) << "layout " << path << " (" << mesh.vertices.size()
+            << " vertices, 20 wireframe draws per frame): separate " << times[0]
+            << " ms, interleaved " << times[1] << " ms, " << times[0] / times[1] << "x";
+        cout << line.str() << endl;
+    }
+
+    glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+    glDeleteProgram(program);
+}
+
+// Triangles submitted and frame times for a crowd of skeletons, the meshes
+// of SKINNING_SCENE with the default LODs, spread along a depth range in
+// front of the camera, with LODSelection::enabled and without
+static void benchLODs() {
+    const char* vertexShader =
+        "#version 330 core\n"
+        "layout(location = 0) in vec3 position;\n"
+        "uniform mat4 MVP;\n"
+        "void main() { gl_Position = MVP * vec4(position, 1.0); }\n";
+    const char* fragmentShader =
+        "#version 330 core\n"
+        "out vec4 fragment;\n"
+        "void main() { fragment = vec4(1.0); }\n";
+    GLuint program = compileProgram(vertexShader, fragmentShader);
+    GLint mvpLocation = glGetUniformLocation(program, "MVP");
+
+    const int width = 320, height = 240;
+    OffscreenTarget target(width, height);
+    glUseProgram(program);
+
+    bool cache = MeshCache::enabled, lodsEnabled = LODSelection::enabled;
+    MeshCache::enabled = false;
+    vector<unique_ptr<Drawable>> skeleton;
+    size_t fullTriangles = 0;
+    {
+        QuietCout quiet;
+        for (const auto& path : SKINNING_SCENE) {
+            skeleton.emplace_back(new Drawable(path));
+            skeleton.back()->generateLODs();
+            fullTriangles += skeleton.back()->lods[0].count / 3;
+        }
+    }
+    const mat4 projection = perspective(radians(45.0f), float(width) / height, 0.1f, 1000.0f);
+    const mat4 view = lookAt(vec3(0.0f, 1.0f, 0.0f), vec3(0.0f, 1.0f, -1.0f), vec3(0, 1, 0));
+
+    struct Crowd {
+        int skeletons;
+        float nearest, farthest;
+    };
+    const vector<Crowd> crowds = {{25, 2.0f, 20.0f}, {100, 2.0f, 100.0f}, {400, 5.0f, 400.0f}};
+    for (const auto& crowd : crowds) {
+        // five abreast, rows evenly spaced in depth, spread with it
+        vector<mat4> models;
+        for (int i = 0; i < crowd.skeletons; i++) {
+            int rows = (crowd.skeletons + 4) / 5;
+            float depth = mix(crowd.nearest, crowd.farthest, float(i / 5) / std::max(1, rows - 1));
+            models.push_back(translate(mat4(), vec3(0.25f * depth * (i % 5 - 2), 0.0f, -depth)));
+        }
+
+        size_t triangles[2] = {0, 0};
+        double ms[2];
+        for (int enabled = 0; enabled < 2; enabled++) {
+            LODSelection::enabled = enabled != 0;
+            ms[enabled] = bestOf(5, [&]() {
+                triangles[enabled] = 0;
+                glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+                for (const auto& model : models) {
+                    for (const auto& d : skeleton) {
+                        mat4 modelView = view * model;
+                        unsigned int lod = d->selectLOD(modelView, projection);
+                        mat4 mvp = projection * modelView * d->dequantization;
+                        glUniformMatrix4fv(mvpLocation, 1, GL_FALSE, &mvp[0][0]);
+                        d->bind();
+                        d->draw(GL_TRIANGLES, lod);
+                        triangles[enabled] += d->lods[lod].count / 3;
+                    }
+                }
+                glFinish();
+            });
+        }
+
+        ostringstream line;
+        line << fixed << setprecision(2) << "lods " << crowd.skeletons << " skeletons at "
+            << setprecision(0) << crowd.nearest << " to " << crowd.farthest << " m ("
+            << fullTriangles << " triangles each): full detail " << triangles[0]
+            << " triangles " << setprecision(2) << ms[0] << " ms, LODs " << triangles[1]
+            << " triangles (" << setprecision(1) << 100.0 * triangles[1] / triangles[0]
+            << "%) " << setprecision(2) << ms[1] << " ms, " << ms[0] / ms[1] << "x";
+        cout << line.str() << endl;
+    }
+
+    LODSelection::enabled = lodsEnabled;
+    MeshCache::enabled = cache;
+    glBindVertexArray(0);
+    glDeleteProgram(program);
+}
+
+// count shapes, each a patch of 8 x 8 quads with its own group, using the
+// materials of an .mtl in turn, like a scene exported object by object
+static void writeSceneOBJ(const string& path, const string& mtlPath, int count,
+                          int materials) {
+    ofstream mtl(mtlPath);
+    for (int i = 0; i < materials; i++) {
+        mtl << "newmtl color" << i << "\nKa 0 0 0\nKd " << float(i % 2) << " "
+            << float(i / 2 % 2) << " " << float(i / 4 % 2) << "\nKs 0 0 0\nNs 10\n\n";
+    }
+    ofstream out(path);
+    out << "mtllib " << mtlPath << "\n";
+    out << "vn 0 0 1\n";
+    const int size = 8;
+    for (int shape = 0; shape < count; shape++) {
+        float x0 = 1.1f * (shape % 32), y0 = 1.1f * (shape / 32);
+        for (int y = 0; y <= size; y++) {
+            for (int x = 0; x <= size; x++) {
+                float u = float(x) / size, v = float(y) / size;
+                out << "v " << x0 + u << " " << y0 + v << " 0\nvt " << u << " " << v << "\n";
+            }
+        }
+        out << "g shape" << shape << "\nusemtl color" << shape % materials << "\n";
+        int first = shape * (size + 1) * (size + 1) + 1;
+        for (int y = 0; y < size; y++) {
+            for (int x = 0; x < size; x++) {
+                int a = first + y * (size + 1) + x, b = a + 1, c = a + size + 1, d = c + 1;
+                out << "f " << a << "/" << a << "/1 " << b << "/" << b << "/1 " << c << "/" << c
+                    << "/1\nf " << b << "/" << b << "/1 " << d << "/" << d << "/1 " << c << "/"
+                    << c << "/1\n";
+            }
+        }
+    }
+}
+
+// Location of the diffuse color in the program of benchBatching()
+static GLint batchingDiffuseLocation = -1;
+
+// Material upload of benchBatching(), a uniform like the labs set
+static void uploadBatchingMaterial(const ogl::Material& mtl) {
+    glUniform4fv(batchingDiffuseLocation, 1, &mtl.Kd[0]);
+}
+
+// A scene of many shapes and few materials drawn mesh by mesh, a VAO bind,
+// material upload and draw each as ogl::Model did before it was packed,
+// against Model::draw(), which draws a batch per material
+static void benchBatching() {
+    const char* vertexShader =
+        "#version 330 core\n"
+        "layout(location = 0) in vec3 position;\n"
+        "uniform mat4 MVP;\n"
+        "void main() { gl_Position = MVP * vec4(position, 1.0); }\n";
+    const char* fragmentShader =
+        "#version 330 core\n"
+        "uniform vec4 Kd;\n"
+        "out vec4 fragment;\n"
+        "void main() { fragment = Kd; }\n";
+    GLuint program = compileProgram(vertexShader, fragmentShader);
+    batchingDiffuseLocation = glGetUniformLocation(program, "Kd");
+
+    const int width = 320, height = 240;
+    OffscreenTarget target(width, height);
+    glUseProgram(program);
+    mat4 mvp = ortho(0.0f, 35.2f, 0.0f, 26.4f, -1.0f, 1.0f);
+    glUniformMatrix4fv(glGetUniformLocation(program, "MVP"), 1, GL_FALSE, &mvp[0][0]);
+
+    const string obj = "bench_scene.obj", mtl = "bench_scene.mtl";
+    bool cache = MeshCache::enabled;
+    MeshCache::enabled = false;
+    for (int shapes : {64, 512}) {
+        const int materials = 8;
+        writeSceneOBJ(obj, mtl, shapes, materials);
+        unique_ptr<ogl::Model> model;
+        {
+            QuietCout quiet;
+            model.reset(new ogl::Model(obj, uploadBatchingMaterial));
+        }
+
+        // the same meshes with buffers of their own
+        vector<ogl::Mesh> meshes;
+        for (auto& mesh : model->meshes) {
+            MeshData data;
+            data.vertices = mesh.indexedVertices;
+            data.uvs = mesh.indexedUVS;
+            data.normals = mesh.indexedNormals;
+            data.indices = mesh.indices;
+            meshes.emplace_back(std::move(data), mesh.mtl);
+        }
+
+        const int frames = 20;
+        ogl::ModelDrawStats perMesh{0, 0, 0}, batched{0, 0, 0};
+        double perMeshMs = bestOf(5, [&]() {
+            for (int frame = 0; frame < frames; frame++) {
+                glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+                perMesh = ogl::ModelDrawStats{0, 0, 0};
+                for (auto& mesh : meshes) {
+                    mesh.bind();
+                    perMesh.vertexArrayBinds++;
+                    uploadBatchingMaterial(mesh.mtl);
+                    perMesh.materialUploads++;
+                    mesh.draw();
+                    perMesh.drawCalls++;
+                }
+            }
+            glFinish();
+        });
+        double batchedMs = bestOf(5, [&]() {
+            for (int frame = 0; frame < frames; frame++) {
+                glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+                batched = model->draw();
+            }
+            glFinish();
+        });
+
+        ostringstream line;
+        line << fixed << setprecision(2) << "batching " << shapes << " shapes, " << materials
+            << " materials: per mesh " << perMesh.drawCalls << " draws, "
+            << perMesh.vertexArrayBinds << " VAO binds, " << perMesh.materialUploads
+            << " material uploads, " << perMeshMs / frames << " ms per frame; batched "
+            << batched.drawCalls << " draws, " << batched.vertexArrayBinds << " VAO binds, "
+            << batched.materialUploads << " material uploads, " << batchedMs / frames
+            << " ms per frame, " << perMeshMs / batchedMs << "x";
+        cout << line.str() << endl;
+    }
+    MeshCache::enabled = cache;
+    remove(obj.c_str());
+    remove(mtl.c_str());
+    glBindVertexArray(0);
+    glDeleteProgram(program);
+}
+
+// The images of the labs that SOIL reads; water.bmp has a BITMAPV5HEADER
+// that its stb_image does not know
+static const vector<string> LAB_IMAGES = {
+    "../../Standard_Shading/src/earth_diffuse.jpg", "../../Standard_Shading/src/suzanne_diffuse.bmp",
+    "../../Standard_Shading/src/suzanne_specular.bmp", "../../Texture_Mapping/src/uvtemplate.bmp",
+    "../../Texture_Mapping/src/water2.bmp"
+};
+
+// A row of quads, one per image of LAB_IMAGES, each with its own material
+// textured by it
+static void writeTexturedOBJ(const string& path, const string& mtlPath) {
+    ofstream mtl(mtlPath);
+    ofstream out(path);
+    out << "mtllib " << mtlPath << "\n";
+    for (size_t i = 0; i < LAB_IMAGES.size(); i++) {
+        mtl << "newmtl image" << i << "\nKa 0 0 0\nKd 1 1 1\nKs 0 0 0\nNs 10\nmap_Kd "
+            << LAB_IMAGES[i] << "\n\n";
+        float x = 2.0f * i;
+        out << "v " << x << " 0 0\nv " << x + 1 << " 0 0\nv " << x + 1 << " 1 0\nv " << x
+            << " 1 0\n";
+    }
+    out << "vt 0 0\nvt 1 0\nvt 1 1\nvt 0 1\nvn 0 0 1\n";
+    for (size_t i = 0; i < LAB_IMAGES.size(); i++) {
+        size_t v = 4 * i + 1;
+        out << "usemtl image" << i << "\n";
+        out << "f " << v << "/1/1 " << v + 1 << "/2/1 " << v + 2 << "/3/1\n";
+        out << "f " << v << "/1/1 " << v + 2 << "/3/1 " << v + 3 << "/4/1\n";
+    }
+}
+
+// Loading earth_diffuse.jpg, the images of the labs one by one against
+// loadSOILTextures(), which decodes them in parallel, and an ogl::Model
+// whose materials use all of them. Textures are not block compressed
+static void benchTextures() {
+    const string obj = "bench_textures.obj", mtl = "bench_textures.mtl";
+    writeTexturedOBJ(obj, mtl);
+    bool compress = TextureCache::enabled, cache = MeshCache::enabled;
+    TextureCache::enabled = false;
+    MeshCache::enabled = false;
+
+    const string& earth = LAB_IMAGES[0];
+    int width = 0, height = 0;
+    double decode = bestOf(5, [&]() {
+        SOILImage image = decodeSOIL(earth.c_str());
+        width = image.width;
+        height = image.height;
+        SOIL_free_image_data(image.data);
+    });
+    double load = bestOf(5, [&]() {
+        GLuint texture = loadSOIL(earth.c_str());
+        glFinish();
+        glDeleteTextures(1, &texture);
+    });
+    ostringstream line;
+    line << fixed << setprecision(2) << "textures " << earth << " (" << width << "x" << height
+        << "): decodeSOIL " << decode << " ms, loadSOIL " << load << " ms";
+    cout << line.str() << endl;
+
+    double serial = bestOf(5, [&]() {
+        for (const auto& path : LAB_IMAGES) {
+            GLuint texture = loadSOIL(path.c_str());
+            glDeleteTextures(1, &texture);
+        }
+        glFinish();
+    });
+    double parallel = bestOf(5, [&]() {
+        vector<GLuint> textures = loadSOILTextures(LAB_IMAGES);
+        glFinish();
+        glDeleteTextures(static_cast<GLsizei>(textures.size()), textures.data());
+    });
+    double model = bestOf(5, [&]() {
+        ogl::Model scene(obj);
+        glFinish();
+    });
+    line.str("");
+    line << fixed << setprecision(2) << "textures " << LAB_IMAGES.size() << " images ("
+        << thread::hardware_concurrency() << " hardware threads): loadSOIL one by one "
+        << serial << " ms, loadSOILTextures " << parallel << " ms (" << serial / parallel
+        << "x), Model " << obj << " " << model << " ms";
+    cout << line.str() << endl;
+
+    TextureCache::enabled = compress;
+    MeshCache::enabled = cache;
+    remove(obj.c_str());
+    remove(mtl.c_str());
+}
+
+// A .glb of one indexed primitive with mesh's positions, normals, uvs and
+// 32 bit indices, each array in its own buffer view like exporters write
+// them, and a plain material
+static void writeGLB(const string& path, const MeshData& mesh) {
+    vector<unsigned char> bin;
+    ostringstream views, accessors, attributes;
+    int count = 0;
+    auto append = [&](const void* data, size_t size, size_t elements, GLenum componentType,
+                      const char* type, const string& bounds) {
+        while (bin.size() % 4) bin.push_back(0);
+        views << (count ? "," : "") << "{\"buffer\":0,\"byteOffset\":" << bin.size()
+            << ",\"byteLength\":" << size << "}";
+        accessors << (count ? "," : "") << "{\"bufferView\":" << count
+            << ",\"componentType\":" << componentType << ",\"count\":" << elements
+            << ",\"type\":\"" << type << "\"" << bounds << "}";
+        const unsigned char* bytes = static_cast<const unsigned char*>(data);
+        bin.insert(bin.end(), bytes, bytes + size);
+        return count++;
+    };
+
+    vec3 minimum = mesh.vertices[0], maximum = mesh.vertices[0];
+    for (const auto& v : mesh.vertices) {
+        minimum = min(minimum, v);
+        maximum = max(maximum, v);
+    }
+    ostringstream bounds;
+    bounds << setprecision(9) << ",\"min\":[" << minimum.x << "," << minimum.y << ","
+        << minimum.z << "],\"max\":[" << maximum.x << "," << maximum.y << "," << maximum.z
+        << "]";
+    attributes << "\"POSITION\":"
+        << append(mesh.vertices.data(), mesh.vertices.size() * sizeof(vec3),
+                  mesh.vertices.size(), GL_FLOAT, "VEC3", bounds.str());
+    if (!mesh.normals.empty()) {
+        attributes << ",\"NORMAL\":"
+            << append(mesh.normals.data(), mesh.normals.size() * sizeof(vec3),
+                      mesh.normals.size(), GL_FLOAT, "VEC3", "");
+    }
+    if (!mesh.uvs.empty()) {
+        attributes << ",\"TEXCOORD_0\":"
+            << append(mesh.uvs.data(), mesh.uvs.size() * sizeof(vec2), mesh.uvs.size(),
+                      GL_FLOAT, "VEC2", "");
+    }
+    int indices = append(mesh.indices.data(), mesh.indices.size() * sizeof(unsigned int),
+                         mesh.indices.size(), GL_UNSIGNED_INT, "SCALAR", "");
+    while (bin.size() % 4) bin.push_back(0);
+
+    ostringstream json;
+    json << "{\"asset\":{\"version\":\"2.0\"},\"scene\":0,\"scenes\":[{\"nodes\":[0]}],"
+        << "\"nodes\":[{\"mesh\":0}],\"meshes\":[{\"primitives\":[{\"attributes\":{"
+        << attributes.str() << "},\"indices\":" << indices << ",\"material\":0}]}],"
+        << "\"materials\":[{\"pbrMetallicRoughness\":{\"baseColorFactor\":[0.8,0.8,0.8,1]}}],"
+        << "\"buffers\":[{\"byteLength\":" << bin.size() << "}],\"bufferViews\":["
+        << views.str() << "],\"accessors\":[" << accessors.str() << "]}";
+    string text = json.str();
+    while (text.size() % 4) text += ' ';
+
+    // header, JSON chunk and BIN chunk, little endian like the hosts we run on
+    uint32_t header[5] = {0x46546C67, 2, uint32_t(12 + 8 + text.size() + 8 + bin.size()),
+                          uint32_t(text.size()), 0x4E4F534A};
+    uint32_t binHeader[2] = {uint32_t(bin.size()), 0x004E4942};
+    ofstream out(path, ios::binary);
+    out.write(reinterpret_cast<const char*>(header), sizeof(header));
+    out.write(text.data(), text.size());
+    out.write(reinterpret_cast<const char*>(binHeader), sizeof(binHeader));
+    out.write(reinterpret_cast<const char*>(bin.data()), bin.size());
+}
+
+// An ogl::Model of heart.obj, male.obj and the 512 x 512 grid against one of
+// the same indexed mesh written as a .glb, whose buffer views are uploaded
+// as they are from the mapping. The .obj is loaded without MeshCache and
+// with a warm one
+static void benchGLB() {
+    const string grid = "bench_grid.obj";
+    writeGridOBJ(grid, 512);
+    bool cache = MeshCache::enabled;
+    const vector<string> inputs = {"../../Mesh_Manipulation/src/heart.obj", "models/male.obj", grid};
+
+    for (const auto& path : inputs) {
+        const string glb = "bench_model.glb";
+        MeshData mesh;
+        {
+            QuietCout quiet;
+            mesh = loadOBJIndexed(path);
+        }
+        writeGLB(glb, mesh);
+        ifstream written(glb, ios::binary | ios::ate);
+        size_t glbSize = static_cast<size_t>(written.tellg());
+
+        MeshCache::enabled = false;
+        double obj = bestOf(3, [&]() {
+            ogl::Model model(path);
+            glFinish();
+        });
+        MeshCache::enabled = true;
+        remove((path + ".model.meshcache").c_str());
+        {
+            QuietCout quiet;
+            ogl::Model model(path);
+        }
+        double warm = bestOf(3, [&]() {
+            ogl::Model model(path);
+            glFinish();
+        });
+        remove((path + ".model.meshcache").c_str());
+        double binary = bestOf(3, [&]() {
+            ogl::Model model(glb);
+            glFinish();
+        });
+        remove(glb.c_str());
+
+        ostringstream line;
+        line << fixed << setprecision(2) << "glb " << path << " (" << mesh.vertices.size()
+            << " vertices, " << mesh.indices.size() / 3 << " triangles, .glb of "
+            << glbSize / 1024 << " KiB): Model .obj " << obj << " ms, warm MeshCache " << warm
+            << " ms, .glb " << binary << " ms, " << obj / binary << "x faster than .obj";
+        cout << line.str() << endl;
+    }
+    MeshCache::enabled = cache;
+    remove(grid.c_str());
+}
+
+int main(int argc, char* argv[]) {
+    vector<string> sections(argv + 1, argv + argc);
+    auto selected = [&](const string& name) {
+        if (sections.empty()) return true;
+        for (const auto& section : sections) {
+            if (section == name) return true;
+        }
+        return false;
+    };
+
+    if (selected("obj")) benchOBJ();
+    if (selected("threads")) benchThreads();
+    if (selected("indexvbo")) benchIndexVBO();
+    if (selected("weld")) benchWeld();
+    if (selected("meshlets")) benchMeshlets();
+    if (selected("mips")) benchMips();
+    if (selected("memory")) benchMemory();
+    if (selected("cache") || selected("layout") || selected("textures") || selected("glb") ||
+        selected("lods") || selected("batching")) {
+        GLFWwindow* window = createHiddenContext();
+        if (selected("cache")) benchCache();
+        if (selected("layout")) benchLayout();
+        if (selected("textures")) benchTextures();
+        if (selected("glb")) benchGLB();
+        if (selected("lods")) benchLODs();
+        if (selected("batching")) benchBatching();
+        glfwDestroyWindow(window);
+        glfwTerminate();
+    }
+    return 0;
+}
@@ -18,7 +18,11 @@
 #include <common/util.h>
 #include <common/camera.h>
 #include <common/model.h>
+#include <common/vertex.h>
 #include <common/skeleton.h>
+#include <common/loader.h>
+#include <common/geometry.h>
+#include <common/arena.h>
 
 using namespace std;
 using namespace glm;
@@ -49,10 +53,12 @@ GLuint LaLocation, LdLocation, LsLocation, lightPositionLocation, lightPowerLoca
 // material properties
 GLuint KdLocation, KsLocation, KaLocation, NsLocation;
 
-GLuint surfaceVAO, surfaceVerticesVBO, surfacesBoneIndecesVBO, maleBoneIndicesVBO;
+GLuint surfaceVAO, surfaceVerticesVBO, surfacesBoneIndecesVBO;
+typedef VertexAttribute<3, float> BoneIndexAttribute;
 Drawable *segment, *skeletonSkin;
 GLuint useSkinningLocation, boneTransformationsLocation;
 Skeleton* skeleton;
+AssetLoader* assets;
 
 struct Light {
     glm::vec4 La;
@@ -312,6 +318,14 @@ void createContext() {
     // and form a parent child relations. A joint is attached on a body.
     skeleton = new Skeleton(modelMatrixLocation, viewMatrixLocation, projectionMatrixLocation);
 
+    // The bones are registered first and streamed in by assets->start() while
+    // the main loop runs, quantized and simplified into LODs on the loading
+    // threads. Left bones are mirror images of the right ones and share their
+    // buffers, and the CPU copies are dropped once uploaded. Their buffers are
+    // moved into the geometry arena, so they are all drawn with one VAO
+    assets = new AssetLoader();
+    MeshLoadOptions boneOptions{true, {0.5f, 0.25f, 0.1f}, true, true, true};
+
     // Relation definitions between bodies and joints
 
     // pelvis root joint
@@ -320,9 +334,9 @@ void createContext() {
     skeleton->joints[JointName::BASE] = baseJoint;
 
     Body* pelvisBody = new Body();
-    pelvisBody->drawables.push_back(new Drawable("models/sacrum.vtp"));
-    pelvisBody->drawables.push_back(new Drawable("models/pelvis.vtp"));
-    pelvisBody->drawables.push_back(new Drawable("models/l_pelvis.vtp"));
+    pelvisBody->drawables.push_back(assets->addMesh("models/sacrum.vtp", boneOptions));
+    pelvisBody->drawables.push_back(assets->addMesh("models/pelvis.vtp", boneOptions));
+    pelvisBody->drawables.push_back(assets->addMesh("models/l_pelvis.vtp", boneOptions));
     pelvisBody->joint = baseJoint;
     skeleton->bodies[BodyName::PELVIS] = pelvisBody;
 
@@ -332,7 +346,7 @@ void createContext() {
     skeleton->joints[JointName::HIP_R] = hipR;
 
     Body* femurR = new Body();
-    femurR->drawables.push_back(new Drawable("models/femur.vtp"));
+    femurR->drawables.push_back(assets->addMesh("models/femur.vtp", boneOptions));
     femurR->joint = hipR;
     skeleton->bodies[BodyName::FEMUR_R] = femurR;
 
@@ -342,8 +356,8 @@ void createContext() {
     skeleton->joints[JointName::KNEE_R] = kneeR;
 
     Body* tibiaR = new Body();
-    tibiaR->drawables.push_back(new Drawable("models/tibia.vtp"));
-    tibiaR->drawables.push_back(new Drawable("models/fibula.vtp"));
+    tibiaR->drawables.push_back(assets->addMesh("models/tibia.vtp", boneOptions));
+    tibiaR->drawables.push_back(assets->addMesh("models/fibula.vtp", boneOptions));
     tibiaR->joint = kneeR;
     skeleton->bodies[BodyName::TIBIA_R] = tibiaR;
 
@@ -353,7 +367,7 @@ void createContext() {
     skeleton->joints[JointName::ANKLE_R] = ankleR;
 
     Body* talusR = new Body();
-    talusR->drawables.push_back(new Drawable("models/talus.vtp"));
+    talusR->drawables.push_back(assets->addMesh("models/talus.vtp", boneOptions));
     talusR->joint = ankleR;
     skeleton->bodies[BodyName::TALUS_R] = talusR;
 
@@ -363,7 +377,7 @@ void createContext() {
     skeleton->joints[JointName::SUBTALAR_R] = subtalarR;
 
     Body* calcnR = new Body();
-    calcnR->drawables.push_back(new Drawable("models/foot.vtp"));
+    calcnR->drawables.push_back(assets->addMesh("models/foot.vtp", boneOptions));
     calcnR->joint = subtalarR;
     skeleton->bodies[BodyName::CALCN_R] = calcnR;
 
@@ -373,7 +387,7 @@ void createContext() {
     skeleton->joints[JointName::MTP_R] = mtpR;
 
     Body* toesR = new Body();
-    toesR->drawables.push_back(new Drawable("models/bofoot.vtp"));
+    toesR->drawables.push_back(assets->addMesh("models/bofoot.vtp", boneOptions));
     toesR->joint = mtpR;
     skeleton->bodies[BodyName::TOES_R] = toesR;
 
@@ -383,10 +397,10 @@ void createContext() {
     skeleton->joints[JointName::BACK] = back;
 
     Body* torso = new Body();
-    torso->drawables.push_back(new Drawable("models/hat_spine.vtp"));
-    torso->drawables.push_back(new Drawable("models/hat_jaw.vtp"));
-    torso->drawables.push_back(new Drawable("models/hat_skull.vtp"));
-    torso->drawables.push_back(new Drawable("models/hat_ribs.vtp"));
+    torso->drawables.push_back(assets->addMesh("models/hat_spine.vtp", boneOptions));
+    torso->drawables.push_back(assets->addMesh("models/hat_jaw.vtp", boneOptions));
+    torso->drawables.push_back(assets->addMesh("models/hat_skull.vtp", boneOptions));
+    torso->drawables.push_back(assets->addMesh("models/hat_ribs.vtp", boneOptions));
     torso->joint = back;
     skeleton->bodies[BodyName::TORSO] = torso;
 
@@ -396,7 +410,7 @@ void createContext() {
     skeleton->joints[JointName::HIP_L] = hipL;
 
     Body* femurL = new Body();
-    femurL->drawables.push_back(new Drawable("models/l_femur.vtp"));
+    femurL->drawables.push_back(assets->addMesh("models/l_femur.vtp", boneOptions));
     femurL->joint = hipL;
     skeleton->bodies[BodyName::FEMUR_L] = femurL;
 
@@ -406,8 +420,8 @@ void createContext() {
     skeleton->joints[JointName::KNEE_L] = kneeL;
 
     Body* tibiaL = new Body();
-    tibiaL->drawables.push_back(new Drawable("models/l_tibia.vtp"));
-    tibiaL->drawables.push_back(new Drawable("models/l_fibula.vtp"));
+    tibiaL->drawables.push_back(assets->addMesh("models/l_tibia.vtp", boneOptions));
+    tibiaL->drawables.push_back(assets->addMesh("models/l_fibula.vtp", boneOptions));
     tibiaL->joint = kneeL;
     skeleton->bodies[BodyName::TIBIA_L] = tibiaL;
 
@@ -417,7 +431,7 @@ void createContext() {
     skeleton->joints[JointName::ANKLE_L] = ankleL;
 
     Body* talusL = new Body();
-    talusL->drawables.push_back(new Drawable("models/l_talus.vtp"));
+    talusL->drawables.push_back(assets->addMesh("models/l_talus.vtp", boneOptions));
     talusL->joint = ankleL;
     skeleton->bodies[BodyName::TALUS_L] = talusL;
 
@@ -427,7 +441,7 @@ void createContext() {
     skeleton->joints[JointName::SUBTALAR_L] = subtalarL;
 
     Body* calcnL = new Body();
-    calcnL->drawables.push_back(new Drawable("models/l_foot.vtp"));
+    calcnL->drawables.push_back(assets->addMesh("models/l_foot.vtp", boneOptions));
     calcnL->joint = subtalarL;
     skeleton->bodies[BodyName::CALCN_L] = calcnL;
 
@@ -437,32 +451,32 @@ void createContext() {
     skeleton->joints[JointName::MTP_L] = mtpL;
 
     Body* toesL = new Body();
-    toesL->drawables.push_back(new Drawable("models/l_bofoot.vtp"));
+    toesL->drawables.push_back(assets->addMesh("models/l_bofoot.vtp", boneOptions));
     toesL->joint = mtpL;
     skeleton->bodies[BodyName::TOES_L] = toesL;
 
-    // skin
+    // skin, the bone index of each vertex is interleaved with its attributes
     skeletonSkin = new Drawable("models/male.obj");
+    skeletonSkin->fillCPU();
     auto maleBoneIndices = calculateSkinningIndices();
-    glGenBuffers(1, &maleBoneIndicesVBO);
-    glBindBuffer(GL_ARRAY_BUFFER, maleBoneIndicesVBO);
-    glBufferData(GL_ARRAY_BUFFER, maleBoneIndices.size() * sizeof(float),
-                 &maleBoneIndices[0], GL_STATIC_DRAW);
-    glVertexAttribPointer(3, 1, GL_FLOAT, GL_FALSE, 0, NULL);
-    glEnableVertexAttribArray(3);
+    skeletonSkin->quantize<BoneIndexAttribute>(maleBoneIndices);
+    skeletonSkin->releaseCPU();
+    skeletonSkin->moveToArena();
+
+    assets->start(window);
 }
 
 void free() {
+    delete assets;
     delete segment;
     delete skeleton;
     delete skeletonSkin;
+    GeometryArena::destroy();
 
     glDeleteBuffers(1, &surfaceVAO);
     glDeleteVertexArrays(1, &surfaceVerticesVBO);
     glDeleteVertexArrays(1, &surfacesBoneIndecesVBO);
 
-    glDeleteVertexArrays(1, &maleBoneIndicesVBO);
-
     glDeleteProgram(shaderProgram);
     glfwTerminate();
 }
@@ -475,6 +489,14 @@ void mainLoop() {
 
         glUseProgram(shaderProgram);
 
+        // Bones that finished streaming in
+        static bool streaming = true;
+        if (assets->poll() && streaming) {
+            GeometryRegistry::report();
+            GeometryArena::report();
+            streaming = false;
+        }
+
         // Camera
         camera->update();
         mat4 projectionMatrix = camera->projectionMatrix;
@@ -523,7 +545,11 @@ void mainLoop() {
         glUniformMatrix4fv(projectionMatrixLocation, 1, GL_FALSE, &projectionMatrix[0][0]);
 
         // Bone transformations
+        // the skin positions are quantized, dequantize before skinning
         auto T = calculateSkinningTransformations(q);
+        for (auto& t : T) {
+            t = t * skeletonSkin->dequantization;
+        }
         glUniformMatrix4fv(boneTransformationsLocation, T.size(),
             GL_FALSE, &T[0][0][0]);
 
@@ -0,0 +1,132 @@
+// Reports the vertex cache efficiency of the meshes of the labs before and
+// after optimizeMesh(). Run it from src/ like the lab, optionally passing
+// the directories to scan instead of the asset folders of the four labs:
+//
+//   vertex_cache [--overdraw] [directory...]
+
+// Include C++ headers
+#include <algorithm>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <dirent.h>
+#include <sys/stat.h>
+#endif
+
+// Mesh loading and optimization
+#include <common/model.h>
+#include <common/optimize.h>
+
+using namespace std;
+
+// The .obj and .vtp files under directory, recursively
+static void findMeshes(const string& directory, vector<string>& paths) {
+    vector<string> entries;
+#ifdef _WIN32
+    WIN32_FIND_DATAA entry;
+    HANDLE find = FindFirstFileA((directory + "/*").c_str(), &entry);
+    if (find == INVALID_HANDLE_VALUE) return;
+    do {
+        entries.push_back(entry.cFileName);
+    } while (FindNextFileA(find, &entry));
+    FindClose(find);
+#else
+    DIR* dir = opendir(directory.c_str());
+    if (!dir) return;
+    while (dirent* entry = readdir(dir)) entries.push_back(entry->d_name);
+    closedir(dir);
+#endif
+    sort(entries.begin(), entries.end());
+
+    for (const string& name : entries) {
+        if (name == "." || name == "..") continue;
+        string path = directory + "/" + name;
+#ifdef _WIN32
+        bool isDirectory = (GetFileAttributesA(path.c_str()) & FILE_ATTRIBUTE_DIRECTORY) != 0;
+#else
+        struct stat status;
+        bool isDirectory = stat(path.c_str(), &status) == 0 && S_ISDIR(status.st_mode);
+#endif
+        if (isDirectory) {
+            findMeshes(path, paths);
+        } else if (name.size() > 4 && (name.compare(name.size() - 4, 4, ".obj") == 0 ||
+                                       name.compare(name.size() - 4, 4, ".vtp") == 0)) {
+            paths.push_back(path);
+        }
+    }
+}
+
+int main(int argc, char* argv[]) {
+    vector<string> directories;
+    MeshOptimizer::enabled = true;
+    MeshOptimizer::report = false;
+    for (int i = 1; i < argc; i++) {
+        string arg = argv[i];
+        if (arg == "--overdraw") {
+            MeshOptimizer::overdraw = true;
+        } else {
+            directories.push_back(arg);
+        }
+    }
+    if (directories.empty()) {
+        directories = {"../../Mesh_Manipulation/src", "../../Skinning_Animation/src",
+                       "../../Standard_Shading/src", "../../Texture_Mapping/src"};
+    }
+
+    vector<string> paths;
+    for (const auto& directory : directories) findMeshes(directory, paths);
+    if (paths.empty()) {
+        cerr << "No .obj or .vtp files found" << endl;
+        return 1;
+    }
+
+    size_t totalTriangles = 0, totalVertices = 0;
+    double totalBefore = 0.0, totalAfter = 0.0;
+    for (const auto& path : paths) {
+        MeshData mesh;
+        try {
+            bool obj = path.compare(path.size() - 4, 4, ".obj") == 0;
+            // the meshes as Drawable loads them, indexed in file order
+            mesh = obj ? loadOBJIndexed(path) : loadVTPIndexed(path);
+        } catch (const runtime_error& error) {
+            cerr << path << ": " << error.what() << endl;
+            continue;
+        }
+        if (mesh.indices.size() < 3) continue;
+
+        size_t triangles = mesh.indices.size() / 3;
+        VertexCacheStats before = analyzeVertexCache(mesh.indices, mesh.vertices.size());
+        optimizeMesh(mesh.indices, mesh.vertices, mesh.uvs, mesh.normals, path);
+        VertexCacheStats after = analyzeVertexCache(mesh.indices, mesh.vertices.size());
+
+        ostringstream line;
+        line << fixed << setprecision(3) << path << ": " << triangles << " triangles, "
+            << mesh.vertices.size() << " vertices, ACMR " << before.acmr << " -> "
+            << after.acmr << ", ATVR " << before.atvr << " -> " << after.atvr;
+        cout << line.str() << endl;
+
+        totalTriangles += triangles;
+        totalVertices += mesh.vertices.size();
+        totalBefore += before.acmr * triangles;
+        totalAfter += after.acmr * triangles;
+    }
+    if (totalTriangles == 0) return 1;
+
+    // transformed vertices over all meshes, per triangle and per vertex
+    ostringstream line;
+    line << fixed << setprecision(3) << "Total: " << totalTriangles << " triangles, "
+        << totalVertices << " vertices, ACMR " << totalBefore / totalTriangles << " -> "
+        << totalAfter / totalTriangles << ", ATVR " << totalBefore / totalVertices
+        << " -> " << totalAfter / totalVertices;
+    cout << line.str() << endl;
+    return 0;
+}
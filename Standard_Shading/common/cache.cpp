@@ -0,0 +1,317 @@
+#include <algorithm>
+#include <iostream>
+#include <fstream>
+#include <cstdio>
+#include <cstring>
+#include "cache.h"
+#include "optimize.h"
+
+using namespace glm;
+using namespace std;
+
+// Cache file layout, every field is little endian and 4-byte aligned:
+//   CacheHeader
+//   CacheRecord[meshCount]
+//   per mesh: interleaved vertices, indices padded to 4 bytes
+//   per material: 10 floats, then 4 texture names as length + padded bytes
+static const char CACHE_MAGIC[8] = {'O', 'G', 'L', 'M', 'E', 'S', 'H', '\0'};
+
+struct CacheHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t meshCount;
+    uint64_t hash;
+    uint32_t materialCount;
+    uint32_t reserved;
+};
+
+struct CacheRecord {
+    uint32_t vertexCount;
+    uint32_t indexCount;
+    uint32_t attributes;
+    uint32_t indexSize;
+    int32_t material;
+};
+
+enum CacheAttribute { CACHE_UVS = 1, CACHE_NORMALS = 2 };
+
+// Bytes per vertex of a mesh with these attributes
+static uint32_t vertexStride(uint32_t attributes) {
+    return sizeof(vec3) + (attributes & CACHE_NORMALS ? sizeof(vec3) : 0) +
+        (attributes & CACHE_UVS ? sizeof(vec2) : 0);
+}
+
+// The index at i of indices stored with size bytes each
+static uint32_t indexAt(const void* indices, uint32_t size, size_t i) {
+    const unsigned char* p = static_cast<const unsigned char*>(indices) + i * size;
+    if (size == 1) return *p;
+    if (size == 2) {
+        uint16_t index;
+        memcpy(&index, p, sizeof index);
+        return index;
+    }
+    uint32_t index;
+    memcpy(&index, p, sizeof index);
+    return index;
+}
+
+void CachedMesh::unpack(vector<vec3>& vertices, vector<vec2>& uvs, vector<vec3>& normals,
+                        vector<unsigned int>& indices) const {
+    const unsigned char* vertex = static_cast<const unsigned char*>(vertexData);
+    vertices.resize(vertexCount);
+    normals.resize(hasNormals ? vertexCount : 0);
+    uvs.resize(hasUVs ? vertexCount : 0);
+    for (uint32_t i = 0; i < vertexCount; i++, vertex += vertexStride) {
+        memcpy(&vertices[i], vertex, sizeof(vec3));
+        if (hasNormals) memcpy(&normals[i], vertex + sizeof(vec3), sizeof(vec3));
+        if (hasUVs) memcpy(&uvs[i], vertex + vertexStride - sizeof(vec2), sizeof(vec2));
+    }
+    indices.resize(indexCount);
+    for (uint32_t i = 0; i < indexCount; i++) indices[i] = indexAt(indexData, indexSize, i);
+}
+
+bool MeshCache::enabled = true;
+
+// Names listed by the mtllib statements of an .obj file. Like the loaders,
+// they are opened relative to the working directory.
+static vector<string> materialLibraries(const char* p, const char* end) {
+    vector<string> names;
+    while (p < end) {
+        const char* eol = static_cast<const char*>(memchr(p, '\n', end - p));
+        if (!eol) eol = end;
+        while (p != eol && (*p == ' ' || *p == '\t')) p++;
+        if (eol - p >= 7 && strncmp(p, "mtllib", 6) == 0 && (p[6] == ' ' || p[6] == '\t')) {
+            const char* name = p + 7;
+            while (name != eol) {
+                while (name != eol && (*name == ' ' || *name == '\t' || *name == '\r')) name++;
+                const char* last = name;
+                while (last != eol && *last != ' ' && *last != '\t' && *last != '\r') last++;
+                if (last != name) names.emplace_back(name, last);
+                name = last;
+            }
+        }
+        p = eol + 1;
+    }
+    return names;
+}
+
+MeshCache::MeshCache(const string& source, const string& kind)
+    : path{source + "." + kind + ".meshcache"}, hash{0} {
+    if (!enabled || !fileExists(source)) return;
+    {
+        MappedFile contents(source);
+        hash = hashBytes(contents.begin(), contents.size(), MESH_CACHE_VERSION);
+
+        // the materials are cached too, so editing a .mtl file, or creating
+        // a missing one, invalidates the cache
+        if (source.size() >= 4 && source.compare(source.size() - 4, 4, ".obj") == 0) {
+            for (const string& name : materialLibraries(contents.begin(), contents.end())) {
+                hash = hashBytes(name.data(), name.size(), hash);
+                if (!fileExists(name)) continue;
+                try {
+                    MappedFile library(name);
+                    hash = hashBytes(library.begin(), library.size(), hash);
+                } catch (const runtime_error&) {
+                }
+            }
+        }
+
+        // and the meshes are stored as optimizeMesh() reordered them
+        const uint32_t settings = (MeshOptimizer::enabled ? 1 : 0) | (MeshOptimizer::overdraw ? 2 : 0);
+        hash = hashBytes(&settings, sizeof settings, hash);
+    }
+    if (!fileExists(path)) return;
+
+    try {
+        file.reset(new MappedFile(path));
+    } catch (const runtime_error&) {
+        return;
+    }
+    if (!read()) {
+        file.reset();
+        cachedMeshes.clear();
+        cachedMaterials.clear();
+    }
+}
+
+// Bounds checked cursor over the mapped cache
+struct CacheReader {
+    const char* p;
+    const char* end;
+
+    const void* take(size_t bytes) {
+        if (bytes > static_cast<size_t>(end - p)) return nullptr;
+        const char* data = p;
+        p += bytes;
+        return data;
+    }
+
+    bool readString(string& s) {
+        const void* length = take(sizeof(uint32_t));
+        if (!length) return false;
+        uint32_t n;
+        memcpy(&n, length, sizeof n);
+        const char* data = static_cast<const char*>(take((size_t(n) + 3) & ~size_t(3)));
+        if (!data) return false;
+        s.assign(data, n);
+        return true;
+    }
+};
+
+bool MeshCache::read() {
+    CacheReader reader{file->begin(), file->end()};
+    const CacheHeader* header = static_cast<const CacheHeader*>(reader.take(sizeof(CacheHeader)));
+    if (!header || memcmp(header->magic, CACHE_MAGIC, sizeof CACHE_MAGIC) != 0 ||
+        header->version != MESH_CACHE_VERSION || header->hash != hash) {
+        return false;
+    }
+
+    const CacheRecord* records = static_cast<const CacheRecord*>(
+        reader.take(size_t(header->meshCount) * sizeof(CacheRecord)));
+    if (!records) return false;
+
+    for (uint32_t i = 0; i < header->meshCount; i++) {
+        const CacheRecord& record = records[i];
+        if (record.material >= static_cast<int64_t>(header->materialCount)) return false;
+        if (record.indexSize != 1 && record.indexSize != 2 && record.indexSize != 4) return false;
+        CachedMesh mesh{};
+        mesh.vertexCount = record.vertexCount;
+        mesh.indexCount = record.indexCount;
+        mesh.vertexStride = vertexStride(record.attributes);
+        mesh.indexSize = record.indexSize;
+        mesh.hasUVs = (record.attributes & CACHE_UVS) != 0;
+        mesh.hasNormals = (record.attributes & CACHE_NORMALS) != 0;
+        mesh.material = record.material;
+        mesh.vertexData = reader.take(size_t(mesh.vertexCount) * mesh.vertexStride);
+        mesh.indexData = reader.take((size_t(mesh.indexCount) * mesh.indexSize + 3) & ~size_t(3));
+        if (!mesh.vertexData || !mesh.indexData) return false;
+        for (uint32_t j = 0; j < mesh.indexCount; j++) {
+            if (indexAt(mesh.indexData, mesh.indexSize, j) >= mesh.vertexCount) return false;
+        }
+        cachedMeshes.push_back(mesh);
+    }
+
+    cachedMaterials.resize(header->materialCount);
+    for (auto& material : cachedMaterials) {
+        const float* values = static_cast<const float*>(reader.take(10 * sizeof(float)));
+        if (!values) return false;
+        copy(values, values + 3, material.ambient);
+        copy(values + 3, values + 6, material.diffuse);
+        copy(values + 6, values + 9, material.specular);
+        material.shininess = values[9];
+        if (!reader.readString(material.ambientTexture) ||
+            !reader.readString(material.diffuseTexture) ||
+            !reader.readString(material.specularTexture) ||
+            !reader.readString(material.highlightTexture)) {
+            return false;
+        }
+    }
+    return reader.p == reader.end;
+}
+
+static void writeString(ofstream& out, const string& s) {
+    static const char padding[4] = {};
+    uint32_t n = static_cast<uint32_t>(s.size());
+    out.write(reinterpret_cast<const char*>(&n), sizeof n);
+    out.write(s.data(), n);
+    out.write(padding, (4 - n % 4) % 4);
+}
+
+// The vertices of mesh as CachedMesh interleaves them
+static vector<char> interleaveVertices(const MeshView& mesh, uint32_t attributes) {
+    size_t stride = vertexStride(attributes);
+    vector<char> data(mesh.vertexCount * stride);
+    char* vertex = data.data();
+    for (uint32_t i = 0; i < mesh.vertexCount; i++, vertex += stride) {
+        memcpy(vertex, &mesh.vertices[i], sizeof(vec3));
+        if (mesh.normals) memcpy(vertex + sizeof(vec3), &mesh.normals[i], sizeof(vec3));
+        if (mesh.uvs) memcpy(vertex + stride - sizeof(vec2), &mesh.uvs[i], sizeof(vec2));
+    }
+    return data;
+}
+
+// The indices of mesh in size bytes each, padded to 4 bytes
+static vector<char> narrowIndices(const MeshView& mesh, uint32_t size) {
+    vector<char> data((size_t(mesh.indexCount) * size + 3) & ~size_t(3), 0);
+    for (uint32_t i = 0; i < mesh.indexCount; i++) {
+        uint32_t index = mesh.indices[i];
+        if (size == 1) {
+            data[i] = static_cast<char>(index);
+        } else if (size == 2) {
+            uint16_t narrow = static_cast<uint16_t>(index);
+            memcpy(&data[i * size], &narrow, size);
+        } else {
+            memcpy(&data[i * size], &index, size);
+        }
+    }
+    return data;
+}
+
+// The narrowest index size that holds the indices of mesh, by the same rule
+// as narrowIndexType()
+static uint32_t indexSize(const MeshView& mesh) {
+    uint32_t maximum = 0;
+    for (uint32_t i = 0; i < mesh.indexCount; i++) maximum = std::max(maximum, mesh.indices[i]);
+    return maximum <= 0xff ? 1 : maximum <= 0xffff ? 2 : 4;
+}
+
+void MeshCache::save(const vector<MeshView>& meshes,
+                     const vector<CachedMaterial>& materials) {
+    if (!enabled || hash == 0) return;
+
+    string temporary = path + ".tmp";
+    {
+        ofstream out(temporary, ios::binary | ios::trunc);
+        CacheHeader header{};
+        memcpy(header.magic, CACHE_MAGIC, sizeof CACHE_MAGIC);
+        header.version = MESH_CACHE_VERSION;
+        header.meshCount = static_cast<uint32_t>(meshes.size());
+        header.hash = hash;
+        header.materialCount = static_cast<uint32_t>(materials.size());
+        out.write(reinterpret_cast<const char*>(&header), sizeof header);
+
+        vector<CacheRecord> records;
+        for (const auto& mesh : meshes) {
+            CacheRecord record{mesh.vertexCount, mesh.indexCount, 0, indexSize(mesh), mesh.material};
+            if (mesh.uvs) record.attributes |= CACHE_UVS;
+            if (mesh.normals) record.attributes |= CACHE_NORMALS;
+            records.push_back(record);
+        }
+        out.write(reinterpret_cast<const char*>(records.data()),
+                  records.size() * sizeof(CacheRecord));
+        for (size_t i = 0; i < meshes.size(); i++) {
+            vector<char> vertices = interleaveVertices(meshes[i], records[i].attributes);
+            out.write(vertices.data(), vertices.size());
+            vector<char> indices = narrowIndices(meshes[i], records[i].indexSize);
+            out.write(indices.data(), indices.size());
+        }
+        for (const auto& material : materials) {
+            float values[10];
+            copy(material.ambient, material.ambient + 3, values);
+            copy(material.diffuse, material.diffuse + 3, values + 3);
+            copy(material.specular, material.specular + 3, values + 6);
+            values[9] = material.shininess;
+            out.write(reinterpret_cast<const char*>(values), sizeof values);
+            writeString(out, material.ambientTexture);
+            writeString(out, material.diffuseTexture);
+            writeString(out, material.specularTexture);
+            writeString(out, material.highlightTexture);
+        }
+        if (!out) {
+            cout << "Can't write mesh cache: " << temporary << endl;
+            out.close();
+            remove(temporary.c_str());
+            return;
+        }
+    }
+
+    // the old cache must be unmapped before it can be replaced
+    file.reset();
+    cachedMeshes.clear();
+    cachedMaterials.clear();
+    remove(path.c_str());
+    if (rename(temporary.c_str(), path.c_str()) != 0) {
+        cout << "Can't replace mesh cache: " << path << endl;
+        remove(temporary.c_str());
+    }
+}
@@ -0,0 +1,160 @@
+#include <algorithm>
+#include <iostream>
+#include "util.h"
+#include "model.h"
+#include "geometry.h"
+#include "arena.h"
+
+using namespace glm;
+using namespace std;
+
+uint64_t hashGeometry(
+    const vector<vec3>& positions, const vector<vec3>& normals,
+    const vector<vec2>& uvs, const vector<unsigned int>& indices, int mirrorAxis) {
+    vector<uint64_t> vertices(positions.size());
+    for (size_t i = 0; i < positions.size(); i++) {
+        vec3 position = positions[i];
+        vec3 normal = i < normals.size() ? normals[i] : vec3(0.0f);
+        if (mirrorAxis >= 0) {
+            position[mirrorAxis] = -position[mirrorAxis];
+            normal[mirrorAxis] = -normal[mirrorAxis];
+        }
+        vec2 uv = i < uvs.size() ? uvs[i] : vec2(0.0f);
+        float values[8] = {position.x, position.y, position.z, normal.x, normal.y, normal.z,
+                           uv.x, uv.y};
+        // -0 and 0 are the same coordinate, but not the same bytes
+        for (float& value : values) value += 0.0f;
+        vertices[i] = hashBytes(values, sizeof values);
+    }
+
+    uint64_t sum = 0;
+    for (size_t i = 0; i + 2 < indices.size(); i += 3) {
+        uint64_t corners[3] = {vertices[indices[i]], vertices[indices[i + 1]],
+                               vertices[indices[i + 2]]};
+        if (mirrorAxis >= 0) swap(corners[1], corners[2]);
+        // the same triangle starts at the same corner whatever its order
+        size_t first = min_element(corners, corners + 3) - corners;
+        uint64_t triangle[3] = {corners[first], corners[(first + 1) % 3],
+                                corners[(first + 2) % 3]};
+        sum += hashBytes(triangle, sizeof triangle);
+    }
+    uint64_t totals[2] = {indices.size() / 3, sum};
+    return hashBytes(totals, sizeof totals);
+}
+
+SharedGeometry::~SharedGeometry() {
+    if (vertexBlock) {
+        GeometryArena::free(vertexBlock);
+        GeometryArena::free(indexBlock);
+        return;
+    }
+    glDeleteBuffers(1, &vertexVBO);
+    glDeleteBuffers(1, &elementVBO);
+    glDeleteVertexArrays(1, &VAO);
+}
+
+/*****************************************************************************/
+
+map<uint64_t, weak_ptr<SharedGeometry>> GeometryRegistry::entries;
+size_t GeometryRegistry::releasedCpuBytes = 0;
+
+bool GeometryRegistry::share(Drawable& drawable) {
+    // the key hashes the indexed arrays
+    drawable.fillCPU();
+    for (auto entry = entries.begin(); entry != entries.end();) {
+        entry = entry->second.expired() ? entries.erase(entry) : next(entry);
+    }
+
+    uint64_t own = key(drawable, -1);
+    for (int axis = -1; axis < 3; axis++) {
+        auto found = entries.find(axis < 0 ? own : key(drawable, axis));
+        if (found == entries.end()) continue;
+        shared_ptr<SharedGeometry> geometry = found->second.lock();
+        use(drawable, geometry, geometry->dequantization, geometry->bounds, axis);
+        return true;
+    }
+    add(drawable, own);
+    return false;
+}
+
+void GeometryRegistry::share(Drawable& drawable, Drawable& source, int mirrorAxis) {
+    if (!source.geometry) share(source);
+    use(drawable, source.geometry, source.dequantization, source.bounds, mirrorAxis);
+}
+
+GeometryMemory GeometryRegistry::memory() {
+    GeometryMemory memory{0, 0, 0, 0, releasedCpuBytes};
+    for (const auto& entry : entries) {
+        shared_ptr<SharedGeometry> geometry = entry.second.lock();
+        if (!geometry) continue;
+        // not counting the pointer just locked
+        size_t users = geometry.use_count() - 1;
+        size_t bytes = geometry->vertexBytes + geometry->indexBytes;
+        memory.drawables += users;
+        memory.geometries++;
+        memory.gpuBytes += bytes;
+        memory.unsharedGpuBytes += bytes * users;
+    }
+    return memory;
+}
+
+void GeometryRegistry::report() {
+    GeometryMemory memory = GeometryRegistry::memory();
+    cout << "Shared geometry: " << memory.drawables << " drawables use "
+        << memory.geometries << " sets of buffers, GPU " << memory.unsharedGpuBytes
+        << " -> " << memory.gpuBytes << " bytes, released " << memory.releasedCpuBytes
+        << " bytes of CPU copies" << endl;
+}
+
+// Hash of the geometry of drawable and of what its buffers hold besides it
+uint64_t GeometryRegistry::key(const Drawable& drawable, int mirrorAxis) {
+    uint64_t format[2] = {drawable.vertexStride, drawable.lods.size()};
+    return hashBytes(format, sizeof format,
+                     hashGeometry(drawable.indexedVertices, drawable.indexedNormals,
+                                  drawable.indexedUVS, drawable.indices, mirrorAxis));
+}
+
+void GeometryRegistry::add(Drawable& drawable, uint64_t key) {
+    size_t vertexBytes = drawable.vertexBlock ? drawable.vertexBlock->size
+                                              : bufferSize(drawable.vertexVBO);
+    size_t indexBytes = drawable.indexBlock ? drawable.indexBlock->size
+                                            : bufferSize(drawable.elementVBO);
+    drawable.geometry.reset(new SharedGeometry{
+        key, drawable.VAO, drawable.vertexVBO, drawable.elementVBO, drawable.vertexBlock,
+        drawable.indexBlock, drawable.indexType, drawable.vertexStride, drawable.vertexSetup,
+        vertexBytes, indexBytes, drawable.dequantization, drawable.lods, drawable.bounds});
+    entries[key] = drawable.geometry;
+}
+
+void GeometryRegistry::use(Drawable& drawable, const shared_ptr<SharedGeometry>& geometry,
+                           const mat4& dequantization, vec4 bounds, int mirrorAxis) {
+    if (drawable.geometry == geometry) return;
+    if (!drawable.geometry && drawable.vertexBlock) {
+        GeometryArena::free(drawable.vertexBlock);
+        GeometryArena::free(drawable.indexBlock);
+    } else if (!drawable.geometry) {
+        glDeleteBuffers(1, &drawable.vertexVBO);
+        glDeleteBuffers(1, &drawable.elementVBO);
+        glDeleteVertexArrays(1, &drawable.VAO);
+    }
+    drawable.geometry = geometry;
+    drawable.VAO = geometry->VAO;
+    drawable.vertexVBO = geometry->vertexVBO;
+    drawable.elementVBO = geometry->elementVBO;
+    drawable.vertexBlock = geometry->vertexBlock;
+    drawable.indexBlock = geometry->indexBlock;
+    drawable.indexType = geometry->indexType;
+    drawable.vertexStride = geometry->vertexStride;
+    drawable.vertexSetup = geometry->vertexSetup;
+    drawable.lods = geometry->lods;
+    // they index the drawable's own triangle order
+    drawable.meshlets.clear();
+
+    mat4 mirror(1.0f);
+    if (mirrorAxis >= 0) {
+        mirror[mirrorAxis][mirrorAxis] = -1.0f;
+        bounds[mirrorAxis] = -bounds[mirrorAxis];
+    }
+    drawable.dequantization = mirror * dequantization;
+    drawable.bounds = bounds;
+}
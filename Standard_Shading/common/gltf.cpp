@@ -0,0 +1,521 @@
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include "gltf.h"
+
+using namespace glm;
+using namespace std;
+
+const JSONValue* JSONValue::find(const char* key) const {
+    for (const auto& member : members) {
+        if (member.first == key) return &member.second;
+    }
+    return nullptr;
+}
+
+double JSONValue::get(const char* key, double fallback) const {
+    const JSONValue* value = find(key);
+    return value && (value->type == NUMBER || value->type == BOOLEAN) ? value->number : fallback;
+}
+
+const vector<JSONValue>& JSONValue::array(const char* key) const {
+    static const vector<JSONValue> none;
+    const JSONValue* value = find(key);
+    return value && value->type == ARRAY ? value->items : none;
+}
+
+const JSONValue& JSONValue::at(const char* key, size_t index) const {
+    const vector<JSONValue>& items = array(key);
+    if (index >= items.size()) {
+        throw runtime_error(string("glTF ") + key + " " + to_string(index) + " is missing");
+    }
+    return items[index];
+}
+
+static const char* skipJSONSpaces(const char* p, const char* end) {
+    while (p < end && (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r')) p++;
+    return p;
+}
+
+// p is at the opening quote. \u escapes of the basic plane are written as
+// UTF-8, surrogate pairs are not joined
+static const char* parseJSONString(const char* p, const char* end, string& out) {
+    p++;
+    while (true) {
+        const char* run = p;
+        while (p < end && *p != '"' && *p != '\\') p++;
+        out.append(run, p);
+        if (p == end) throw runtime_error("Unterminated string in glTF JSON");
+        if (*p++ == '"') return p;
+        if (p == end) throw runtime_error("Unterminated string in glTF JSON");
+        char c = *p++;
+        switch (c) {
+        case 'b': out += '\b'; break;
+        case 'f': out += '\f'; break;
+        case 'n': out += '\n'; break;
+        case 'r': out += '\r'; break;
+        case 't': out += '\t'; break;
+        case 'u': {
+            if (end - p < 4) throw runtime_error("Malformed escape in glTF JSON");
+            unsigned int code = static_cast<unsigned int>(stoul(string(p, p + 4), nullptr, 16));
+            p += 4;
+            if (code < 0x80) {
+                out += static_cast<char>(code);
+            } else if (code < 0x800) {
+                out += static_cast<char>(0xc0 | code >> 6);
+                out += static_cast<char>(0x80 | (code & 0x3f));
+            } else {
+                out += static_cast<char>(0xe0 | code >> 12);
+                out += static_cast<char>(0x80 | (code >> 6 & 0x3f));
+                out += static_cast<char>(0x80 | (code & 0x3f));
+            }
+            break;
+        }
+        default: out += c;
+        }
+    }
+}
+
+static const char* parseJSONLiteral(const char* p, const char* end, const char* literal) {
+    size_t length = strlen(literal);
+    if (static_cast<size_t>(end - p) < length || strncmp(p, literal, length) != 0) {
+        throw runtime_error("Malformed glTF JSON");
+    }
+    return p + length;
+}
+
+// Integers are read exactly, for byte offsets past the precision of a float
+static const char* parseJSONNumber(const char* p, const char* end, double& number) {
+    const char* last = p;
+    bool integer = true;
+    while (last < end && (isdigit(static_cast<unsigned char>(*last)) || *last == '-' ||
+                          *last == '+' || *last == '.' || *last == 'e' || *last == 'E')) {
+        if (*last == '.' || *last == 'e' || *last == 'E') integer = false;
+        last++;
+    }
+    if (last == p) throw runtime_error("Malformed glTF JSON");
+    if (integer) {
+        bool negative = *p == '-';
+        double value = 0.0;
+        for (const char* digit = p + negative; digit < last; digit++) {
+            value = value * 10.0 + (*digit - '0');
+        }
+        number = negative ? -value : value;
+        return last;
+    }
+    float value;
+    if (parseFloat(p, last, value) != last) throw runtime_error("Malformed number in glTF JSON");
+    number = value;
+    return last;
+}
+
+static const char* parseJSON(const char* p, const char* end, JSONValue& value, int depth) {
+    p = skipJSONSpaces(p, end);
+    if (p == end) throw runtime_error("Unexpected end of glTF JSON");
+    if (depth > 64) throw runtime_error("glTF JSON nested too deep");
+    switch (*p) {
+    case '{':
+        value.type = JSONValue::OBJECT;
+        p = skipJSONSpaces(p + 1, end);
+        if (p < end && *p == '}') return p + 1;
+        while (true) {
+            p = skipJSONSpaces(p, end);
+            if (p == end || *p != '"') throw runtime_error("Malformed object in glTF JSON");
+            value.members.emplace_back();
+            p = parseJSONString(p, end, value.members.back().first);
+            p = skipJSONSpaces(p, end);
+            if (p == end || *p != ':') throw runtime_error("Malformed object in glTF JSON");
+            p = skipJSONSpaces(parseJSON(p + 1, end, value.members.back().second, depth + 1), end);
+            if (p < end && *p == ',') {
+                p++;
+            } else if (p < end && *p == '}') {
+                return p + 1;
+            } else {
+                throw runtime_error("Malformed object in glTF JSON");
+            }
+        }
+    case '[':
+        value.type = JSONValue::ARRAY;
+        p = skipJSONSpaces(p + 1, end);
+        if (p < end && *p == ']') return p + 1;
+        while (true) {
+            value.items.emplace_back();
+            p = skipJSONSpaces(parseJSON(p, end, value.items.back(), depth + 1), end);
+            if (p < end && *p == ',') {
+                p++;
+            } else if (p < end && *p == ']') {
+                return p + 1;
+            } else {
+                throw runtime_error("Malformed array in glTF JSON");
+            }
+        }
+    case '"':
+        value.type = JSONValue::STRING;
+        return parseJSONString(p, end, value.text);
+    case 't':
+        value.type = JSONValue::BOOLEAN;
+        value.number = 1.0;
+        return parseJSONLiteral(p, end, "true");
+    case 'f':
+        value.type = JSONValue::BOOLEAN;
+        return parseJSONLiteral(p, end, "false");
+    case 'n':
+        return parseJSONLiteral(p, end, "null");
+    default:
+        value.type = JSONValue::NUMBER;
+        return parseJSONNumber(p, end, value.number);
+    }
+}
+
+size_t glbIndex(const JSONValue& value) {
+    if (value.type != JSONValue::NUMBER || value.number < 0) {
+        throw runtime_error("Malformed index in glTF JSON");
+    }
+    return static_cast<size_t>(value.number);
+}
+
+size_t glbComponentSize(GLenum type) {
+    switch (type) {
+    case GL_BYTE: case GL_UNSIGNED_BYTE: return 1;
+    case GL_SHORT: case GL_UNSIGNED_SHORT: return 2;
+    case GL_UNSIGNED_INT: case GL_FLOAT: return 4;
+    }
+    throw runtime_error("Unknown glTF component type " + to_string(type));
+}
+
+static int glbComponents(const string& type) {
+    if (type == "SCALAR") return 1;
+    if (type == "VEC2") return 2;
+    if (type == "VEC3") return 3;
+    if (type == "VEC4") return 4;
+    throw runtime_error("Unsupported glTF accessor type " + type);
+}
+
+static uint32_t readGLBWord(const char* p) {
+    uint32_t word;
+    memcpy(&word, p, sizeof word);
+    return word;
+}
+
+static const uint32_t GLB_MAGIC = 0x46546c67;       // "glTF"
+static const uint32_t GLB_JSON_CHUNK = 0x4e4f534a;  // "JSON"
+static const uint32_t GLB_BIN_CHUNK = 0x004e4942;   // "BIN\0"
+
+GLBFile::GLBFile(const string& path) : file(path), bin(nullptr), binSize(0) {
+    const char* p = file.begin();
+    if (file.size() < 20 || readGLBWord(p) != GLB_MAGIC) {
+        throw runtime_error("Not a binary glTF file: " + path);
+    }
+    if (readGLBWord(p + 4) != 2) throw runtime_error("Only glTF 2.0 is supported: " + path);
+    size_t length = std::min<size_t>(readGLBWord(p + 8), file.size());
+
+    // the JSON chunk comes first, chunks of unknown types are skipped
+    bool hasJSON = false;
+    for (size_t offset = 12; offset + 8 <= length; ) {
+        size_t chunkLength = readGLBWord(p + offset);
+        uint32_t type = readGLBWord(p + offset + 4);
+        const char* data = p + offset + 8;
+        if (chunkLength > length - offset - 8) {
+            throw runtime_error("Truncated glTF chunk: " + path);
+        }
+        if (!hasJSON) {
+            if (type != GLB_JSON_CHUNK) throw runtime_error("glTF JSON chunk missing: " + path);
+            parseJSON(data, data + chunkLength, json, 0);
+            hasJSON = true;
+        } else if (type == GLB_BIN_CHUNK && !bin) {
+            bin = reinterpret_cast<const unsigned char*>(data);
+            binSize = chunkLength;
+        }
+        offset += 8 + chunkLength;
+    }
+    if (!hasJSON) throw runtime_error("glTF JSON chunk missing: " + path);
+}
+
+const unsigned char* GLBFile::bufferView(size_t index, size_t& size) const {
+    const JSONValue& view = json.at("bufferViews", index);
+    size_t buffer = static_cast<size_t>(view.get("buffer", 0));
+    if (buffer != 0 || !bin || json.at("buffers", 0).find("uri")) {
+        throw runtime_error("Only the binary chunk of a .glb can be read");
+    }
+    size_t offset = static_cast<size_t>(view.get("byteOffset", 0));
+    size = static_cast<size_t>(view.get("byteLength", 0));
+    if (offset > binSize || size > binSize - offset) {
+        throw runtime_error("glTF buffer view out of the binary chunk");
+    }
+    return bin + offset;
+}
+
+GLBAccessor GLBFile::accessor(size_t index) const {
+    const JSONValue& accessor = json.at("accessors", index);
+    if (accessor.find("sparse")) throw runtime_error("Sparse glTF accessors are not supported");
+    const JSONValue* view = accessor.find("bufferView");
+    if (!view) throw runtime_error("glTF accessors without a buffer view are not supported");
+    const JSONValue* type = accessor.find("type");
+
+    GLBAccessor result;
+    size_t viewSize;
+    result.view = glbIndex(*view);
+    const unsigned char* viewData = bufferView(result.view, viewSize);
+    result.componentType = static_cast<GLenum>(accessor.get("componentType", 0));
+    result.components = glbComponents(type ? type->text : string());
+    result.count = static_cast<size_t>(accessor.get("count", 0));
+    result.normalized = accessor.get("normalized", 0) != 0;
+    size_t elementSize = glbComponentSize(result.componentType) * result.components;
+    result.stride = static_cast<size_t>(json.at("bufferViews", result.view).get("byteStride", 0));
+    if (result.stride == 0) result.stride = elementSize;
+
+    result.offset = static_cast<size_t>(accessor.get("byteOffset", 0));
+    if (result.count > 0 && (result.offset > viewSize ||
+        (result.count - 1) * result.stride + elementSize > viewSize - result.offset)) {
+        throw runtime_error("glTF accessor out of its buffer view");
+    }
+    result.data = viewData + result.offset;
+    return result;
+}
+
+// One component as a float, normalized integers mapped to [0, 1] or [-1, 1]
+// like GL reads them
+static void readGLBComponent(const unsigned char* p, GLenum type, bool normalized, float& out) {
+    switch (type) {
+    case GL_FLOAT: memcpy(&out, p, sizeof out); return;
+    case GL_UNSIGNED_BYTE: out = normalized ? *p / 255.0f : *p; return;
+    case GL_BYTE: {
+        int8_t value = static_cast<int8_t>(*p);
+        out = normalized ? std::max(value / 127.0f, -1.0f) : value;
+        return;
+    }
+    case GL_UNSIGNED_SHORT: {
+        uint16_t value;
+        memcpy(&value, p, sizeof value);
+        out = normalized ? value / 65535.0f : value;
+        return;
+    }
+    case GL_SHORT: {
+        int16_t value;
+        memcpy(&value, p, sizeof value);
+        out = normalized ? std::max(value / 32767.0f, -1.0f) : value;
+        return;
+    }
+    }
+    throw runtime_error("glTF float attributes can not be unsigned int");
+}
+
+// One component of joint indices
+static void readGLBComponent(const unsigned char* p, GLenum type, bool, uint16_t& out) {
+    switch (type) {
+    case GL_UNSIGNED_BYTE: out = *p; return;
+    case GL_UNSIGNED_SHORT: memcpy(&out, p, sizeof out); return;
+    }
+    throw runtime_error("glTF joints must be unsigned bytes or shorts");
+}
+
+static GLenum glbComponentType(float) { return GL_FLOAT; }
+static GLenum glbComponentType(uint16_t) { return GL_UNSIGNED_SHORT; }
+
+// Copy an accessor into out. Tightly packed data of the type of T is copied
+// as it is, anything else is converted component by component
+template<typename T>
+static void readGLBAccessor(const GLBAccessor& accessor, vector<T>& out) {
+    typedef typename T::value_type Scalar;
+    const int components = static_cast<int>(sizeof(T) / sizeof(Scalar));
+    if (accessor.components != components) throw runtime_error("Unexpected type of glTF accessor");
+    out.resize(accessor.count);
+    if (accessor.componentType == glbComponentType(Scalar()) && accessor.stride == sizeof(T)) {
+        memcpy(out.data(), accessor.data, sizeof(T) * accessor.count);
+        return;
+    }
+    size_t componentSize = glbComponentSize(accessor.componentType);
+    for (size_t i = 0; i < accessor.count; i++) {
+        const unsigned char* element = accessor.data + i * accessor.stride;
+        for (int c = 0; c < components; c++) {
+            readGLBComponent(element + c * componentSize, accessor.componentType,
+                             accessor.normalized, out[i][c]);
+        }
+    }
+}
+
+static void readGLBIndices(const GLBAccessor& accessor, size_t vertexCount,
+                           vector<unsigned int>& out) {
+    if (accessor.components != 1) throw runtime_error("glTF indices must be scalars");
+    out.resize(accessor.count);
+    if (accessor.componentType == GL_UNSIGNED_INT && accessor.stride == sizeof(unsigned int)) {
+        memcpy(out.data(), accessor.data, sizeof(unsigned int) * accessor.count);
+    } else {
+        for (size_t i = 0; i < accessor.count; i++) {
+            const unsigned char* p = accessor.data + i * accessor.stride;
+            switch (accessor.componentType) {
+            case GL_UNSIGNED_BYTE: out[i] = *p; break;
+            case GL_UNSIGNED_SHORT: { uint16_t index; memcpy(&index, p, sizeof index); out[i] = index; break; }
+            default: throw runtime_error("glTF indices must be unsigned integers");
+            }
+        }
+    }
+    for (unsigned int index : out) {
+        if (index >= vertexCount) throw runtime_error("glTF index out of range");
+    }
+}
+
+// How GL reads an accessor with the given number of components as the
+// attribute at location
+static GLBAttribute glbAttribute(const GLBAccessor& accessor, GLuint location, int components) {
+    if (accessor.components != components) throw runtime_error("Unexpected type of glTF accessor");
+    if (accessor.componentType == GL_UNSIGNED_INT) {
+        throw runtime_error("glTF float attributes can not be unsigned int");
+    }
+    return GLBAttribute{location, components, accessor.componentType,
+                        static_cast<GLboolean>(accessor.normalized ? GL_TRUE : GL_FALSE),
+                        static_cast<GLsizei>(accessor.stride), accessor.view, accessor.offset};
+}
+
+GLBPrimitive describeGLBPrimitive(const GLBFile& file, const JSONValue& primitive) {
+    if (primitive.get("mode", GL_TRIANGLES) != GL_TRIANGLES) {
+        throw runtime_error("Only triangle glTF primitives are supported");
+    }
+    const JSONValue* attributes = primitive.find("attributes");
+    const JSONValue* position = attributes ? attributes->find("POSITION") : nullptr;
+    if (!position) throw runtime_error("glTF primitive without positions");
+
+    GLBPrimitive result{};
+    GLBAccessor positions = file.accessor(glbIndex(*position));
+    result.vertexCount = positions.count;
+    result.attributes.push_back(glbAttribute(positions, PositionAttribute::location, 3));
+    vector<GLBAccessor> accessors;
+    if (const JSONValue* normal = attributes->find("NORMAL")) {
+        accessors.push_back(file.accessor(glbIndex(*normal)));
+        result.attributes.push_back(glbAttribute(accessors.back(), NormalAttribute::location, 3));
+    }
+    if (const JSONValue* uv = attributes->find("TEXCOORD_0")) {
+        accessors.push_back(file.accessor(glbIndex(*uv)));
+        result.attributes.push_back(glbAttribute(accessors.back(), UVAttribute::location, 2));
+    }
+    const JSONValue* joints = attributes->find("JOINTS_0");
+    const JSONValue* weights = attributes->find("WEIGHTS_0");
+    if (joints && weights) {
+        accessors.push_back(file.accessor(glbIndex(*joints)));
+        GLenum type = accessors.back().componentType;
+        if (type != GL_UNSIGNED_BYTE && type != GL_UNSIGNED_SHORT) {
+            throw runtime_error("glTF joints must be unsigned bytes or shorts");
+        }
+        result.attributes.push_back(glbAttribute(accessors.back(), JointAttribute::location, 4));
+        accessors.push_back(file.accessor(glbIndex(*weights)));
+        result.attributes.push_back(glbAttribute(accessors.back(), WeightAttribute::location, 4));
+    }
+    for (const auto& accessor : accessors) {
+        if (accessor.count != result.vertexCount) throw runtime_error("glTF attributes differ in size");
+    }
+    double material = primitive.get("material", -1);
+    result.material = material >= 0 ? static_cast<int>(material) : -1;
+
+    const JSONValue* indices = primitive.find("indices");
+    if (!indices) return result;
+    GLBAccessor accessor = file.accessor(glbIndex(*indices));
+    if (accessor.components != 1) throw runtime_error("glTF indices must be scalars");
+    if (accessor.componentType != GL_UNSIGNED_BYTE && accessor.componentType != GL_UNSIGNED_SHORT &&
+        accessor.componentType != GL_UNSIGNED_INT) {
+        throw runtime_error("glTF indices must be unsigned integers");
+    }
+    // GL reads the indices tightly packed, which glTF requires of them too
+    if (accessor.stride != glbComponentSize(accessor.componentType)) {
+        throw runtime_error("glTF indices must be tightly packed");
+    }
+    for (size_t i = 0; i < accessor.count; i++) {
+        const unsigned char* p = accessor.data + i * accessor.stride;
+        size_t index = *p;
+        if (accessor.componentType == GL_UNSIGNED_SHORT) {
+            uint16_t value;
+            memcpy(&value, p, sizeof value);
+            index = value;
+        } else if (accessor.componentType == GL_UNSIGNED_INT) {
+            uint32_t value;
+            memcpy(&value, p, sizeof value);
+            index = value;
+        }
+        if (index >= result.vertexCount) throw runtime_error("glTF index out of range");
+    }
+    result.indexType = accessor.componentType;
+    result.indexCount = accessor.count;
+    result.indexView = accessor.view;
+    result.indexOffset = accessor.offset;
+    return result;
+}
+
+MeshData readGLBPrimitive(const GLBFile& file, const JSONValue& primitive) {
+    if (primitive.get("mode", GL_TRIANGLES) != GL_TRIANGLES) {
+        throw runtime_error("Only triangle glTF primitives are supported");
+    }
+    const JSONValue* attributes = primitive.find("attributes");
+    const JSONValue* position = attributes ? attributes->find("POSITION") : nullptr;
+    if (!position) throw runtime_error("glTF primitive without positions");
+
+    MeshData mesh;
+    readGLBAccessor(file.accessor(glbIndex(*position)), mesh.vertices);
+    size_t count = mesh.vertices.size();
+    if (const JSONValue* normal = attributes->find("NORMAL")) {
+        readGLBAccessor(file.accessor(glbIndex(*normal)), mesh.normals);
+    }
+    if (const JSONValue* uv = attributes->find("TEXCOORD_0")) {
+        readGLBAccessor(file.accessor(glbIndex(*uv)), mesh.uvs);
+    }
+    const JSONValue* joints = attributes->find("JOINTS_0");
+    const JSONValue* weights = attributes->find("WEIGHTS_0");
+    if (joints && weights) {
+        readGLBAccessor(file.accessor(glbIndex(*joints)), mesh.joints);
+        readGLBAccessor(file.accessor(glbIndex(*weights)), mesh.weights);
+    }
+    if ((!mesh.normals.empty() && mesh.normals.size() != count) ||
+        (!mesh.uvs.empty() && mesh.uvs.size() != count) ||
+        (!mesh.joints.empty() && (mesh.joints.size() != count || mesh.weights.size() != count))) {
+        throw runtime_error("glTF attributes differ in size");
+    }
+
+    if (const JSONValue* indices = primitive.find("indices")) {
+        readGLBIndices(file.accessor(glbIndex(*indices)), count, mesh.indices);
+    } else {
+        mesh.indices.resize(count);
+        for (size_t i = 0; i < count; i++) mesh.indices[i] = static_cast<unsigned int>(i);
+    }
+    return mesh;
+}
+
+// Append the vertices of a primitive; an attribute only some of them have is
+// zero for the others
+template<typename T>
+static void appendGLBAttribute(vector<T>& to, vector<T>& from, size_t base, size_t count) {
+    if (to.empty() && from.empty()) return;
+    to.resize(base, T(0));
+    if (from.empty()) {
+        to.resize(base + count, T(0));
+    } else {
+        to.insert(to.end(), from.begin(), from.end());
+    }
+}
+
+static void appendGLBPrimitive(MeshData& to, MeshData&& from) {
+    if (to.vertices.empty()) {
+        to = std::move(from);
+        return;
+    }
+    size_t base = to.vertices.size(), count = from.vertices.size();
+    appendGLBAttribute(to.normals, from.normals, base, count);
+    appendGLBAttribute(to.uvs, from.uvs, base, count);
+    appendGLBAttribute(to.joints, from.joints, base, count);
+    appendGLBAttribute(to.weights, from.weights, base, count);
+    to.vertices.insert(to.vertices.end(), from.vertices.begin(), from.vertices.end());
+    to.indices.reserve(to.indices.size() + from.indices.size());
+    for (unsigned int index : from.indices) {
+        to.indices.push_back(static_cast<unsigned int>(base) + index);
+    }
+}
+
+MeshData loadGLB(const string& path) {
+    GLBFile file(path);
+    MeshData mesh;
+    for (const JSONValue& gltfMesh : file.json.array("meshes")) {
+        for (const JSONValue& primitive : gltfMesh.array("primitives")) {
+            appendGLBPrimitive(mesh, readGLBPrimitive(file, primitive));
+        }
+    }
+    return mesh;
+}
+
@@ -0,0 +1,495 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <exception>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+#include "util.h"
+#include "geometry.h"
+#include "loader.h"
+#include <glfw3.h>
+#include <SOIL.h>
+
+using namespace glm;
+using namespace std;
+
+// Bounded multi-producer, single-consumer queue of job indices. A producer
+// claims a slot with one atomic increment and publishes it with a release
+// store; the consumer takes the slots in the order they were claimed. Every
+// job is pushed exactly once, so the capacity is the number of jobs
+class CompletionQueue {
+public:
+    CompletionQueue(size_t capacity)
+        : slots(capacity), ready(new atomic<bool>[capacity]), tail(0), head(0) {
+        for (size_t i = 0; i < capacity; i++) ready[i].store(false, memory_order_relaxed);
+    }
+
+    void push(size_t job) {
+        size_t slot = tail.fetch_add(1, memory_order_relaxed);
+        slots[slot] = job;
+        ready[slot].store(true, memory_order_release);
+    }
+
+    // Only called by the consumer
+    bool pop(size_t& job) {
+        if (head == slots.size() || !ready[head].load(memory_order_acquire)) return false;
+        job = slots[head++];
+        return true;
+    }
+
+private:
+    vector<size_t> slots;
+    unique_ptr<atomic<bool>[]> ready;
+    atomic<size_t> tail;
+    size_t head;
+};
+
+// State shared by the threads of load() or start()
+struct AssetLoader::Batch {
+    Batch(size_t count)
+        : loaded(count), uploaded(count), next(0), failed(false), context(nullptr),
+        vertexArray(0), handedOver(0), stats{} {
+    }
+
+    // Keep the exception being handled and stop loading
+    void fail() {
+        lock_guard<mutex> lock(errorMutex);
+        if (!error) error = current_exception();
+        failed = true;
+    }
+
+    vector<size_t> order;        // jobs by decreasing file size
+    CompletionQueue loaded;      // waiting to be uploaded
+    CompletionQueue uploaded;    // waiting for their fence, only with start()
+    atomic<size_t> next;
+    atomic<bool> failed;
+    exception_ptr error;
+    mutex errorMutex;
+    vector<thread> loaders;
+    thread uploader;
+    GLFWwindow* context;         // hidden window of the upload thread
+    GLuint vertexArray;          // bound while uploading, see upload()
+    map<uint64_t, Job*> geometries;  // of the jobs that upload their own buffers
+    mutex geometryMutex;
+    vector<size_t> fenced;       // uploaded, the GPU may not be done yet
+    size_t handedOver;
+    AssetLoadStats stats;
+    chrono::steady_clock::time_point start;
+};
+
+static double millisecondsSince(chrono::steady_clock::time_point start) {
+    return chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+}
+
+static size_t fileSize(const string& path) {
+    ifstream file(path, ios::binary | ios::ate);
+    return file ? static_cast<size_t>(file.tellg()) : 0;
+}
+
+AssetLoader::AssetLoader(unsigned int threads) : threads(threads) {
+}
+
+AssetLoader::~AssetLoader() {
+    if (!batch) return;
+    // the threads run out without loading anything else
+    batch->failed = true;
+    try {
+        finish();
+    } catch (...) {
+    }
+}
+
+Drawable* AssetLoader::addMesh(const string& path, const MeshLoadOptions& options) {
+    if (batch) throw runtime_error("AssetLoader is already streaming");
+    Drawable* drawable = new Drawable();
+    drawable->path = path;
+    Job job{};
+    job.path = path;
+    job.drawable = drawable;
+    job.loaded.reset(new Drawable());
+    job.loaded->path = path;
+    job.options = options;
+    jobs.push_back(std::move(job));
+    return drawable;
+}
+
+void AssetLoader::addTexture(const string& path, GLuint& texture) {
+    if (batch) throw runtime_error("AssetLoader is already streaming");
+    Job job{};
+    job.path = path;
+    job.texture = &texture;
+    // asked here, the loading threads have no GL context
+    job.compress = TextureCache::supported();
+    jobs.push_back(std::move(job));
+}
+
+AssetLoadStats AssetLoader::load() {
+    if (batch) throw runtime_error("AssetLoader is already streaming");
+    begin(nullptr);
+    uploadAll(false);
+    return finish();
+}
+
+void AssetLoader::start(GLFWwindow* window) {
+    if (batch) throw runtime_error("AssetLoader is already streaming");
+    glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+    GLFWwindow* context = glfwCreateWindow(1, 1, "", NULL, window);
+    glfwWindowHint(GLFW_VISIBLE, GLFW_TRUE);
+    if (context == NULL) {
+        throw runtime_error("Failed to create the upload context");
+    }
+
+    begin(context);
+    batch->uploader = thread([this]() {
+        glfwMakeContextCurrent(batch->context);
+        uploadAll(true);
+        glfwMakeContextCurrent(NULL);
+    });
+}
+
+bool AssetLoader::poll() {
+    if (!batch) return true;
+    Batch& b = *batch;
+
+    size_t i;
+    while (b.uploaded.pop(i)) b.fenced.push_back(i);
+    for (size_t k = 0; k < b.fenced.size();) {
+        Job& job = jobs[b.fenced[k]];
+        if (job.fence) {
+            if (glClientWaitSync(job.fence, 0, 0) == GL_TIMEOUT_EXPIRED) {
+                k++;
+                continue;
+            }
+            glDeleteSync(job.fence);
+            job.fence = 0;
+        }
+        // wait for the job whose buffers it shares
+        if (!b.failed && job.source && !job.source->attached) {
+            k++;
+            continue;
+        }
+        if (!b.failed) {
+            auto start = chrono::steady_clock::now();
+            attach(job);
+            b.stats.attachMs += millisecondsSince(start);
+        }
+        b.handedOver++;
+        b.fenced[k] = b.fenced.back();
+        b.fenced.pop_back();
+    }
+
+    if (b.handedOver < jobs.size()) return false;
+    finish();
+    return true;
+}
+
+void AssetLoader::begin(GLFWwindow* context) {
+    size_t count = jobs.size();
+    batch.reset(new Batch(count));
+    batch->start = chrono::steady_clock::now();
+    batch->context = context;
+
+    // the largest files take the longest, start them first so they do not
+    // end up alone on one thread at the end
+    vector<size_t> sizes(count);
+    batch->order.resize(count);
+    for (size_t i = 0; i < count; i++) {
+        batch->order[i] = i;
+        sizes[i] = fileSize(jobs[i].path);
+    }
+    stable_sort(batch->order.begin(), batch->order.end(), [&](size_t a, size_t b) {
+        return sizes[a] > sizes[b];
+    });
+
+    unsigned int pool = threads ? threads : std::max(1u, thread::hardware_concurrency());
+    size_t workers = std::max<size_t>(1, std::min<size_t>(pool, count));
+    batch->stats.threads = static_cast<unsigned int>(workers);
+    // the thread that uploads is one of them
+    for (size_t i = 1; i < workers; i++) {
+        batch->loaders.emplace_back([this]() { while (work()) {} });
+    }
+}
+
+// Load the next job, false once every job is taken. After a failure the
+// remaining jobs are only passed on
+bool AssetLoader::work() {
+    Batch& b = *batch;
+    size_t taken = b.next++;
+    if (taken >= jobs.size()) return false;
+    size_t i = b.order[taken];
+    if (!b.failed) {
+        try {
+            run(jobs[i]);
+        } catch (...) {
+            b.fail();
+        }
+    }
+    b.loaded.push(i);
+    return true;
+}
+
+// Upload the jobs as they are loaded, with the GL context of the calling
+// thread. With fence they are handed over by poll(), else right away
+void AssetLoader::uploadAll(bool fence) {
+    Batch& b = *batch;
+    // jobs sharing the buffers of another are attached after all of them
+    vector<size_t> sharing;
+    glGenVertexArrays(1, &b.vertexArray);
+    for (size_t uploaded = 0; uploaded < jobs.size();) {
+        size_t i;
+        if (!b.loaded.pop(i)) {
+            // nothing to upload, help loading or wait for the other threads
+            if (!work()) this_thread::yield();
+            continue;
+        }
+
+        Job& job = jobs[i];
+        if (!b.failed) {
+            try {
+                auto start = chrono::steady_clock::now();
+                upload(job);
+                job.uploadMs = millisecondsSince(start);
+                if (fence) {
+                    job.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+                    // poll() only waits for the fence, make sure it is sent
+                    glFlush();
+                } else if (job.source) {
+                    sharing.push_back(i);
+                } else {
+                    start = chrono::steady_clock::now();
+                    attach(job);
+                    b.stats.attachMs += millisecondsSince(start);
+                }
+            } catch (...) {
+                b.fail();
+            }
+        }
+        if (fence) {
+            b.uploaded.push(i);
+        } else {
+            b.handedOver++;
+        }
+        uploaded++;
+    }
+    glDeleteVertexArrays(1, &b.vertexArray);
+
+    for (size_t i : sharing) {
+        if (b.failed) break;
+        auto start = chrono::steady_clock::now();
+        attach(jobs[i]);
+        b.stats.attachMs += millisecondsSince(start);
+    }
+}
+
+// Join the threads and release what was not handed over. Rethrows the first
+// exception of a thread, else logs the stats
+AssetLoadStats AssetLoader::finish() {
+    Batch& b = *batch;
+    for (auto& t : b.loaders) t.join();
+    if (b.uploader.joinable()) b.uploader.join();
+    if (b.context) glfwDestroyWindow(b.context);
+
+    AssetLoadStats stats = b.stats;
+    for (auto& job : jobs) {
+        (job.texture ? stats.textures : stats.meshes)++;
+        stats.loadMs += job.loadMs;
+        stats.prepareMs += job.prepareMs;
+        stats.uploadMs += job.uploadMs;
+        if (job.fence) glDeleteSync(job.fence);
+        if (job.uploadedTexture) glDeleteTextures(1, &job.uploadedTexture);
+        if (job.image.data) SOIL_free_image_data(job.image.data);
+    }
+    stats.wallMs = millisecondsSince(b.start);
+    exception_ptr error = b.error;
+    bool cancelled = b.failed;
+    // the loaded drawables that were not handed over delete their buffers
+    jobs.clear();
+    batch.reset();
+    if (error) rethrow_exception(error);
+    if (cancelled) return stats;
+
+    ostringstream line;
+    line << fixed << setprecision(1) << "Loaded " << stats.meshes << " meshes and "
+        << stats.textures << " textures on " << stats.threads << " threads in "
+        << stats.wallMs << " ms: load " << stats.loadMs << " ms, prepare "
+        << stats.prepareMs << " ms, upload " << stats.uploadMs << " ms, attach "
+        << stats.attachMs << " ms";
+    cout << line.str() << endl;
+    return stats;
+}
+
+void AssetLoader::run(Job& job) {
+    auto start = chrono::steady_clock::now();
+    if (job.texture) {
+        if (job.compress) {
+            // one thread per image, the loader's threads already run in parallel
+            job.cache.reset(new TextureCache(job.path));
+            if (!job.cache->valid()) job.cache->cook(1);
+        } else {
+            job.image = decodeSOIL(job.path.c_str());
+            buildMipmaps(job.image, 1);
+        }
+        job.loadMs = millisecondsSince(start);
+        return;
+    }
+
+    Drawable& drawable = *job.loaded;
+    drawable.loadFile();
+    // a cached mesh is uploaded from the mapped file unless its arrays are needed
+    if (job.options.share || job.options.quantize || !job.options.lodRatios.empty()) {
+        drawable.fillCPU();
+    }
+    job.loadMs = millisecondsSince(start);
+    // the geometry hash does not cover the skin of a .glb
+    if (job.options.share && drawable.joints.empty() && findSource(job)) return;
+
+    auto prepareStart = chrono::steady_clock::now();
+    if (!job.options.lodRatios.empty()) {
+        drawable.lods = buildLODChain(drawable.indices, drawable.indexedVertices,
+                                      drawable.indexedNormals, drawable.indexedUVS,
+                                      job.options.lodRatios, job.chain);
+        drawable.bounds = boundingSphere(drawable.indexedVertices);
+    }
+    if (job.options.quantize) {
+        job.positions = quantizePositions(drawable.indexedVertices, drawable.dequantization);
+        job.normals = packNormals(drawable.indexedNormals);
+        job.uvs = packUVs(drawable.indexedUVS);
+    }
+    job.prepareMs = millisecondsSince(prepareStart);
+}
+
+// Find a job of the batch with the same geometry, or a mirror image of it,
+// and the same options, or claim the geometry for this one. Returns true if
+// this job is to share the buffers of another
+bool AssetLoader::findSource(Job& job) {
+    Batch& b = *batch;
+    const Drawable& drawable = *job.loaded;
+    uint64_t options = hashBytes(job.options.lodRatios.data(),
+                                 sizeof(float) * job.options.lodRatios.size(),
+                                 job.options.quantize);
+    uint64_t keys[4];
+    for (int axis = -1; axis < 3; axis++) {
+        keys[axis + 1] = hashBytes(&options, sizeof options, hashGeometry(
+            drawable.indexedVertices, drawable.indexedNormals, drawable.indexedUVS,
+            drawable.indices, axis));
+    }
+
+    lock_guard<mutex> lock(b.geometryMutex);
+    for (int axis = -1; axis < 3; axis++) {
+        auto found = b.geometries.find(keys[axis + 1]);
+        if (found == b.geometries.end()) continue;
+        job.source = found->second;
+        job.mirrorAxis = axis;
+        return true;
+    }
+    b.geometries[keys[0]] = &job;
+    return false;
+}
+
+void AssetLoader::upload(Job& job) {
+    if (job.texture) {
+        if (job.cache) {
+            job.uploadedTexture = job.cache->upload();
+            if (job.uploadedTexture) job.cache->log();
+        } else {
+            job.uploadedTexture = uploadSOIL(job.image);
+        }
+        return;
+    }
+    // nothing of its own to upload
+    if (job.source) return;
+
+    Drawable& drawable = *job.loaded;
+    // uploadVertexArrays() also points the bound VAO at the buffer; VAOs are
+    // not shared between contexts, so this is the loader's own and attach()
+    // sets up the drawable's
+    glBindVertexArray(batch->vertexArray);
+    glGenBuffers(1, &drawable.vertexVBO);
+    glGenBuffers(1, &drawable.elementVBO);
+
+    glBindBuffer(GL_ARRAY_BUFFER, drawable.vertexVBO);
+    bool normals = !drawable.indexedNormals.empty();
+    bool uvs = !drawable.indexedUVS.empty();
+    if (job.options.quantize) {
+        drawable.vertexStride = uploadVertexArrays<QuantizedPositionAttribute,
+                                                   PackedNormalAttribute, HalfUVAttribute>(
+            job.positions, job.normals, job.uvs);
+        job.setup = vertexArraysSetup<QuantizedPositionAttribute, PackedNormalAttribute,
+                                      HalfUVAttribute>(normals, uvs);
+    } else {
+        drawable.uploadIndexedArrays();
+        job.setup = drawable.vertexSetup;
+    }
+
+    // the LOD chain starts with the full mesh
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, drawable.elementVBO);
+    if (job.chain.empty()) {
+        drawable.uploadIndexArray();
+    } else {
+        drawable.indexType = uploadIndices(job.chain);
+    }
+
+    job.chain = vector<unsigned int>();
+    job.positions = vector<u16vec4>();
+    job.normals = job.uvs = vector<uint32_t>();
+}
+
+// Hand a job over to its caller, on the thread that draws
+void AssetLoader::attach(Job& job) {
+    if (job.texture) {
+        *job.texture = job.uploadedTexture;
+        job.uploadedTexture = 0;
+        return;
+    }
+
+    Drawable& drawable = *job.drawable;
+    Drawable& loaded = *job.loaded;
+    drawable.indexedVertices.swap(loaded.indexedVertices);
+    drawable.indexedNormals.swap(loaded.indexedNormals);
+    drawable.indexedUVS.swap(loaded.indexedUVS);
+    drawable.indices.swap(loaded.indices);
+    drawable.joints.swap(loaded.joints);
+    drawable.weights.swap(loaded.weights);
+    drawable.cache.swap(loaded.cache);
+    swap(drawable.cached, loaded.cached);
+    job.attached = true;
+    if (job.source) {
+        GeometryRegistry::share(drawable, *job.source->drawable, job.mirrorAxis);
+        if (job.options.releaseCPU) drawable.releaseCPU();
+        job.loaded.reset();
+        return;
+    }
+
+    drawable.lods.swap(loaded.lods);
+    drawable.bounds = loaded.bounds;
+    drawable.dequantization = loaded.dequantization;
+    drawable.indexType = loaded.indexType;
+    drawable.vertexStride = loaded.vertexStride;
+    drawable.vertexVBO = loaded.vertexVBO;
+    drawable.elementVBO = loaded.elementVBO;
+    loaded.vertexVBO = loaded.elementVBO = 0;
+    drawable.vertexSetup = job.setup;
+
+    // binding the buffers also makes what another context wrote visible,
+    // copying them into the arena binds them too
+    if (job.options.arena) {
+        drawable.moveToArena();
+    } else {
+        glGenVertexArrays(1, &drawable.VAO);
+        glBindVertexArray(drawable.VAO);
+        glBindBuffer(GL_ARRAY_BUFFER, drawable.vertexVBO);
+        job.setup();
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, drawable.elementVBO);
+    }
+    if (job.options.quantize) drawable.logQuantization(drawable.floatStride());
+    if (job.options.share) GeometryRegistry::share(drawable);
+    if (job.options.releaseCPU) drawable.releaseCPU();
+    job.loaded.reset();
+}
@@ -0,0 +1,58 @@
+#ifndef MESHLET_H
+#define MESHLET_H
+
+#include <GL/glew.h>
+#include <vector>
+#include <glm/glm.hpp>
+
+/**
+* A cluster of neighbouring triangles, stored as a range of the index
+* buffer, with the bounds used to cull it as a whole.
+*/
+struct Meshlet {
+    unsigned int first;        // first index
+    unsigned int count;        // number of indices, 3 per triangle
+    unsigned int vertexCount;  // distinct vertices used
+    glm::vec4 sphere;          // bounding sphere, center in xyz and radius in w
+    glm::vec3 coneAxis;        // average normal of the triangles
+    float coneCutoff;          // sine of the normal cone angle, 1 if it is too wide to cull
+};
+
+/**
+* Split an indexed triangle list into meshlets of at most maxVertices
+* vertices and maxTriangles triangles, grown over shared vertices so they
+* stay compact. indices is reordered so every meshlet is a contiguous range.
+*/
+std::vector<Meshlet> buildMeshlets(
+    std::vector<unsigned int>& indices, const std::vector<glm::vec3>& positions,
+    unsigned int maxVertices = 64, unsigned int maxTriangles = 124);
+
+/**
+* Index ranges left after culling, as glMultiDrawElements() arguments.
+*/
+struct MeshletDrawList {
+    std::vector<GLsizei> counts;
+    std::vector<const void*> offsets;
+    /* Filled when drawing geometry in the arena, see drawMeshlets() */
+    std::vector<GLint> baseVertices;
+};
+
+struct MeshletStats {
+    size_t meshlets, visibleMeshlets;
+    size_t triangles, visibleTriangles;
+    size_t ranges;    // draws after merging adjacent visible meshlets
+};
+
+/**
+* Cull the meshlets outside the view frustum and, if backfaces is set,
+* those whose triangles all face away from the camera, then merge the
+* visible ones into as few index ranges as possible. indexSize is the size
+* of one index in bytes. Backface culling is only valid for meshes with
+* consistent counter-clockwise winding.
+*/
+MeshletStats cullMeshlets(
+    const std::vector<Meshlet>& meshlets, const glm::mat4& modelView,
+    const glm::mat4& projection, size_t indexSize, bool backfaces,
+    MeshletDrawList& draws);
+
+#endif
@@ -0,0 +1,342 @@
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <SOIL.h>
+#include "texstream.h"
+#include "texcache.h"
+#include "texture.h"
+#include "dds.h"
+#include "util.h"
+
+using namespace std;
+using namespace glm;
+
+int TextureStreamer::tailSize = 64;
+
+// One mipmap, in the mapping of a .dds or in a SOILImage
+struct StreamLevel {
+    const unsigned char* data;
+    size_t size;
+    int width, height;
+};
+
+struct StreamedTexture {
+    GLuint texture;
+    GLenum internalFormat;
+    bool compressed;
+    std::vector<StreamLevel> mips;
+    int tail;         // first level of the tail, always resident
+    int resident;     // finest resident level, the base level
+    int wanted;       // finest level requested
+    int requested;    // finest level requested this frame, mips.size() if none
+    uint64_t lastUsed;
+    std::unique_ptr<MappedFile> file;
+    SOILImage image;
+
+    ~StreamedTexture() {
+        if (image.data) SOIL_free_image_data(image.data);
+    }
+
+    int levels() const { return static_cast<int>(mips.size()); }
+};
+
+// Levels of a cooked .dds, or nothing if the image can not be cooked
+static bool loadCachedLevels(const string& imagePath, StreamedTexture& streamed) {
+    if (!TextureCache::supported()) return false;
+    TextureCache cache(imagePath);
+    if (!cache.valid() && !cache.cook()) return false;
+    try {
+        streamed.file.reset(new MappedFile(cache.path()));
+        DDSImage image = parseDDS(reinterpret_cast<const unsigned char*>(streamed.file->begin()),
+                                  streamed.file->size());
+        if (image.target != GL_TEXTURE_2D) return false;
+        streamed.internalFormat = image.format.internalFormat;
+        for (const DDSSurface& surface : image.surfaces) {
+            streamed.mips.push_back(StreamLevel{surface.data, surface.size, surface.width,
+                                                surface.height});
+        }
+    } catch (const runtime_error& e) {
+        cout << "Texture cache " << cache.path() << " not streamed: " << e.what() << endl;
+        streamed.file.reset();
+        streamed.mips.clear();
+        return false;
+    }
+    streamed.compressed = true;
+    return true;
+}
+
+TextureStreamer::TextureStreamer(size_t budget, size_t uploadPerFrame)
+    : budget{budget}, uploadPerFrame{uploadPerFrame}, frame{0}, residentBytes{0},
+      frameStats{}, current{} {
+    frameStats.budget = budget;
+}
+
+TextureStreamer::~TextureStreamer() {
+    for (const auto& texture : textures) glDeleteTextures(1, &texture.first);
+}
+
+GLuint TextureStreamer::add(const string& imagePath) {
+    unique_ptr<StreamedTexture> streamed(new StreamedTexture());
+    if (!loadCachedLevels(imagePath, *streamed)) {
+        // uncompressed, with the mipmaps kept next to the image
+        streamed->image = decodeSOIL(imagePath.c_str());
+        if (!streamed->image.data) throw runtime_error("Failed to load texture: " + imagePath);
+        buildMipmaps(streamed->image);
+        SOILImage& image = streamed->image;
+        streamed->compressed = false;
+        streamed->internalFormat = GL_RGB8;
+        streamed->mips.push_back(StreamLevel{image.data, size_t(image.width) * image.height * 3,
+                                             image.width, image.height});
+        for (size_t level = 1; level <= image.mips.size(); level++) {
+            int w = std::max(1, image.width >> level), h = std::max(1, image.height >> level);
+            streamed->mips.push_back(StreamLevel{image.mips[level - 1].data(),
+                                                 image.mips[level - 1].size(), w, h});
+        }
+    }
+
+    // no level has storage until it is uploaded
+    StreamedTexture& texture = *streamed;
+    GLsizei levels = texture.levels();
+    glGenTextures(1, &texture.texture);
+    glBindTexture(GL_TEXTURE_2D, texture.texture);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, levels - 1);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, levels - 1);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+
+    // the tail goes up at once, smallest first
+    texture.tail = levels - 1;
+    while (texture.tail > 0 &&
+           std::max(texture.mips[texture.tail - 1].width, texture.mips[texture.tail - 1].height) <= tailSize) {
+        texture.tail--;
+    }
+    texture.resident = levels;
+    texture.wanted = 0;
+    texture.requested = levels;
+    texture.lastUsed = frame;
+    while (texture.resident > texture.tail) upload(texture);
+
+    GLuint name = texture.texture;
+    textures[name] = move(streamed);
+    return name;
+}
+
+void TextureStreamer::remove(GLuint texture) {
+    StreamedTexture& streamed = find(texture);
+    for (int level = streamed.resident; level < streamed.levels(); level++) {
+        residentBytes -= streamed.mips[level].size;
+    }
+    glDeleteTextures(1, &texture);
+    textures.erase(texture);
+}
+
+StreamedTexture& TextureStreamer::find(GLuint texture) const {
+    auto found = textures.find(texture);
+    if (found == textures.end()) {
+        throw runtime_error("Texture " + to_string(texture) + " is not streamed");
+    }
+    return *found->second;
+}
+
+void TextureStreamer::request(GLuint texture, int level) {
+    StreamedTexture& streamed = find(texture);
+    streamed.requested = std::min(streamed.requested, std::max(level, 0));
+    streamed.lastUsed = frame;
+}
+
+void TextureStreamer::request(GLuint texture, const vec4& sphere, const mat4& modelView,
+                              const mat4& projection, float uvPerUnit, int viewportHeight) {
+    const StreamedTexture& streamed = find(texture);
+    // pixels one unit of model space covers at the nearest point of the
+    // sphere, as selectLOD() measures it
+    float scale = std::max(length(vec3(modelView[0])),
+                           std::max(length(vec3(modelView[1])), length(vec3(modelView[2]))));
+    float pixelsPerUnit = 0.5f * projection[1][1] * scale * viewportHeight;
+    if (projection[2][3] != 0.0f) {
+        float depth = -(modelView * vec4(vec3(sphere), 1.0f)).z - sphere.w * scale;
+        pixelsPerUnit = depth > 0.0f ? pixelsPerUnit / depth : INFINITY;
+    }
+    const StreamLevel& top = streamed.mips[0];
+    float texelsPerUnit = uvPerUnit * std::max(top.width, top.height);
+    // each level halves the texels per pixel
+    int level = 0;
+    if (pixelsPerUnit > 0.0f && texelsPerUnit > pixelsPerUnit) {
+        level = static_cast<int>(floor(log2(texelsPerUnit / pixelsPerUnit)));
+    }
+    request(texture, std::min(level, streamed.levels() - 1));
+}
+
+int TextureStreamer::residentLevel(GLuint texture) const {
+    return find(texture).resident;
+}
+
+// Specify one level of a texture, allocating and filling it, or giving its
+// storage back when mip is null
+static void specifyLevel(const StreamedTexture& texture, int level, const StreamLevel* mip) {
+    GLsizei width = mip ? mip->width : 0, height = mip ? mip->height : 0;
+    const unsigned char* data = mip ? mip->data : NULL;
+    if (texture.compressed) {
+        glCompressedTexImage2D(GL_TEXTURE_2D, level, texture.internalFormat, width, height, 0,
+                               mip ? static_cast<GLsizei>(mip->size) : 0, data);
+    } else {
+        // rows of RGB pixels are not 4 byte aligned
+        GLint alignment;
+        glGetIntegerv(GL_UNPACK_ALIGNMENT, &alignment);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        glTexImage2D(GL_TEXTURE_2D, level, texture.internalFormat, width, height, 0,
+                     GL_RGB, GL_UNSIGNED_BYTE, data);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, alignment);
+    }
+}
+
+void TextureStreamer::upload(StreamedTexture& texture) {
+    int level = texture.resident - 1;
+    const StreamLevel& mip = texture.mips[level];
+    glBindTexture(GL_TEXTURE_2D, texture.texture);
+    specifyLevel(texture, level, &mip);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, level);
+    texture.resident = level;
+    residentBytes += mip.size;
+    current.uploadedLevels++;
+    current.uploadedBytes += mip.size;
+}
+
+void TextureStreamer::evict(StreamedTexture& texture) {
+    int level = texture.resident;
+    const StreamLevel& mip = texture.mips[level];
+    texture.resident++;
+    glBindTexture(GL_TEXTURE_2D, texture.texture);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, texture.resident);
+    specifyLevel(texture, level, nullptr);
+    residentBytes -= mip.size;
+    current.evictedLevels++;
+    current.evictedBytes += mip.size;
+}
+
+// The first level of a texture that making room for keep can not evict:
+// only levels finer than the texture wants, unless keep was used more
+// recently, and never the tail. Anything goes without keep
+static int keptLevel(const StreamedTexture& texture, const StreamedTexture* keep) {
+    if (&texture == keep) return texture.resident;
+    if (keep && texture.lastUsed >= keep->lastUsed) return std::min(texture.wanted, texture.tail);
+    return texture.tail;
+}
+
+bool TextureStreamer::makeRoom(size_t bytes, const StreamedTexture* keep) {
+    if (residentBytes + bytes <= budget) return true;
+    // evict nothing if evicting everything allowed is not enough
+    if (keep) {
+        size_t evictable = 0;
+        for (const auto& entry : textures) {
+            const StreamedTexture& texture = *entry.second;
+            for (int level = texture.resident; level < keptLevel(texture, keep); level++) {
+                evictable += texture.mips[level].size;
+            }
+        }
+        if (residentBytes + bytes > budget + evictable) return false;
+    }
+
+    while (residentBytes + bytes > budget) {
+        // the finest level of the least recently used texture goes first
+        StreamedTexture* victim = nullptr;
+        for (const auto& entry : textures) {
+            StreamedTexture& texture = *entry.second;
+            if (texture.resident >= keptLevel(texture, keep)) continue;
+            if (!victim || texture.lastUsed < victim->lastUsed ||
+                (texture.lastUsed == victim->lastUsed &&
+                 texture.mips[texture.resident].size > victim->mips[victim->resident].size)) {
+                victim = &texture;
+            }
+        }
+        if (!victim) return false;
+        evict(*victim);
+    }
+    return true;
+}
+
+TextureStreamStats TextureStreamer::update() {
+    for (const auto& entry : textures) {
+        StreamedTexture& texture = *entry.second;
+        if (texture.requested < texture.levels()) texture.wanted = texture.requested;
+        texture.requested = texture.levels();
+    }
+
+    // back under a lowered budget
+    makeRoom(0, nullptr);
+
+    // the most recently used textures first, then the ones furthest from
+    // what they want, one level at a time so they all sharpen together.
+    // Textures whose next level does not fit wait for a later frame
+    vector<const StreamedTexture*> blocked;
+    while (current.uploadedBytes < uploadPerFrame) {
+        StreamedTexture* next = nullptr;
+        for (const auto& entry : textures) {
+            StreamedTexture& texture = *entry.second;
+            if (texture.resident <= texture.wanted ||
+                std::find(blocked.begin(), blocked.end(), &texture) != blocked.end()) continue;
+            if (!next || texture.lastUsed > next->lastUsed ||
+                (texture.lastUsed == next->lastUsed &&
+                 texture.resident - texture.wanted > next->resident - next->wanted)) {
+                next = &texture;
+            }
+        }
+        if (!next) break;
+        if (makeRoom(next->mips[next->resident - 1].size, next)) {
+            upload(*next);
+        } else {
+            blocked.push_back(next);
+        }
+    }
+
+    current.frame = frame++;
+    current.textures = textures.size();
+    current.residentBytes = residentBytes;
+    current.budget = budget;
+    for (const auto& entry : textures) {
+        const StreamedTexture& texture = *entry.second;
+        for (int level = 0; level < texture.levels(); level++) {
+            size_t size = texture.mips[level].size;
+            if (level >= texture.resident) current.allocatedBytes += size;
+            current.fullBytes += size;
+        }
+        current.pendingLevels += std::max(0, texture.resident - texture.wanted);
+    }
+    frameStats = current;
+    current = TextureStreamStats{};
+    return frameStats;
+}
+
+void TextureStreamer::report() const {
+    const TextureStreamStats& s = frameStats;
+    ostringstream line;
+    line << fixed << setprecision(2) << "Texture streaming, frame " << s.frame << ": "
+        << s.textures << " textures, " << s.residentBytes / 1048576.0 << " of "
+        << s.budget / 1048576.0 << " MB budget resident, " << s.allocatedBytes / 1048576.0
+        << " of " << s.fullBytes / 1048576.0 << " MB allocated, " << s.pendingLevels << " levels pending, uploaded "
+        << s.uploadedLevels << " (" << s.uploadedBytes / 1048576.0 << " MB), evicted "
+        << s.evictedLevels << " (" << s.evictedBytes / 1048576.0 << " MB)";
+    cout << line.str() << endl;
+}
+
+float uvDensity(const vector<vec3>& positions, const vector<vec2>& uvs,
+                const vector<unsigned int>& indices) {
+    size_t count = indices.empty() ? positions.size() : indices.size();
+    double area = 0.0, uvArea = 0.0;
+    for (size_t i = 0; i + 2 < count; i += 3) {
+        size_t a = i, b = i + 1, c = i + 2;
+        if (!indices.empty()) {
+            a = indices[a];
+            b = indices[b];
+            c = indices[c];
+        }
+        area += length(cross(positions[b] - positions[a], positions[c] - positions[a]));
+        vec2 u = uvs[b] - uvs[a], v = uvs[c] - uvs[a];
+        uvArea += fabs(u.x * v.y - u.y * v.x);
+    }
+    return area > 0.0 ? static_cast<float>(sqrt(uvArea / area)) : 1.0f;
+}
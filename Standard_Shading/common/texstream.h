@@ -0,0 +1,114 @@
+#ifndef TEXSTREAM_H
+#define TEXSTREAM_H
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+struct StreamedTexture;
+
+/**
+* Residency of the textures of a TextureStreamer after an update(), and the
+* uploads and evictions of that frame.
+*/
+struct TextureStreamStats {
+    uint64_t frame;
+    size_t textures;
+    size_t residentBytes;    // mipmaps uploaded and sampled
+    size_t allocatedBytes;   // storage of the levels that have any
+    size_t fullBytes;        // the full mip chains of the textures
+    size_t budget;
+    size_t pendingLevels;    // requested but not resident yet
+    size_t uploadedLevels, uploadedBytes;
+    size_t evictedLevels, evictedBytes;
+};
+
+/**
+* Streams the mipmaps of textures into GL under a memory budget. Only the
+* levels from GL_TEXTURE_BASE_LEVEL down have storage: add() uploads the
+* coarse tail of the chain so the texture can be drawn at once; update() then
+* uploads finer levels, coarse to fine and a few per frame, down to the level
+* request() asked for. When the resident levels would go over the budget, the
+* finest levels of the least recently requested textures are evicted: the
+* base level is raised past them and their storage is given back, to be
+* allocated and uploaded again if they are requested again. Immutable storage
+* can not shrink, and allocating a smaller texture would change the name
+* callers hold, so each level is specified on its own with glTexImage2D(), an
+* evicted one to 0x0.
+*
+* Mipmaps come from the TextureCache of each image, memory mapped, or are
+* decoded and built with buildMipmaps() and kept in memory when S3TC is not
+* available. Only use it on the thread that draws.
+*/
+class TextureStreamer {
+public:
+    /* budget bytes of resident mipmaps, uploading about uploadPerFrame
+    bytes per update() */
+    explicit TextureStreamer(size_t budget, size_t uploadPerFrame = 4 << 20);
+    TextureStreamer(const TextureStreamer&) = delete;
+    TextureStreamer& operator=(const TextureStreamer&) = delete;
+    /* Deletes the textures */
+    ~TextureStreamer();
+
+    /* Create the texture of an image file with its tail resident. It wants
+    its full resolution until requested otherwise. Throws a runtime_error if
+    the image can not be read */
+    GLuint add(const std::string& imagePath);
+    /* Delete a texture added to the streamer */
+    void remove(GLuint texture);
+    bool streams(GLuint texture) const { return textures.count(texture) != 0; }
+
+    /* Ask for the finest level a texture is sampled at this frame. Every
+    request marks the texture as used, and the finest level asked for since
+    the last update() wins */
+    void request(GLuint texture, int level);
+    /* Ask for the level whose texels match the pixels of an object drawn
+    with the texture: a bounding sphere, with modelView and projection, and
+    uvPerUnit, the texture coordinates per unit of model space, see
+    uvDensity(), on a viewport viewportHeight pixels high */
+    void request(GLuint texture, const glm::vec4& sphere, const glm::mat4& modelView,
+                 const glm::mat4& projection, float uvPerUnit, int viewportHeight);
+
+    /* Once per frame: evict down to the budget and upload requested
+    levels. Returns the stats of the frame */
+    TextureStreamStats update();
+    TextureStreamStats stats() const { return frameStats; }
+    /* Finest resident level of a texture */
+    int residentLevel(GLuint texture) const;
+    /* Logs the stats of the last update() */
+    void report() const;
+
+    void setBudget(size_t bytes) { budget = bytes; }
+
+    /* Largest side of the levels add() uploads, and update() never evicts */
+    static int tailSize;
+
+private:
+    size_t budget;
+    size_t uploadPerFrame;
+    uint64_t frame;
+    size_t residentBytes;
+    std::map<GLuint, std::unique_ptr<StreamedTexture>> textures;
+    /* The last update(), and the uploads and evictions since */
+    TextureStreamStats frameStats, current;
+
+    StreamedTexture& find(GLuint texture) const;
+    /* Evict until bytes more fit in the budget, see update() */
+    bool makeRoom(size_t bytes, const StreamedTexture* keep);
+    void evict(StreamedTexture& texture);
+    void upload(StreamedTexture& texture);
+};
+
+/**
+* Texture coordinates per unit of model space of triangles, the square root
+* of their total UV area over their total area, for TextureStreamer::request().
+* Without indices every three positions are a triangle.
+*/
+float uvDensity(const std::vector<glm::vec3>& positions, const std::vector<glm::vec2>& uvs,
+                const std::vector<unsigned int>& indices = {});
+
+#endif
@@ -2,6 +2,9 @@
 #define TEXTURE_H
 
 #include <GL/glew.h>
+#include <cstddef>
+#include <string>
+#include <vector>
 
 /**
 * A simple .bmp loader. Use loadSOIL() instead.
@@ -9,9 +12,19 @@
 GLuint loadBMP(const char* imagePath);
 
 /**
-* A .dds loader.
+* A .dds loader for every format, cube map and array parseDDS() reads. The
+* file is memory mapped and each mipmap uploaded from the mapping, sampled
+* trilinearly. target receives GL_TEXTURE_2D, GL_TEXTURE_CUBE_MAP,
+* GL_TEXTURE_2D_ARRAY or GL_TEXTURE_CUBE_MAP_ARRAY. Throws a runtime_error
+* for files it can not read.
 */
-GLuint loadDDS(const char* imagePath);
+GLuint loadDDS(const char* imagePath, GLenum* target = nullptr);
+
+/**
+* loadDDS() of a .dds file already in memory, e.g. one just cooked by a
+* TextureCache.
+*/
+GLuint uploadDDS(const unsigned char* data, size_t size, GLenum* target = nullptr);
 
 /**
 * Readable Image Formats:
@@ -28,4 +41,89 @@ GLuint loadDDS(const char* imagePath);
 */
 GLuint loadSOIL(const char* imagePath);
 
-#endif
\ No newline at end of file
+/**
+* Filters generateMipmaps() downsamples with: a box over the pixels each texel
+* covers, or a Kaiser windowed sinc 3 texels wide on each side that keeps
+* distant levels sharper.
+*/
+enum MipFilter { MIP_BOX, MIP_KAISER };
+
+/**
+* The mip chain of an image of 1 to 4 interleaved channels, levels 1 and up
+* down to 1x1, each max(1, width >> level) by max(1, height >> level) and
+* built from the one above it. Pixels are filtered in linear space: with srgb
+* the colour channels are converted from and back to sRGB, while alpha, the
+* last channel of 2 and 4 channel images, is always linear. Rows of each level
+* are filtered with SSE2 on up to `threads` threads (0 uses every hardware
+* thread). Throws a runtime_error for other channel counts.
+*/
+std::vector<std::vector<unsigned char>> generateMipmaps(const unsigned char* pixels, int width,
+                                                        int height, int channels,
+                                                        MipFilter filter = MIP_BOX,
+                                                        bool srgb = true,
+                                                        unsigned int threads = 0);
+
+/**
+* generateMipmaps() of a float image, e.g. an HDR one, whose values are
+* already linear and are not clamped.
+*/
+std::vector<std::vector<float>> generateMipmaps(const float* pixels, int width, int height,
+                                                int channels, MipFilter filter = MIP_BOX,
+                                                unsigned int threads = 0);
+
+/**
+* An RGB image decoded by decodeSOIL(), and the mipmaps buildMipmaps() made
+* of it, levels 1 and up.
+*/
+struct SOILImage {
+    unsigned char* data = nullptr;
+    int width = 0, height = 0;
+    std::vector<std::vector<unsigned char>> mips;
+};
+
+/**
+* Decode an image file, or one already in memory, with the stb_image inside
+* SOIL to forceChannels channels (a SOIL_LOAD_* value). Unlike
+* SOIL_load_image() it can run on several threads at once: the reason of a
+* failure is returned in error instead of SOIL_last_result(). Returns nullptr
+* on failure; free the pixels with SOIL_free_image_data().
+*/
+unsigned char* decodeImage(const char* imagePath, int& width, int& height, int& channels,
+                           int forceChannels, std::string& error);
+unsigned char* decodeImage(const unsigned char* buffer, size_t size, int& width, int& height,
+                           int& channels, int forceChannels, std::string& error);
+
+/**
+* The two halves of loadSOIL(). decodeSOIL() only reads the file, with
+* decodeImage(), so it can run on any thread without a GL context, alongside
+* other decodes; uploadSOIL() creates the texture on
+* the GL thread and frees the image. The texture keeps the size of the image,
+* power of two or not, in immutable glTexStorage2D() storage, with the
+* mipmaps of the image if it has any.
+*/
+SOILImage decodeSOIL(const char* imagePath);
+GLuint uploadSOIL(SOILImage& image);
+
+/**
+* Fill image.mips with generateMipmaps(), box filtered in linear space, so
+* uploadSOIL() creates a trilinearly sampled texture. Like decodeSOIL() it
+* needs no GL context.
+*/
+void buildMipmaps(SOILImage& image, unsigned int threads = 0);
+
+/**
+* decodeSOIL() of an image file already in memory, e.g. one embedded in a
+* .glb.
+*/
+SOILImage decodeSOIL(const unsigned char* buffer, size_t size);
+
+/**
+* loadSOIL() of several images: they are decoded on up to `threads` threads
+* (0 uses every hardware thread) and uploaded on the calling thread. The
+* texture of an image that could not be read is 0. Each image gets its
+* buildMipmaps() on the same threads.
+*/
+std::vector<GLuint> loadSOILTextures(const std::vector<std::string>& imagePaths,
+                                     unsigned int threads = 0);
+
+#endif
@@ -113,8 +113,21 @@ typedef unsigned char validate_uint32[sizeof(uint32) == 4];
 // Generic API that works on all image types
 //
 
-// this is not threadsafe
-static char *failure_reason;
+// one per thread, so images can be decoded on several threads at once; the
+// tables init_defaults() builds lazily must then be built before the first
+// concurrent decode, by decoding a PNG with fixed Huffman codes
+#ifndef STBI_THREAD_LOCAL
+#if defined(_MSC_VER)
+#define STBI_THREAD_LOCAL __declspec(thread)
+#elif defined(__GNUC__)
+#define STBI_THREAD_LOCAL __thread
+#elif defined(__STDC_VERSION__) && __STDC_VERSION__ >= 201112L && !defined(__STDC_NO_THREADS__)
+#define STBI_THREAD_LOCAL _Thread_local
+#else
+#define STBI_THREAD_LOCAL
+#endif
+#endif
+static STBI_THREAD_LOCAL char *failure_reason;
 
 char *stbi_failure_reason(void) {
     return failure_reason;
@@ -1736,7 +1749,7 @@ static int parse_huffman_block(zbuf *a) {
 
 static int compute_huffman_codes(zbuf *a) {
     static uint8 length_dezigzag[19] = {16,17,18,0,8,7,9,6,10,5,11,4,12,3,13,2,14,1,15};
-    static zhuffman z_codelength; // static just to save stack space
+    zhuffman z_codelength;
     uint8 lencodes[286 + 32 + 137];//padding for maximum single op
     uint8 codelength_sizes[19];
     int i, n;
@@ -2235,8 +2248,7 @@ static int parse_png_file(png *z, int scan, int req_comp) {
                 // if critical, fail
                 if ((c.type & (1 << 29)) == 0) {
 #ifndef STBI_NO_FAILURE_STRINGS
-                    // not threadsafe
-                    static char invalid_chunk[] = "XXXX chunk not known";
+                    static STBI_THREAD_LOCAL char invalid_chunk[] = "XXXX chunk not known";
                     invalid_chunk[0] = (uint8) (c.type >> 24);
                     invalid_chunk[1] = (uint8) (c.type >> 16);
                     invalid_chunk[2] = (uint8) (c.type >> 8);
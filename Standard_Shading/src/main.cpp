@@ -19,7 +19,9 @@
 #include <common/util.h>
 #include <common/camera.h>
 #include <common/model.h>
+#include <common/vertex.h>
 #include <common/texture.h>
+#include <common/texstream.h>
 
 using namespace std;
 using namespace glm;
@@ -44,11 +46,13 @@ GLuint projectionMatrixLocation, viewMatrixLocation, modelMatrixLocation;
 GLuint lightLocation;
 GLuint diffuceColorSampler, specularColorSampler;
 GLuint diffuseTexture, specularTexture;
+TextureStreamer* textures;
+vec4 objBounds;
+float objUVDensity;
 GLuint objVAO, triangleVAO;
-GLuint objVerticiesVBO, objUVVBO, objNormalsVBO;
+GLuint objVBO;
 GLuint triangleVerticesVBO, triangleNormalsVBO;
-std::vector<vec3> objVertices, objNormals;
-std::vector<vec2> objUVs;
+MeshData obj;
 
 #define RENDER_TRIANGLE 0
 
@@ -78,19 +82,24 @@ void createContext()
     glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
 
     // Load Suzanne
-    loadOBJWithTiny("suzanne.obj", objVertices, objUVs, objNormals);
+    obj = loadOBJWithTiny("suzanne.obj");
     
     /* Flat shading implementation if needed
-    for (int i = 0; i < objVertices.size(); i += 3) {
-        objNormals[i] = cross(normalize(objVertices[i + 1] - objVertices[i]), normalize(objVertices[i + 2] - objVertices[i]));
-        objNormals[i + 1] = objNormals[i];
-        objNormals[i + 2] = objNormals[i];
+    for (int i = 0; i < obj.vertices.size(); i += 3) {
+        obj.normals[i] = cross(normalize(obj.vertices[i + 1] - obj.vertices[i]), normalize(obj.vertices[i + 2] - obj.vertices[i]));
+        obj.normals[i + 1] = obj.normals[i];
+        obj.normals[i + 2] = obj.normals[i];
     }
     //*/
 
-    // Load diffuse and specular texture maps
-    diffuseTexture = loadSOIL("suzanne_diffuse.bmp");
-    specularTexture = loadSOIL("suzanne_specular.bmp");
+    // Load diffuse and specular texture maps, block compressed to .dds caches
+    // on first use. Their coarse mipmaps are drawn at once and the finer ones
+    // streamed in as the camera comes close, within 1 MB
+    textures = new TextureStreamer(1 << 20);
+    diffuseTexture = textures->add("suzanne_diffuse.bmp");
+    specularTexture = textures->add("suzanne_specular.bmp");
+    objBounds = boundingSphere(obj.vertices);
+    objUVDensity = uvDensity(obj.vertices, obj.uvs);
 
     // get pointers to the uniform variables
     diffuceColorSampler = glGetUniformLocation(shaderProgram, "diffuceColorSampler");
@@ -105,31 +114,11 @@ void createContext()
     glGenVertexArrays(1, &objVAO);
     glBindVertexArray(objVAO);
 
-    // vertex VBO
-    glGenBuffers(1, &objVerticiesVBO);
-    glBindBuffer(GL_ARRAY_BUFFER, objVerticiesVBO);
-    glBufferData(GL_ARRAY_BUFFER, objVertices.size() * sizeof(glm::vec3),
-        &objVertices[0], GL_STATIC_DRAW);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, NULL);
-    glEnableVertexAttribArray(0);
-
-    // normal VBO
-    glGenBuffers(1, &objNormalsVBO);
-    glBindBuffer(GL_ARRAY_BUFFER, objNormalsVBO);
-    glBufferData(GL_ARRAY_BUFFER, objNormals.size() * sizeof(glm::vec3),
-        &objNormals[0], GL_STATIC_DRAW);
-    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 0, NULL);
-    glEnableVertexAttribArray(1);
-    
-
-    // uvs VBO
-    glGenBuffers(1, &objUVVBO);
-    glBindBuffer(GL_ARRAY_BUFFER, objUVVBO);
-    glBufferData(GL_ARRAY_BUFFER, objUVs.size() * sizeof(glm::vec2),
-        &objUVs[0], GL_STATIC_DRAW);
-    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 0, NULL);
-    glEnableVertexAttribArray(2);
-    //*/
+    // interleaved vertex VBO: position, normal and uv
+    glGenBuffers(1, &objVBO);
+    glBindBuffer(GL_ARRAY_BUFFER, objVBO);
+    VertexFormat<PositionAttribute, NormalAttribute, UVAttribute>::upload(
+        obj.vertices, obj.normals, obj.uvs);
 }
 
 void free()
@@ -138,12 +127,10 @@ void free()
     glDeleteBuffers(1, &triangleNormalsVBO);
     glDeleteVertexArrays(1, &triangleVAO);
 
-    glDeleteBuffers(1, &objVerticiesVBO);
-    glDeleteBuffers(1, &objUVVBO);
-    glDeleteBuffers(1, &objNormalsVBO);
+    glDeleteBuffers(1, &objVBO);
     glDeleteVertexArrays(1, &objVAO);
 
-    glDeleteTextures(1, &diffuseTexture);
+    delete textures;
     glDeleteProgram(shaderProgram);
     glfwTerminate();
 }
@@ -232,9 +219,17 @@ void mainLoop()
             glUniform1i(specularColorSampler, 1);
 
             // draw
-            glDrawArrays(GL_TRIANGLES, 0, objVertices.size());
-        
+            glDrawArrays(GL_TRIANGLES, 0, obj.vertices.size());
+
+            // the texel density this suzanne needs
+            mat4 modelView = viewMatrix * modelMatrix;
+            textures->request(diffuseTexture, objBounds, modelView, projectionMatrix, objUVDensity, W_HEIGHT);
+            textures->request(specularTexture, objBounds, modelView, projectionMatrix, objUVDensity, W_HEIGHT);
         }
+
+        // stream the requested mipmaps, and log frames that changed them
+        TextureStreamStats streaming = textures->update();
+        if (streaming.uploadedLevels || streaming.evictedLevels) textures->report();
         glfwSwapBuffers(window);
 
         glfwPollEvents();
@@ -0,0 +1,265 @@
+#include <algorithm>
+#include <iostream>
+#include "arena.h"
+
+using namespace std;
+
+float BufferArena::defragmentThreshold = 0.25f;
+
+static size_t alignUp(size_t offset, size_t alignment) {
+    return (offset + alignment - 1) / alignment * alignment;
+}
+
+// Buffers are created and filled through the copy targets, which leave the
+// bindings of the VAOs alone
+static GLuint createArenaBuffer(size_t capacity) {
+    GLuint buffer;
+    glGenBuffers(1, &buffer);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+    if (GLEW_ARB_buffer_storage) {
+        glBufferStorage(GL_COPY_WRITE_BUFFER, capacity, NULL, GL_DYNAMIC_STORAGE_BIT);
+    } else {
+        glBufferData(GL_COPY_WRITE_BUFFER, capacity, NULL, GL_STATIC_DRAW);
+    }
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    return buffer;
+}
+
+BufferArena::BufferArena(size_t capacity)
+    : buffer(createArenaBuffer(capacity)), capacity(capacity), relocations(0) {
+    freeRanges[0] = capacity;
+}
+
+BufferArena::~BufferArena() {
+    for (ArenaBlock* block : blocks) delete block;
+    glDeleteBuffers(1, &buffer);
+}
+
+ArenaBlock* BufferArena::allocate(size_t size, size_t alignment) {
+    if (alignment == 0) alignment = 1;
+    ArenaBlock* block = place(size, alignment);
+    if (!block) {
+        relocate(size + alignment - 1);
+        block = place(size, alignment);
+    }
+    return block;
+}
+
+void BufferArena::free(ArenaBlock* block) {
+    if (!block) return;
+    blocks.erase(block);
+    size_t offset = block->offset, size = block->size;
+    delete block;
+    if (size == 0) return;
+
+    // merge with the free ranges on either side
+    auto next = freeRanges.lower_bound(offset);
+    if (next != freeRanges.end() && next->first == offset + size) {
+        size += next->second;
+        next = freeRanges.erase(next);
+    }
+    if (next != freeRanges.begin()) {
+        auto previous = prev(next);
+        if (previous->first + previous->second == offset) {
+            offset = previous->first;
+            size += previous->second;
+            freeRanges.erase(previous);
+        }
+    }
+    freeRanges[offset] = size;
+
+    // the range at the end is not a hole
+    size_t holes = 0;
+    for (const auto& range : freeRanges) {
+        if (range.first + range.second != capacity) holes += range.second;
+    }
+    if (holes > defragmentThreshold * capacity) defragment();
+}
+
+void BufferArena::upload(const ArenaBlock* block, const void* data) {
+    if (block->size == 0) return;
+    glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+    glBufferSubData(GL_COPY_WRITE_BUFFER, block->offset, block->size, data);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+}
+
+void BufferArena::copy(GLuint source, const ArenaBlock* block) {
+    if (block->size == 0) return;
+    glBindBuffer(GL_COPY_READ_BUFFER, source);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+    glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, block->offset, block->size);
+    glBindBuffer(GL_COPY_READ_BUFFER, 0);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+}
+
+void BufferArena::defragment() {
+    relocate(0);
+}
+
+ArenaStats BufferArena::stats() const {
+    ArenaStats stats{capacity, 0, blocks.size(), freeRanges.size(), 0, relocations};
+    for (const ArenaBlock* block : blocks) stats.used += block->size;
+    for (const auto& range : freeRanges) {
+        stats.largestFree = max(stats.largestFree, range.second);
+    }
+    return stats;
+}
+
+// First free range the block fits in once aligned, or nullptr
+ArenaBlock* BufferArena::place(size_t size, size_t alignment) {
+    for (auto range = freeRanges.begin(); range != freeRanges.end(); ++range) {
+        size_t start = range->first, end = range->first + range->second;
+        size_t offset = alignUp(start, alignment);
+        if (offset + size > end) continue;
+
+        freeRanges.erase(range);
+        if (offset > start) freeRanges[start] = offset - start;
+        if (offset + size < end) freeRanges[offset + size] = end - offset - size;
+        ArenaBlock* block = new ArenaBlock{this, offset, size, alignment};
+        blocks.insert(block);
+        return block;
+    }
+    return nullptr;
+}
+
+// Copy the live blocks, in order and packed, into a new buffer with at least
+// minimumFree bytes after them
+void BufferArena::relocate(size_t minimumFree) {
+    vector<ArenaBlock*> live(blocks.begin(), blocks.end());
+    sort(live.begin(), live.end(), [](const ArenaBlock* a, const ArenaBlock* b) {
+        return a->offset < b->offset;
+    });
+    size_t end = 0;
+    for (const ArenaBlock* block : live) end = alignUp(end, block->alignment) + block->size;
+    size_t newCapacity = capacity;
+    while (newCapacity < end + minimumFree) newCapacity *= 2;
+
+    GLuint target = createArenaBuffer(newCapacity);
+    glBindBuffer(GL_COPY_READ_BUFFER, buffer);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, target);
+    end = 0;
+    for (ArenaBlock* block : live) {
+        size_t offset = alignUp(end, block->alignment);
+        if (block->size > 0) {
+            glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER,
+                                block->offset, offset, block->size);
+        }
+        block->offset = offset;
+        end = offset + block->size;
+    }
+    glBindBuffer(GL_COPY_READ_BUFFER, 0);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    glDeleteBuffers(1, &buffer);
+
+    buffer = target;
+    capacity = newCapacity;
+    freeRanges.clear();
+    if (end < capacity) freeRanges[end] = capacity - end;
+    relocations++;
+}
+
+size_t bufferSize(GLuint buffer) {
+    GLint size = 0;
+    glBindBuffer(GL_COPY_READ_BUFFER, buffer);
+    glGetBufferParameteriv(GL_COPY_READ_BUFFER, GL_BUFFER_SIZE, &size);
+    glBindBuffer(GL_COPY_READ_BUFFER, 0);
+    return static_cast<size_t>(size);
+}
+
+/*****************************************************************************/
+
+size_t GeometryArena::initialCapacity = 16 * 1024 * 1024;
+BufferArena* GeometryArena::vertices = nullptr;
+BufferArena* GeometryArena::indices = nullptr;
+map<VertexSetupFunction, GLuint> GeometryArena::vertexArrays;
+GLuint GeometryArena::vertexBuffer = 0;
+GLuint GeometryArena::indexBuffer = 0;
+
+ArenaBlock* GeometryArena::allocateVertices(size_t size, size_t stride) {
+    ArenaBlock* block = arena(vertices).allocate(size, stride);
+    bindBuffers();
+    return block;
+}
+
+ArenaBlock* GeometryArena::allocateIndices(size_t size, size_t indexSize) {
+    ArenaBlock* block = arena(indices).allocate(size, indexSize);
+    bindBuffers();
+    return block;
+}
+
+void GeometryArena::free(ArenaBlock* block) {
+    if (!block) return;
+    block->arena->free(block);
+    bindBuffers();
+}
+
+GLuint GeometryArena::vertexArray(VertexSetupFunction format) {
+    bindBuffers();
+    GLuint& vertexArray = vertexArrays[format];
+    if (vertexArray == 0) {
+        glGenVertexArrays(1, &vertexArray);
+        glBindVertexArray(vertexArray);
+        glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
+        format();
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBuffer);
+    }
+    return vertexArray;
+}
+
+void GeometryArena::defragment() {
+    if (!vertices) return;
+    vertices->defragment();
+    indices->defragment();
+    bindBuffers();
+}
+
+ArenaStats GeometryArena::vertexStats() {
+    return vertices ? vertices->stats() : ArenaStats{};
+}
+
+ArenaStats GeometryArena::indexStats() {
+    return indices ? indices->stats() : ArenaStats{};
+}
+
+void GeometryArena::report() {
+    const char* names[2] = {"vertices", "indices"};
+    ArenaStats stats[2] = {vertexStats(), indexStats()};
+    for (int i = 0; i < 2; i++) {
+        cout << "Geometry arena, " << names[i] << ": " << stats[i].blocks << " blocks, "
+            << stats[i].used << " of " << stats[i].capacity << " bytes used, "
+            << stats[i].freeRanges << " free ranges, largest " << stats[i].largestFree
+            << " bytes, " << stats[i].relocations << " relocations" << endl;
+    }
+    cout << "Geometry arena: " << vertexArrays.size() << " vertex formats" << endl;
+}
+
+void GeometryArena::destroy() {
+    for (const auto& vertexArray : vertexArrays) {
+        glDeleteVertexArrays(1, &vertexArray.second);
+    }
+    vertexArrays.clear();
+    delete vertices;
+    delete indices;
+    vertices = indices = nullptr;
+    vertexBuffer = indexBuffer = 0;
+}
+
+BufferArena& GeometryArena::arena(BufferArena*& arena) {
+    if (!arena) arena = new BufferArena(initialCapacity);
+    return *arena;
+}
+
+// Point the VAOs at the arenas again if they moved to new buffers
+void GeometryArena::bindBuffers() {
+    GLuint vertexTarget = arena(vertices).buffer, indexTarget = arena(indices).buffer;
+    if (vertexTarget == vertexBuffer && indexTarget == indexBuffer) return;
+    for (const auto& vertexArray : vertexArrays) {
+        glBindVertexArray(vertexArray.second);
+        glBindBuffer(GL_ARRAY_BUFFER, vertexTarget);
+        vertexArray.first();
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexTarget);
+    }
+    glBindVertexArray(0);
+    vertexBuffer = vertexTarget;
+    indexBuffer = indexTarget;
+}
@@ -0,0 +1,361 @@
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+extern "C" {
+#include <image_DXT.h>
+}
+#include "dds.h"
+
+using namespace std;
+
+// The header that follows DDS_header when its FourCC is "DX10"
+struct DDSHeaderDX10 {
+    uint32_t dxgiFormat;
+    uint32_t resourceDimension;
+    uint32_t miscFlag;
+    uint32_t arraySize;
+    uint32_t miscFlags2;
+};
+
+static const uint32_t DDPF_ALPHA = 0x2;
+static const uint32_t DDPF_LUMINANCE = 0x20000;
+static const uint32_t DDSCAPS2_CUBEMAP_ALLFACES = 0xfc00;
+static const uint32_t DX10_DIMENSION_TEXTURE2D = 3;
+static const uint32_t DX10_MISC_TEXTURECUBE = 0x4;
+
+static uint32_t fourCC(const char* code) {
+    return uint32_t(code[0]) | uint32_t(code[1]) << 8 | uint32_t(code[2]) << 16 |
+           uint32_t(code[3]) << 24;
+}
+
+static DDSFormat blocks(GLenum internalFormat, unsigned int blockBytes) {
+    return DDSFormat{internalFormat, 0, 0, blockBytes, 0, {0, 0, 0, 0}};
+}
+
+static DDSFormat pixels(GLenum internalFormat, GLenum format, GLenum type, unsigned int bits) {
+    return DDSFormat{internalFormat, format, type, 0, bits, {0, 0, 0, 0}};
+}
+
+static DDSFormat swizzled(DDSFormat format, GLint r, GLint g, GLint b, GLint a) {
+    format.swizzle[0] = r;
+    format.swizzle[1] = g;
+    format.swizzle[2] = b;
+    format.swizzle[3] = a;
+    return format;
+}
+
+// DXGI_FORMAT values of the DX10 header, the typeless ones read as UNORM
+static bool dxgiFormat(uint32_t dxgi, DDSFormat& f) {
+    switch (dxgi) {
+    case 2:  f = pixels(GL_RGBA32F, GL_RGBA, GL_FLOAT, 128); return true;
+    case 6:  f = pixels(GL_RGB32F, GL_RGB, GL_FLOAT, 96); return true;
+    case 10: f = pixels(GL_RGBA16F, GL_RGBA, GL_HALF_FLOAT, 64); return true;
+    case 11: f = pixels(GL_RGBA16, GL_RGBA, GL_UNSIGNED_SHORT, 64); return true;
+    case 13: f = pixels(GL_RGBA16_SNORM, GL_RGBA, GL_SHORT, 64); return true;
+    case 16: f = pixels(GL_RG32F, GL_RG, GL_FLOAT, 64); return true;
+    case 24: f = pixels(GL_RGB10_A2, GL_RGBA, GL_UNSIGNED_INT_2_10_10_10_REV, 32); return true;
+    case 26: f = pixels(GL_R11F_G11F_B10F, GL_RGB, GL_UNSIGNED_INT_10F_11F_11F_REV, 32); return true;
+    case 27:
+    case 28: f = pixels(GL_RGBA8, GL_RGBA, GL_UNSIGNED_BYTE, 32); return true;
+    case 29: f = pixels(GL_SRGB8_ALPHA8, GL_RGBA, GL_UNSIGNED_BYTE, 32); return true;
+    case 31: f = pixels(GL_RGBA8_SNORM, GL_RGBA, GL_BYTE, 32); return true;
+    case 34: f = pixels(GL_RG16F, GL_RG, GL_HALF_FLOAT, 32); return true;
+    case 35: f = pixels(GL_RG16, GL_RG, GL_UNSIGNED_SHORT, 32); return true;
+    case 41: f = pixels(GL_R32F, GL_RED, GL_FLOAT, 32); return true;
+    case 49: f = pixels(GL_RG8, GL_RG, GL_UNSIGNED_BYTE, 16); return true;
+    case 51: f = pixels(GL_RG8_SNORM, GL_RG, GL_BYTE, 16); return true;
+    case 54: f = pixels(GL_R16F, GL_RED, GL_HALF_FLOAT, 16); return true;
+    case 56: f = pixels(GL_R16, GL_RED, GL_UNSIGNED_SHORT, 16); return true;
+    case 61: f = pixels(GL_R8, GL_RED, GL_UNSIGNED_BYTE, 8); return true;
+    case 63: f = pixels(GL_R8_SNORM, GL_RED, GL_BYTE, 8); return true;
+    case 65: f = swizzled(pixels(GL_R8, GL_RED, GL_UNSIGNED_BYTE, 8), GL_ZERO, GL_ZERO, GL_ZERO, GL_RED); return true;
+    case 67: f = pixels(GL_RGB9_E5, GL_RGB, GL_UNSIGNED_INT_5_9_9_9_REV, 32); return true;
+    case 70:
+    case 71: f = blocks(GL_COMPRESSED_RGBA_S3TC_DXT1_EXT, 8); return true;
+    case 72: f = blocks(GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT1_EXT, 8); return true;
+    case 73:
+    case 74: f = blocks(GL_COMPRESSED_RGBA_S3TC_DXT3_EXT, 16); return true;
+    case 75: f = blocks(GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT3_EXT, 16); return true;
+    case 76:
+    case 77: f = blocks(GL_COMPRESSED_RGBA_S3TC_DXT5_EXT, 16); return true;
+    case 78: f = blocks(GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT, 16); return true;
+    case 79:
+    case 80: f = blocks(GL_COMPRESSED_RED_RGTC1, 8); return true;
+    case 81: f = blocks(GL_COMPRESSED_SIGNED_RED_RGTC1, 8); return true;
+    case 82:
+    case 83: f = blocks(GL_COMPRESSED_RG_RGTC2, 16); return true;
+    case 84: f = blocks(GL_COMPRESSED_SIGNED_RG_RGTC2, 16); return true;
+    case 85: f = pixels(GL_RGB8, GL_RGB, GL_UNSIGNED_SHORT_5_6_5, 16); return true;
+    case 86: f = pixels(GL_RGB5_A1, GL_BGRA, GL_UNSIGNED_SHORT_1_5_5_5_REV, 16); return true;
+    case 87: f = pixels(GL_RGBA8, GL_BGRA, GL_UNSIGNED_BYTE, 32); return true;
+    case 88: f = pixels(GL_RGB8, GL_BGRA, GL_UNSIGNED_BYTE, 32); return true;
+    case 91: f = pixels(GL_SRGB8_ALPHA8, GL_BGRA, GL_UNSIGNED_BYTE, 32); return true;
+    case 93: f = pixels(GL_SRGB8, GL_BGRA, GL_UNSIGNED_BYTE, 32); return true;
+    case 94:
+    case 95: f = blocks(GL_COMPRESSED_RGB_BPTC_UNSIGNED_FLOAT_ARB, 16); return true;
+    case 96: f = blocks(GL_COMPRESSED_RGB_BPTC_SIGNED_FLOAT_ARB, 16); return true;
+    case 97:
+    case 98: f = blocks(GL_COMPRESSED_RGBA_BPTC_UNORM_ARB, 16); return true;
+    case 99: f = blocks(GL_COMPRESSED_SRGB_ALPHA_BPTC_UNORM_ARB, 16); return true;
+    case 115: f = pixels(GL_RGBA4, GL_BGRA, GL_UNSIGNED_SHORT_4_4_4_4_REV, 16); return true;
+    }
+    return false;
+}
+
+// FourCC codes of the legacy header, including the D3DFMT numbers writers
+// store there for float formats
+static bool fourCCFormat(uint32_t code, bool alpha, DDSFormat& f) {
+    if (code == fourCC("DXT1")) {
+        // DDPF_ALPHAPIXELS: its 3 color blocks are transparent
+        f = blocks(alpha ? GL_COMPRESSED_RGBA_S3TC_DXT1_EXT : GL_COMPRESSED_RGB_S3TC_DXT1_EXT, 8);
+    } else if (code == fourCC("DXT2") || code == fourCC("DXT3")) {
+        f = blocks(GL_COMPRESSED_RGBA_S3TC_DXT3_EXT, 16);
+    } else if (code == fourCC("DXT4") || code == fourCC("DXT5")) {
+        f = blocks(GL_COMPRESSED_RGBA_S3TC_DXT5_EXT, 16);
+    } else if (code == fourCC("ATI1") || code == fourCC("BC4U")) {
+        f = blocks(GL_COMPRESSED_RED_RGTC1, 8);
+    } else if (code == fourCC("BC4S")) {
+        f = blocks(GL_COMPRESSED_SIGNED_RED_RGTC1, 8);
+    } else if (code == fourCC("ATI2") || code == fourCC("BC5U")) {
+        f = blocks(GL_COMPRESSED_RG_RGTC2, 16);
+    } else if (code == fourCC("BC5S")) {
+        f = blocks(GL_COMPRESSED_SIGNED_RG_RGTC2, 16);
+    } else {
+        switch (code) {
+        case 36:  f = pixels(GL_RGBA16, GL_RGBA, GL_UNSIGNED_SHORT, 64); break;
+        case 111: f = pixels(GL_R16F, GL_RED, GL_HALF_FLOAT, 16); break;
+        case 112: f = pixels(GL_RG16F, GL_RG, GL_HALF_FLOAT, 32); break;
+        case 113: f = pixels(GL_RGBA16F, GL_RGBA, GL_HALF_FLOAT, 64); break;
+        case 114: f = pixels(GL_R32F, GL_RED, GL_FLOAT, 32); break;
+        case 115: f = pixels(GL_RG32F, GL_RG, GL_FLOAT, 64); break;
+        case 116: f = pixels(GL_RGBA32F, GL_RGBA, GL_FLOAT, 128); break;
+        default: return false;
+        }
+    }
+    return true;
+}
+
+// Uncompressed legacy formats, recognised by their bit masks
+static bool maskFormat(const DDS_header& header, DDSFormat& f) {
+    uint32_t flags = header.sPixelFormat.dwFlags;
+    uint32_t bits = header.sPixelFormat.dwRGBBitCount;
+    uint32_t r = header.sPixelFormat.dwRBitMask;
+    uint32_t g = header.sPixelFormat.dwGBitMask;
+    uint32_t b = header.sPixelFormat.dwBBitMask;
+    uint32_t a = (flags & (DDPF_ALPHAPIXELS | DDPF_ALPHA)) ? header.sPixelFormat.dwAlphaBitMask : 0;
+
+    if (flags & DDPF_RGB) {
+        if (bits == 32 && r == 0xff && g == 0xff00 && b == 0xff0000) {
+            f = pixels(a ? GL_RGBA8 : GL_RGB8, GL_RGBA, GL_UNSIGNED_BYTE, 32);
+        } else if (bits == 32 && r == 0xff0000 && g == 0xff00 && b == 0xff) {
+            f = pixels(a ? GL_RGBA8 : GL_RGB8, GL_BGRA, GL_UNSIGNED_BYTE, 32);
+        } else if (bits == 32 && r == 0x3ff && g == 0xffc00 && b == 0x3ff00000) {
+            f = pixels(GL_RGB10_A2, GL_RGBA, GL_UNSIGNED_INT_2_10_10_10_REV, 32);
+        } else if (bits == 32 && r == 0xffff && g == 0xffff0000) {
+            f = pixels(GL_RG16, GL_RG, GL_UNSIGNED_SHORT, 32);
+        } else if (bits == 24 && r == 0xff0000 && g == 0xff00 && b == 0xff) {
+            f = pixels(GL_RGB8, GL_BGR, GL_UNSIGNED_BYTE, 24);
+        } else if (bits == 24 && r == 0xff && g == 0xff00 && b == 0xff0000) {
+            f = pixels(GL_RGB8, GL_RGB, GL_UNSIGNED_BYTE, 24);
+        } else if (bits == 16 && r == 0xf800 && g == 0x7e0 && b == 0x1f) {
+            f = pixels(GL_RGB8, GL_RGB, GL_UNSIGNED_SHORT_5_6_5, 16);
+        } else if (bits == 16 && r == 0x7c00 && g == 0x3e0 && b == 0x1f) {
+            f = pixels(a ? GL_RGB5_A1 : GL_RGB5, GL_BGRA, GL_UNSIGNED_SHORT_1_5_5_5_REV, 16);
+        } else if (bits == 16 && r == 0xf00 && g == 0xf0 && b == 0xf) {
+            f = pixels(GL_RGBA4, GL_BGRA, GL_UNSIGNED_SHORT_4_4_4_4_REV, 16);
+        } else {
+            return false;
+        }
+    } else if (flags & DDPF_LUMINANCE) {
+        if (bits == 8 && r == 0xff) {
+            f = swizzled(pixels(GL_R8, GL_RED, GL_UNSIGNED_BYTE, 8), GL_RED, GL_RED, GL_RED, GL_ONE);
+        } else if (bits == 16 && r == 0xff && a == 0xff00) {
+            f = swizzled(pixels(GL_RG8, GL_RG, GL_UNSIGNED_BYTE, 16), GL_RED, GL_RED, GL_RED, GL_GREEN);
+        } else if (bits == 16 && r == 0xffff) {
+            f = swizzled(pixels(GL_R16, GL_RED, GL_UNSIGNED_SHORT, 16), GL_RED, GL_RED, GL_RED, GL_ONE);
+        } else {
+            return false;
+        }
+    } else if ((flags & DDPF_ALPHA) && bits == 8 && a == 0xff) {
+        f = swizzled(pixels(GL_R8, GL_RED, GL_UNSIGNED_BYTE, 8), GL_ZERO, GL_ZERO, GL_ZERO, GL_RED);
+    } else {
+        return false;
+    }
+    return true;
+}
+
+static size_t surfaceSize(const DDSFormat& format, int width, int height) {
+    if (format.blockBytes) {
+        return size_t((width + 3) / 4) * ((height + 3) / 4) * format.blockBytes;
+    }
+    return (size_t(width) * format.pixelBits + 7) / 8 * height;
+}
+
+DDSImage parseDDS(const unsigned char* data, size_t size) {
+    DDS_header header;
+    if (size < sizeof header || memcmp(data, "DDS ", 4) != 0) {
+        throw runtime_error("Not a DDS file");
+    }
+    memcpy(&header, data, sizeof header);
+    if (header.dwSize != 124 || header.dwWidth == 0 || header.dwHeight == 0 ||
+        header.dwWidth > 65536 || header.dwHeight > 65536) {
+        throw runtime_error("Malformed DDS header");
+    }
+    size_t offset = sizeof header;
+
+    DDSImage image;
+    image.width = header.dwWidth;
+    image.height = header.dwHeight;
+    image.layers = 1;
+    image.faces = 1;
+    bool volume = (header.sCaps.dwCaps2 & DDSCAPS2_VOLUME) ||
+                  ((header.dwFlags & DDSD_DEPTH) && header.dwDepth > 1);
+
+    uint32_t code = header.sPixelFormat.dwFourCC;
+    if ((header.sPixelFormat.dwFlags & DDPF_FOURCC) && code == fourCC("DX10")) {
+        DDSHeaderDX10 dx10;
+        if (size < offset + sizeof dx10) throw runtime_error("Truncated DDS DX10 header");
+        memcpy(&dx10, data + offset, sizeof dx10);
+        offset += sizeof dx10;
+        if (!dxgiFormat(dx10.dxgiFormat, image.format)) {
+            throw runtime_error("Unsupported DDS DXGI format: " + to_string(dx10.dxgiFormat));
+        }
+        if (dx10.resourceDimension != DX10_DIMENSION_TEXTURE2D) volume = true;
+        if (dx10.arraySize == 0 || dx10.arraySize > 65536) {
+            throw runtime_error("Malformed DDS DX10 header");
+        }
+        image.layers = dx10.arraySize;
+        if (dx10.miscFlag & DX10_MISC_TEXTURECUBE) image.faces = 6;
+    } else if (header.sPixelFormat.dwFlags & DDPF_FOURCC) {
+        bool alpha = (header.sPixelFormat.dwFlags & DDPF_ALPHAPIXELS) != 0;
+        if (!fourCCFormat(code, alpha, image.format)) {
+            throw runtime_error("Unsupported DDS FourCC: " + to_string(code));
+        }
+    } else if (!maskFormat(header, image.format)) {
+        throw runtime_error("Unsupported DDS pixel format");
+    }
+    if (header.sCaps.dwCaps2 & DDSCAPS2_CUBEMAP) {
+        if ((header.sCaps.dwCaps2 & DDSCAPS2_CUBEMAP_ALLFACES) != DDSCAPS2_CUBEMAP_ALLFACES) {
+            throw runtime_error("DDS cube maps without all six faces are not supported");
+        }
+        image.faces = 6;
+    }
+    if (volume) throw runtime_error("1D and 3D DDS textures are not supported");
+    if (image.faces == 6 && image.width != image.height) {
+        throw runtime_error("Malformed DDS cube map: faces are not square");
+    }
+
+    int fullChain = 1;
+    for (int s = std::max(image.width, image.height); s > 1; s /= 2) fullChain++;
+    if (header.dwMipMapCount > static_cast<uint32_t>(fullChain)) {
+        throw runtime_error("Malformed DDS header: too many mipmaps");
+    }
+    image.levels = std::max(1, static_cast<int>(header.dwMipMapCount));
+
+    if (image.faces == 6) {
+        image.target = image.layers > 1 ? GL_TEXTURE_CUBE_MAP_ARRAY : GL_TEXTURE_CUBE_MAP;
+    } else {
+        image.target = image.layers > 1 ? GL_TEXTURE_2D_ARRAY : GL_TEXTURE_2D;
+    }
+
+    // every face of every array element holds its whole mip chain
+    for (int layer = 0; layer < image.layers * image.faces; layer++) {
+        int width = image.width, height = image.height;
+        for (int level = 0; level < image.levels; level++) {
+            size_t bytes = surfaceSize(image.format, width, height);
+            if (bytes > size - offset) throw runtime_error("Truncated DDS file");
+            image.surfaces.push_back(DDSSurface{data + offset, bytes, width, height, level, layer});
+            offset += bytes;
+            width = std::max(1, width / 2);
+            height = std::max(1, height / 2);
+        }
+    }
+    return image;
+}
+
+GLuint uploadDDS(const DDSImage& image) {
+    GLenum target = image.target;
+    const DDSFormat& format = image.format;
+    bool array = target == GL_TEXTURE_2D_ARRAY || target == GL_TEXTURE_CUBE_MAP_ARRAY;
+    if (target == GL_TEXTURE_CUBE_MAP_ARRAY && !GLEW_VERSION_4_0 &&
+        !GLEW_ARB_texture_cube_map_array) {
+        throw runtime_error("DDS cube map arrays need GL 4.0");
+    }
+    int depth = image.layers * image.faces;
+
+    GLuint texture;
+    glGenTextures(1, &texture);
+    glBindTexture(target, texture);
+
+    // rows of uncompressed surfaces are packed
+    GLint alignment;
+    glGetIntegerv(GL_UNPACK_ALIGNMENT, &alignment);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
+    if (GLEW_ARB_texture_storage) {
+        if (array) {
+            glTexStorage3D(target, image.levels, format.internalFormat, image.width, image.height, depth);
+        } else {
+            glTexStorage2D(target, image.levels, format.internalFormat, image.width, image.height);
+        }
+    } else {
+        // define every level, then fill it like the storage above
+        for (int level = 0; level < image.levels; level++) {
+            const DDSSurface& s = image.surfaces[level];
+            if (array && format.blockBytes) {
+                glCompressedTexImage3D(target, level, format.internalFormat, s.width, s.height,
+                                       depth, 0, static_cast<GLsizei>(s.size * depth), NULL);
+            } else if (array) {
+                glTexImage3D(target, level, format.internalFormat, s.width, s.height, depth, 0,
+                             format.format, format.type, NULL);
+            }
+            for (int face = 0; !array && face < image.faces; face++) {
+                GLenum faceTarget = image.faces == 6 ? GL_TEXTURE_CUBE_MAP_POSITIVE_X + face : target;
+                if (format.blockBytes) {
+                    glCompressedTexImage2D(faceTarget, level, format.internalFormat, s.width,
+                                           s.height, 0, static_cast<GLsizei>(s.size), NULL);
+                } else {
+                    glTexImage2D(faceTarget, level, format.internalFormat, s.width, s.height, 0,
+                                 format.format, format.type, NULL);
+                }
+            }
+        }
+        glTexParameteri(target, GL_TEXTURE_MAX_LEVEL, image.levels - 1);
+    }
+
+    // each surface straight from where it points
+    for (const DDSSurface& s : image.surfaces) {
+        GLsizei bytes = static_cast<GLsizei>(s.size);
+        if (array && format.blockBytes) {
+            glCompressedTexSubImage3D(target, s.level, 0, 0, s.layer, s.width, s.height, 1,
+                                      format.internalFormat, bytes, s.data);
+        } else if (array) {
+            glTexSubImage3D(target, s.level, 0, 0, s.layer, s.width, s.height, 1,
+                            format.format, format.type, s.data);
+        } else {
+            GLenum faceTarget = image.faces == 6 ? GL_TEXTURE_CUBE_MAP_POSITIVE_X + s.layer : target;
+            if (format.blockBytes) {
+                glCompressedTexSubImage2D(faceTarget, s.level, 0, 0, s.width, s.height,
+                                          format.internalFormat, bytes, s.data);
+            } else {
+                glTexSubImage2D(faceTarget, s.level, 0, 0, s.width, s.height,
+                                format.format, format.type, s.data);
+            }
+        }
+    }
+    glPixelStorei(GL_UNPACK_ALIGNMENT, alignment);
+
+    // Trilinear filtering over the levels the file has; cube maps do not wrap
+    GLint wrap = image.faces == 6 ? GL_CLAMP_TO_EDGE : GL_REPEAT;
+    glTexParameteri(target, GL_TEXTURE_WRAP_S, wrap);
+    glTexParameteri(target, GL_TEXTURE_WRAP_T, wrap);
+    glTexParameteri(target, GL_TEXTURE_WRAP_R, wrap);
+    glTexParameteri(target, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(target, GL_TEXTURE_MIN_FILTER,
+                    image.levels > 1 ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+    if (format.swizzle[0]) glTexParameteriv(target, GL_TEXTURE_SWIZZLE_RGBA, format.swizzle);
+
+    return texture;
+}
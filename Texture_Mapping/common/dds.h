@@ -0,0 +1,64 @@
+#ifndef DDS_H
+#define DDS_H
+
+#include <GL/glew.h>
+#include <cstddef>
+#include <vector>
+
+/**
+* How GL stores and reads the pixels of a .dds format. Block compressed
+* formats have blockBytes per 4x4 block and no format or type; the others
+* have pixelBits per pixel, rows packed without padding.
+*/
+struct DDSFormat {
+    GLenum internalFormat;
+    GLenum format, type;
+    unsigned int blockBytes;
+    unsigned int pixelBits;
+    /* GL_TEXTURE_SWIZZLE_RGBA of luminance and alpha formats, all 0 for none */
+    GLint swizzle[4];
+};
+
+/**
+* One mipmap of one face or array layer, pointing into the .dds data.
+*/
+struct DDSSurface {
+    const unsigned char* data;
+    size_t size;
+    int width, height;
+    int level;
+    int layer;    // array element * faces + face, the zoffset of array textures
+};
+
+/**
+* The texture stored in a .dds: GL_TEXTURE_2D, GL_TEXTURE_CUBE_MAP,
+* GL_TEXTURE_2D_ARRAY or GL_TEXTURE_CUBE_MAP_ARRAY, with faces (1 or 6) per
+* array element and every surface in file order.
+*/
+struct DDSImage {
+    GLenum target;
+    DDSFormat format;
+    int width, height;
+    int levels, layers, faces;
+    std::vector<DDSSurface> surfaces;
+};
+
+/**
+* Parse a .dds file in memory: the legacy header with FourCC or bit mask
+* formats (DXT1-5, ATI1/2, BC4/5, RGB(A), luminance, alpha and D3DFMT float
+* formats) or the DX10 extended header (the DXGI formats GL can sample,
+* including BC6H and BC7), cube maps and texture arrays. The size of every
+* mipmap is computed from its dimensions and checked against the data.
+* Throws a runtime_error for malformed files and unsupported formats.
+*/
+DDSImage parseDDS(const unsigned char* data, size_t size);
+
+/**
+* Create the texture of a parsed .dds and upload every surface from where it
+* points, the mapping of the file or a buffer, into immutable storage when
+* GL_ARB_texture_storage is available. Returns the texture, bound to
+* image.target.
+*/
+GLuint uploadDDS(const DDSImage& image);
+
+#endif
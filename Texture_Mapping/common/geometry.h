@@ -0,0 +1,95 @@
+#ifndef GEOMETRY_H
+#define GEOMETRY_H
+
+#include <GL/glew.h>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <vector>
+#include <glm/glm.hpp>
+#include "simplify.h"
+#include "vertex.h"
+
+class Drawable;
+struct ArenaBlock;
+
+/**
+* Content hash of an indexed triangle mesh that does not depend on the order
+* of its vertices or triangles: every triangle is hashed from the position,
+* normal and uv of its corners in winding order, from any corner, and the
+* triangle hashes are summed. With mirrorAxis 0, 1 or 2 the mesh is hashed
+* as if it were mirrored along x, y or z, with its winding reversed so its
+* triangles still face out, which is how left and right bones are modelled.
+*/
+uint64_t hashGeometry(
+    const std::vector<glm::vec3>& positions, const std::vector<glm::vec3>& normals,
+    const std::vector<glm::vec2>& uvs, const std::vector<unsigned int>& indices,
+    int mirrorAxis = -1);
+
+/**
+* VAO and buffers of a registered drawable, or its blocks of the
+* GeometryArena, with what is needed to draw them. They are deleted with the
+* last drawable that uses them.
+*/
+struct SharedGeometry {
+    uint64_t key;
+    GLuint VAO, vertexVBO, elementVBO;
+    ArenaBlock* vertexBlock;
+    ArenaBlock* indexBlock;
+    GLenum indexType;
+    size_t vertexStride;
+    VertexSetupFunction vertexSetup;
+    size_t vertexBytes, indexBytes;
+    glm::mat4 dequantization;
+    std::vector<MeshLOD> lods;
+    glm::vec4 bounds;
+
+    ~SharedGeometry();
+};
+
+struct GeometryMemory {
+    size_t drawables;          // using registered geometry
+    size_t geometries;         // distinct registered geometries
+    size_t gpuBytes;           // held by their buffers
+    size_t unsharedGpuBytes;   // if every drawable had buffers of its own
+    size_t releasedCpuBytes;   // freed by Drawable::releaseCPU()
+};
+
+/**
+* Registry of the GPU geometry of drawables, keyed by hashGeometry() of
+* their indexed arrays and by their vertex format and number of LODs.
+* Drawables with the same geometry, or a mirror image of it, share one VAO
+* and one set of buffers, counted by the drawables that hold them. A mirror
+* image is drawn with the reflection folded into its dequantization, so its
+* winding is reversed. Only use it on the thread that draws.
+*/
+class GeometryRegistry {
+public:
+    /* Make drawable use the buffers of a registered drawable with the same
+    geometry, deleting its own, or register it if there is none. Its buffers
+    must be uploaded and its indexed arrays still filled. Returns true if it
+    shares another drawable's buffers */
+    static bool share(Drawable& drawable);
+
+    /* Make drawable use the buffers of source, registering source first if
+    needed, mirrored along mirrorAxis unless it is -1. Use it when drawable is
+    known to have the same geometry, e.g. before its buffers are uploaded */
+    static void share(Drawable& drawable, Drawable& source, int mirrorAxis = -1);
+
+    static GeometryMemory memory();
+    /* Logs memory() */
+    static void report();
+
+    /* Bytes of CPU copies freed by Drawable::releaseCPU() */
+    static size_t releasedCpuBytes;
+
+private:
+    static std::map<uint64_t, std::weak_ptr<SharedGeometry>> entries;
+
+    static uint64_t key(const Drawable& drawable, int mirrorAxis);
+    static void add(Drawable& drawable, uint64_t key);
+    static void use(Drawable& drawable, const std::shared_ptr<SharedGeometry>& geometry,
+                    const glm::mat4& dequantization, glm::vec4 bounds, int mirrorAxis);
+};
+
+#endif
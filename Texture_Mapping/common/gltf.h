@@ -0,0 +1,134 @@
+#ifndef GLTF_H
+#define GLTF_H
+
+#include <GL/glew.h>
+#include <cstddef>
+#include <string>
+#include <utility>
+#include <vector>
+#include "model.h"
+#include "util.h"
+
+/**
+* A value of the JSON chunk of a .glb. Objects keep their members in order,
+* booleans are numbers 0 and 1.
+*/
+struct JSONValue {
+    enum Type { NUL, BOOLEAN, NUMBER, STRING, ARRAY, OBJECT };
+    Type type;
+    double number;
+    std::string text;
+    std::vector<JSONValue> items;
+    std::vector<std::pair<std::string, JSONValue>> members;
+
+    JSONValue() : type(NUL), number(0.0) {}
+
+    /* Member of an object, or nullptr if it is missing */
+    const JSONValue* find(const char* key) const;
+    /* Number of a member, or fallback if it is missing */
+    double get(const char* key, double fallback) const;
+    /* Items of an array member, none if it is missing */
+    const std::vector<JSONValue>& array(const char* key) const;
+    /* Item of an array member, throws if it is missing */
+    const JSONValue& at(const char* key, size_t index) const;
+};
+
+/**
+* Index into another glTF array, e.g. the accessor of an attribute. Throws
+* if value is not one.
+*/
+size_t glbIndex(const JSONValue& value);
+
+/**
+* Size in bytes of a glTF component type, which are GL enums.
+*/
+size_t glbComponentSize(GLenum type);
+
+/**
+* An accessor pointing into the binary chunk. glTF uses the GL enums for its
+* component types.
+*/
+struct GLBAccessor {
+    const unsigned char* data;
+    size_t count;
+    size_t stride;    // the byteStride of the buffer view, or the element size
+    GLenum componentType;
+    int components;
+    bool normalized;
+    size_t view;      // index of the buffer view
+    size_t offset;    // byteOffset in the buffer view
+};
+
+/**
+* A mapped .glb: its parsed JSON chunk and its binary chunk, if any. Throws
+* a runtime_error if it is not a glTF 2.0 binary file.
+*/
+struct GLBFile {
+    MappedFile file;
+    JSONValue json;
+    const unsigned char* bin;
+    size_t binSize;
+
+    GLBFile(const std::string& path);
+
+    /* Bytes of a buffer view, which must be in the binary chunk */
+    const unsigned char* bufferView(size_t index, size_t& size) const;
+    /* An accessor, checked to be within its buffer view */
+    GLBAccessor accessor(size_t index) const;
+};
+
+/**
+* How GL reads an attribute of a primitive straight from its buffer view:
+* the arguments of glVertexAttribPointer(), with the offset counted from
+* the start of the view.
+*/
+struct GLBAttribute {
+    GLuint location;
+    GLint size;
+    GLenum type;
+    GLboolean normalized;
+    GLsizei stride;
+    size_t view;
+    size_t offset;
+};
+
+/**
+* An indexed triangle primitive as GL draws it straight from the binary
+* chunk: POSITION, NORMAL, TEXCOORD_0, JOINTS_0 and WEIGHTS_0 at the
+* locations of PositionAttribute, NormalAttribute, UVAttribute,
+* JointAttribute and WeightAttribute, and the indices in their own type,
+* checked to be within the vertices. indexType is 0 if the primitive is not
+* indexed, it can not be drawn like this then.
+*/
+struct GLBPrimitive {
+    std::vector<GLBAttribute> attributes;
+    size_t vertexCount;
+    GLenum indexType;
+    size_t indexCount;
+    size_t indexView;
+    size_t indexOffset;
+    int material;    // -1 for glTF's default material
+};
+
+GLBPrimitive describeGLBPrimitive(const GLBFile& file, const JSONValue& primitive);
+
+/**
+* Indexed arrays of a triangle primitive, with its first set of uvs and of
+* joints and weights. Primitives without indices get 0, 1, 2... The
+* accessors are copied out of the binary chunk, as they are if they already
+* have the type of the arrays.
+*/
+MeshData readGLBPrimitive(const GLBFile& file, const JSONValue& primitive);
+
+/**
+* A binary glTF 2.0 (.glb) loader. The file is memory mapped and the accessors
+* of every triangle primitive are copied out of its binary chunk, as they are
+* if they already have the type of the arrays, so positions, normals, uvs,
+* indices and float weights take one memcpy each. The primitives of all
+* meshes are merged, without their node transforms. Texture coordinates are
+* kept as they are, glTF already has the image origin at the top like the
+* flipped .obj uvs.
+*/
+MeshData loadGLB(const std::string& path);
+
+#endif
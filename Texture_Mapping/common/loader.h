@@ -0,0 +1,134 @@
+#ifndef LOADER_H
+#define LOADER_H
+
+#include <GL/glew.h>
+#include <memory>
+#include <vector>
+#include <string>
+#include "model.h"
+#include "texture.h"
+#include "texcache.h"
+
+struct GLFWwindow;
+
+/**
+* Work done for a mesh of AssetLoader on the loading threads, before it is
+* uploaded.
+*/
+struct MeshLoadOptions {
+    /* See Drawable::quantize(), without extra attributes */
+    bool quantize;
+    /* See Drawable::generateLODs(), no LODs if empty */
+    std::vector<float> lodRatios;
+    /* Meshes of the batch with the same geometry, or mirror images of each
+    other, are prepared and uploaded once and share their buffers, see
+    GeometryRegistry */
+    bool share;
+    /* See Drawable::releaseCPU() */
+    bool releaseCPU;
+    /* See Drawable::moveToArena(), done before sharing */
+    bool arena;
+};
+
+/**
+* Time spent by AssetLoader. The load, prepare and upload times are summed
+* over all threads, so with several threads they exceed the wall time.
+*/
+struct AssetLoadStats {
+    size_t meshes, textures;
+    unsigned int threads;
+    double loadMs;       // reading, parsing, indexing and optimizing, or decoding images
+    double prepareMs;    // quantization and LODs
+    double uploadMs;     // filling buffers and textures
+    double attachMs;     // creating VAOs, on the thread that draws
+    double wallMs;
+};
+
+/**
+* Batch loader for the assets of a scene. Every mesh and texture is
+* registered first, then a pool of threads reads, parses and prepares them.
+* Images are decoded, and their mipmaps built and compressed, in parallel.
+* The finished assets are passed on to be uploaded through lock-free queues.
+*
+* load() uploads them on the calling thread as they arrive and returns when
+* everything is loaded. start() returns at once: a thread with a second GL
+* context, shared with the window, uploads the assets and fences them, and
+* poll() hands them over once the GPU is done, so a scene can be drawn
+* while it streams in. The thread that uploads loads assets too while none
+* is waiting.
+*/
+class AssetLoader {
+public:
+    /* threads is the number of threads that load, including the one that
+    uploads, 0 uses every hardware thread */
+    AssetLoader(unsigned int threads = 0);
+    /* Stops streaming; assets that were not handed over are dropped */
+    ~AssetLoader();
+
+    /* The returned drawable has no buffers and VAO 0 until it is loaded. It
+    is owned by the caller, like one made with new Drawable(path). Assets can
+    not be added while streaming */
+    Drawable* addMesh(const std::string& path,
+                      const MeshLoadOptions& options = MeshLoadOptions{false, {}, false, false, false});
+
+    /* texture receives the texture of the image once it is loaded, block
+    compressed through its TextureCache if TextureCache::supported(), until
+    then it is left alone */
+    void addTexture(const std::string& path, GLuint& texture);
+
+    /* Load everything registered since the last call. The first exception
+    of a thread is rethrown once all of them are done */
+    AssetLoadStats load();
+
+    /* Stream everything registered since the last call, see poll(). Must be
+    called on the main thread with the context of window current */
+    void start(GLFWwindow* window);
+
+    /* Call every frame on the thread of the window's context. Hands over the
+    assets whose upload the GPU has finished and returns true once all of
+    them are, or if nothing is streaming. The first exception of a thread is
+    rethrown once all of them are done */
+    bool poll();
+
+private:
+    struct Job {
+        std::string path;
+        Drawable* drawable;
+        /* Filled on the loading and upload threads, then moved to drawable */
+        std::unique_ptr<Drawable> loaded;
+        MeshLoadOptions options;
+        GLuint* texture;
+        SOILImage image;
+        bool compress;
+        std::unique_ptr<TextureCache> cache;
+        GLuint uploadedTexture;
+        /* Indices of every LOD and the compact vertex arrays, if requested */
+        std::vector<unsigned int> chain;
+        std::vector<glm::u16vec4> positions;
+        std::vector<uint32_t> normals, uvs;
+        VertexSetupFunction setup;
+        GLsync fence;
+        double loadMs, prepareMs, uploadMs;
+        /* The job whose buffers this one shares, mirrored along mirrorAxis
+        unless it is -1 */
+        Job* source;
+        int mirrorAxis;
+        bool attached;
+    };
+    struct Batch;
+
+    unsigned int threads;
+    std::vector<Job> jobs;
+    std::unique_ptr<Batch> batch;
+
+    void begin(GLFWwindow* context);
+    bool work();
+    void uploadAll(bool fence);
+    AssetLoadStats finish();
+    void run(Job& job);
+    bool findSource(Job& job);
+    void upload(Job& job);
+    void attach(Job& job);
+};
+
+#endif
@@ -0,0 +1,207 @@
+#include <algorithm>
+#include <cmath>
+#include "meshlet.h"
+
+using namespace glm;
+using namespace std;
+
+// Weight of a triangle's deviation from the average normal of the meshlet,
+// against the number of vertices it adds, when growing a meshlet. Narrow
+// normal cones let more meshlets be culled as backfacing
+static const float MESHLET_CONE_WEIGHT = 2.0f;
+
+// Sphere and normal cone of the triangles [first, first + count) of indices
+static void computeMeshletBounds(
+    Meshlet& meshlet, const vector<unsigned int>& indices, const vector<vec3>& positions) {
+    vec3 lo = positions[indices[meshlet.first]], hi = lo;
+    for (unsigned int i = meshlet.first; i < meshlet.first + meshlet.count; i++) {
+        lo = min(lo, positions[indices[i]]);
+        hi = max(hi, positions[indices[i]]);
+    }
+    vec3 center = (lo + hi) * 0.5f;
+    float radius = 0.0f;
+    for (unsigned int i = meshlet.first; i < meshlet.first + meshlet.count; i++) {
+        radius = std::max(radius, length(positions[indices[i]] - center));
+    }
+    meshlet.sphere = vec4(center, radius);
+
+    vector<vec3> normals;
+    vec3 axis(0.0f);
+    for (unsigned int i = meshlet.first; i < meshlet.first + meshlet.count; i += 3) {
+        const vec3& a = positions[indices[i]];
+        vec3 n = cross(positions[indices[i + 1]] - a, positions[indices[i + 2]] - a);
+        float area = length(n);
+        if (area == 0.0f) continue;
+        normals.push_back(n / area);
+        axis += normals.back();
+    }
+    float axisLength = length(axis);
+    meshlet.coneAxis = axisLength > 0.0f ? axis / axisLength : vec3(0.0f, 0.0f, 1.0f);
+    meshlet.coneCutoff = 1.0f;
+    if (axisLength == 0.0f || normals.empty()) return;
+
+    float minDot = 1.0f;
+    for (const auto& n : normals) minDot = std::min(minDot, dot(n, meshlet.coneAxis));
+    // a cone wider than about 84 degrees is hardly ever culled
+    if (minDot > 0.1f) meshlet.coneCutoff = sqrt(1.0f - minDot * minDot);
+}
+
+vector<Meshlet> buildMeshlets(
+    vector<unsigned int>& indices, const vector<vec3>& positions,
+    unsigned int maxVertices, unsigned int maxTriangles) {
+    size_t triangleCount = indices.size() / 3;
+    size_t vertexCount = positions.size();
+    vector<Meshlet> meshlets;
+    if (triangleCount == 0) return meshlets;
+
+    // triangles around every vertex
+    vector<size_t> offsets(vertexCount + 1, 0);
+    for (size_t i = 0; i < triangleCount * 3; i++) offsets[indices[i] + 1]++;
+    for (size_t v = 0; v < vertexCount; v++) offsets[v + 1] += offsets[v];
+    vector<unsigned int> adjacency(offsets.back());
+    {
+        vector<size_t> fill(offsets.begin(), offsets.end() - 1);
+        for (size_t i = 0; i < triangleCount * 3; i++) {
+            adjacency[fill[indices[i]]++] = static_cast<unsigned int>(i / 3);
+        }
+    }
+
+    vector<vec3> normals(triangleCount);
+    for (size_t t = 0; t < triangleCount; t++) {
+        const vec3& a = positions[indices[3 * t]];
+        vec3 n = cross(positions[indices[3 * t + 1]] - a, positions[indices[3 * t + 2]] - a);
+        float area = length(n);
+        normals[t] = area > 0.0f ? n / area : vec3(0.0f);
+    }
+
+    vector<unsigned int> output;
+    output.reserve(triangleCount * 3);
+    vector<bool> used(triangleCount, false);
+    // the meshlet a vertex was last added to, plus one
+    vector<unsigned int> inMeshlet(vertexCount, 0);
+    vector<unsigned int> candidates;
+    size_t cursor = 0;
+
+    while (true) {
+        while (cursor < triangleCount && used[cursor]) cursor++;
+        if (cursor == triangleCount) break;
+
+        Meshlet meshlet{};
+        meshlet.first = static_cast<unsigned int>(output.size());
+        unsigned int stamp = static_cast<unsigned int>(meshlets.size() + 1);
+        candidates.clear();
+        vec3 normalSum(0.0f);
+
+        auto newVertices = [&](unsigned int t) {
+            unsigned int n = 0;
+            for (int k = 0; k < 3; k++) n += inMeshlet[indices[3 * t + k]] != stamp;
+            return n;
+        };
+        auto add = [&](unsigned int t) {
+            used[t] = true;
+            normalSum += normals[t];
+            for (int k = 0; k < 3; k++) {
+                unsigned int v = indices[3 * t + k];
+                output.push_back(v);
+                if (inMeshlet[v] == stamp) continue;
+                inMeshlet[v] = stamp;
+                meshlet.vertexCount++;
+                for (size_t a = offsets[v]; a < offsets[v + 1]; a++) {
+                    if (!used[adjacency[a]]) candidates.push_back(adjacency[a]);
+                }
+            }
+            meshlet.count += 3;
+        };
+
+        add(static_cast<unsigned int>(cursor));
+        // grow by the neighbour that adds the fewest vertices and keeps the
+        // normals closest together
+        while (meshlet.count / 3 < maxTriangles) {
+            float axisLength = length(normalSum);
+            vec3 axis = axisLength > 0.0f ? normalSum / axisLength : vec3(0.0f);
+            float bestScore = 0.0f;
+            size_t best = 0;
+            bool found = false;
+            size_t live = 0;
+            for (size_t i = 0; i < candidates.size(); i++) {
+                unsigned int t = candidates[i];
+                if (used[t]) continue;
+                candidates[live] = t;
+                unsigned int n = newVertices(t);
+                float score = n + MESHLET_CONE_WEIGHT * (1.0f - dot(normals[t], axis));
+                if (meshlet.vertexCount + n <= maxVertices && (!found || score < bestScore)) {
+                    best = live;
+                    bestScore = score;
+                    found = true;
+                }
+                live++;
+            }
+            candidates.resize(live);
+            if (!found) break;
+            unsigned int t = candidates[best];
+            candidates[best] = candidates.back();
+            candidates.pop_back();
+            add(t);
+        }
+
+        computeMeshletBounds(meshlet, output, positions);
+        meshlets.push_back(meshlet);
+    }
+
+    // keep a trailing partial triangle, if any
+    output.insert(output.end(), indices.begin() + triangleCount * 3, indices.end());
+    indices.swap(output);
+    return meshlets;
+}
+
+MeshletStats cullMeshlets(
+    const vector<Meshlet>& meshlets, const mat4& modelView, const mat4& projection,
+    size_t indexSize, bool backfaces, MeshletDrawList& draws) {
+    draws.counts.clear();
+    draws.offsets.clear();
+    MeshletStats stats{meshlets.size(), 0, 0, 0, 0};
+
+    // frustum planes in model space (Gribb and Hartmann), normalized so the
+    // sphere radius can be compared with the distance directly
+    mat4 mvp = projection * modelView;
+    vec4 row[4];
+    for (int i = 0; i < 4; i++) row[i] = vec4(mvp[0][i], mvp[1][i], mvp[2][i], mvp[3][i]);
+    vec4 planes[6] = {row[3] + row[0], row[3] - row[0], row[3] + row[1],
+                      row[3] - row[1], row[3] + row[2], row[3] - row[2]};
+    for (auto& plane : planes) plane /= length(vec3(plane));
+    vec3 camera = vec3(inverse(modelView) * vec4(0.0f, 0.0f, 0.0f, 1.0f));
+
+    unsigned int rangeEnd = ~0u;
+    for (const auto& meshlet : meshlets) {
+        stats.triangles += meshlet.count / 3;
+        vec3 center(meshlet.sphere);
+        float radius = meshlet.sphere.w;
+
+        bool visible = true;
+        for (const auto& plane : planes) {
+            if (dot(vec3(plane), center) + plane.w < -radius) {
+                visible = false;
+                break;
+            }
+        }
+        if (visible && backfaces) {
+            // every point of the sphere must see the cone from behind
+            vec3 view = center - camera;
+            float cutoff = meshlet.coneCutoff;
+            visible = dot(view, meshlet.coneAxis) <= cutoff * length(view) + radius * (1.0f + cutoff);
+        }
+        if (!visible) continue;
+
+        stats.visibleMeshlets++;
+        stats.visibleTriangles += meshlet.count / 3;
+        if (meshlet.first == rangeEnd) {
+            draws.counts.back() += meshlet.count;
+        } else {
+            draws.counts.push_back(meshlet.count);
+            draws.offsets.push_back(reinterpret_cast<const void*>(meshlet.first * indexSize));
+        }
+        rangeEnd = meshlet.first + meshlet.count;
+    }
+    stats.ranges = draws.counts.size();
+    return stats;
+}
@@ -1,33 +1,38 @@
 #include <iostream>
 #include <sstream>
+#include <cstring>
+#include <cstdint>
+#include <cmath>
+#include <algorithm>
+#include <type_traits>
+#include <thread>
 #include <map>
-#include <tinyxml2.h>
 #define TINYOBJLOADER_IMPLEMENTATION
 #include <tiny_obj_loader.h>
+#include <stb_image_aug.h>
 #include "util.h"
+#include "cache.h"
 #include "model.h"
+#include "optimize.h"
 #include "texture.h"
+#include "texcache.h"
+#include "texstream.h"
+#include "geometry.h"
+#include "arena.h"
+#include "gltf.h"
 
 using namespace glm;
 using namespace std;
 using namespace ogl;
-using namespace tinyxml2;
 
 // simple OBJ loader
-void loadOBJ(
-    const string& path,
-    vector<vec3>& vertices,
-    vector<vec2>& uvs,
-    vector<vec3>& normals,
-    vector<unsigned int>& indices
-) {
+MeshData loadOBJ(const string& path) {
     cout << "Loading OBJ file: " << path << endl;
 
     vector<unsigned int> vertexIndices, uvIndices, normalIndices;
     vector<vec3> temp_vertices;
     vector<vec2> temp_uvs;
     vector<vec3> temp_normals;
-    indices.clear();
 
     FILE * file = fopen(path.c_str(), "r");
     if (file == NULL) {
@@ -85,6 +90,11 @@ void loadOBJ(
         }
     }
 
+    MeshData mesh;
+    mesh.vertices.reserve(vertexIndices.size());
+    mesh.uvs.reserve(vertexIndices.size());
+    mesh.normals.reserve(vertexIndices.size());
+
     // For each vertex of each triangle
     for (unsigned int i = 0; i < vertexIndices.size(); i++) {
         // Get the indices of its attributes
@@ -98,138 +108,542 @@ void loadOBJ(
         vec3 normal = temp_normals[normalIndex - 1];
 
         // Put the attributes in buffers
-        vertices.push_back(vertex);
-        uvs.push_back(uv);
-        normals.push_back(normal);
-        indices.push_back(indices.size());
+        mesh.vertices.push_back(vertex);
+        mesh.uvs.push_back(uv);
+        mesh.normals.push_back(normal);
     }
     fclose(file);
+    return mesh;
 }
 
-void loadVTP(
-    const string& path,
-    vector<vec3>& vertices, vector<vec2>& uvs,
-    vector<vec3>& normals,
-    vector<unsigned int>& indices) {
-    indices.clear();
-    const char* method = "PolygonalMesh::loadVtpFile()";
-    XMLDocument vtp;
-    assert(vtp.LoadFile(path.c_str()) == 0);
-
-    XMLElement* root = vtp.FirstChildElement("VTKFile");
-    assert(root != nullptr);
-    assert(root->Attribute("type", "PolyData"));
-
-    XMLElement* polydata = root->FirstChildElement("PolyData");
-    assert(polydata != nullptr);
-    XMLElement* piece = polydata->FirstChildElement("Piece");
-    assert(piece != nullptr);
-    XMLElement* enormals = piece->FirstChildElement("PointData");
-    assert(enormals != nullptr);
-    XMLElement* points = piece->FirstChildElement("Points");
-    assert(points != nullptr);
-
-    int numPoints, numPolys;
-    piece->QueryIntAttribute("NumberOfPoints", &numPoints);
-    piece->QueryIntAttribute("NumberOfPolys", &numPolys);
-
-    //assert(enormals->Attribute("format", "ascii"));
-    const char* normalsStr = enormals->FirstChildElement("DataArray")->FirstChild()->Value();
-    stringstream sNorm(normalsStr);
-    vector<vec3> tempNormals;
-    do {
-        vec3 normal;
-        sNorm >> normal.x >> normal.y >> normal.z;
-        tempNormals.push_back(normal);
-    } while (sNorm.good());
-    assert(tempNormals.size() == numPoints + 1);
-
-    XMLElement* pointData = points->FirstChildElement("DataArray");
-    assert(pointData != nullptr);
-    assert(pointData->Attribute("format", "ascii"));
-    const char* coordsStr = points->FirstChildElement("DataArray")->FirstChild()->Value();
-
-    stringstream sCoord(coordsStr);
-    vector<vec3> coordinates;
-    do {
-        vec3 coord;
-        sCoord >> coord.x >> coord.y >> coord.z;
-        coordinates.push_back(coord);
-    } while (sCoord.good());
-    coordinates.pop_back();  // the last is corrupted
-    assert(coordinates.size() == numPoints);
-
-    XMLElement* polys = piece->FirstChildElement("Polys");
-    assert(polys != nullptr);
-
-    // TODO beter implementation
-    XMLElement *econnectivity, *eoffsets;
-    if (polys->FirstChildElement("DataArray")->Attribute("Name", "connectivity")) {
-        econnectivity = polys->FirstChildElement("DataArray");
-        assert(econnectivity != nullptr);
-        assert(econnectivity->Attribute("format", "ascii"));
-    } else {
-        throw runtime_error("Can't access connectivity");
+// Tag of the XML subset written by VTK. The attribute text points into the
+// parsed buffer.
+struct XMLTag {
+    string name;
+    bool closing, selfClosing;
+    const char* attributes;
+    const char* attributesEnd;
+
+    // Value of an attribute, or an empty string if it is missing
+    string attribute(const char* key) const {
+        size_t keyLength = strlen(key);
+        const char* p = attributes;
+        while (p < attributesEnd) {
+            while (p < attributesEnd && isXMLSpace(*p)) p++;
+            const char* nameBegin = p;
+            while (p < attributesEnd && *p != '=' && !isXMLSpace(*p)) p++;
+            const char* nameEnd = p;
+            while (p < attributesEnd && *p != '"' && *p != '\'') p++;
+            if (p == attributesEnd) break;
+            char quote = *p++;
+            const char* valueBegin = p;
+            while (p < attributesEnd && *p != quote) p++;
+            if (static_cast<size_t>(nameEnd - nameBegin) == keyLength &&
+                strncmp(nameBegin, key, keyLength) == 0) {
+                return string(valueBegin, p);
+            }
+            p++;
+        }
+        return string();
     }
 
-    if (polys->LastChildElement("DataArray")->Attribute("Name", "offsets")) {
-        eoffsets = polys->LastChildElement("DataArray");
-        assert(eoffsets != nullptr);
-        assert(eoffsets->Attribute("format", "ascii"));
-    } else {
-        throw runtime_error("Can't access offsets");
+    static bool isXMLSpace(char c) {
+        return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+    }
+};
+
+// Advances p past the next tag, skipping text, comments and processing
+// instructions. Returns false at the end of the document.
+static bool nextXMLTag(const char*& p, const char* end, XMLTag& tag) {
+    while (true) {
+        p = static_cast<const char*>(memchr(p, '<', end - p));
+        if (p == nullptr) {
+            p = end;
+            return false;
+        }
+        if (end - p >= 4 && strncmp(p, "<!--", 4) == 0) {
+            const char* close = p + 4;
+            while (end - close >= 3 && strncmp(close, "-->", 3) != 0) close++;
+            p = end - close >= 3 ? close + 3 : end;
+            continue;
+        }
+        if (end - p >= 2 && (p[1] == '?' || p[1] == '!')) {
+            const char* close = static_cast<const char*>(memchr(p, '>', end - p));
+            p = close ? close + 1 : end;
+            continue;
+        }
+        break;
+    }
+
+    p++;
+    tag.closing = p != end && *p == '/';
+    if (tag.closing) p++;
+    const char* nameBegin = p;
+    while (p != end && !XMLTag::isXMLSpace(*p) && *p != '>' && *p != '/') p++;
+    tag.name.assign(nameBegin, p);
+
+    tag.attributes = p;
+    char quote = 0;
+    while (p != end && (quote || *p != '>')) {
+        if (*p == '"' || *p == '\'') quote = quote == *p ? 0 : (quote ? quote : *p);
+        p++;
+    }
+    if (p == end) throw runtime_error("Unterminated XML tag: " + tag.name);
+    tag.selfClosing = p[-1] == '/';
+    tag.attributesEnd = tag.selfClosing ? p - 1 : p;
+    p++;
+    return true;
+}
+
+// Parses whitespace separated numbers up to the next tag into out
+template<typename T>
+static const char* parseVTPASCII(const char* p, const char* end, T* out, size_t count,
+                                 const char* (*parse)(const char*, const char*, T&)) {
+    for (size_t i = 0; i < count; i++) {
+        while (p != end && XMLTag::isXMLSpace(*p)) p++;
+        const char* next = parse(p, end, out[i]);
+        if (next == p) throw runtime_error("Too few values in VTP DataArray");
+        p = next;
+    }
+    while (p != end && XMLTag::isXMLSpace(*p)) p++;
+    if (p != end && *p != '<') throw runtime_error("Too many values in VTP DataArray");
+    return p;
+}
+
+// Parses whitespace separated integers of unknown count up to the next tag.
+// Negative values wrap around, past any point id
+static const char* parseVTPASCII(const char* p, const char* end, vector<unsigned int>& out) {
+    while (true) {
+        while (p != end && XMLTag::isXMLSpace(*p)) p++;
+        if (p == end || *p == '<') return p;
+        int value;
+        const char* next = parseInt(p, end, value);
+        if (next == p) throw runtime_error("Malformed value in VTP DataArray");
+        out.push_back(static_cast<unsigned int>(value));
+        p = next;
+    }
+}
+
+// Encoding of the binary DataArrays of a .vtp file
+struct VTPEncoding {
+    bool base64;      // inline "binary" arrays and base64 appended data
+    bool compressed;  // vtkZLibDataCompressor
+    bool header64;    // header_type="UInt64"
+};
+
+// Binary data of a DataArray. Uncompressed data is prefixed by its size in
+// bytes. Compressed data is prefixed by the block count, the uncompressed
+// block size, the size of the last block and the compressed size of every
+// block, followed by the zlib streams of the blocks. In base64 the
+// compression header is encoded on its own.
+class VTPBinaryReader {
+public:
+    VTPBinaryReader(const VTPEncoding& encoding, const char* p, const char* end)
+        : encoding(encoding), end(end) {
+        if (encoding.base64) {
+            while (p != end && XMLTag::isXMLSpace(*p)) p++;
+        }
+        data = p;
+        size_t word = encoding.header64 ? 8 : 4;
+        if (!encoding.compressed) {
+            dataSize = static_cast<size_t>(readHeader(0, 1)[0]);
+            return;
+        }
+
+        vector<uint64_t> header = readHeader(0, 3);
+        size_t blocks = static_cast<size_t>(header[0]);
+        blockSize = static_cast<size_t>(header[1]);
+        size_t lastBlockSize = static_cast<size_t>(header[2]);
+        header = readHeader(0, 3 + blocks);
+        compressedSizes.assign(header.begin() + 3, header.end());
+        dataSize = blocks == 0 ? 0 : (blocks - 1) * blockSize +
+            (lastBlockSize ? lastBlockSize : blockSize);
+
+        size_t headerBytes = (3 + blocks) * word;
+        payload = encoding.base64 ? data + (headerBytes + 2) / 3 * 4 : data + headerBytes;
     }
 
-    // read offsets
-    const char* offsetsStr = eoffsets->FirstChild()->Value();
-    stringstream sOffsets(offsetsStr);
+    // Size of the decoded array in bytes
+    size_t size() const {
+        return dataSize;
+    }
+
+    // Decodes size() bytes into out
+    void read(unsigned char* out) const {
+        size_t word = encoding.header64 ? 8 : 4;
+        if (!encoding.compressed) {
+            if (encoding.base64) {
+                // the size prefix and the data share the same base64 stream
+                if (decodeBase64(data, end, out, word, dataSize) != dataSize) {
+                    throw runtime_error("Truncated binary VTP DataArray");
+                }
+            } else {
+                if (static_cast<size_t>(end - data) < word + dataSize) {
+                    throw runtime_error("Truncated appended VTP DataArray");
+                }
+                memcpy(out, data + word, dataSize);
+            }
+            return;
+        }
+
+        size_t compressedTotal = 0;
+        for (uint64_t size : compressedSizes) compressedTotal += static_cast<size_t>(size);
+        vector<unsigned char> decoded;
+        const char* blocks = payload;
+        if (encoding.base64) {
+            decoded.resize(compressedTotal);
+            if (decodeBase64(payload, end, decoded.data(), 0, compressedTotal) != compressedTotal) {
+                throw runtime_error("Truncated binary VTP DataArray");
+            }
+            blocks = reinterpret_cast<const char*>(decoded.data());
+        } else if (static_cast<size_t>(end - payload) < compressedTotal) {
+            throw runtime_error("Truncated appended VTP DataArray");
+        }
+
+        // zlib streams are inflated with the decoder stb_image uses for PNG
+        size_t offset = 0;
+        for (size_t i = 0; i < compressedSizes.size(); i++) {
+            size_t size = std::min(blockSize, dataSize - i * blockSize);
+            int inflated = stbi_zlib_decode_buffer(
+                reinterpret_cast<char*>(out + i * blockSize), static_cast<int>(size),
+                blocks + offset, static_cast<int>(compressedSizes[i]));
+            if (inflated != static_cast<int>(size)) {
+                throw runtime_error("Corrupted zlib block in VTP DataArray");
+            }
+            offset += static_cast<size_t>(compressedSizes[i]);
+        }
+    }
+
+private:
+    // Reads the first `count` header words
+    vector<uint64_t> readHeader(size_t skip, size_t count) const {
+        size_t word = encoding.header64 ? 8 : 4;
+        vector<unsigned char> bytes(count * word);
+        size_t read;
+        if (encoding.base64) {
+            read = decodeBase64(data, end, bytes.data(), skip, bytes.size());
+        } else {
+            read = std::min(bytes.size(), static_cast<size_t>(end - data));
+            memcpy(bytes.data(), data, read);
+        }
+        if (read != bytes.size()) throw runtime_error("Truncated VTP DataArray header");
+
+        vector<uint64_t> header(count);
+        for (size_t i = 0; i < count; i++) {
+            if (encoding.header64) {
+                uint64_t value;
+                memcpy(&value, &bytes[i * word], 8);
+                header[i] = value;
+            } else {
+                uint32_t value;
+                memcpy(&value, &bytes[i * word], 4);
+                header[i] = value;
+            }
+        }
+        return header;
+    }
+
+    VTPEncoding encoding;
+    const char* data;
+    const char* end;
+    const char* payload;
+    size_t dataSize, blockSize;
+    vector<uint64_t> compressedSizes;
+};
+
+// Size in bytes of a VTK scalar type, 0 if unsupported
+static size_t vtpTypeSize(const string& type) {
+    if (type == "Float32" || type == "Int32" || type == "UInt32") return 4;
+    if (type == "Float64" || type == "Int64" || type == "UInt64") return 8;
+    return 0;
+}
+
+// Converts a decoded VTK scalar to T
+template<typename T>
+static T vtpValue(const string& type, const unsigned char* p) {
+    if (type == "Float32") { float v; memcpy(&v, p, 4); return static_cast<T>(v); }
+    if (type == "Float64") { double v; memcpy(&v, p, 8); return static_cast<T>(v); }
+    if (type == "Int32") { int32_t v; memcpy(&v, p, 4); return static_cast<T>(v); }
+    if (type == "UInt32") { uint32_t v; memcpy(&v, p, 4); return static_cast<T>(v); }
+    if (type == "Int64") { int64_t v; memcpy(&v, p, 8); return static_cast<T>(v); }
+    uint64_t v;
+    memcpy(&v, p, 8);
+    return static_cast<T>(v);
+}
+
+// Scalar type and component count of the elements of a decoded DataArray
+template<typename T>
+struct VTPElement {
+    typedef T scalar;
+    static const size_t components = 1;
+};
+
+template<>
+struct VTPElement<vec3> {
+    typedef float scalar;
+    static const size_t components = 3;
+};
+
+// Decodes a binary DataArray into out, resizing it to the decoded element
+// count. Arrays already stored as the scalars of T are decoded in place,
+// anything else is converted value by value.
+template<typename T>
+static void readVTPBinary(const VTPBinaryReader& reader, const string& type, vector<T>& out) {
+    typedef typename VTPElement<T>::scalar Scalar;
+    size_t typeSize = vtpTypeSize(type);
+    if (typeSize == 0) throw runtime_error("Unsupported VTP DataArray type: " + type);
+    size_t count = reader.size() / typeSize;
+    if (reader.size() % typeSize != 0 || count % VTPElement<T>::components != 0) {
+        throw runtime_error("Truncated VTP DataArray");
+    }
+    out.resize(count / VTPElement<T>::components);
+    Scalar* values = reinterpret_cast<Scalar*>(out.data());
+    bool native = typeSize == sizeof(Scalar) &&
+        (std::is_floating_point<Scalar>::value ? type[0] == 'F' : type[0] != 'F');
+    if (native) {
+        if (count) reader.read(reinterpret_cast<unsigned char*>(values));
+        return;
+    }
+    vector<unsigned char> raw(reader.size());
+    if (count) reader.read(raw.data());
+    for (size_t i = 0; i < count; i++) {
+        values[i] = vtpValue<Scalar>(type, &raw[i * typeSize]);
+    }
+}
+
+// The mesh arrays of a .vtp file
+enum VTPArray { VTP_NORMALS, VTP_POINTS, VTP_CONNECTIVITY, VTP_OFFSETS };
+
+struct VTPData {
+    int numPoints = -1, numPolys = -1;
+    vector<vec3> normals, coordinates;
+    vector<unsigned int> connectivity;
     vector<int> offsets;
-    do {
-        int offset;
-        sOffsets >> offset;
-        offsets.push_back(offset);
-    } while (sOffsets.good());
-    assert(offsets.size() == numPolys + 1);
-
-    // read connectivity
-    const char* connStr = econnectivity->FirstChild()->Value();
-    stringstream sConn(connStr);
-    vector<int> connectivity;
-    do {
-        int conn;
-        sConn >> conn;
-        connectivity.push_back(conn);
-    } while (sConn.good());
-    assert(connectivity.size() == offsets.back() + 1);
-
-    // construct vertices
+    bool hasPoints = false, hasOffsets = false;
+};
+
+// An appended DataArray, read once the AppendedData section is reached
+struct VTPAppendedArray {
+    VTPArray array;
+    string type;
+    size_t offset;
+};
+
+static void readVTPBinaryArray(const VTPBinaryReader& reader, VTPArray array,
+                               const string& type, VTPData& vtp) {
+    switch (array) {
+    case VTP_NORMALS:
+        readVTPBinary(reader, type, vtp.normals);
+        if (vtp.normals.size() != static_cast<size_t>(vtp.numPoints)) {
+            throw runtime_error("Normals don't match NumberOfPoints");
+        }
+        break;
+    case VTP_POINTS:
+        readVTPBinary(reader, type, vtp.coordinates);
+        if (vtp.coordinates.size() != static_cast<size_t>(vtp.numPoints)) {
+            throw runtime_error("Points don't match NumberOfPoints");
+        }
+        vtp.hasPoints = true;
+        break;
+    case VTP_CONNECTIVITY:
+        readVTPBinary(reader, type, vtp.connectivity);
+        break;
+    case VTP_OFFSETS:
+        readVTPBinary(reader, type, vtp.offsets);
+        if (vtp.offsets.size() != static_cast<size_t>(vtp.numPolys)) {
+            throw runtime_error("Offsets don't match NumberOfPolys");
+        }
+        vtp.hasOffsets = true;
+        break;
+    }
+}
+
+static const char* readVTPASCIIArray(const char* p, const char* end, VTPArray array,
+                                     VTPData& vtp) {
+    switch (array) {
+    case VTP_NORMALS:
+        vtp.normals.resize(vtp.numPoints);
+        return parseVTPASCII(p, end, reinterpret_cast<float*>(vtp.normals.data()),
+                             3 * vtp.normals.size(), parseFloat);
+    case VTP_POINTS:
+        vtp.coordinates.resize(vtp.numPoints);
+        vtp.hasPoints = true;
+        return parseVTPASCII(p, end, reinterpret_cast<float*>(vtp.coordinates.data()),
+                             3 * vtp.coordinates.size(), parseFloat);
+    case VTP_CONNECTIVITY:
+        vtp.connectivity.reserve(3 * vtp.numPolys);
+        return parseVTPASCII(p, end, vtp.connectivity);
+    case VTP_OFFSETS:
+        vtp.offsets.resize(vtp.numPolys);
+        vtp.hasOffsets = true;
+        return parseVTPASCII(p, end, vtp.offsets.data(), vtp.offsets.size(), parseInt);
+    }
+    return p;
+}
+
+// Parse the mesh arrays of a .vtp file, check its polygons and count the
+// triangles of their fans
+static size_t readVTP(const string& path, VTPData& vtp) {
+    MappedFile file(path);
+    const char* p = file.begin();
+    const char* end = file.end();
+
+    enum Section { OTHER, POINT_DATA, POINTS, POLYS } section = OTHER;
+    VTPEncoding encoding{true, false, false};
+    string normalsName;
+    vector<VTPAppendedArray> appended;
+
+    // Single pass over the tags. Only the arrays that make up the mesh are
+    // parsed, everything else is skipped along with the text between tags.
+    XMLTag tag;
+    while (nextXMLTag(p, end, tag)) {
+        if (tag.name == "VTKFile" && !tag.closing) {
+            if (tag.attribute("type") != "PolyData") {
+                throw runtime_error("Not a PolyData VTK file: " + path);
+            }
+            if (tag.attribute("byte_order") == "BigEndian") {
+                throw runtime_error("Big endian VTP files are not supported: " + path);
+            }
+            string compressor = tag.attribute("compressor");
+            encoding.compressed = compressor == "vtkZLibDataCompressor";
+            if (!compressor.empty() && !encoding.compressed) {
+                throw runtime_error("Unsupported VTP compressor: " + compressor);
+            }
+            encoding.header64 = tag.attribute("header_type") == "UInt64";
+        } else if (tag.name == "Piece" && !tag.closing) {
+            if (vtp.numPoints >= 0) throw runtime_error("Multi-piece VTP files are not supported");
+            vtp.numPoints = atoi(tag.attribute("NumberOfPoints").c_str());
+            vtp.numPolys = atoi(tag.attribute("NumberOfPolys").c_str());
+        } else if (tag.name == "PointData") {
+            section = tag.closing ? OTHER : POINT_DATA;
+            normalsName = tag.attribute("Normals");
+            if (normalsName.empty()) normalsName = "Normals";
+        } else if (tag.name == "Points") {
+            section = tag.closing ? OTHER : POINTS;
+        } else if (tag.name == "Polys") {
+            section = tag.closing ? OTHER : POLYS;
+        } else if (tag.name == "DataArray" && !tag.closing) {
+            if (vtp.numPoints < 0) throw runtime_error("DataArray outside of a Piece: " + path);
+            string name = tag.attribute("Name");
+            VTPArray array;
+            if (section == POINT_DATA && name == normalsName) array = VTP_NORMALS;
+            else if (section == POINTS) array = VTP_POINTS;
+            else if (section == POLYS && name == "connectivity") array = VTP_CONNECTIVITY;
+            else if (section == POLYS && name == "offsets") array = VTP_OFFSETS;
+            else continue;
+
+            string format = tag.attribute("format");
+            if (format == "ascii" && !tag.selfClosing) {
+                p = readVTPASCIIArray(p, end, array, vtp);
+            } else if (format == "binary" && !tag.selfClosing) {
+                VTPBinaryReader reader(encoding, p, end);
+                readVTPBinaryArray(reader, array, tag.attribute("type"), vtp);
+            } else if (format == "appended") {
+                VTPAppendedArray entry{array, tag.attribute("type"),
+                                       static_cast<size_t>(atoll(tag.attribute("offset").c_str()))};
+                appended.push_back(entry);
+            } else {
+                throw runtime_error("Unsupported DataArray format '" + format + "': " + path);
+            }
+        } else if (tag.name == "AppendedData" && !tag.closing) {
+            // raw data may contain anything, so it is never scanned for tags
+            VTPEncoding appendedEncoding = encoding;
+            appendedEncoding.base64 = tag.attribute("encoding") == "base64";
+            const char* base = static_cast<const char*>(memchr(p, '_', end - p));
+            if (base == nullptr) throw runtime_error("Missing AppendedData marker: " + path);
+            base++;
+            for (const auto& entry : appended) {
+                if (entry.offset >= static_cast<size_t>(end - base)) {
+                    throw runtime_error("Appended DataArray offset out of range: " + path);
+                }
+                VTPBinaryReader reader(appendedEncoding, base + entry.offset, end);
+                readVTPBinaryArray(reader, entry.array, entry.type, vtp);
+            }
+            appended.clear();
+            break;
+        }
+    }
+    if (!appended.empty()) throw runtime_error("Missing AppendedData: " + path);
+    if (!vtp.hasPoints) throw runtime_error("Can't access points");
+    if (!vtp.hasOffsets) throw runtime_error("Can't access offsets");
+
+    int numPoints = vtp.numPoints, numPolys = vtp.numPolys;
+    const vector<unsigned int>& connectivity = vtp.connectivity;
+    const vector<int>& offsets = vtp.offsets;
+
+    size_t numTriangles = 0;
     int startPoly = 0;
     for (int i = 0; i < numPolys; ++i) {
-        vector<int> face = slice(connectivity, startPoly, offsets[i]);
-        int i1 = 0, i2 = 1, i3 = 2;
-        while (i3 != face.size()) {
-            vertices.push_back(coordinates[face[i1]]);
-            normals.push_back(tempNormals[face[i1]]);
-            indices.push_back(indices.size());
-            vertices.push_back(coordinates[face[i2]]);
-            normals.push_back(tempNormals[face[i2]]);
-            indices.push_back(indices.size());
-            vertices.push_back(coordinates[face[i3]]);
-            normals.push_back(tempNormals[face[i3]]);
-            indices.push_back(indices.size());
-            i2++;
-            i3++;
+        if (offsets[i] < startPoly || offsets[i] > static_cast<int>(connectivity.size())) {
+            throw runtime_error("Invalid offsets in " + path);
         }
+        if (offsets[i] - startPoly > 2) numTriangles += offsets[i] - startPoly - 2;
         startPoly = offsets[i];
     }
+    for (unsigned int id : connectivity) {
+        if (id >= static_cast<unsigned int>(numPoints)) {
+            throw runtime_error("Invalid connectivity in " + path);
+        }
+    }
+    return numTriangles;
 }
 
-void loadOBJWithTiny(
-    const string& path,
-    vector<vec3>& vertices,
-    vector<vec2>& uvs,
-    vector<vec3>& normals,
-    vector<unsigned int>& indices) {
+// Call corner(pointId) for the corners of every triangle of the fans
+template<typename Corner>
+static void triangulateVTP(const VTPData& vtp, Corner corner) {
+    const unsigned int* connectivity = vtp.connectivity.data();
+    int startPoly = 0;
+    for (int i = 0; i < vtp.numPolys; ++i) {
+        const unsigned int* face = connectivity + startPoly;
+        int faceSize = vtp.offsets[i] - startPoly;
+        for (int k = 2; k < faceSize; k++) {
+            corner(face[0]);
+            corner(face[k - 1]);
+            corner(face[k]);
+        }
+        startPoly = vtp.offsets[i];
+    }
+}
+
+MeshData loadVTP(const string& path) {
+    VTPData vtp;
+    size_t numTriangles = readVTP(path, vtp);
+
+    // construct vertices, triangulating every polygon in place
+    MeshData mesh;
+    mesh.vertices.reserve(3 * numTriangles);
+    if (!vtp.normals.empty()) mesh.normals.reserve(3 * numTriangles);
+    triangulateVTP(vtp, [&](unsigned int corner) {
+        mesh.vertices.push_back(vtp.coordinates[corner]);
+        if (!vtp.normals.empty()) mesh.normals.push_back(vtp.normals[corner]);
+    });
+    return mesh;
+}
+
+MeshData loadVTPIndexed(const string& path) {
+    VTPData vtp;
+    size_t numTriangles = readVTP(path, vtp);
+
+    // the points and normals are the vertices, and the connectivity of a
+    // file of only triangles is the indices, so they are moved, not copied
+    MeshData mesh;
+    mesh.vertices = std::move(vtp.coordinates);
+    mesh.normals = std::move(vtp.normals);
+    bool triangles = vtp.connectivity.size() == 3 * numTriangles;
+    for (int i = 0; i < vtp.numPolys && triangles; ++i) triangles = vtp.offsets[i] == 3 * (i + 1);
+    if (triangles) {
+        mesh.indices = std::move(vtp.connectivity);
+        return mesh;
+    }
+
+    mesh.indices.reserve(3 * numTriangles);
+    triangulateVTP(vtp, [&](unsigned int corner) {
+        mesh.indices.push_back(corner);
+    });
+    return mesh;
+}
+
+MeshData loadOBJWithTiny(const string& path) {
     tinyobj::attrib_t attrib;
     vector<tinyobj::shape_t> shapes;
     vector<tinyobj::material_t> materials;
@@ -239,6 +653,13 @@ void loadOBJWithTiny(
         throw runtime_error(err);
     }
 
+    size_t corners = 0;
+    for (const auto& shape : shapes) corners += shape.mesh.indices.size();
+    MeshData mesh;
+    mesh.vertices.reserve(corners);
+    if (attrib.texcoords.size() != 0) mesh.uvs.reserve(corners);
+    if (attrib.normals.size() != 0) mesh.normals.reserve(corners);
+
     for (const auto& shape : shapes) {
         for (const auto& index : shape.mesh.indices) {
             vec3 vertex = {
@@ -249,46 +670,401 @@ void loadOBJWithTiny(
                 vec2 uv = {
                     attrib.texcoords[2 * index.texcoord_index + 0],
                     1 - attrib.texcoords[2 * index.texcoord_index + 1]};
-                uvs.push_back(uv);
+                mesh.uvs.push_back(uv);
             }
             if (attrib.normals.size() != 0) {
                 vec3 normal = {
                     attrib.normals[3 * index.normal_index + 0],
                     attrib.normals[3 * index.normal_index + 1],
                     attrib.normals[3 * index.normal_index + 2]};
-                normals.push_back(normal);
+                mesh.normals.push_back(normal);
             }
 
-            vertices.push_back(vertex);
-            indices.push_back(indices.size());
+            mesh.vertices.push_back(vertex);
         }
     }
 
     // TODO .mtl loader
+    return mesh;
+}
+
+// Face corner of an .obj file. Indices are zero-based, -1 marks a missing
+// attribute.
+struct OBJCorner {
+    int v, vt, vn;
+};
+
+// Attribute tables of an .obj file
+struct OBJTables {
+    vector<vec3> positions, normals;
+    vector<vec2> texcoords;
+};
+
+// Grouping statement of an .obj file, positioned in the corner stream
+struct OBJStatement {
+    enum Type { GROUP, OBJECT, USEMTL, MTLLIB } type;
+    size_t corner;
+    string name;
+};
+
+// A line aligned part of an .obj file. v, vt and vn hold the number of
+// attributes declared before the chunk, so relative indices can be resolved
+// while parsing.
+struct OBJChunk {
+    const char* begin;
+    const char* end;
+    size_t v, vt, vn;
+    vector<OBJCorner> corners;
+    vector<OBJStatement> statements;
+};
+
+// Below this size per chunk the file is not worth splitting
+static const size_t OBJ_MIN_CHUNK_SIZE = 256 * 1024;
+
+static inline const char* skipSpaces(const char* p, const char* end) {
+    while (p != end && (*p == ' ' || *p == '\t' || *p == '\r')) p++;
+    return p;
+}
+
+static inline bool isOBJSpace(char c) {
+    return c == ' ' || c == '\t';
+}
+
+// Reads the next whitespace separated number of the line, missing or
+// malformed values default to zero like tinyobjloader.
+static inline const char* parseOBJFloat(const char* p, const char* eol, float& value) {
+    p = skipSpaces(p, eol);
+    value = 0.0f;
+    parseFloat(p, eol, value);
+    while (p != eol && *p != ' ' && *p != '\t' && *p != '\r') p++;
+    return p;
+}
+
+// Converts a one-based (or negative, relative) .obj index to zero-based
+static inline int fixOBJIndex(int index, size_t count) {
+    if (index > 0) return index - 1;
+    if (index < 0 && static_cast<int>(count) + index >= 0) {
+        return static_cast<int>(count) + index;
+    }
+    throw runtime_error("Invalid face index in .obj file");
+}
+
+static const char* parseOBJCorner(const char* p, const char* eol,
+                                  const OBJChunk& chunk, OBJCorner& corner) {
+    int index;
+    corner.v = corner.vt = corner.vn = -1;
+    const char* next = parseInt(p, eol, index);
+    if (next == p) throw runtime_error("Malformed face in .obj file");
+    corner.v = fixOBJIndex(index, chunk.v);
+    p = next;
+    if (p == eol || *p != '/') return p;
+    p++;
+    if (p != eol && *p != '/') {
+        next = parseInt(p, eol, index);
+        if (next == p) throw runtime_error("Malformed face in .obj file");
+        corner.vt = fixOBJIndex(index, chunk.vt);
+        p = next;
+    }
+    if (p == eol || *p != '/') return p;
+    p++;
+    next = parseInt(p, eol, index);
+    if (next == p) throw runtime_error("Malformed face in .obj file");
+    corner.vn = fixOBJIndex(index, chunk.vn);
+    return next;
+}
+
+static inline const char* findEndOfLine(const char* p, const char* end) {
+    const char* eol = static_cast<const char*>(memchr(p, '\n', end - p));
+    return eol ? eol : end;
+}
+
+// Trimmed rest of the line after a keyword
+static inline string parseOBJName(const char* p, const char* eol) {
+    p = skipSpaces(p, eol);
+    const char* last = eol;
+    while (last != p && (last[-1] == ' ' || last[-1] == '\t' || last[-1] == '\r')) last--;
+    return string(p, last);
+}
+
+// Counts the attributes declared in the chunk
+static void countOBJLines(OBJChunk& chunk) {
+    chunk.v = chunk.vt = chunk.vn = 0;
+    for (const char* line = chunk.begin; line < chunk.end;) {
+        const char* eol = findEndOfLine(line, chunk.end);
+        const char* p = skipSpaces(line, eol);
+        if (eol - p >= 2 && p[0] == 'v') {
+            if (isOBJSpace(p[1])) chunk.v++;
+            else if (eol - p >= 3 && p[1] == 't' && isOBJSpace(p[2])) chunk.vt++;
+            else if (eol - p >= 3 && p[1] == 'n' && isOBJSpace(p[2])) chunk.vn++;
+        }
+        line = eol + 1;
+    }
+}
+
+// Parses the chunk, storing its attributes in the pre-sized tables.
+// Statements other than v, vt, vn, f, g, o, usemtl and mtllib are ignored.
+static void parseOBJLines(OBJChunk& chunk, OBJTables& tables) {
+    for (const char* line = chunk.begin; line < chunk.end;) {
+        const char* eol = findEndOfLine(line, chunk.end);
+        const char* p = skipSpaces(line, eol);
+        if (eol - p >= 2 && p[0] == 'v') {
+            if (isOBJSpace(p[1])) {
+                vec3& position = tables.positions[chunk.v++];
+                p = parseOBJFloat(p + 2, eol, position.x);
+                p = parseOBJFloat(p, eol, position.y);
+                parseOBJFloat(p, eol, position.z);
+            } else if (eol - p >= 3 && p[1] == 't' && isOBJSpace(p[2])) {
+                vec2& texcoord = tables.texcoords[chunk.vt++];
+                p = parseOBJFloat(p + 3, eol, texcoord.x);
+                parseOBJFloat(p, eol, texcoord.y);
+            } else if (eol - p >= 3 && p[1] == 'n' && isOBJSpace(p[2])) {
+                vec3& normal = tables.normals[chunk.vn++];
+                p = parseOBJFloat(p + 3, eol, normal.x);
+                p = parseOBJFloat(p, eol, normal.y);
+                parseOBJFloat(p, eol, normal.z);
+            }
+        } else if (eol - p >= 2 && p[0] == 'f' && isOBJSpace(p[1])) {
+            // triangle fan, streamed without a temporary polygon
+            OBJCorner first, previous, current;
+            int count = 0;
+            p = skipSpaces(p + 2, eol);
+            while (p != eol) {
+                p = skipSpaces(parseOBJCorner(p, eol, chunk, current), eol);
+                if (count >= 2) {
+                    chunk.corners.push_back(first);
+                    chunk.corners.push_back(previous);
+                    chunk.corners.push_back(current);
+                }
+                if (count == 0) first = current;
+                previous = current;
+                count++;
+            }
+        } else if (eol - p >= 2 && (p[0] == 'g' || p[0] == 'o') && isOBJSpace(p[1])) {
+            OBJStatement statement{p[0] == 'g' ? OBJStatement::GROUP : OBJStatement::OBJECT,
+                                   chunk.corners.size(), parseOBJName(p + 2, eol)};
+            chunk.statements.push_back(statement);
+        } else if (eol - p >= 7 && (strncmp(p, "usemtl", 6) == 0 || strncmp(p, "mtllib", 6) == 0) &&
+                   isOBJSpace(p[6])) {
+            OBJStatement statement{p[0] == 'u' ? OBJStatement::USEMTL : OBJStatement::MTLLIB,
+                                   chunk.corners.size(), parseOBJName(p + 7, eol)};
+            chunk.statements.push_back(statement);
+        }
+        line = eol + 1;
+    }
+}
+
+// Splits the file in line aligned chunks, counts their attributes in
+// parallel and then parses them in parallel, every chunk writing its
+// attributes straight to their final place in the tables.
+static void parseOBJ(const MappedFile& file, unsigned int threads,
+                     OBJTables& tables, vector<OBJChunk>& chunks) {
+    if (threads == 0) threads = thread::hardware_concurrency();
+    size_t count = std::max<size_t>(1, std::min<size_t>(
+        std::max(threads, 1u), file.size() / OBJ_MIN_CHUNK_SIZE));
+
+    chunks.resize(count);
+    const char* begin = file.begin();
+    for (size_t i = 0; i < count; i++) {
+        const char* end = file.begin() + file.size() * (i + 1) / count;
+        if (i + 1 < count) {
+            end = std::max(end, begin);
+            end = findEndOfLine(end, file.end());
+            if (end != file.end()) end++;
+        } else {
+            end = file.end();
+        }
+        chunks[i].begin = begin;
+        chunks[i].end = end;
+        begin = end;
+    }
+
+    parallelFor(count, threads, [&](size_t i) {
+        countOBJLines(chunks[i]);
+    });
+
+    size_t v = 0, vt = 0, vn = 0;
+    for (auto& chunk : chunks) {
+        size_t cv = chunk.v, cvt = chunk.vt, cvn = chunk.vn;
+        chunk.v = v;
+        chunk.vt = vt;
+        chunk.vn = vn;
+        v += cv;
+        vt += cvt;
+        vn += cvn;
+    }
+    tables.positions.resize(v);
+    tables.texcoords.resize(vt);
+    tables.normals.resize(vn);
+
+    parallelFor(count, threads, [&](size_t i) {
+        parseOBJLines(chunks[i], tables);
+    });
+}
+
+// Expands the corners [begin, end) into per-corner attribute arrays starting
+// at offset. uvs and normals are only written if the file declares them.
+static void expandOBJ(
+    const OBJTables& tables,
+    const OBJCorner* begin, const OBJCorner* end, size_t offset,
+    vector<vec3>& vertices,
+    vector<vec2>& uvs,
+    vector<vec3>& normals) {
+    bool hasUVs = !tables.texcoords.empty();
+    bool hasNormals = !tables.normals.empty();
+    int numPositions = static_cast<int>(tables.positions.size());
+    int numTexcoords = static_cast<int>(tables.texcoords.size());
+    int numNormals = static_cast<int>(tables.normals.size());
+
+    for (size_t i = offset; begin != end; ++begin, ++i) {
+        const OBJCorner& corner = *begin;
+        if (corner.v < 0 || corner.v >= numPositions ||
+            corner.vt >= numTexcoords || corner.vn >= numNormals) {
+            throw runtime_error("Face index out of range in .obj file");
+        }
+        vertices[i] = tables.positions[corner.v];
+        if (hasUVs) {
+            uvs[i] = corner.vt >= 0
+                ? vec2(tables.texcoords[corner.vt].x, 1 - tables.texcoords[corner.vt].y)
+                : vec2(0.0f);
+        }
+        if (hasNormals) {
+            normals[i] = corner.vn >= 0 ? tables.normals[corner.vn] : vec3(0.0f);
+        }
+    }
+}
+
+// Slot of the vertex hash table: the high bits of the vertex hash, used to
+// skip most comparisons, and the output index (or EMPTY_SLOT)
+struct VertexSlot {
+    uint32_t tag;
+    uint32_t index;
+};
+
+static const uint32_t EMPTY_SLOT = 0xffffffffu;
+
+// Numbers the distinct (v, vt, vn) tuples of the corners in order of first
+// use, with the same open addressing scheme as indexVBO(). Meshes have about
+// six corners per vertex, so the table starts small and doubles whenever it
+// gets 2/3 full.
+class OBJCornerIndex {
+public:
+    OBJCornerIndex(size_t expectedCorners) {
+        size_t capacity = 16;
+        while (capacity < expectedCorners / 4) capacity *= 2;
+        table.assign(capacity, VertexSlot{0, EMPTY_SLOT});
+        mask = capacity - 1;
+    }
+
+    unsigned int operator()(const OBJCorner& corner) {
+        uint64_t hash = hashBytes(&corner, sizeof(OBJCorner));
+        uint32_t tag = static_cast<uint32_t>(hash >> 32);
+        size_t slot = static_cast<size_t>(hash) & mask;
+        for (;; slot = (slot + 1) & mask) {
+            const VertexSlot& entry = table[slot];
+            if (entry.index == EMPTY_SLOT) break;
+            if (entry.tag == tag && memcmp(&corners[entry.index], &corner, sizeof(OBJCorner)) == 0) {
+                return entry.index;
+            }
+        }
+        unsigned int index = static_cast<unsigned int>(corners.size());
+        corners.push_back(corner);
+        table[slot] = {tag, index};
+        if (3 * corners.size() > 2 * table.size()) grow();
+        return index;
+    }
+
+    vector<OBJCorner> corners;
+
+private:
+    vector<VertexSlot> table;
+    size_t mask;
+
+    void grow() {
+        table.assign(2 * table.size(), VertexSlot{0, EMPTY_SLOT});
+        mask = table.size() - 1;
+        for (size_t i = 0; i < corners.size(); i++) {
+            uint64_t hash = hashBytes(&corners[i], sizeof(OBJCorner));
+            size_t slot = static_cast<size_t>(hash) & mask;
+            while (table[slot].index != EMPTY_SLOT) slot = (slot + 1) & mask;
+            table[slot] = {static_cast<uint32_t>(hash >> 32), static_cast<unsigned int>(i)};
+        }
+    }
+};
+
+// Expand the distinct corners into vertices, on up to `threads` threads
+static void expandOBJCorners(
+    const OBJTables& tables, const vector<OBJCorner>& corners, unsigned int threads,
+    vector<vec3>& vertices,
+    vector<vec2>& uvs,
+    vector<vec3>& normals) {
+    size_t count = corners.size();
+    vertices.resize(count);
+    uvs.resize(tables.texcoords.empty() ? 0 : count);
+    normals.resize(tables.normals.empty() ? 0 : count);
+    size_t blocks = (count + OBJ_MIN_CHUNK_SIZE - 1) / OBJ_MIN_CHUNK_SIZE;
+    parallelFor(blocks, threads, [&](size_t i) {
+        size_t begin = i * OBJ_MIN_CHUNK_SIZE;
+        size_t end = std::min(count, begin + OBJ_MIN_CHUNK_SIZE);
+        expandOBJ(tables, &corners[begin], &corners[0] + end, begin,
+                  vertices, uvs, normals);
+    });
+}
+
+MeshData loadOBJParallel(const string& path, unsigned int threads) {
+    MappedFile file(path);
+    OBJTables tables;
+    vector<OBJChunk> chunks;
+    parseOBJ(file, threads, tables, chunks);
+
+    vector<size_t> offsets(chunks.size() + 1, 0);
+    for (size_t i = 0; i < chunks.size(); i++) {
+        offsets[i + 1] = offsets[i] + chunks[i].corners.size();
+    }
+    size_t count = offsets.back();
+    MeshData mesh;
+    mesh.vertices.resize(count);
+    mesh.uvs.resize(tables.texcoords.empty() ? 0 : count);
+    mesh.normals.resize(tables.normals.empty() ? 0 : count);
+
+    parallelFor(chunks.size(), threads, [&](size_t i) {
+        const vector<OBJCorner>& corners = chunks[i].corners;
+        if (corners.empty()) return;
+        expandOBJ(tables, &corners[0], &corners[0] + corners.size(), offsets[i],
+                  mesh.vertices, mesh.uvs, mesh.normals);
+    });
+    return mesh;
+}
+
+MeshData loadOBJIndexed(const string& path, unsigned int threads) {
+    MappedFile file(path);
+    OBJTables tables;
+    vector<OBJChunk> chunks;
+    parseOBJ(file, threads, tables, chunks);
+
+    size_t count = 0;
+    for (const auto& chunk : chunks) count += chunk.corners.size();
+    OBJCornerIndex cornerIndex(count);
+    MeshData mesh;
+    mesh.indices.resize(count);
+    size_t i = 0;
+    for (auto& chunk : chunks) {
+        for (const auto& corner : chunk.corners) mesh.indices[i++] = cornerIndex(corner);
+        vector<OBJCorner>().swap(chunk.corners);
+    }
+    expandOBJCorners(tables, cornerIndex.corners, threads, mesh.vertices, mesh.uvs, mesh.normals);
+    return mesh;
+}
+
+MeshData loadOBJMapped(const string& path) {
+    return loadOBJParallel(path, 1);
 }
 
 struct PackedVertex {
     glm::vec3 position;
     glm::vec2 uv;
     glm::vec3 normal;
-    bool operator<(const PackedVertex that) const {
-        return memcmp((void*) this, (void*) &that, sizeof(PackedVertex)) > 0;
-    };
 };
 
-bool getSimilarVertexIndex(
-    PackedVertex& packed,
-    map<PackedVertex, unsigned int>& vertexToOutIndex,
-    unsigned int& result) {
-    map<PackedVertex, unsigned int>::iterator it = vertexToOutIndex.find(packed);
-    if (it == vertexToOutIndex.end()) {
-        return false;
-    } else {
-        result = it->second;
-        return true;
-    }
-}
-
 void indexVBO(
     const vector<vec3>& in_vertices,
     const vector<vec2>& in_uvs,
@@ -297,211 +1073,1044 @@ void indexVBO(
     vector<vec3>& out_vertices,
     vector<vec2>& out_uvs,
     vector<vec3>& out_normals) {
-    map<PackedVertex, unsigned int> vertexToOutIndex;
-
-    // For each input vertex
-    for (int i = 0; i < static_cast<int>(in_vertices.size()); i++) {
-        vec3 vertices = in_vertices[i];
-        vec2 uvs;
-        vec3 normals;
-        if (in_uvs.size() != 0) uvs = in_uvs[i];
-        if (in_normals.size() != 0) normals = in_normals[i];
-        PackedVertex packed = {vertices, uvs, normals};
-
-        // Try to find a similar vertex in out_XXXX
-        unsigned int index;
-        bool found = getSimilarVertexIndex(packed, vertexToOutIndex, index);
-
-        if (found) { // A similar vertex is already in the VBO, use it instead !
-            out_indices.push_back(index);
+    // Open addressing with linear probing. The table is sized once for the
+    // worst case of all vertices being unique, at a load factor below 2/3.
+    size_t count = in_vertices.size();
+    size_t capacity = 16;
+    while (capacity < count + count / 2) capacity *= 2;
+    size_t mask = capacity - 1;
+    vector<VertexSlot> table(capacity, VertexSlot{0, EMPTY_SLOT});
+    out_indices.reserve(out_indices.size() + count);
+
+    bool hasUVs = in_uvs.size() != 0;
+    bool hasNormals = in_normals.size() != 0;
+    for (size_t i = 0; i < count; i++) {
+        PackedVertex packed = {
+            in_vertices[i],
+            hasUVs ? in_uvs[i] : vec2(),
+            hasNormals ? in_normals[i] : vec3()};
+        uint64_t hash = hashBytes(&packed, sizeof(PackedVertex));
+        uint32_t tag = static_cast<uint32_t>(hash >> 32);
+
+        // Vertices are equal if their bytes are, like the memcmp of the
+        // original std::map version, so the same indices are produced
+        size_t slot = static_cast<size_t>(hash) & mask;
+        for (;; slot = (slot + 1) & mask) {
+            const VertexSlot& entry = table[slot];
+            if (entry.index == EMPTY_SLOT) break;
+            if (entry.tag != tag) continue;
+            PackedVertex other = {
+                out_vertices[entry.index],
+                hasUVs ? out_uvs[entry.index] : vec2(),
+                hasNormals ? out_normals[entry.index] : vec3()};
+            if (memcmp(&packed, &other, sizeof(PackedVertex)) == 0) break;
+        }
+
+        if (table[slot].index != EMPTY_SLOT) { // A similar vertex is already in the VBO, use it instead !
+            out_indices.push_back(table[slot].index);
         } else { // If not, it needs to be added in the output data.
-            out_vertices.push_back(vertices);
-            if (in_uvs.size() != 0) out_uvs.push_back(uvs);
-            if (in_normals.size() != 0) out_normals.push_back(normals);
-            unsigned int newindex = (unsigned int) out_vertices.size() - 1;
+            unsigned int newindex = static_cast<unsigned int>(out_vertices.size());
+            out_vertices.push_back(packed.position);
+            if (hasUVs) out_uvs.push_back(packed.uv);
+            if (hasNormals) out_normals.push_back(packed.normal);
             out_indices.push_back(newindex);
-            vertexToOutIndex[packed] = newindex;
+            table[slot] = {tag, newindex};
         }
     }
 }
 
-Drawable::Drawable(string path) {
+// Welding key of a vertex: its 8 components, snapped to the grid of their
+// attribute, or their float bits if the attribute has no epsilon
+struct WeldVertex {
+    int64_t c[8];
+};
+
+// Sort key of a vertex: its 64-bit hash. Equal vertices always share a key,
+// the rare unequal ones that collide are told apart when grouping.
+struct WeldKey {
+    uint64_t key;
+    uint32_t index;
+};
+
+static const size_t WELD_MIN_BLOCK_SIZE = 64 * 1024;
+
+static inline int64_t weldComponent(float x, float epsilon) {
+    const double limit = 4.0e18;
+    if (epsilon > 0 && std::isfinite(x)) {
+        double cell = std::floor(double(x) / epsilon + 0.5);
+        return static_cast<int64_t>(std::max(-limit, std::min(limit, cell)));
+    }
+    uint32_t bits;
+    memcpy(&bits, &x, sizeof bits);
+    // keep raw bits apart from grid cells
+    return epsilon > 0 ? (int64_t(1) << 62) + bits : bits;
+}
+
+static const int WELD_RADIX_BITS = 11;
+static const size_t WELD_RADIX = size_t(1) << WELD_RADIX_BITS;
+
+// Stable LSD radix sort of the keys, 11 bits per pass over all 64 bits.
+// Every block of the array is counted and scattered by its own thread.
+static void radixSortWeldKeys(vector<WeldKey>& keys, size_t blocks, unsigned int threads) {
+    size_t n = keys.size();
+    vector<WeldKey> sorted(n);
+    vector<size_t> counts(blocks * WELD_RADIX);
+    for (int shift = 0; shift < 64; shift += WELD_RADIX_BITS) {
+        fill(counts.begin(), counts.end(), 0);
+        parallelFor(blocks, threads, [&](size_t b) {
+            size_t* count = &counts[b * WELD_RADIX];
+            for (size_t i = b * n / blocks; i < (b + 1) * n / blocks; i++) {
+                count[(keys[i].key >> shift) & (WELD_RADIX - 1)]++;
+            }
+        });
+
+        // digit-major prefix sum, a pass where every key has the same digit is skipped
+        size_t offset = 0;
+        bool skip = false;
+        for (size_t digit = 0; digit < WELD_RADIX; digit++) {
+            size_t total = 0;
+            for (size_t b = 0; b < blocks; b++) {
+                size_t count = counts[b * WELD_RADIX + digit];
+                counts[b * WELD_RADIX + digit] = offset + total;
+                total += count;
+            }
+            if (total == n) skip = true;
+            offset += total;
+        }
+        if (skip) continue;
+
+        parallelFor(blocks, threads, [&](size_t b) {
+            size_t* position = &counts[b * WELD_RADIX];
+            for (size_t i = b * n / blocks; i < (b + 1) * n / blocks; i++) {
+                sorted[position[(keys[i].key >> shift) & (WELD_RADIX - 1)]++] = keys[i];
+            }
+        });
+        keys.swap(sorted);
+    }
+}
+
+WeldStats weldVertices(
+    const vector<vec3>& in_vertices,
+    const vector<vec2>& in_uvs,
+    const vector<vec3>& in_normals,
+    vector<unsigned int>& out_indices,
+    vector<vec3>& out_vertices,
+    vector<vec2>& out_uvs,
+    vector<vec3>& out_normals,
+    const WeldOptions& options) {
+    size_t n = in_vertices.size();
+    unsigned int threads = options.threads;
+    if (threads == 0) threads = std::max(1u, std::thread::hardware_concurrency());
+    size_t blocks = std::max<size_t>(1, std::min<size_t>(threads, n / WELD_MIN_BLOCK_SIZE));
+    bool hasUVs = in_uvs.size() != 0;
+    bool hasNormals = in_normals.size() != 0;
+
+    auto weldVertex = [&](size_t i) {
+        vec3 position = in_vertices[i];
+        vec2 uv = hasUVs ? in_uvs[i] : vec2();
+        vec3 normal = hasNormals ? in_normals[i] : vec3();
+        WeldVertex vertex = {{
+            weldComponent(position.x, options.positionEpsilon),
+            weldComponent(position.y, options.positionEpsilon),
+            weldComponent(position.z, options.positionEpsilon),
+            weldComponent(uv.x, options.uvEpsilon),
+            weldComponent(uv.y, options.uvEpsilon),
+            weldComponent(normal.x, options.normalEpsilon),
+            weldComponent(normal.y, options.normalEpsilon),
+            weldComponent(normal.z, options.normalEpsilon)}};
+        return vertex;
+    };
+    auto block = [&](size_t b, size_t& begin, size_t& end) {
+        begin = b * n / blocks;
+        end = (b + 1) * n / blocks;
+    };
+
+    vector<WeldKey> keys(n);
+    parallelFor(blocks, threads, [&](size_t b) {
+        size_t begin, end;
+        block(b, begin, end);
+        for (size_t i = begin; i < end; i++) {
+            WeldVertex vertex = weldVertex(i);
+            keys[i] = {hashBytes(&vertex, sizeof vertex), static_cast<uint32_t>(i)};
+        }
+    });
+    radixSortWeldKeys(keys, blocks, threads);
+
+    // Within a run of equal keys the indices are ascending, so the first
+    // vertex of every group of equal vertices is its first occurrence.
+    // Blocks are moved to run boundaries so that no run is split.
+    vector<uint32_t> first(n);
+    parallelFor(blocks, threads, [&](size_t b) {
+        size_t begin, end;
+        block(b, begin, end);
+        while (begin > 0 && begin < n && keys[begin].key == keys[begin - 1].key) begin++;
+        while (end < n && keys[end].key == keys[end - 1].key) end++;
+        vector<pair<WeldVertex, uint32_t>> groups;
+        for (size_t run = begin; run < end;) {
+            size_t runEnd = run + 1;
+            while (runEnd < end && keys[runEnd].key == keys[run].key) runEnd++;
+            groups.clear();
+            for (size_t i = run; i < runEnd; i++) {
+                uint32_t index = keys[i].index;
+                WeldVertex vertex = weldVertex(index);
+                size_t g = 0;
+                while (g < groups.size() &&
+                       memcmp(&groups[g].first, &vertex, sizeof vertex) != 0) g++;
+                if (g == groups.size()) groups.push_back({vertex, index});
+                first[index] = groups[g].second;
+            }
+            run = runEnd;
+        }
+    });
+    vector<WeldKey>().swap(keys);
+
+    // Number the first occurrences in input order
+    vector<size_t> counts(blocks + 1, 0);
+    parallelFor(blocks, threads, [&](size_t b) {
+        size_t begin, end;
+        block(b, begin, end);
+        for (size_t i = begin; i < end; i++) {
+            if (first[i] == i) counts[b + 1]++;
+        }
+    });
+    for (size_t b = 0; b < blocks; b++) counts[b + 1] += counts[b];
+
+    size_t base = out_vertices.size();
+    size_t unique = counts[blocks];
+    out_vertices.resize(base + unique);
+    if (hasUVs) out_uvs.resize(out_uvs.size() + unique);
+    if (hasNormals) out_normals.resize(out_normals.size() + unique);
+    vec2* uvs = hasUVs ? &out_uvs[out_uvs.size() - unique] : nullptr;
+    vec3* normals = hasNormals ? &out_normals[out_normals.size() - unique] : nullptr;
+    vector<uint32_t> outIndex(n);
+    parallelFor(blocks, threads, [&](size_t b) {
+        size_t begin, end;
+        block(b, begin, end);
+        size_t next = counts[b];
+        for (size_t i = begin; i < end; i++) {
+            if (first[i] != i) continue;
+            outIndex[i] = static_cast<uint32_t>(base + next);
+            out_vertices[base + next] = in_vertices[i];
+            if (uvs) uvs[next] = in_uvs[i];
+            if (normals) normals[next] = in_normals[i];
+            next++;
+        }
+    });
+
+    size_t indexBase = out_indices.size();
+    out_indices.resize(indexBase + n);
+    parallelFor(blocks, threads, [&](size_t b) {
+        size_t begin, end;
+        block(b, begin, end);
+        for (size_t i = begin; i < end; i++) {
+            out_indices[indexBase + i] = outIndex[first[i]];
+        }
+    });
+
+    return WeldStats{n, unique};
+}
+
+// Copy the cached mesh a Drawable or Mesh was uploaded from into its
+// indexed arrays and let go of the mapped cache
+template<typename T>
+static void fillFromCache(T& mesh) {
+    if (!mesh.cached) return;
+    mesh.cached->unpack(mesh.indexedVertices, mesh.indexedUVS, mesh.indexedNormals, mesh.indices);
+    mesh.cached = nullptr;
+    mesh.cache.reset();
+}
+
+// Move the arrays of a loaded mesh into a Drawable or Mesh. A triangle soup
+// is indexed and reordered, indexed or empty arrays are taken as they are
+template<typename T>
+static void takeMeshData(T& target, MeshData&& mesh) {
+    if (!mesh.indices.empty() || mesh.vertices.empty()) {
+        target.indexedVertices = std::move(mesh.vertices);
+        target.indexedUVS = std::move(mesh.uvs);
+        target.indexedNormals = std::move(mesh.normals);
+        target.indices = std::move(mesh.indices);
+        target.joints = std::move(mesh.joints);
+        target.weights = std::move(mesh.weights);
+        return;
+    }
+    target.vertices = std::move(mesh.vertices);
+    target.uvs = std::move(mesh.uvs);
+    target.normals = std::move(mesh.normals);
+    indexVBO(target.vertices, target.uvs, target.normals, target.indices,
+             target.indexedVertices, target.indexedUVS, target.indexedNormals);
+    optimizeMesh(target.indices, target.indexedVertices, target.indexedUVS,
+                 target.indexedNormals);
+}
+
+// Upload the indexed arrays of a Drawable or Mesh into the bound
+// GL_ARRAY_BUFFER and point the bound VAO at them, with the skin if there is
+// one. A cached mesh is stored in the same format and uploaded as it is
+template<typename T>
+static void uploadMeshVertices(T& mesh) {
+    if (mesh.cached) {
+        const CachedMesh& cached = *mesh.cached;
+        glBufferData(GL_ARRAY_BUFFER, size_t(cached.vertexCount) * cached.vertexStride,
+                     cached.vertexData, GL_STATIC_DRAW);
+        mesh.vertexStride = cached.vertexStride;
+        mesh.vertexSetup = vertexArraysSetup<PositionAttribute, NormalAttribute, UVAttribute>(
+            cached.hasNormals, cached.hasUVs);
+        mesh.vertexSetup();
+        return;
+    }
+    bool normals = !mesh.indexedNormals.empty(), uvs = !mesh.indexedUVS.empty();
+    if (!mesh.joints.empty()) {
+        mesh.vertexStride = uploadVertexArrays<PositionAttribute, NormalAttribute, UVAttribute,
+                                               JointAttribute, WeightAttribute>(
+            mesh.indexedVertices, mesh.indexedNormals, mesh.indexedUVS, mesh.joints, mesh.weights);
+        mesh.vertexSetup = vertexArraysSetup<PositionAttribute, NormalAttribute, UVAttribute,
+                                             JointAttribute, WeightAttribute>(normals, uvs);
+        return;
+    }
+    mesh.vertexStride = uploadVertexArrays<PositionAttribute, NormalAttribute, UVAttribute>(
+        mesh.indexedVertices, mesh.indexedNormals, mesh.indexedUVS);
+    mesh.vertexSetup = vertexArraysSetup<PositionAttribute, NormalAttribute, UVAttribute>(
+        normals, uvs);
+}
+
+// Upload the indices of a Drawable or Mesh, or its cached ones, into the
+// bound GL_ELEMENT_ARRAY_BUFFER
+template<typename T>
+static void uploadMeshIndices(T& mesh) {
+    if (!mesh.cached) {
+        mesh.indexType = uploadIndices(mesh.indices);
+        return;
+    }
+    const CachedMesh& cached = *mesh.cached;
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, size_t(cached.indexCount) * cached.indexSize,
+                 cached.indexData, GL_STATIC_DRAW);
+    mesh.indexType = cached.indexSize == 1 ? GL_UNSIGNED_BYTE :
+        cached.indexSize == 2 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+}
+
+// View of the indexed arrays of a Drawable or Mesh, for saving
+template<typename T>
+static MeshView meshView(const T& source, int material) {
+    MeshView mesh{};
+    mesh.vertices = source.indexedVertices.data();
+    mesh.uvs = source.indexedUVS.empty() ? nullptr : source.indexedUVS.data();
+    mesh.normals = source.indexedNormals.empty() ? nullptr : source.indexedNormals.data();
+    mesh.indices = source.indices.data();
+    mesh.vertexCount = static_cast<uint32_t>(source.indexedVertices.size());
+    mesh.indexCount = static_cast<uint32_t>(source.indices.size());
+    mesh.material = material;
+    return mesh;
+}
+
+template<typename T>
+static void checkOutsideArena(const T& mesh) {
+    if (mesh.vertexBlock) throw runtime_error("Geometry in the arena can not be changed");
+}
+
+// Simplify a Drawable or Mesh into a LOD chain and replace its element
+// buffer with the indices of every LOD
+template<typename T>
+static void generateLODChain(T& mesh, const vector<float>& ratios) {
+    checkOutsideArena(mesh);
+    fillFromCache(mesh);
+    vector<unsigned int> chain;
+    mesh.lods = buildLODChain(mesh.indices, mesh.indexedVertices, mesh.indexedNormals,
+                              mesh.indexedUVS, ratios, chain);
+    mesh.bounds = boundingSphere(mesh.indexedVertices);
+    glBindVertexArray(mesh.VAO);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh.elementVBO);
+    mesh.indexType = uploadIndices(chain);
+}
+
+// Indices of the full mesh, also once its CPU copies are released
+template<typename T>
+static size_t fullIndexCount(const T& mesh) {
+    return mesh.lods.empty() ? mesh.indices.size() : mesh.lods[0].count;
+}
+
+// Where the indices and vertices of a Drawable or Mesh start in its buffers,
+// 0 unless it was moved to the arena
+template<typename T>
+static size_t indexOffset(const T& mesh) {
+    return mesh.indexBlock ? mesh.indexBlock->offset : 0;
+}
+
+template<typename T>
+static GLint baseVertex(const T& mesh) {
+    return mesh.vertexBlock ? mesh.vertexBlock->baseVertex() : 0;
+}
+
+template<typename T>
+static void drawLOD(const T& mesh, int mode, unsigned int lod) {
+    size_t offset = indexOffset(mesh);
+    size_t count = fullIndexCount(mesh);
+    if (lod > 0 && lod < mesh.lods.size()) {
+        offset += mesh.lods[lod].first * indexTypeSize(mesh.indexType);
+        count = mesh.lods[lod].count;
+    }
+    glDrawElementsBaseVertex(mode, count, mesh.indexType,
+                             reinterpret_cast<const void*>(offset), baseVertex(mesh));
+}
+
+// Split a Drawable or Mesh into meshlets and upload its reordered indices
+template<typename T>
+static void buildMeshletRanges(T& mesh, unsigned int maxVertices, unsigned int maxTriangles) {
+    checkOutsideArena(mesh);
+    if (!mesh.lods.empty()) {
+        throw runtime_error("Meshlets must be built before the LODs");
+    }
+    fillFromCache(mesh);
+    mesh.meshlets = buildMeshlets(mesh.indices, mesh.indexedVertices, maxVertices, maxTriangles);
+    glBindVertexArray(mesh.VAO);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh.elementVBO);
+    mesh.indexType = uploadIndices(mesh.indices);
+}
+
+template<typename T>
+static MeshletStats drawMeshletRanges(
+    T& mesh, const mat4& modelView, const mat4& projection, bool backfaces, int mode) {
+    if (mesh.meshlets.empty()) {
+        size_t triangles = fullIndexCount(mesh) / 3;
+        drawLOD(mesh, mode, 0);
+        return MeshletStats{0, 0, triangles, triangles, 1};
+    }
+    MeshletDrawList& draws = mesh.meshletDraws;
+    MeshletStats stats = cullMeshlets(mesh.meshlets, modelView, projection,
+                                      indexTypeSize(mesh.indexType), backfaces, draws);
+    if (stats.ranges == 0) return stats;
+    if (!mesh.vertexBlock) {
+        glMultiDrawElements(mode, draws.counts.data(), mesh.indexType,
+                            draws.offsets.data(), static_cast<GLsizei>(stats.ranges));
+        return stats;
+    }
+    for (auto& offset : draws.offsets) {
+        offset = static_cast<const char*>(offset) + indexOffset(mesh);
+    }
+    draws.baseVertices.assign(stats.ranges, baseVertex(mesh));
+    glMultiDrawElementsBaseVertex(mode, draws.counts.data(), mesh.indexType,
+                                  draws.offsets.data(), static_cast<GLsizei>(stats.ranges),
+                                  draws.baseVertices.data());
+    return stats;
+}
+
+// Give back the buffers of a Drawable or Mesh, or its blocks of the arena
+template<typename T>
+static void deleteBuffers(T& mesh) {
+    if (mesh.vertexBlock) {
+        GeometryArena::free(mesh.vertexBlock);
+        GeometryArena::free(mesh.indexBlock);
+        return;
+    }
+    glDeleteBuffers(1, &mesh.vertexVBO);
+    glDeleteBuffers(1, &mesh.elementVBO);
+    glDeleteVertexArrays(1, &mesh.VAO);
+}
+
+// Copy the buffers of a Drawable or Mesh into blocks of the arena, whose
+// offsets are added when drawing
+template<typename T>
+static void moveBuffersToArena(T& mesh) {
+    ArenaBlock* vertexBlock = GeometryArena::allocateVertices(
+        bufferSize(mesh.vertexVBO), mesh.vertexStride);
+    ArenaBlock* indexBlock = GeometryArena::allocateIndices(
+        bufferSize(mesh.elementVBO), indexTypeSize(mesh.indexType));
+    vertexBlock->arena->copy(mesh.vertexVBO, vertexBlock);
+    indexBlock->arena->copy(mesh.elementVBO, indexBlock);
+    deleteBuffers(mesh);
+    mesh.VAO = GeometryArena::vertexArray(mesh.vertexSetup);
+    mesh.vertexVBO = mesh.elementVBO = 0;
+    mesh.vertexBlock = vertexBlock;
+    mesh.indexBlock = indexBlock;
+}
+
+Drawable::Drawable(string path)
+    : dequantization(1.0f), path{path}, cached(nullptr), vertexBlock(nullptr),
+    indexBlock(nullptr) {
+    loadFile();
+    createBuffers();
+}
+
+Drawable::Drawable()
+    : VAO(0), vertexVBO(0), elementVBO(0), indexType(GL_UNSIGNED_INT), vertexStride(0),
+    vertexSetup(nullptr), dequantization(1.0f), cached(nullptr), vertexBlock(nullptr),
+    indexBlock(nullptr) {
+}
+
+void Drawable::loadFile() {
+    // a .glb is binary and indexed already, it is used as the exporter wrote it
+    if (path.substr(path.size() - 3, 3) == "glb") {
+        takeMeshData(*this, loadGLB(path));
+        return;
+    }
+
+    // a valid cache stays mapped until it is uploaded
+    shared_ptr<MeshCache> meshCache = make_shared<MeshCache>(path, "drawable");
+    if (meshCache->valid() && meshCache->meshes().size() == 1) {
+        cached = &meshCache->meshes()[0];
+        cache = meshCache;
+        return;
+    }
+
+    // the files are already indexed, so indexVBO() is not needed
     if (path.substr(path.size() - 3, 3) == "obj") {
-        loadOBJWithTiny(path.c_str(), vertices, uvs, normals, VEC_UINT_DEFAUTL_VALUE);
+        takeMeshData(*this, loadOBJIndexed(path));
     } else if (path.substr(path.size() - 3, 3) == "vtp") {
-        loadVTP(path.c_str(), vertices, uvs, normals, VEC_UINT_DEFAUTL_VALUE);
+        takeMeshData(*this, loadVTPIndexed(path));
     } else {
         throw runtime_error("File format not supported: " + path);
     }
 
-    createContext();
+    optimizeMesh(indices, indexedVertices, indexedUVS, indexedNormals, path);
+    meshCache->save({meshView(*this, -1)});
 }
 
-Drawable::Drawable(const vector<vec3>& vertices, const vector<vec2>& uvs,
-                   const vector<vec3>& normals) : vertices(vertices), uvs(uvs), normals(normals) {
-    createContext();
+Drawable::Drawable(MeshData&& mesh)
+    : dequantization(1.0f), cached(nullptr), vertexBlock(nullptr), indexBlock(nullptr) {
+    takeMeshData(*this, std::move(mesh));
+    createBuffers();
 }
 
 Drawable::~Drawable() {
-    glDeleteBuffers(1, &verticesVBO);
-    glDeleteBuffers(1, &uvsVBO);
-    glDeleteBuffers(1, &normalsVBO);
-    glDeleteBuffers(1, &elementVBO);
-    glDeleteBuffers(1, &VAO);
+    // shared buffers are deleted with the last drawable using them
+    if (geometry) return;
+    deleteBuffers(*this);
 }
 
 void Drawable::bind() {
     glBindVertexArray(VAO);
 }
 
-void Drawable::draw(int mode) {
-    glDrawElements(mode, indices.size(), GL_UNSIGNED_INT, NULL);
+void Drawable::draw(int mode, unsigned int lod) {
+    drawLOD(*this, mode, lod);
 }
 
-void Drawable::createContext() {
-    indices = vector<unsigned int>();
-    indexVBO(vertices, uvs, normals, indices, indexedVertices, indexedUVS, indexedNormals);
+void Drawable::generateLODs(const vector<float>& ratios) {
+    checkChangeable();
+    generateLODChain(*this, ratios);
+}
 
-    glGenVertexArrays(1, &VAO);
-    glBindVertexArray(VAO);
+unsigned int Drawable::selectLOD(const mat4& modelView, const mat4& projection) const {
+    return ::selectLOD(lods, bounds, modelView, projection);
+}
+
+void Drawable::buildMeshlets(unsigned int maxVertices, unsigned int maxTriangles) {
+    checkChangeable();
+    buildMeshletRanges(*this, maxVertices, maxTriangles);
+}
 
-    glGenBuffers(1, &verticesVBO);
-    glBindBuffer(GL_ARRAY_BUFFER, verticesVBO);
-    glBufferData(GL_ARRAY_BUFFER, indexedVertices.size() * sizeof(vec3),
-                 &indexedVertices[0], GL_STATIC_DRAW);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, NULL);
-    glEnableVertexAttribArray(0);
+MeshletStats Drawable::drawMeshlets(const mat4& modelView, const mat4& projection,
+                              bool backfaces, int mode) {
+    return drawMeshletRanges(*this, modelView, projection, backfaces, mode);
+}
 
-    if (indexedNormals.size() != 0) {
-        glGenBuffers(1, &normalsVBO);
-        glBindBuffer(GL_ARRAY_BUFFER, normalsVBO);
-        glBufferData(GL_ARRAY_BUFFER, indexedNormals.size() * sizeof(vec3),
-                     &indexedNormals[0], GL_STATIC_DRAW);
-        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 0, NULL);
-        glEnableVertexAttribArray(1);
+void Drawable::releaseCPU() {
+    // the full mesh is drawn from lods[0] from now on
+    if (lods.empty()) {
+        size_t count = cached ? cached->indexCount : indices.size();
+        lods.push_back(MeshLOD{0, static_cast<unsigned int>(count), 0.0f});
     }
+    cached = nullptr;
+    cache.reset();
+    size_t bytes = sizeof(vec3) * (vertices.capacity() + normals.capacity() +
+                                   indexedVertices.capacity() + indexedNormals.capacity()) +
+        sizeof(vec2) * (uvs.capacity() + indexedUVS.capacity()) +
+        sizeof(unsigned int) * indices.capacity() +
+        sizeof(u16vec4) * joints.capacity() + sizeof(vec4) * weights.capacity();
+    vector<vec3>().swap(vertices);
+    vector<vec3>().swap(normals);
+    vector<vec3>().swap(indexedVertices);
+    vector<vec3>().swap(indexedNormals);
+    vector<vec2>().swap(uvs);
+    vector<vec2>().swap(indexedUVS);
+    vector<unsigned int>().swap(indices);
+    vector<u16vec4>().swap(joints);
+    vector<vec4>().swap(weights);
+    GeometryRegistry::releasedCpuBytes += bytes;
+}
+
+void Drawable::fillCPU() {
+    fillFromCache(*this);
+}
 
-    if (indexedUVS.size() != 0) {
-        glGenBuffers(1, &uvsVBO);
-        glBindBuffer(GL_ARRAY_BUFFER, uvsVBO);
-        glBufferData(GL_ARRAY_BUFFER, indexedUVS.size() * sizeof(vec2),
-                     &indexedUVS[0], GL_STATIC_DRAW);
-        glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 0, NULL);
-        glEnableVertexAttribArray(2);
+void Drawable::moveToArena() {
+    if (vertexBlock) return;
+    checkChangeable();
+    moveBuffersToArena(*this);
+}
+
+void Drawable::uploadIndexedArrays() {
+    uploadMeshVertices(*this);
+}
+
+void Drawable::uploadIndexArray() {
+    uploadMeshIndices(*this);
+}
+
+void Drawable::bindVertexBuffer() {
+    checkChangeable();
+    glBindVertexArray(VAO);
+    // every GL 3.3 implementation has at least 16 attribute locations
+    for (GLuint location = 0; location < 16; location++) {
+        glDisableVertexAttribArray(location);
     }
+    glBindBuffer(GL_ARRAY_BUFFER, vertexVBO);
+}
 
-    // Generate a buffer for the indices as well
+void Drawable::checkChangeable() const {
+    if (geometry) throw runtime_error("Shared geometry can not be changed: " + path);
+    if (vertexBlock) throw runtime_error("Geometry in the arena can not be changed: " + path);
+}
+
+size_t Drawable::floatStride() const {
+    return VertexFormat<PositionAttribute>::stride +
+        (indexedNormals.empty() ? 0 : VertexFormat<NormalAttribute>::stride) +
+        (indexedUVS.empty() ? 0 : VertexFormat<UVAttribute>::stride);
+}
+
+void Drawable::logQuantization(size_t floatStride) {
+    size_t count = indexedVertices.size();
+    size_t before = floatStride * count + sizeof(unsigned int) * indices.size();
+    size_t after = vertexStride * count + indexTypeSize(indexType) * indices.size();
+    cout << "Quantized " << (path.empty() ? "mesh" : path) << ": "
+        << count << " vertices " << floatStride * count << " -> " << vertexStride * count
+        << " bytes, " << indices.size() << " indices "
+        << sizeof(unsigned int) * indices.size() << " -> " << indexTypeSize(indexType) * indices.size()
+        << " bytes, total " << before << " -> " << after << " bytes" << endl;
+}
+
+void Drawable::generateBuffers() {
+    glGenVertexArrays(1, &VAO);
+    glBindVertexArray(VAO);
+    glGenBuffers(1, &vertexVBO);
     glGenBuffers(1, &elementVBO);
+}
+
+void Drawable::createBuffers() {
+    generateBuffers();
+
+    glBindBuffer(GL_ARRAY_BUFFER, vertexVBO);
+    uploadMeshVertices(*this);
+
     glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, elementVBO);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int),
-                 &indices[0], GL_STATIC_DRAW);
+    uploadMeshIndices(*this);
 }
 
 /*****************************************************************************/
 
-Mesh::Mesh(
-    const vector<vec3>& vertices,
-    const vector<vec2>& uvs,
-    const vector<vec3>& normals,
-    const Material& mtl)
-    : vertices{vertices}, uvs{uvs}, normals{normals}, mtl{mtl} {
-    createContext();
+Mesh::Mesh(MeshData&& mesh, const Material& mtl, bool buffers)
+    : mtl{mtl}, VAO(0), vertexVBO(0), elementVBO(0), indexType(GL_UNSIGNED_INT),
+    vertexStride(0), vertexSetup(nullptr), vertexBlock(nullptr), indexBlock(nullptr),
+    cached(nullptr) {
+    takeMeshData(*this, std::move(mesh));
+    if (buffers) createBuffers();
+}
+
+Mesh::Mesh(shared_ptr<const MeshCache> cache, const CachedMesh& mesh, const Material& mtl,
+           bool buffers)
+    : mtl{mtl}, VAO(0), vertexVBO(0), elementVBO(0), indexType(GL_UNSIGNED_INT),
+    vertexStride(0), vertexSetup(nullptr), vertexBlock(nullptr), indexBlock(nullptr),
+    cache{std::move(cache)}, cached(&mesh) {
+    if (buffers) {
+        createBuffers();
+    } else {
+        fillCPU();
+    }
 }
 
 Mesh::Mesh(Mesh&& other)
     : vertices{std::move(other.vertices)}, normals{std::move(other.normals)},
     indexedVertices{std::move(other.indexedVertices)}, indexedNormals{std::move(other.indexedNormals)},
     uvs{std::move(other.uvs)}, indexedUVS{std::move(other.indexedUVS)},
-    indices{std::move(other.indices)}, mtl{std::move(other.mtl)},
-    VAO{other.VAO}, verticesVBO{other.verticesVBO}, normalsVBO{other.normalsVBO},
-    uvsVBO{other.uvsVBO}, elementVBO{other.elementVBO} {
+    indices{std::move(other.indices)}, joints{std::move(other.joints)},
+    weights{std::move(other.weights)}, mtl{std::move(other.mtl)},
+    VAO{other.VAO}, vertexVBO{other.vertexVBO}, elementVBO{other.elementVBO},
+    indexType{other.indexType}, vertexStride{other.vertexStride}, vertexSetup{other.vertexSetup},
+    vertexBlock{other.vertexBlock}, indexBlock{other.indexBlock},
+    lods{std::move(other.lods)}, bounds{other.bounds},
+    meshlets{std::move(other.meshlets)}, meshletDraws{std::move(other.meshletDraws)},
+    cache{std::move(other.cache)}, cached{other.cached} {
+    other.cached = nullptr;
     other.VAO = 0;
-    other.verticesVBO = 0;
-    other.normalsVBO = 0;
-    other.uvsVBO = 0;
+    other.vertexVBO = 0;
     other.elementVBO = 0;
+    other.vertexBlock = other.indexBlock = nullptr;
 }
 
 Mesh::~Mesh() {
-    glDeleteBuffers(1, &verticesVBO);
-    glDeleteBuffers(1, &uvsVBO);
-    glDeleteBuffers(1, &normalsVBO);
-    glDeleteBuffers(1, &elementVBO);
-    glDeleteVertexArrays(1, &VAO);
+    deleteBuffers(*this);
 }
 
 void Mesh::bind() {
     glBindVertexArray(VAO);
 }
 
-void Mesh::draw(int mode) {
-    glDrawElements(mode, indices.size(), GL_UNSIGNED_INT, NULL);
+void Mesh::draw(int mode, unsigned int lod) {
+    drawLOD(*this, mode, lod);
 }
 
-void Mesh::createContext() {
-    indices = vector<unsigned int>();
-    indexVBO(vertices, uvs, normals, indices, indexedVertices, indexedUVS, indexedNormals);
+void Mesh::generateLODs(const vector<float>& ratios) {
+    generateLODChain(*this, ratios);
+}
 
-    glGenVertexArrays(1, &VAO);
-    glBindVertexArray(VAO);
+unsigned int Mesh::selectLOD(const mat4& modelView, const mat4& projection) const {
+    return ::selectLOD(lods, bounds, modelView, projection);
+}
 
-    glGenBuffers(1, &verticesVBO);
-    glBindBuffer(GL_ARRAY_BUFFER, verticesVBO);
-    glBufferData(GL_ARRAY_BUFFER, indexedVertices.size() * sizeof(vec3),
-                 &indexedVertices[0], GL_STATIC_DRAW);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, NULL);
-    glEnableVertexAttribArray(0);
+void Mesh::buildMeshlets(unsigned int maxVertices, unsigned int maxTriangles) {
+    buildMeshletRanges(*this, maxVertices, maxTriangles);
+}
 
-    if (indexedNormals.size() != 0) {
-        glGenBuffers(1, &normalsVBO);
-        glBindBuffer(GL_ARRAY_BUFFER, normalsVBO);
-        glBufferData(GL_ARRAY_BUFFER, indexedNormals.size() * sizeof(vec3),
-                     &indexedNormals[0], GL_STATIC_DRAW);
-        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 0, NULL);
-        glEnableVertexAttribArray(1);
-    }
+MeshletStats Mesh::drawMeshlets(const mat4& modelView, const mat4& projection,
+                          bool backfaces, int mode) {
+    return drawMeshletRanges(*this, modelView, projection, backfaces, mode);
+}
 
-    if (indexedUVS.size() != 0) {
-        glGenBuffers(1, &uvsVBO);
-        glBindBuffer(GL_ARRAY_BUFFER, uvsVBO);
-        glBufferData(GL_ARRAY_BUFFER, indexedUVS.size() * sizeof(vec2),
-                     &indexedUVS[0], GL_STATIC_DRAW);
-        glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 0, NULL);
-        glEnableVertexAttribArray(2);
-    }
+void Mesh::fillCPU() {
+    fillFromCache(*this);
+}
+
+void Mesh::moveToArena() {
+    if (!vertexBlock) moveBuffersToArena(*this);
+}
+
+void Mesh::createBuffers() {
+    glGenVertexArrays(1, &VAO);
+    glBindVertexArray(VAO);
+
+    glGenBuffers(1, &vertexVBO);
+    glBindBuffer(GL_ARRAY_BUFFER, vertexVBO);
+    uploadMeshVertices(*this);
 
     // Generate a buffer for the indices as well
     glGenBuffers(1, &elementVBO);
     glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, elementVBO);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int),
-                 &indices[0], GL_STATIC_DRAW);
+    uploadMeshIndices(*this);
 }
 
-Model::Model(string path, Model::MTLUploadFunction* uploader)
-    : uploadFunction{uploader} {
+TextureStreamer* Model::textureStreamer = nullptr;
+
+Model::Model(string path, Model::MTLUploadFunction* uploader, unsigned int threads)
+    : VAO(0), vertexBlock(nullptr), indexBlock(nullptr), indexType(GL_UNSIGNED_INT),
+    uploadFunction{uploader}, streamer{textureStreamer}, glbBuffer(0) {
     if (path.substr(path.size() - 3, 3) == "obj") {
-        loadOBJWithTiny(path.c_str());
+        shared_ptr<MeshCache> cache = make_shared<MeshCache>(path, "model");
+        if (cache->valid()) {
+            loadCache(cache);
+        } else if (threads == 1) {
+            loadOBJWithTiny(path.c_str(), *cache);
+        } else {
+            loadOBJParallel(path.c_str(), threads, *cache);
+        }
+    } else if (path.substr(path.size() - 3, 3) == "glb") {
+        loadGLB(path);
     } else {
         throw runtime_error("File format not supported: " + path);
     }
+    if (!glbBuffer) pack();
 }
 
 Model::~Model() {
     for (const auto& t : textures) {
-        glDeleteTextures(1, &t.second);
+        if (streamer && streamer->streams(t.second)) {
+            streamer->remove(t.second);
+        } else {
+            glDeleteTextures(1, &t.second);
+        }
+    }
+    GeometryArena::free(vertexBlock);
+    GeometryArena::free(indexBlock);
+    if (glbBuffer) {
+        glDeleteVertexArrays(static_cast<GLsizei>(glbVertexArrays.size()), glbVertexArrays.data());
+        glDeleteBuffers(1, &glbBuffer);
+    }
+}
+
+ModelDrawStats Model::draw() {
+    // a .glb drawn from its buffer views has no LODs, its draws never change
+    if (!glbBuffer) {
+        for (auto& batch : batches) {
+            for (size_t i = 0; i < batch.meshes.size(); i++) selectLOD(batch, i, 0);
+        }
+    }
+    return drawBatches();
+}
+
+ModelDrawStats Model::draw(const mat4& modelView, const mat4& projection) {
+    if (!glbBuffer) {
+        for (auto& batch : batches) {
+            for (size_t i = 0; i < batch.meshes.size(); i++) {
+                selectLOD(batch, i, meshes[batch.meshes[i]].selectLOD(modelView, projection));
+            }
+        }
+    }
+    if (streamer) requestTextures(modelView, projection);
+    return drawBatches();
+}
+
+void Model::requestTextures(const mat4& modelView, const mat4& projection) {
+    GLint viewport[4];
+    glGetIntegerv(GL_VIEWPORT, viewport);
+    for (const auto& batch : batches) {
+        const Material& mtl = batch.mtl;
+        for (GLuint texture : {mtl.texKa, mtl.texKd, mtl.texKs, mtl.texNs}) {
+            if (!texture || !streamer->streams(texture)) continue;
+            for (size_t i : batch.meshes) {
+                streamer->request(texture, meshes[i].bounds, modelView, projection,
+                                  meshUVDensity[i], viewport[3]);
+            }
+        }
+    }
+}
+
+void Model::generateLODs(const vector<float>& ratios) {
+    if (glbBuffer) unpackGLB();
+    // the LOD chain of every mesh takes its place in the index block
+    vector<vector<unsigned int>> chains(meshes.size());
+    vector<const vector<unsigned int>*> packed;
+    for (size_t i = 0; i < meshes.size(); i++) {
+        Mesh& mesh = meshes[i];
+        mesh.lods = buildLODChain(mesh.indices, mesh.indexedVertices, mesh.indexedNormals,
+                                  mesh.indexedUVS, ratios, chains[i]);
+        mesh.bounds = boundingSphere(mesh.indexedVertices);
+        packed.push_back(&chains[i]);
+    }
+    packIndices(packed);
+}
+
+void Model::pack() {
+    // what streamed textures need to know of the meshes
+    if (streamer) {
+        for (auto& mesh : meshes) {
+            if (mesh.bounds.w == 0.0f) mesh.bounds = boundingSphere(mesh.indexedVertices);
+            meshUVDensity.push_back(mesh.indexedUVS.empty() ? 1.0f :
+                uvDensity(mesh.indexedVertices, mesh.indexedUVS, mesh.indices));
+        }
+    }
+
+    // meshes with the same material and textures go to the same batch, in
+    // order of first use
+    for (size_t i = 0; i < meshes.size(); i++) {
+        auto batch = find_if(batches.begin(), batches.end(), [&](const MeshBatch& b) {
+            return memcmp(&b.mtl, &meshes[i].mtl, sizeof(Material)) == 0;
+        });
+        if (batch == batches.end()) {
+            batches.push_back(MeshBatch{});
+            batch = batches.end() - 1;
+            batch->mtl = meshes[i].mtl;
+        }
+        batch->meshes.push_back(i);
+    }
+
+    // one block of vertices, a mesh without normals, uvs or a skin gets zeros
+    // if another has them
+    bool hasNormals = false, hasUVs = false, hasSkin = false;
+    size_t vertexCount = 0;
+    for (const auto& mesh : meshes) {
+        hasNormals |= !mesh.indexedNormals.empty();
+        hasUVs |= !mesh.indexedUVS.empty();
+        hasSkin |= !mesh.joints.empty();
+        vertexCount += mesh.indexedVertices.size();
     }
+    vector<vec3> positions, normals;
+    vector<vec2> uvs;
+    vector<u16vec4> joints;
+    vector<vec4> weights;
+    positions.reserve(vertexCount);
+    if (hasNormals) normals.reserve(vertexCount);
+    if (hasUVs) uvs.reserve(vertexCount);
+    if (hasSkin) {
+        joints.reserve(vertexCount);
+        weights.reserve(vertexCount);
+    }
+    for (const auto& mesh : meshes) {
+        meshBaseVertex.push_back(static_cast<GLint>(positions.size()));
+        positions.insert(positions.end(), mesh.indexedVertices.begin(), mesh.indexedVertices.end());
+        if (hasNormals) {
+            normals.insert(normals.end(), mesh.indexedNormals.begin(), mesh.indexedNormals.end());
+            normals.resize(positions.size(), vec3(0.0f));
+        }
+        if (hasUVs) {
+            uvs.insert(uvs.end(), mesh.indexedUVS.begin(), mesh.indexedUVS.end());
+            uvs.resize(positions.size(), vec2(0.0f));
+        }
+        if (hasSkin) {
+            joints.insert(joints.end(), mesh.joints.begin(), mesh.joints.end());
+            joints.resize(positions.size(), u16vec4(0));
+            weights.insert(weights.end(), mesh.weights.begin(), mesh.weights.end());
+            weights.resize(positions.size(), vec4(0.0f));
+        }
+    }
+    for (auto& batch : batches) {
+        batch.counts.resize(batch.meshes.size());
+        batch.offsets.resize(batch.meshes.size());
+        batch.baseVertices.resize(batch.meshes.size());
+    }
+
+    PackedVertices vertices = hasSkin ?
+        packVertexArrays<PositionAttribute, NormalAttribute, UVAttribute,
+                         JointAttribute, WeightAttribute>(positions, normals, uvs, joints, weights) :
+        packVertexArrays<PositionAttribute, NormalAttribute, UVAttribute>(positions, normals, uvs);
+    vertexBlock = GeometryArena::allocateVertices(vertices.data.size(), vertices.stride);
+    vertexBlock->arena->upload(vertexBlock, vertices.data.data());
+    VAO = GeometryArena::vertexArray(vertices.setup);
+    for (auto& batch : batches) batch.VAO = VAO;
+
+    vector<const vector<unsigned int>*> packed;
+    for (const auto& mesh : meshes) packed.push_back(&mesh.indices);
+    packIndices(packed);
 }
 
-void Model::draw() {
-    for (auto& mesh : meshes) {
-        mesh.bind();
-        if (uploadFunction)
-            uploadFunction(mesh.mtl);
-        mesh.draw();
+// Upload the indices of every mesh one after the other into a new index
+// block. They stay relative to the mesh, the draws add its base vertex
+void Model::packIndices(const vector<const vector<unsigned int>*>& chains) {
+    size_t count = 0;
+    for (const auto* chain : chains) count += chain->size();
+    vector<unsigned int> indices;
+    indices.reserve(count);
+    meshFirst.clear();
+    for (const auto* chain : chains) {
+        meshFirst.push_back(indices.size());
+        indices.insert(indices.end(), chain->begin(), chain->end());
     }
+    indexType = narrowIndexType(indices);
+    vector<unsigned char> data = narrowIndices(indices, indexType);
+    GeometryArena::free(indexBlock);
+    indexBlock = GeometryArena::allocateIndices(data.size(), indexTypeSize(indexType));
+    indexBlock->arena->upload(indexBlock, data.data());
+    for (auto& batch : batches) batch.indexType = indexType;
 }
 
-void Model::loadOBJWithTiny(const std::string& filename) {
+// Point the draw of the i-th mesh of batch at one of its LODs, where the
+// blocks are now
+void Model::selectLOD(MeshBatch& batch, size_t i, unsigned int lod) {
+    size_t index = batch.meshes[i];
+    const Mesh& mesh = meshes[index];
+    size_t first = meshFirst[index];
+    size_t count = mesh.indices.size();
+    if (lod > 0 && lod < mesh.lods.size()) {
+        first += mesh.lods[lod].first;
+        count = mesh.lods[lod].count;
+    }
+    batch.counts[i] = static_cast<GLsizei>(count);
+    batch.offsets[i] = reinterpret_cast<const void*>(
+        indexBlock->offset + first * indexTypeSize(indexType));
+    batch.baseVertices[i] = vertexBlock->baseVertex() + meshBaseVertex[index];
+}
+
+ModelDrawStats Model::drawBatches() {
+    ModelDrawStats stats{0, 0, 0};
+    GLuint bound = 0;
+    for (const auto& batch : batches) {
+        if (batch.VAO != bound) {
+            glBindVertexArray(batch.VAO);
+            bound = batch.VAO;
+            stats.vertexArrayBinds++;
+        }
+        if (uploadFunction) {
+            uploadFunction(batch.mtl);
+            stats.materialUploads++;
+        }
+        glMultiDrawElementsBaseVertex(GL_TRIANGLES, batch.counts.data(), batch.indexType,
+                                      batch.offsets.data(),
+                                      static_cast<GLsizei>(batch.counts.size()),
+                                      batch.baseVertices.data());
+        stats.drawCalls++;
+    }
+    return stats;
+}
+
+// Material used by a face, -1 if the model has none. Like tinyobjloader,
+// unknown ids fall back to the last material.
+static int resolveMaterial(const vector<tinyobj::material_t>& materials, int idx) {
+    if (materials.size() == 0) return -1;
+    if (idx < 0 || idx >= static_cast<int>(materials.size()))
+        idx = static_cast<int>(materials.size()) - 1;
+    return idx;
+}
+
+// Textures must already be loaded
+static Material convertMaterial(
+    const vector<tinyobj::material_t>& materials, int idx,
+    map<string, GLuint>& textures) {
+    Material mtl{};
+    if (idx < 0) return mtl;
+    const tinyobj::material_t& mat = materials[idx];
+    mtl = {
+        {mat.ambient[0], mat.ambient[1], mat.ambient[2], 1},
+        {mat.diffuse[0], mat.diffuse[1], mat.diffuse[2], 1},
+        {mat.specular[0], mat.specular[1], mat.specular[2], 1},
+        mat.shininess,
+        textures[mat.ambient_texname],
+        textures[mat.diffuse_texname],
+        textures[mat.specular_texname],
+        textures[mat.specular_highlight_texname]
+    };
+    if (mtl.texKa) mtl.Ka.r = -1.0f;
+    if (mtl.texKd) mtl.Kd.r = -1.0f;
+    if (mtl.texKs) mtl.Ks.r = -1.0f;
+    if (mtl.texNs) mtl.Ns = -1.0f;
+    return mtl;
+}
+
+static void saveModelCache(
+    MeshCache& cache, const vector<Mesh>& meshes,
+    const vector<tinyobj::material_t>& materials, const vector<int>& meshMaterials) {
+    vector<MeshView> views;
+    for (size_t i = 0; i < meshes.size(); i++) {
+        views.push_back(meshView(meshes[i], meshMaterials[i]));
+    }
+    vector<CachedMaterial> cachedMaterials;
+    for (const auto& mat : materials) {
+        CachedMaterial material;
+        copy(mat.ambient, mat.ambient + 3, material.ambient);
+        copy(mat.diffuse, mat.diffuse + 3, material.diffuse);
+        copy(mat.specular, mat.specular + 3, material.specular);
+        material.shininess = mat.shininess;
+        material.ambientTexture = mat.ambient_texname;
+        material.diffuseTexture = mat.diffuse_texname;
+        material.specularTexture = mat.specular_texname;
+        material.highlightTexture = mat.specular_highlight_texname;
+        cachedMaterials.push_back(material);
+    }
+    cache.save(views, cachedMaterials);
+}
+
+// Every texture the materials use, in order
+static vector<string> textureNames(const vector<tinyobj::material_t>& materials) {
+    vector<string> names;
+    for (const auto& mat : materials) {
+        names.push_back(mat.ambient_texname);
+        names.push_back(mat.diffuse_texname);
+        names.push_back(mat.specular_texname);
+        names.push_back(mat.specular_highlight_texname);
+    }
+    return names;
+}
+
+void Model::loadCache(const shared_ptr<const MeshCache>& cache) {
+    vector<tinyobj::material_t> materials(cache->materials().size());
+    for (size_t i = 0; i < materials.size(); i++) {
+        const CachedMaterial& material = cache->materials()[i];
+        tinyobj::material_t& mat = materials[i];
+        copy(material.ambient, material.ambient + 3, mat.ambient);
+        copy(material.diffuse, material.diffuse + 3, mat.diffuse);
+        copy(material.specular, material.specular + 3, mat.specular);
+        mat.shininess = material.shininess;
+        mat.ambient_texname = material.ambientTexture;
+        mat.diffuse_texname = material.diffuseTexture;
+        mat.specular_texname = material.specularTexture;
+        mat.specular_highlight_texname = material.highlightTexture;
+    }
+    loadTextures(textureNames(materials));
+
+    // the meshes are packed into one block, so they are unpacked first
+    meshes.reserve(cache->meshes().size());
+    for (const auto& mesh : cache->meshes()) {
+        meshes.emplace_back(cache, mesh, convertMaterial(materials, mesh.material, textures),
+                            false);
+    }
+}
+
+void Model::loadOBJWithTiny(const std::string& filename, MeshCache& cache) {
     tinyobj::attrib_t attrib;
     vector<tinyobj::shape_t> shapes;
     vector<tinyobj::material_t> materials;
@@ -511,17 +2120,16 @@ void Model::loadOBJWithTiny(const std::string& filename) {
         throw runtime_error(err);
     }
 
-    for (const auto& material : materials) {
-        loadTexture(material.ambient_texname);
-        loadTexture(material.diffuse_texname);
-        loadTexture(material.specular_texname);
-        loadTexture(material.specular_highlight_texname);
-    }
+    loadTextures(textureNames(materials));
 
+    vector<int> meshMaterials;
+    meshes.reserve(shapes.size());
     for (const auto& shape : shapes) {
-        vector<vec3> vertices{};
-        vector<vec2> uvs{};
-        vector<vec3> normals{};
+        MeshData mesh;
+        size_t corners = shape.mesh.indices.size();
+        mesh.vertices.reserve(corners);
+        if (attrib.texcoords.size() != 0) mesh.uvs.reserve(corners);
+        if (attrib.normals.size() != 0) mesh.normals.reserve(corners);
         for (const auto& index : shape.mesh.indices) {
             int vertex_index = index.vertex_index;
             if (vertex_index < 0) vertex_index += attrib.vertices.size() / 3;
@@ -535,7 +2143,7 @@ void Model::loadOBJWithTiny(const std::string& filename) {
                 vec2 uv = {
                     attrib.texcoords[2 * texcoord_index + 0],
                     1 - attrib.texcoords[2 * texcoord_index + 1]};
-                uvs.push_back(uv);
+                mesh.uvs.push_back(uv);
             }
             if (attrib.normals.size() != 0) {
                 int normal_index = index.normal_index;
@@ -544,40 +2152,385 @@ void Model::loadOBJWithTiny(const std::string& filename) {
                     attrib.normals[3 * normal_index + 0],
                     attrib.normals[3 * normal_index + 1],
                     attrib.normals[3 * normal_index + 2]};
-                normals.push_back(normal);
-            }
-            vertices.push_back(vertex);
-        }
-        Material mtl{};
-        if (materials.size() > 0 && shape.mesh.material_ids.size() > 0) {
-            int idx = shape.mesh.material_ids[0];
-            if (idx < 0 || idx >= static_cast<int>(materials.size()))
-                idx = static_cast<int>(materials.size()) - 1;
-            tinyobj::material_t mat = materials[idx];
-            mtl = {
-                {mat.ambient[0], mat.ambient[1], mat.ambient[2], 1},
-                {mat.diffuse[0], mat.diffuse[1], mat.diffuse[2], 1},
-                {mat.specular[0], mat.specular[1], mat.specular[2], 1},
-                mat.shininess,
-                textures[mat.ambient_texname],
-                textures[mat.diffuse_texname],
-                textures[mat.specular_texname],
-                textures[mat.specular_highlight_texname]
-            };
-            if (mtl.texKa) mtl.Ka.r = -1.0f;
-            if (mtl.texKd) mtl.Kd.r = -1.0f;
-            if (mtl.texKs) mtl.Ks.r = -1.0f;
-            if (mtl.texNs) mtl.Ns = -1.0f;
-        }
-        meshes.emplace_back(vertices, uvs, normals, mtl);
-    }
-}
-
-void Model::loadTexture(const std::string& filename) {
-    if (filename.length() == 0) return;
-    if (textures.find(filename) == end(textures)) {
-        GLuint id = loadSOIL(filename.c_str());
-        if (!id) throw std::runtime_error("Failed to load texture: " + filename);
-        textures[filename] = id;
+                mesh.normals.push_back(normal);
+            }
+            mesh.vertices.push_back(vertex);
+        }
+        int material = -1;
+        if (shape.mesh.material_ids.size() > 0) {
+            material = resolveMaterial(materials, shape.mesh.material_ids[0]);
+        }
+        meshMaterials.push_back(material);
+        meshes.emplace_back(std::move(mesh), convertMaterial(materials, material, textures), false);
+    }
+    saveModelCache(cache, meshes, materials, meshMaterials);
+}
+
+void Model::loadOBJParallel(const std::string& filename, unsigned int threads,
+                            MeshCache& cache) {
+    MappedFile file(filename);
+    OBJTables tables;
+    vector<OBJChunk> chunks;
+    parseOBJ(file, threads, tables, chunks);
+
+    // merge the per-chunk corners
+    vector<size_t> offsets(chunks.size() + 1, 0);
+    for (size_t i = 0; i < chunks.size(); i++) {
+        offsets[i + 1] = offsets[i] + chunks[i].corners.size();
+    }
+    vector<OBJCorner> corners(offsets.back());
+    parallelFor(chunks.size(), threads, [&](size_t i) {
+        copy(chunks[i].corners.begin(), chunks[i].corners.end(), corners.begin() + offsets[i]);
+        vector<OBJCorner>().swap(chunks[i].corners);
+    });
+
+    // Replay the grouping statements in file order, splitting the corners
+    // into shapes the same way tinyobjloader does: g and o start a new
+    // shape, while usemtl only changes the material of the following faces.
+    struct ShapeRange {
+        size_t begin, end;
+        int material;
+    };
+    vector<ShapeRange> ranges;
+    vector<tinyobj::material_t> materials;
+    map<string, int> materialMap;
+    tinyobj::MaterialFileReader reader("");
+    int material = -1, shapeMaterial = -1;
+    size_t shapeBegin = 0, groupBegin = 0;
+    bool shapeHasFaces = false;
+    auto flush = [&](size_t corner) {
+        if (corner == groupBegin) return false;
+        if (!shapeHasFaces) shapeMaterial = material;
+        shapeHasFaces = true;
+        groupBegin = corner;
+        return true;
+    };
+    for (size_t i = 0; i < chunks.size(); i++) {
+        for (const auto& statement : chunks[i].statements) {
+            size_t corner = offsets[i] + statement.corner;
+            switch (statement.type) {
+            case OBJStatement::USEMTL: {
+                auto it = materialMap.find(statement.name);
+                int newMaterial = it != materialMap.end() ? it->second : -1;
+                if (newMaterial != material) {
+                    flush(corner);
+                    material = newMaterial;
+                }
+                break;
+            }
+            case OBJStatement::MTLLIB: {
+                stringstream names(statement.name);
+                string name, err;
+                while (getline(names, name, ' ')) {
+                    if (!name.empty() && reader(name, &materials, &materialMap, &err)) break;
+                }
+                break;
+            }
+            case OBJStatement::GROUP:
+            case OBJStatement::OBJECT: {
+                bool flushed = flush(corner);
+                if (statement.type == OBJStatement::GROUP ? shapeHasFaces : flushed) {
+                    ranges.push_back({shapeBegin, corner, shapeMaterial});
+                }
+                shapeBegin = groupBegin = corner;
+                shapeHasFaces = false;
+                break;
+            }
+            }
+        }
+    }
+    if (flush(corners.size()) || shapeHasFaces) {
+        ranges.push_back({shapeBegin, corners.size(), shapeMaterial});
+    }
+
+    loadTextures(textureNames(materials));
+
+    // every shape is indexed by its (v, vt, vn) tuples, no indexVBO() needed
+    vector<int> meshMaterials;
+    meshes.reserve(ranges.size());
+    for (const auto& range : ranges) {
+        OBJCornerIndex cornerIndex(range.end - range.begin);
+        MeshData mesh;
+        mesh.indices.reserve(range.end - range.begin);
+        for (size_t i = range.begin; i < range.end; i++) {
+            mesh.indices.push_back(cornerIndex(corners[i]));
+        }
+        expandOBJCorners(tables, cornerIndex.corners, threads,
+                         mesh.vertices, mesh.uvs, mesh.normals);
+        optimizeMesh(mesh.indices, mesh.vertices, mesh.uvs, mesh.normals, filename);
+
+        int material = resolveMaterial(materials, range.material);
+        meshMaterials.push_back(material);
+        meshes.emplace_back(std::move(mesh), convertMaterial(materials, material, textures), false);
+    }
+    saveModelCache(cache, meshes, materials, meshMaterials);
+}
+
+// Material of the metallic roughness factors of a glTF material: Kd is the
+// diffuse part of the base color and Ka a tenth of it, like the ambient the
+// shaders use for textured materials, Ks the reflectance at normal incidence
+// and Ns the Blinn-Phong exponent of the same roughness. texture is the base
+// color texture, or 0
+static Material convertGLBMaterial(const JSONValue& material, GLuint texture) {
+    vec4 base(1.0f);
+    float metallic = 1.0f, roughness = 1.0f;
+    if (const JSONValue* pbr = material.find("pbrMetallicRoughness")) {
+        if (const JSONValue* factor = pbr->find("baseColorFactor")) {
+            for (int c = 0; c < 4 && c < static_cast<int>(factor->items.size()); c++) {
+                base[c] = static_cast<float>(factor->items[c].number);
+            }
+        }
+        metallic = static_cast<float>(pbr->get("metallicFactor", 1.0));
+        roughness = static_cast<float>(pbr->get("roughnessFactor", 1.0));
+    }
+    vec3 diffuse = vec3(base) * (1.0f - metallic);
+    vec3 specular = mix(vec3(0.04f), vec3(base), metallic);
+    float alpha = std::max(roughness * roughness, 1e-3f);
+    float shininess = clamp(2.0f / (alpha * alpha) - 2.0f, 1.0f, 1000.0f);
+
+    Material mtl = {
+        vec4(0.1f * diffuse, 1.0f),
+        vec4(diffuse, 1.0f),
+        vec4(specular, 1.0f),
+        shininess,
+        texture,
+        texture,
+        0,
+        0
+    };
+    if (mtl.texKa) mtl.Ka.r = -1.0f;
+    if (mtl.texKd) mtl.Kd.r = -1.0f;
+    return mtl;
+}
+
+void Model::loadGLB(const std::string& filename) {
+    GLBFile file(filename);
+
+    // the base color images of the materials, loaded from the mapping in
+    // parallel like loadTextures() does with files
+    const vector<JSONValue>& gltfMaterials = file.json.array("materials");
+    vector<string> names;
+    vector<const JSONValue*> views;
+    for (const JSONValue& material : gltfMaterials) {
+        const JSONValue* pbr = material.find("pbrMetallicRoughness");
+        const JSONValue* info = pbr ? pbr->find("baseColorTexture") : nullptr;
+        const JSONValue* index = info ? info->find("index") : nullptr;
+        const JSONValue* source = index ? file.json.at("textures", glbIndex(*index)).find("source") : nullptr;
+        names.push_back(source ? filename + "#image" + to_string(glbIndex(*source)) : string());
+        if (!source || textures.count(names.back()) ||
+            find(names.begin(), names.end() - 1, names.back()) != names.end() - 1) {
+            views.push_back(nullptr);
+            continue;
+        }
+        views.push_back(file.json.at("images", glbIndex(*source)).find("bufferView"));
+        if (!views.back()) throw runtime_error("Only images embedded in the .glb are supported: " + names.back());
+    }
+    if (TextureCache::supported()) {
+        // block compressed through a cache per image, <model>.image<n>.dds
+        vector<unique_ptr<TextureCache>> caches(views.size());
+        vector<TextureCache*> stale;
+        for (size_t i = 0; i < views.size(); i++) {
+            if (!views[i]) continue;
+            size_t size;
+            const unsigned char* data = file.bufferView(glbIndex(*views[i]), size);
+            size_t image = names[i].rfind("#image");
+            string path = filename + "." + names[i].substr(image + 1) + ".texcache.dds";
+            caches[i].reset(new TextureCache(path, data, size));
+            if (!caches[i]->valid()) stale.push_back(caches[i].get());
+        }
+        TextureCache::cook(stale);
+        for (size_t i = 0; i < views.size(); i++) {
+            if (!views[i]) continue;
+            GLuint id = caches[i]->upload();
+            if (!id) throw std::runtime_error("Failed to load texture: " + names[i]);
+            caches[i]->log();
+            textures[names[i]] = id;
+        }
+    } else {
+        vector<SOILImage> images(views.size());
+        parallelFor(views.size(), 0, [&](size_t i) {
+            if (!views[i]) return;
+            size_t size;
+            const unsigned char* data = file.bufferView(glbIndex(*views[i]), size);
+            images[i] = decodeSOIL(data, size);
+        });
+        for (auto& image : images) buildMipmaps(image);
+        for (size_t i = 0; i < views.size(); i++) {
+            if (!views[i]) continue;
+            GLuint id = uploadSOIL(images[i]);
+            if (!id) throw std::runtime_error("Failed to load texture: " + names[i]);
+            textures[names[i]] = id;
+        }
+    }
+
+    vector<Material> materials;
+    for (size_t i = 0; i < gltfMaterials.size(); i++) {
+        materials.push_back(convertGLBMaterial(gltfMaterials[i],
+                                               names[i].empty() ? 0 : textures[names[i]]));
+    }
+    // glTF's default material is plain white
+    materials.push_back(convertGLBMaterial(JSONValue(), 0));
+    auto material = [&](int index) -> const Material& {
+        return index >= 0 && index < static_cast<int>(materials.size()) - 1 ?
+            materials[index] : materials.back();
+    };
+
+    vector<GLBPrimitive> primitives;
+    for (const JSONValue& gltfMesh : file.json.array("meshes")) {
+        for (const JSONValue& primitive : gltfMesh.array("primitives")) {
+            primitives.push_back(describeGLBPrimitive(file, primitive));
+        }
+    }
+    // primitives without indices are drawn from arrays, packed like an .obj
+    if (any_of(primitives.begin(), primitives.end(),
+               [](const GLBPrimitive& primitive) { return primitive.indexType == 0; })) {
+        for (const JSONValue& gltfMesh : file.json.array("meshes")) {
+            for (const JSONValue& primitive : gltfMesh.array("primitives")) {
+                meshes.emplace_back(readGLBPrimitive(file, primitive),
+                                    material(static_cast<int>(primitive.get("material", -1))),
+                                    false);
+            }
+        }
+        return;
+    }
+
+    // the buffer views the primitives read are uploaded as they are, one
+    // after the other at multiples of 4 bytes, which keeps the alignment
+    // glTF gives the accessors in them. They are placed attribute by
+    // attribute, so views of a primitive each follow those of the one before
+    // by the same number of vertices and can be drawn with one VAO
+    map<size_t, size_t> viewOffsets;
+    size_t bytes = 0;
+    auto place = [&](size_t view) {
+        if (viewOffsets.count(view)) return;
+        size_t size;
+        file.bufferView(view, size);
+        viewOffsets[view] = bytes;
+        bytes += (size + 3) & ~size_t(3);
+    };
+    for (GLuint location : {PositionAttribute::location, NormalAttribute::location,
+                            UVAttribute::location, JointAttribute::location,
+                            WeightAttribute::location}) {
+        for (const auto& primitive : primitives) {
+            for (const auto& attribute : primitive.attributes) {
+                if (attribute.location == location) place(attribute.view);
+            }
+        }
+    }
+    for (const auto& primitive : primitives) place(primitive.indexView);
+    glGenBuffers(1, &glbBuffer);
+    glBindBuffer(GL_ARRAY_BUFFER, glbBuffer);
+    glBufferData(GL_ARRAY_BUFFER, bytes, nullptr, GL_STATIC_DRAW);
+    for (const auto& view : viewOffsets) {
+        size_t size;
+        const unsigned char* data = file.bufferView(view.first, size);
+        glBufferSubData(GL_ARRAY_BUFFER, view.second, size, data);
+    }
+    glbPath = filename;
+
+    // primitives with the same attribute formats, each the same number of
+    // vertices after those of the first, share its VAO and are drawn with
+    // that many as base vertex
+    auto offset = [&](const GLBAttribute& attribute) {
+        return viewOffsets[attribute.view] + attribute.offset;
+    };
+    vector<const GLBPrimitive*> layouts;
+    auto baseVertex = [&](const GLBPrimitive& layout, const GLBPrimitive& primitive) -> GLint {
+        if (layout.indexType != primitive.indexType ||
+            layout.attributes.size() != primitive.attributes.size()) return -1;
+        size_t base = 0;
+        for (size_t k = 0; k < layout.attributes.size(); k++) {
+            const GLBAttribute& a = layout.attributes[k];
+            const GLBAttribute& b = primitive.attributes[k];
+            if (a.location != b.location || a.size != b.size || a.type != b.type ||
+                a.normalized != b.normalized || a.stride != b.stride) return -1;
+            size_t from = offset(a), to = offset(b);
+            if (to < from || (to - from) % a.stride != 0) return -1;
+            if (k > 0 && (to - from) / a.stride != base) return -1;
+            base = (to - from) / a.stride;
+        }
+        return base <= INT32_MAX ? static_cast<GLint>(base) : -1;
+    };
+
+    for (size_t i = 0; i < primitives.size(); i++) {
+        const GLBPrimitive& primitive = primitives[i];
+        size_t layout = 0;
+        GLint base = -1;
+        while (layout < layouts.size() && (base = baseVertex(*layouts[layout], primitive)) < 0) {
+            layout++;
+        }
+        if (layout == layouts.size()) {
+            layouts.push_back(&primitive);
+            base = 0;
+            GLuint vertexArray;
+            glGenVertexArrays(1, &vertexArray);
+            glBindVertexArray(vertexArray);
+            glBindBuffer(GL_ARRAY_BUFFER, glbBuffer);
+            for (const auto& attribute : primitive.attributes) {
+                glVertexAttribPointer(attribute.location, attribute.size, attribute.type,
+                                      attribute.normalized, attribute.stride,
+                                      reinterpret_cast<const void*>(offset(attribute)));
+                glEnableVertexAttribArray(attribute.location);
+            }
+            glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, glbBuffer);
+            glbVertexArrays.push_back(vertexArray);
+        }
+
+        // batches by material and VAO, in order of first use
+        meshes.emplace_back(MeshData(), material(primitive.material), false);
+        const Material& mtl = meshes.back().mtl;
+        GLuint vertexArray = glbVertexArrays[layout];
+        auto batch = find_if(batches.begin(), batches.end(), [&](const MeshBatch& b) {
+            return b.VAO == vertexArray && memcmp(&b.mtl, &mtl, sizeof(Material)) == 0;
+        });
+        if (batch == batches.end()) {
+            batches.push_back(MeshBatch{});
+            batch = batches.end() - 1;
+            batch->mtl = mtl;
+            batch->VAO = vertexArray;
+            batch->indexType = primitive.indexType;
+        }
+        batch->meshes.push_back(i);
+        batch->counts.push_back(static_cast<GLsizei>(primitive.indexCount));
+        batch->offsets.push_back(reinterpret_cast<const void*>(
+            viewOffsets[primitive.indexView] + primitive.indexOffset));
+        batch->baseVertices.push_back(base);
+    }
+}
+
+void Model::unpackGLB() {
+    GLBFile file(glbPath);
+    size_t i = 0;
+    for (const JSONValue& gltfMesh : file.json.array("meshes")) {
+        for (const JSONValue& primitive : gltfMesh.array("primitives")) {
+            takeMeshData(meshes.at(i++), readGLBPrimitive(file, primitive));
+        }
+    }
+    glDeleteVertexArrays(static_cast<GLsizei>(glbVertexArrays.size()), glbVertexArrays.data());
+    glDeleteBuffers(1, &glbBuffer);
+    glbVertexArrays.clear();
+    glbBuffer = 0;
+    batches.clear();
+    pack();
+}
+
+void Model::loadTextures(const vector<string>& filenames) {
+    // every image not loaded yet, once
+    vector<string> missing;
+    for (const auto& filename : filenames) {
+        if (filename.empty() || textures.find(filename) != textures.end() ||
+            find(missing.begin(), missing.end(), filename) != missing.end()) continue;
+        missing.push_back(filename);
+    }
+
+    if (streamer) {
+        for (const auto& filename : missing) textures[filename] = streamer->add(filename);
+        return;
+    }
+
+    vector<GLuint> loaded = loadCompressedTextures(missing);
+    for (size_t i = 0; i < missing.size(); i++) textures[missing[i]] = loaded[i];
+    for (size_t i = 0; i < missing.size(); i++) {
+        if (!loaded[i]) throw std::runtime_error("Failed to load texture: " + missing[i]);
     }
 }
\ No newline at end of file
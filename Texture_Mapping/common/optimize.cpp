@@ -0,0 +1,213 @@
+#include <algorithm>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include "optimize.h"
+
+using namespace glm;
+using namespace std;
+
+// Entries of the cache optimizeMesh() targets. Tipsify only needs a lower
+// bound, so this is the FIFO size of older GPUs
+static const unsigned int VERTEX_CACHE_SIZE = 16;
+static const unsigned int NO_VERTEX = ~0u;
+
+bool MeshOptimizer::enabled = true;
+bool MeshOptimizer::overdraw = false;
+bool MeshOptimizer::report = false;
+
+VertexCacheStats analyzeVertexCache(
+    const vector<unsigned int>& indices, size_t vertexCount, unsigned int cacheSize) {
+    // a vertex is cached if fewer than cacheSize misses happened since its own
+    vector<size_t> inserted(vertexCount, 0);
+    size_t misses = 0;
+    for (unsigned int v : indices) {
+        if (inserted[v] == 0 || misses - inserted[v] >= cacheSize) {
+            inserted[v] = ++misses;
+        }
+    }
+    size_t triangles = indices.size() / 3;
+    return VertexCacheStats{
+        triangles ? float(misses) / triangles : 0.0f,
+        vertexCount ? float(misses) / vertexCount : 0.0f};
+}
+
+void optimizeVertexCache(
+    vector<unsigned int>& indices, size_t vertexCount,
+    unsigned int cacheSize, vector<unsigned int>* clusters) {
+    size_t triangleCount = indices.size() / 3;
+    if (clusters) clusters->clear();
+    if (triangleCount == 0) return;
+
+    // triangles around every vertex, and how many of them are not emitted yet
+    vector<unsigned int> live(vertexCount, 0);
+    for (size_t i = 0; i < triangleCount * 3; i++) live[indices[i]]++;
+    vector<size_t> offsets(vertexCount + 1, 0);
+    for (size_t v = 0; v < vertexCount; v++) offsets[v + 1] = offsets[v] + live[v];
+    vector<unsigned int> adjacency(offsets.back());
+    {
+        vector<size_t> fill(offsets.begin(), offsets.end() - 1);
+        for (size_t i = 0; i < triangleCount * 3; i++) {
+            adjacency[fill[indices[i]]++] = static_cast<unsigned int>(i / 3);
+        }
+    }
+
+    vector<unsigned int> output;
+    output.reserve(triangleCount * 3);
+    vector<bool> emitted(triangleCount, false);
+    vector<size_t> cacheTime(vertexCount, 0);
+    vector<unsigned int> deadEnd, candidates;
+    size_t time = cacheSize + 1;
+    size_t cursor = 0;
+
+    // a recently used vertex with live triangles, else the next one in order
+    auto skipDeadEnd = [&]() {
+        while (!deadEnd.empty()) {
+            unsigned int v = deadEnd.back();
+            deadEnd.pop_back();
+            if (live[v] > 0) return v;
+        }
+        for (; cursor < vertexCount; cursor++) {
+            if (live[cursor] > 0) return static_cast<unsigned int>(cursor);
+        }
+        return NO_VERTEX;
+    };
+
+    unsigned int fan = skipDeadEnd();
+    while (fan != NO_VERTEX) {
+        if (clusters && time - cacheTime[fan] > cacheSize) {
+            clusters->push_back(static_cast<unsigned int>(output.size() / 3));
+        }
+
+        // emit the remaining triangles around the fanning vertex
+        candidates.clear();
+        for (size_t a = offsets[fan]; a < offsets[fan + 1]; a++) {
+            unsigned int t = adjacency[a];
+            if (emitted[t]) continue;
+            emitted[t] = true;
+            for (int k = 0; k < 3; k++) {
+                unsigned int v = indices[3 * t + k];
+                output.push_back(v);
+                deadEnd.push_back(v);
+                candidates.push_back(v);
+                live[v]--;
+                if (time - cacheTime[v] > cacheSize) cacheTime[v] = time++;
+            }
+        }
+
+        // continue with the candidate that stays in the cache while its
+        // live triangles are emitted and was cached the longest
+        unsigned int next = NO_VERTEX;
+        size_t best = 0;
+        for (unsigned int v : candidates) {
+            if (live[v] == 0) continue;
+            size_t priority = 0;
+            if (time - cacheTime[v] + 2 * live[v] <= cacheSize) priority = time - cacheTime[v];
+            if (next == NO_VERTEX || priority > best) {
+                next = v;
+                best = priority;
+            }
+        }
+        fan = next != NO_VERTEX ? next : skipDeadEnd();
+    }
+
+    // keep a trailing partial triangle, if any
+    output.insert(output.end(), indices.begin() + triangleCount * 3, indices.end());
+    indices.swap(output);
+}
+
+void optimizeOverdraw(
+    vector<unsigned int>& indices, const vector<vec3>& positions,
+    const vector<unsigned int>& clusters) {
+    size_t triangleCount = indices.size() / 3;
+    if (clusters.size() < 2) return;
+
+    // area weighted centroid and normal of every cluster and of the mesh
+    struct Cluster {
+        size_t begin, end;
+        vec3 centroid, normal;
+        float area, sortKey;
+    };
+    vector<Cluster> parts(clusters.size());
+    vec3 meshCentroid(0.0f);
+    float meshArea = 0.0f;
+    for (size_t c = 0; c < clusters.size(); c++) {
+        Cluster& part = parts[c];
+        part.begin = clusters[c];
+        part.end = c + 1 < clusters.size() ? clusters[c + 1] : triangleCount;
+        part.centroid = part.normal = vec3(0.0f);
+        part.area = 0.0f;
+        for (size_t t = part.begin; t < part.end; t++) {
+            const vec3& a = positions[indices[3 * t + 0]];
+            const vec3& b = positions[indices[3 * t + 1]];
+            const vec3& d = positions[indices[3 * t + 2]];
+            vec3 n = cross(b - a, d - a);
+            float area = length(n);
+            part.normal += n;
+            part.centroid += (a + b + d) * (area / 3.0f);
+            part.area += area;
+        }
+        meshCentroid += part.centroid;
+        meshArea += part.area;
+        if (part.area > 0.0f) part.centroid /= part.area;
+    }
+    if (meshArea > 0.0f) meshCentroid /= meshArea;
+
+    // clusters far out along their normal occlude the rest, draw them first
+    for (auto& part : parts) {
+        float n = length(part.normal);
+        part.sortKey = n > 0.0f ? dot(part.centroid - meshCentroid, part.normal / n) : 0.0f;
+    }
+    stable_sort(parts.begin(), parts.end(), [](const Cluster& a, const Cluster& b) {
+        return a.sortKey > b.sortKey;
+    });
+
+    vector<unsigned int> output;
+    output.reserve(indices.size());
+    for (const auto& part : parts) {
+        output.insert(output.end(), indices.begin() + 3 * part.begin, indices.begin() + 3 * part.end);
+    }
+    output.insert(output.end(), indices.begin() + triangleCount * 3, indices.end());
+    indices.swap(output);
+}
+
+vector<unsigned int> optimizeVertexFetch(vector<unsigned int>& indices, size_t vertexCount) {
+    vector<unsigned int> remap(vertexCount, NO_VERTEX);
+    unsigned int next = 0;
+    for (auto& index : indices) {
+        if (remap[index] == NO_VERTEX) remap[index] = next++;
+        index = remap[index];
+    }
+    for (auto& v : remap) {
+        if (v == NO_VERTEX) v = next++;
+    }
+    return remap;
+}
+
+void optimizeMesh(
+    vector<unsigned int>& indices, vector<vec3>& positions,
+    vector<vec2>& uvs, vector<vec3>& normals, const string& name) {
+    if (!MeshOptimizer::enabled || indices.size() < 3) return;
+
+    VertexCacheStats before{};
+    if (MeshOptimizer::report) before = analyzeVertexCache(indices, positions.size());
+
+    vector<unsigned int> clusters;
+    optimizeVertexCache(indices, positions.size(), VERTEX_CACHE_SIZE,
+                        MeshOptimizer::overdraw ? &clusters : nullptr);
+    if (MeshOptimizer::overdraw) optimizeOverdraw(indices, positions, clusters);
+
+    vector<unsigned int> remap = optimizeVertexFetch(indices, positions.size());
+    remapVertices(positions, remap);
+    remapVertices(uvs, remap);
+    remapVertices(normals, remap);
+
+    if (MeshOptimizer::report) {
+        VertexCacheStats after = analyzeVertexCache(indices, positions.size());
+        ostringstream line;
+        line << fixed << setprecision(3) << "Optimized " << (name.empty() ? "mesh" : name)
+            << ": ACMR " << before.acmr << " -> " << after.acmr
+            << ", ATVR " << before.atvr << " -> " << after.atvr;
+        cout << line.str() << endl;
+    }
+}
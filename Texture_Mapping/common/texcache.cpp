@@ -0,0 +1,328 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <SOIL.h>
+extern "C" {
+#include <image_DXT.h>
+}
+#include "texcache.h"
+#include "texture.h"
+
+using namespace std;
+
+// Cache files are ordinary .dds files: a DDS_header, then the DXT blocks of
+// every level from the largest to 1x1. The key of the cache is kept in
+// dwReserved1, which readers leave alone:
+//   [0] TEXTURE_CACHE_TAG, [1] TEXTURE_CACHE_VERSION, [2..3] hash of the image
+static const unsigned int TEXTURE_CACHE_TAG = 0x54474c4f; // "OGLT"
+static const unsigned int FOURCC_DXT1 = 0x31545844;
+static const unsigned int FOURCC_DXT5 = 0x35545844;
+
+// Pixel rows compressed by one task, a multiple of the 4 rows of a block
+static const int STRIP_ROWS = 64;
+
+bool TextureCache::enabled = true;
+
+static double millisecondsSince(chrono::steady_clock::time_point start) {
+    return chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+}
+
+static int mipLevels(int width, int height) {
+    int levels = 1;
+    for (int size = std::max(width, height); size > 1; size /= 2) levels++;
+    return levels;
+}
+
+static size_t blockBytes(int width, int height, size_t blockSize) {
+    return size_t((width + 3) / 4) * ((height + 3) / 4) * blockSize;
+}
+
+TextureCache::TextureCache(const string& imagePath)
+    : cachePath{imagePath + ".texcache.dds"}, source{nullptr}, sourceSize{0}, hash{0},
+      cached{false}, stats{} {
+    if (!enabled || !fileExists(imagePath)) return;
+    auto start = chrono::steady_clock::now();
+    try {
+        file.reset(new MappedFile(imagePath));
+    } catch (const runtime_error&) {
+        return;
+    }
+    source = reinterpret_cast<const unsigned char*>(file->begin());
+    sourceSize = file->size();
+    check();
+    stats.loadMs = millisecondsSince(start);
+}
+
+TextureCache::TextureCache(const string& cachePath, const unsigned char* data, size_t size)
+    : cachePath{cachePath}, source{data}, sourceSize{size}, hash{0}, cached{false}, stats{} {
+    if (!enabled) {
+        source = nullptr;
+        return;
+    }
+    auto start = chrono::steady_clock::now();
+    check();
+    stats.loadMs = millisecondsSince(start);
+}
+
+// Hash the image and compare it with the key in the header of the cache
+void TextureCache::check() {
+    stats.path = cachePath;
+    hash = hashBytes(source, sourceSize, TEXTURE_CACHE_VERSION);
+
+    ifstream in(cachePath, ios::binary | ios::ate);
+    if (!in) return;
+    size_t size = static_cast<size_t>(in.tellg());
+    DDS_header header;
+    in.seekg(0);
+    if (size < sizeof header || !in.read(reinterpret_cast<char*>(&header), sizeof header)) return;
+
+    unsigned int fourCC = header.sPixelFormat.dwFourCC;
+    if (memcmp(&header.dwMagic, "DDS ", 4) != 0 ||
+        header.dwReserved1[0] != TEXTURE_CACHE_TAG ||
+        header.dwReserved1[1] != TEXTURE_CACHE_VERSION ||
+        header.dwReserved1[2] != static_cast<uint32_t>(hash) ||
+        header.dwReserved1[3] != static_cast<uint32_t>(hash >> 32) ||
+        (fourCC != FOURCC_DXT1 && fourCC != FOURCC_DXT5)) {
+        return;
+    }
+
+    stats.width = header.dwWidth;
+    stats.height = header.dwHeight;
+    stats.levels = header.dwMipMapCount;
+    stats.format = fourCC == FOURCC_DXT1 ? GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+                                         : GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+    size_t blockSize = fourCC == FOURCC_DXT1 ? 8 : 16;
+    size_t pixelSize = fourCC == FOURCC_DXT1 ? 3 : 4;
+    stats.compressedBytes = 0;
+    stats.uncompressedBytes = 0;
+    int width = stats.width, height = stats.height;
+    for (int level = 0; level < stats.levels; level++) {
+        stats.compressedBytes += blockBytes(width, height, blockSize);
+        stats.uncompressedBytes += size_t(width) * height * pixelSize;
+        width = std::max(1, width / 2);
+        height = std::max(1, height / 2);
+    }
+    cached = stats.levels == mipLevels(stats.width, stats.height) &&
+             size == sizeof header + stats.compressedBytes;
+}
+
+// An image on its way to the cache
+struct CookJob {
+    TextureCache* cache;
+    unsigned char* image;
+    int width, height, channels;
+    vector<vector<unsigned char>> mips;    // levels 1 and up
+    vector<const unsigned char*> levels;
+    vector<size_t> offsets;               // of every level in the .dds
+    double ms;
+};
+
+// A band of block rows of one level
+struct CookStrip {
+    size_t job;
+    int level;
+    int row, rows;
+};
+
+bool TextureCache::cook(unsigned int threads) {
+    cook(vector<TextureCache*>{this}, threads);
+    return !cooked.empty();
+}
+
+void TextureCache::cook(const vector<TextureCache*>& caches, unsigned int threads) {
+    vector<CookJob> jobs(caches.size());
+    for (size_t i = 0; i < caches.size(); i++) jobs[i].cache = caches[i];
+
+    // decode the images, one image per task
+    parallelFor(jobs.size(), threads, [&](size_t i) {
+        CookJob& job = jobs[i];
+        TextureCache& cache = *job.cache;
+        job.image = nullptr;
+        if (!cache.source) return;
+        auto start = chrono::steady_clock::now();
+        string error;
+        job.image = decodeImage(cache.source, cache.sourceSize, job.width, job.height,
+                                job.channels, SOIL_LOAD_AUTO, error);
+        if (!job.image) {
+            cout << "SOIL loading error: " << error << endl;
+            return;
+        }
+
+        int levels = mipLevels(job.width, job.height);
+
+        // greyscale and RGB images go to DXT1, the ones with alpha to DXT5
+        bool alpha = job.channels == 2 || job.channels == 4;
+        size_t blockSize = alpha ? 16 : 8;
+        TextureReport& report = cache.stats;
+        report.width = job.width;
+        report.height = job.height;
+        report.levels = levels;
+        report.format = alpha ? GL_COMPRESSED_RGBA_S3TC_DXT5_EXT : GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+        report.cooked = true;
+        report.compressedBytes = 0;
+        report.uncompressedBytes = 0;
+        for (int level = 0, w = job.width, h = job.height; level < levels; level++) {
+            job.offsets.push_back(sizeof(DDS_header) + report.compressedBytes);
+            report.compressedBytes += blockBytes(w, h, blockSize);
+            report.uncompressedBytes += size_t(w) * h * (alpha ? 4 : 3);
+            w = std::max(1, w / 2);
+            h = std::max(1, h / 2);
+        }
+
+        DDS_header header;
+        memset(&header, 0, sizeof header);
+        memcpy(&header.dwMagic, "DDS ", 4);
+        header.dwSize = 124;
+        header.dwFlags = DDSD_CAPS | DDSD_HEIGHT | DDSD_WIDTH | DDSD_PIXELFORMAT |
+                         DDSD_MIPMAPCOUNT | DDSD_LINEARSIZE;
+        header.dwHeight = job.height;
+        header.dwWidth = job.width;
+        header.dwPitchOrLinearSize = static_cast<unsigned int>(blockBytes(job.width, job.height, blockSize));
+        header.dwMipMapCount = levels;
+        header.dwReserved1[0] = TEXTURE_CACHE_TAG;
+        header.dwReserved1[1] = TEXTURE_CACHE_VERSION;
+        header.dwReserved1[2] = static_cast<uint32_t>(cache.hash);
+        header.dwReserved1[3] = static_cast<uint32_t>(cache.hash >> 32);
+        header.sPixelFormat.dwSize = 32;
+        header.sPixelFormat.dwFlags = DDPF_FOURCC;
+        header.sPixelFormat.dwFourCC = alpha ? FOURCC_DXT5 : FOURCC_DXT1;
+        header.sCaps.dwCaps1 = DDSCAPS_TEXTURE | (levels > 1 ? DDSCAPS_COMPLEX | DDSCAPS_MIPMAP : 0);
+        cache.cooked.resize(sizeof header + report.compressedBytes);
+        memcpy(cache.cooked.data(), &header, sizeof header);
+        job.ms = millisecondsSince(start);
+    });
+
+    // then build their mip chains one at a time, the rows of each level on
+    // every thread; the Kaiser filter keeps distant levels sharp
+    for (CookJob& job : jobs) {
+        if (!job.image) continue;
+        auto start = chrono::steady_clock::now();
+        job.mips = generateMipmaps(job.image, job.width, job.height, job.channels,
+                                   MIP_KAISER, true, threads);
+        job.levels.push_back(job.image);
+        for (const auto& mip : job.mips) job.levels.push_back(mip.data());
+        job.ms += millisecondsSince(start);
+    }
+
+    // compress every level of every image in bands of block rows; the blocks
+    // of a band are contiguous in the .dds, so each task writes its own range
+    vector<CookStrip> strips;
+    for (size_t i = 0; i < jobs.size(); i++) {
+        const CookJob& job = jobs[i];
+        if (!job.image) continue;
+        for (int level = 0, h = job.height; level < static_cast<int>(job.levels.size()); level++) {
+            for (int row = 0; row < h; row += STRIP_ROWS) {
+                strips.push_back(CookStrip{i, level, row, std::min(STRIP_ROWS, h - row)});
+            }
+            h = std::max(1, h / 2);
+        }
+    }
+    vector<double> stripMs(strips.size());
+    parallelFor(strips.size(), threads, [&](size_t i) {
+        auto start = chrono::steady_clock::now();
+        const CookStrip& strip = strips[i];
+        const CookJob& job = jobs[strip.job];
+        int width = std::max(1, job.width >> strip.level);
+        bool alpha = job.cache->stats.format == GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+        const unsigned char* pixels = job.levels[strip.level] + size_t(strip.row) * width * job.channels;
+        int size;
+        unsigned char* blocks = alpha ?
+            convert_image_to_DXT5(pixels, width, strip.rows, job.channels, &size) :
+            convert_image_to_DXT1(pixels, width, strip.rows, job.channels, &size);
+        if (!blocks) throw runtime_error("Failed to compress texture: " + job.cache->cachePath);
+        size_t offset = job.offsets[strip.level] + blockBytes(width, strip.row, alpha ? 16 : 8);
+        memcpy(job.cache->cooked.data() + offset, blocks, size);
+        free(blocks);
+        stripMs[i] = millisecondsSince(start);
+    });
+    for (size_t i = 0; i < strips.size(); i++) jobs[strips[i].job].ms += stripMs[i];
+
+    for (auto& job : jobs) {
+        if (!job.image) continue;
+        SOIL_free_image_data(job.image);
+        TextureCache& cache = *job.cache;
+        cache.stats.cookMs = job.ms;
+
+        string temporary = cache.cachePath + ".tmp";
+        {
+            ofstream out(temporary, ios::binary | ios::trunc);
+            out.write(reinterpret_cast<const char*>(cache.cooked.data()), cache.cooked.size());
+            if (!out) {
+                cout << "Can't write texture cache: " << temporary << endl;
+                out.close();
+                remove(temporary.c_str());
+                continue;
+            }
+        }
+        remove(cache.cachePath.c_str());
+        if (rename(temporary.c_str(), cache.cachePath.c_str()) != 0) {
+            cout << "Can't replace texture cache: " << cache.cachePath << endl;
+            remove(temporary.c_str());
+        }
+    }
+}
+
+GLuint TextureCache::upload() {
+    auto start = chrono::steady_clock::now();
+    GLuint texture = 0;
+    if (!cooked.empty()) {
+        texture = uploadDDS(cooked.data(), cooked.size());
+        cooked = vector<unsigned char>();
+    } else if (cached) {
+        texture = loadDDS(cachePath.c_str());
+    }
+    stats.loadMs += millisecondsSince(start);
+    return texture;
+}
+
+void TextureCache::log() const {
+    const double MB = 1024.0 * 1024.0;
+    ostringstream line;
+    line << fixed << setprecision(2) << "Texture " << stats.path << ": " << stats.width << "x"
+        << stats.height << (stats.format == GL_COMPRESSED_RGB_S3TC_DXT1_EXT ? " DXT1, " : " DXT5, ")
+        << stats.levels << " levels, " << stats.uncompressedBytes / MB << " MB -> "
+        << stats.compressedBytes / MB << " MB (" << setprecision(1)
+        << double(stats.uncompressedBytes) / stats.compressedBytes << "x), ";
+    if (stats.cooked) line << "cooked in " << stats.cookMs << " ms, ";
+    line << "loaded in " << stats.loadMs << " ms";
+    cout << line.str() << endl;
+}
+
+bool TextureCache::supported() {
+    if (!enabled) return false;
+    if (GLEW_EXT_texture_compression_s3tc) return true;
+    // GLEW does not read the extensions of a core profile context, look for
+    // the formats among the compressed ones instead
+    GLint count = 0;
+    glGetIntegerv(GL_NUM_COMPRESSED_TEXTURE_FORMATS, &count);
+    vector<GLint> formats(count);
+    if (count > 0) glGetIntegerv(GL_COMPRESSED_TEXTURE_FORMATS, formats.data());
+    return find(formats.begin(), formats.end(), GL_COMPRESSED_RGB_S3TC_DXT1_EXT) != formats.end() &&
+           find(formats.begin(), formats.end(), GL_COMPRESSED_RGBA_S3TC_DXT5_EXT) != formats.end();
+}
+
+vector<GLuint> loadCompressedTextures(const vector<string>& imagePaths, unsigned int threads) {
+    if (!TextureCache::supported()) return loadSOILTextures(imagePaths, threads);
+
+    vector<unique_ptr<TextureCache>> caches(imagePaths.size());
+    parallelFor(imagePaths.size(), threads, [&](size_t i) {
+        caches[i].reset(new TextureCache(imagePaths[i]));
+    });
+    vector<TextureCache*> stale;
+    for (auto& cache : caches) {
+        if (!cache->valid()) stale.push_back(cache.get());
+    }
+    TextureCache::cook(stale, threads);
+
+    vector<GLuint> textures;
+    for (auto& cache : caches) {
+        textures.push_back(cache->upload());
+        if (textures.back()) cache->log();
+    }
+    return textures;
+}
@@ -0,0 +1,101 @@
+#ifndef TEXCACHE_H
+#define TEXCACHE_H
+
+#include <GL/glew.h>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+#include "util.h"
+
+/**
+* Version of the cooked textures. Bump it whenever the mip chain or the
+* block compression changes, so caches written by older builds are cooked again.
+*/
+const uint32_t TEXTURE_CACHE_VERSION = 2;
+
+/**
+* Size and load time of a texture loaded through a TextureCache.
+*/
+struct TextureReport {
+    std::string path;          // the .dds cache
+    int width, height, levels;
+    GLenum format;             // GL_COMPRESSED_RGB_S3TC_DXT1_EXT or GL_COMPRESSED_RGBA_S3TC_DXT5_EXT
+    bool cooked;               // compressed on this load rather than read from the cache
+    size_t uncompressedBytes;  // the same mip chain as RGB8, or RGBA8 with alpha
+    size_t compressedBytes;
+    double cookMs;             // decoding, mip generation and compression summed over
+                               // the threads, 0 if cached
+    double loadMs;             // hashing the image, reading the cache and uploading it
+};
+
+/**
+* Block compressed copy of an image and its full mip chain. The cache lives
+* next to the image as <image>.texcache.dds, a suffix of its own so it is not
+* mistaken for an authored .dds, and is a plain DXT1 (BC1) file, or DXT5
+* (BC3) for images with alpha, that loadDDS() reads. The hash of the image
+* and TEXTURE_CACHE_VERSION are kept in reserved words of the .dds header, so
+* a cache of an edited image is cooked again.
+*/
+class TextureCache {
+public:
+    /* The cache of an image file */
+    explicit TextureCache(const std::string& imagePath);
+    /* The cache of an image already in memory, e.g. one embedded in a .glb,
+    stored at cachePath. data must outlive the cache */
+    TextureCache(const std::string& cachePath, const unsigned char* data, size_t size);
+    TextureCache(const TextureCache&) = delete;
+    TextureCache& operator=(const TextureCache&) = delete;
+
+    /* True if the cache matches the current image and cooking version */
+    bool valid() const { return cached; }
+    const std::string& path() const { return cachePath; }
+    const TextureReport& report() const { return stats; }
+
+    /* Decode the image, build its mip chain and compress it on up to
+    `threads` threads (0 uses every hardware thread), then (re)write the
+    cache. Returns false if the image could not be read; failures to write
+    the cache are only logged */
+    bool cook(unsigned int threads = 0);
+
+    /* cook() several caches at once: images are decoded, and all their
+    levels filtered and compressed, in parallel */
+    static void cook(const std::vector<TextureCache*>& caches, unsigned int threads = 0);
+
+    /* Create the texture on the GL thread, from the cooked image or with
+    loadDDS() of a valid cache. Returns 0 if there is neither */
+    GLuint upload();
+
+    /* Print the size and load time of the texture */
+    void log() const;
+
+    /* True if caches are enabled and the current GL context can sample
+    S3TC textures */
+    static bool supported();
+
+    /* Set to false to load textures uncompressed through loadSOIL() */
+    static bool enabled;
+
+private:
+    std::string cachePath;
+    std::unique_ptr<MappedFile> file;
+    const unsigned char* source;
+    size_t sourceSize;
+    uint64_t hash;
+    bool cached;
+    std::vector<unsigned char> cooked;
+    TextureReport stats;
+
+    void check();
+};
+
+/**
+* loadSOILTextures() through TextureCaches: images without a valid cache are
+* cooked on up to `threads` threads, then every texture is uploaded from its
+* .dds on the calling thread and its report printed. Falls back to
+* loadSOILTextures() if !TextureCache::supported().
+*/
+std::vector<GLuint> loadCompressedTextures(const std::vector<std::string>& imagePaths,
+                                           unsigned int threads = 0);
+
+#endif
@@ -18,6 +18,7 @@
 #include <common/util.h>
 #include <common/camera.h>
 #include <common/model.h>
+#include <common/vertex.h>
 #include <common/texture.h>
 
 using namespace std;
@@ -41,9 +42,8 @@ GLuint MVPLocation;
 GLuint textureSampler;
 GLuint texture;
 GLuint suzanneVAO;
-GLuint suzanneVerticiesVBO, suzanneUVVBO;
-std::vector<vec3> suzanneVertices, suzanneNormals;
-std::vector<vec2> suzanneUVs;
+GLuint suzanneVBO;
+MeshData suzanne;
 
 GLuint movingtexture;
 GLuint timeUniform;
@@ -62,19 +62,17 @@ void createContext() {
     MVPLocation = glGetUniformLocation(shaderProgram, "MVP");
 
     // Load the Suzanne model
-    loadOBJ("suzanne.obj", suzanneVertices, suzanneUVs, suzanneNormals);
+    suzanne = loadOBJMapped("suzanne.obj");
 
     // VAO
     glGenVertexArrays(1, &suzanneVAO);
     glBindVertexArray(suzanneVAO);
 
-    // vertex VBO
-    glGenBuffers(1, &suzanneVerticiesVBO);
-    glBindBuffer(GL_ARRAY_BUFFER, suzanneVerticiesVBO);
-    glBufferData(GL_ARRAY_BUFFER, suzanneVertices.size() * sizeof(glm::vec3),
-                 &suzanneVertices[0], GL_STATIC_DRAW);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, NULL);
-    glEnableVertexAttribArray(0);
+    // interleaved vertex VBO: position and uv
+    glGenBuffers(1, &suzanneVBO);
+    glBindBuffer(GL_ARRAY_BUFFER, suzanneVBO);
+    VertexFormat<PositionAttribute, VertexAttribute<1, vec2>>::upload(
+        suzanne.vertices, suzanne.uvs);
 
     // Get a handle and load the standard texture
     textureSampler = glGetUniformLocation(shaderProgram, "textureSampler");
@@ -88,19 +86,11 @@ void createContext() {
     movingtexture2 = loadBMP("water2.bmp");
 
 
-    // uvs VBO
-    glGenBuffers(1, &suzanneUVVBO);
-    glBindBuffer(GL_ARRAY_BUFFER, suzanneUVVBO);
-    glBufferData(GL_ARRAY_BUFFER, suzanneUVs.size() * sizeof(glm::vec2),
-        &suzanneUVs[0], GL_STATIC_DRAW);
-    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 0, NULL);
-    glEnableVertexAttribArray(1);
     glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
     
 }
 void free() {
-    glDeleteBuffers(1, &suzanneVerticiesVBO);
-    glDeleteBuffers(1, &suzanneUVVBO);
+    glDeleteBuffers(1, &suzanneVBO);
     glDeleteTextures(1, &texture);
     glDeleteVertexArrays(1, &suzanneVAO);
     glDeleteProgram(shaderProgram);
@@ -148,7 +138,7 @@ void mainLoop() {
         // Draw, disabling depth test because the
         // object is transparent.
         glDisable(GL_DEPTH_TEST);
-        glDrawArrays(GL_TRIANGLES, 0, suzanneVertices.size());
+        glDrawArrays(GL_TRIANGLES, 0, suzanne.vertices.size());
         glEnable(GL_DEPTH_TEST);
 
         glfwSwapBuffers(window);